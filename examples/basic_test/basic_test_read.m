@@ -44,4 +44,11 @@ class(boolmatrix)
 
 disp('mat432i16=')
 disp(mat432i16)
-class(mat432i16)
\ No newline at end of file
+class(mat432i16)
+
+disp('sparse1=')
+disp(full(sparse1))
+class(sparse1)
+be=load("basic_test_bigendian.mat");
+disp('basic_test_bigendian.mat:');
+disp(be)
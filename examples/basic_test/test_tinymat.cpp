@@ -22,10 +22,183 @@
 #include <iostream>
 #include <stdio.h>
 #include "tinymatwriter.h"
+#include "tinymatrotatingwriter.h"
+#include "tinymatshardedwriter.h"
+#include "tinymatreader.h"
+#include "tinymatbyteorder.h"
+#include "tinymatmerge.h"
 #include <cmath>
+#include <string>
+#include <string.h>
+#include <complex>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <algorithm>
+#include <memory>
+#include <list>
+#include <stdexcept>
+#ifdef TINYMAT_USES_ZLIB
+#include <zlib.h>
+#endif
 
 using namespace std;
 
+static int failures=0;
+
+// reports a failed check
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        cout<<"FAILED: "<<what<<endl;
+        failures++;
+    }
+}
+
+static long fileSize(const char* filename) {
+    FILE* f=fopen(filename, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    const long size=ftell(f);
+    fclose(f);
+    return size;
+}
+
+// returns the contents of a file
+static std::string fileContents(const char* filename) {
+    std::string data;
+    FILE* f=fopen(filename, "rb");
+    if (!f) return data;
+    char buf[4096];
+    size_t n;
+    while ((n=fread(buf, 1, sizeof(buf), f))>0) data.append(buf, n);
+    fclose(f);
+    return data;
+}
+// turns the element \a realElement of a real matrix into the element of a complex matrix with the imaginary part \a imag
+static std::string complexElement(std::string realElement, const void* imag, uint32_t bytes, uint32_t miType) {
+    // tag and array flags
+    uint32_t u[6];
+    memcpy(u, realElement.data(), sizeof(u));
+    u[1]=u[1]+8+(bytes+7)/8*8;
+    u[4]|=0x0800; // complex
+    memcpy(&(realElement[0]), u, sizeof(u));
+    const uint32_t tag[2]={miType, bytes};
+    realElement.append(reinterpret_cast<const char*>(tag), sizeof(tag));
+    realElement.append(reinterpret_cast<const char*>(imag), bytes);
+    realElement.append((8-bytes%8)%8, '\0');
+    return realElement;
+}
+
+// writes variables of all kinds (used to compare a sizer with a real file)
+static void writeMixedVariables(TinyMATWriterFile* mat) {
+    double m[60*50];
+    std::complex<float> cm[60*50];
+    bool b[12];
+    for (int i=0; i<60*50; i++) {
+        m[i]=(i%7==0)?i:0;
+        cm[i]=std::complex<float>(float(i), -float(i));
+    }
+    for (int i=0; i<12; i++) b[i]=(i%3==0);
+    const int32_t size2[2]={60, 50};
+    const int32_t size3[3]={3, 2, 2};
+    TinyMATWriter_writeValue(mat, "value", 1.5);
+    TinyMATWriter_writeMatrix2D_rowmajor(mat, "rowmajor", m, 60, 50);
+    TinyMATWriter_writeMatrixND_colmajor(mat, "colmajor3d", m, size3, 3);
+    TinyMATWriter_writeMatrixND_colmajor(mat, "logical", b, size3, 3);
+    TinyMATWriter_writeMatrixND_rowmajor(mat, "complex", cm, size2, 2);
+    TinyMATWriter_writeString(mat, "string", "a string with 22 chars");
+    TinyMATWriter_startStruct(mat, "s");
+    TinyMATWriter_writeValue(mat, "field_with_a_long_name", 2.0);
+    TinyMATWriter_writeMatrixND_colmajor(mat, "m", m, size3, 3);
+    TinyMATWriter_startCellVectorAsRow(mat, "cell", 2);
+    TinyMATWriter_writeString(mat, "", "x");
+    TinyMATWriter_writeMatrix2D_rowmajor(mat, "", m, 3, 4);
+    TinyMATWriter_endCellArray(mat);
+    TinyMATWriter_endStruct(mat);
+    const double sp_vals[3]={1, 2, 3};
+    const int32_t sp_rows[3]={0, 3, 1};
+    const int32_t sp_cols[3]={0, 0, 2};
+    TinyMATWriter_writeSparseCOO(mat, "sparse", sp_vals, sp_rows, sp_cols, 3, 4, 3);
+    TinyMATWriter_setSparseThreshold(mat, 0.2);
+    TinyMATWriter_writeMatrixND_colmajor(mat, "dense_as_sparse", m, size2, 2);
+}
+
+// returns the values of the double variable \a name, or an empty vector
+static std::vector<double> readDoubles(TinyMATReaderFile* r, const char* name) {
+    TinyMATReaderArray a;
+    if (!TinyMATReader_find(r, name, &a)) return std::vector<double>();
+    const double* d=TinyMATReader_data<double>(a);
+    if (!d) return std::vector<double>();
+    return std::vector<double>(d, d+a.realBytes/sizeof(double));
+}
+
+// checks, that \a name is the struct struct1 from basic_test.mat
+static bool isStruct1(TinyMATReaderFile* r, const char* name) {
+    TinyMATReaderArray a, x, z;
+    if (!TinyMATReader_find(r, name, &a) || a.mxClass!=TinyMATClass::Struct) return false;
+    if (TinyMATReader_getFieldNames(r, a).size()!=4) return false;
+    if (!TinyMATReader_getField(r, a, "x", &x) || !TinyMATReader_getField(r, a, "z", &z)) return false;
+    const double* dx=TinyMATReader_data<double>(x);
+    const double* dz=TinyMATReader_data<double>(z);
+    return dx && dz && dx[0]==100 && dz[0]==300;
+}
+
+#ifdef TINYMAT_USES_ZLIB
+// writes the MAT-file \a filename to \a compressedFilename with every top-level element compressed (as MATLAB does)
+static bool compressFile(const char* filename, const char* compressedFilename) {
+    const std::string data=fileContents(filename);
+    if (data.size()<128) return false;
+    std::string out=data.substr(0, 128);
+    size_t pos=128;
+    while (pos+8<=data.size()) {
+        uint32_t tag[2];
+        memcpy(tag, data.data()+pos, sizeof(tag));
+        const size_t bytes=8+tag[1];
+        if (pos+bytes>data.size()) return false;
+        uLongf zbytes=compressBound(static_cast<uLong>(bytes));
+        std::string z(zbytes, '\0');
+        if (compress2(reinterpret_cast<Bytef*>(&(z[0])), &zbytes, reinterpret_cast<const Bytef*>(data.data()+pos), static_cast<uLong>(bytes), Z_DEFAULT_COMPRESSION)!=Z_OK) return false;
+        const uint32_t ztag[2]={15, static_cast<uint32_t>(zbytes)}; // miCOMPRESSED
+        out.append(reinterpret_cast<const char*>(ztag), sizeof(ztag));
+        out.append(z.data(), zbytes);
+        pos+=bytes;
+    }
+    FILE* f=fopen(compressedFilename, "wb");
+    if (!f) return false;
+    const bool ok=(fwrite(out.data(), 1, out.size(), f)==out.size());
+    fclose(f);
+    return ok;
+}
+#endif
+
+// records the events of TinyMATReader_visit() as a string, skips the variables and fields called "skip"
+class TraceVisitor: public TinyMATReaderVisitor {
+    public:
+        std::string trace;
+        virtual bool beginVariable(const TinyMATReaderArray& array) override {
+            trace+="var("+TinyMATReader_getName(array)+") ";
+            return TinyMATReader_getName(array)!="skip";
+        }
+        virtual bool beginStruct(const TinyMATReaderArray& /*array*/, uint64_t fields) override {
+            trace+="struct("+std::to_string(fields)+") ";
+            return true;
+        }
+        virtual bool field(const char* name, uint32_t nameLength, uint64_t element) override {
+            trace+="field("+std::string(name, nameLength)+","+std::to_string(element)+") ";
+            return std::string(name, nameLength)!="skip";
+        }
+        virtual void endStruct(const TinyMATReaderArray& /*array*/) override { trace+="endstruct "; }
+        virtual bool beginCell(const TinyMATReaderArray& array) override {
+            trace+="cell("+std::to_string(TinyMATReader_numel(array))+") ";
+            return true;
+        }
+        virtual void endCell(const TinyMATReaderArray& /*array*/) override { trace+="endcell "; }
+        virtual void array(const TinyMATReaderArray& array) override {
+            const double* d=TinyMATReader_data<double>(array);
+            trace+=(d && TinyMATReader_numel(array)>0)?"array("+std::to_string(int(d[0]))+") ":"array ";
+        }
+        virtual void string(const TinyMATReaderArray& array) override { trace+="string("+TinyMATReader_getString(array)+") "; }
+};
 
 int main( int argc, const char* argv[] ) {
     TinyMATWriterFile* mat=TinyMATWriter_open("basic_test.mat");
@@ -125,7 +298,1131 @@ int main( int argc, const char* argv[] ) {
 		TinyMATWriter_writeMatrixND_rowmajor(mat, "boolmatrix", matb, matb_size, 3);
 		TinyMATWriter_writeMatrixND_rowmajor(mat, "mat432i16", mat432i16, mat432i16_size, 3);
 
+		// a sparse 4x3 matrix as coordinate list (duplicate coordinates are summed)
+		int32_t sp_rows[5] = {0, 3, 1, 3, 2};
+		int32_t sp_cols[5] = {0, 0, 1, 0, 2};
+		double sp_vals[5] = {1, 2, 3, 4, 5};
+		TinyMATWriter_writeSparseCOO(mat, "sparse1", sp_vals, sp_rows, sp_cols, 5, 4, 3);
+
+		TinyMATWriter_close(mat);
+	}
+
+	// append to an existing file, that contains an element, which is no variable (an 8-byte uint8 vector) between a and b
+	mat=TinyMATWriter_open("append_test.mat");
+	TinyMATWriter_writeValue(mat, "a", 1.0);
+	TinyMATWriter_close(mat);
+	mat=TinyMATWriter_open("append_test_b.mat");
+	TinyMATWriter_writeValue(mat, "b", 2.0);
+	TinyMATWriter_close(mat);
+	mat=TinyMATWriter_open("append_test_c.mat");
+	TinyMATWriter_writeValue(mat, "c", 3.0);
+	TinyMATWriter_close(mat);
+	{
+		FILE* f=fopen("append_test.mat", "ab");
+		const uint32_t tag[2]={2, 8}; // miUINT8, 8 bytes
+		const uint8_t data[8]={1,2,3,4,5,6,7,8};
+		fwrite(tag, sizeof(uint32_t), 2, f);
+		fwrite(data, 1, 8, f);
+		// append the variable b (without the 128-byte header)
+		const std::string b=fileContents("append_test_b.mat");
+		fwrite(b.data()+128, 1, b.size()-128, f);
+		fclose(f);
+	}
+	const std::string appendBefore=fileContents("append_test.mat");
+	// opening and closing must not change the file
+	TinyMATWriter_close(TinyMATWriter_openAppend("append_test.mat"));
+	check(fileContents("append_test.mat")==appendBefore, "append_test.mat unchanged by openAppend()+close()");
+	mat=TinyMATWriter_openAppend("append_test.mat");
+	check(mat!=NULL, "openAppend(append_test.mat)");
+	if (mat) {
+		TinyMATWriter_writeValue(mat, "c", 3.0);
+		TinyMATWriter_close(mat);
+		// the variable c is appended behind all existing elements
+		check(fileContents("append_test.mat")==appendBefore+fileContents("append_test_c.mat").substr(128), "append_test.mat: c appended");
+	}
+	// an incomplete element at the end of the file is removed
+	{
+		FILE* f=fopen("append_test.mat", "ab");
+		const uint32_t tag[2]={14, 1024}; // miMATRIX, 1024 bytes
+		fwrite(tag, sizeof(uint32_t), 2, f);
+		fclose(f);
+	}
+	TinyMATWriter_close(TinyMATWriter_openAppend("append_test.mat"));
+	check(fileSize("append_test.mat")==long(appendBefore.size()+fileContents("append_test_c.mat").size()-128), "append_test.mat: incomplete element removed");
+
+	// replace variables: in place, if the size does not change, otherwise by a tombstone and a new variable at the end
+	double vec4[4]={1,2,3,4};
+	double vec8[8]={1,2,3,4,5,6,7,8};
+	mat=TinyMATWriter_open("replace_test.mat");
+	if (mat) {
+		TinyMATWriter_setReplaceExisting(mat, true);
+		TinyMATWriter_writeValue(mat, "counter", 0.0);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "vec", vec4, 1,4);
+		TinyMATWriter_writeValue(mat, "last", 5.0);
+		TinyMATWriter_writeValue(mat, "counter", 0.5);
+		TinyMATWriter_close(mat);
+	}
+	// the same variables, written once
+	mat=TinyMATWriter_open("replace_test_ref.mat");
+	TinyMATWriter_writeValue(mat, "counter", 2.0);
+	TinyMATWriter_writeMatrix2D_rowmajor(mat, "vec", vec4, 1,4);
+	TinyMATWriter_writeValue(mat, "last", 5.0);
+	TinyMATWriter_close(mat);
+	mat=TinyMATWriter_open("replace_test_vec8.mat");
+	TinyMATWriter_writeMatrix2D_rowmajor(mat, "vec", vec8, 1,8);
+	TinyMATWriter_close(mat);
+	const std::string replaceRef=fileContents("replace_test_ref.mat").substr(128);
+	const std::string replaceVec8=fileContents("replace_test_vec8.mat").substr(128);
+	mat=TinyMATWriter_openAppend("replace_test.mat");
+	check(mat!=NULL, "openAppend(replace_test.mat)");
+	if (mat) {
+		TinyMATWriter_setReplaceExisting(mat, true);
+		TinyMATWriter_writeValue(mat, "counter", 1.0);
+		TinyMATWriter_writeValue(mat, "counter", 2.0);
+		TinyMATWriter_close(mat);
+		const std::string replaced=fileContents("replace_test.mat");
+		check(replaced.size()>128 && replaced.substr(128)==replaceRef, "replace_test.mat: counter replaced in place");
+
+		mat=TinyMATWriter_openAppend("replace_test.mat");
+		TinyMATWriter_setReplaceExisting(mat, true);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "vec", vec8, 1,8);
+		check(TinyMATWriter_hasVariable(mat, "vec"), "replace_test.mat: hasVariable(vec)");
+		TinyMATWriter_close(mat);
+		// vec is appended, the old vec (behind counter, before last) became a tombstone of the same size
+		const std::string appended=fileContents("replace_test.mat");
+		check(appended.size()==replaced.size()+replaceVec8.size(), "replace_test.mat: vec appended");
+		check(appended.compare(0, replaced.size(), replaced)!=0 && appended.compare(replaced.size(), std::string::npos, replaceVec8)==0, "replace_test.mat: new vec");
+		check(appended.find("tm_free")!=std::string::npos && appended.find("last")==replaced.find("last"), "replace_test.mat: tombstone of vec");
+	}
+
+	// a scalar, which is too small for a tombstone, cannot be replaced by a variable of a different size
+	mat=TinyMATWriter_open("replace_small_test.mat");
+	TinyMATWriter_close(mat);
+	mat=TinyMATWriter_open("replace_small_test_y.mat");
+	TinyMATWriter_writeValue(mat, "y", 1.0);
+	TinyMATWriter_close(mat);
+	{
+		// a uint8 scalar flag=1 with name and data in the small data element format (56 bytes, as written e.g. by MATLAB)
+		FILE* f=fopen("replace_small_test.mat", "ab");
+		const uint32_t flag[14]={14, 48, 6, 8, 9, 0, 5, 8, 1, 1, (4<<16)|1, 0x67616c66, (1<<16)|2, 1};
+		fwrite(flag, sizeof(uint32_t), 14, f);
+		fclose(f);
+	}
+	const std::string smallBefore=fileContents("replace_small_test.mat");
+	mat=TinyMATWriter_openAppend("replace_small_test.mat");
+	check(mat!=NULL, "openAppend(replace_small_test.mat)");
+	if (mat) {
+		TinyMATWriter_setReplaceExisting(mat, true);
+		check(TinyMATWriter_hasVariable(mat, "flag"), "replace_small_test.mat: hasVariable(flag)");
+		bool thrown=false;
+		try {
+			TinyMATWriter_writeValue(mat, "flag", 2.0);
+		} catch (std::runtime_error&) {
+			thrown=true;
+		}
+		check(thrown, "replace_small_test.mat: replacing a uint8 scalar by a double throws");
+		TinyMATWriter_writeValue(mat, "y", 1.0);
+		TinyMATWriter_close(mat);
+		// the old flag is kept and the new one was dropped
+		check(fileContents("replace_small_test.mat")==smallBefore+fileContents("replace_small_test_y.mat").substr(128), "replace_small_test.mat: new flag dropped");
+	}
+
+	// the sparse 4x3 matrix sparse1 from basic_test.mat in CSC and CSR form gives the same variable as the coordinate list
+	{
+		int32_t sp_rows[5] = {0, 3, 1, 3, 2};
+		int32_t sp_cols[5] = {0, 0, 1, 0, 2};
+		double sp_vals[5] = {1, 2, 3, 4, 5};
+		bool sp_bools[5] = {true, true, true, false, true};
+		const int32_t csc_ir[4] = {0, 3, 1, 2};
+		const int32_t csc_jc[4] = {0, 2, 3, 4};
+		const int32_t csc_jc5[4] = {5, 7, 8, 9}; // pointers, which do not start at 0
+		const double csc_pr[4] = {1, 6, 3, 5};
+		const int32_t csr_ja[4] = {0, 1, 2, 0};
+		const int32_t csr_ia[5] = {0, 1, 2, 3, 4};
+		const double csr_a[4] = {1, 3, 5, 6};
+		const int32_t csc_ir_bad[4] = {0, 4, 1, 2}; // row index out of range
+		const int32_t csc_jc_bad[4] = {0, 3, 2, 4}; // decreasing pointers
+		const char* sparseFiles[7]={"sparse_test_coo.mat", "sparse_test_csc.mat", "sparse_test_csr.mat", "sparse_test_cooL.mat", "sparse_test_cscL.mat", "sparse_test_empty.mat", "sparse_test_bad.mat"};
+		for (int i=0; i<7; i++) {
+			mat=TinyMATWriter_open(sparseFiles[i]);
+			if (i==0) TinyMATWriter_writeSparseCOO(mat, "sparse1", sp_vals, sp_rows, sp_cols, 5, 4, 3);
+			if (i==1) TinyMATWriter_writeSparseCSC(mat, "sparse1", csc_pr, csc_ir, csc_jc, 4, 3);
+			if (i==1) TinyMATWriter_writeSparseCSC(mat, "sparse1", csc_pr, csc_ir, csc_jc5, 4, 3);
+			if (i==2) TinyMATWriter_writeSparseCSR(mat, "sparse1", csr_a, csr_ja, csr_ia, 4, 3);
+			if (i==2) TinyMATWriter_writeSparseCSR(mat, "sparse1", csr_a, csr_ja, csr_ia, 4, 3, 2);
+			if (i==3) TinyMATWriter_writeSparseCOO(mat, "sparse1", sp_bools, sp_rows, sp_cols, 5, 4, 3);
+			if (i==4) TinyMATWriter_writeSparseCSC(mat, "sparse1", static_cast<const bool*>(NULL), csc_ir, csc_jc, 4, 3);
+			if (i==5) TinyMATWriter_writeEmptyMatrix(mat, "sparse1");
+			if (i==6) TinyMATWriter_writeSparseCSC(mat, "sparse1", csc_pr, csc_ir_bad, csc_jc, 4, 3);
+			if (i==6) TinyMATWriter_writeSparseCSC(mat, "sparse1", csc_pr, csc_ir, csc_jc_bad, 4, 3);
+			TinyMATWriter_close(mat);
+		}
+		const std::string coo=fileContents(sparseFiles[0]).substr(128);
+		check(coo.size()>0, "sparse_test_coo.mat");
+		check(fileContents(sparseFiles[1]).substr(128)==coo+coo, "sparse_test_csc.mat: CSC == COO");
+		check(fileContents(sparseFiles[2]).substr(128)==coo+coo, "sparse_test_csr.mat: CSR == COO");
+		check(fileContents(sparseFiles[4]).substr(128)==fileContents(sparseFiles[3]).substr(128), "sparse_test_cscL.mat: logical CSC == COO");
+		const std::string empty=fileContents(sparseFiles[5]).substr(128);
+		check(fileContents(sparseFiles[6]).substr(128)==empty+empty, "sparse_test_bad.mat: invalid CSC is written as empty matrix");
+	}
+
+	// with a sparse threshold, mostly-zero double matrices are written just as the same matrix given as coordinate list
+	{
+		const int32_t n=200;
+		std::vector<double> dense(n*n, 0.0);
+		std::vector<int32_t> ri, ci;
+		std::vector<double> vals;
+		for (int32_t k=0; k<5000; k++) {
+			// 200 non-zeros in each of the first 25 columns
+			const int32_t r=(k*7)%n, c=k/200;
+			dense[c*n+r]=k+1;
+			ri.push_back(r);
+			ci.push_back(c);
+			vals.push_back(k+1);
+		}
+		const int32_t sizes[2]={n, n};
+		const std::vector<double> zeros(n*n, 0.0);
+		double few[100]={0};
+		few[5]=1; few[50]=2; few[95]=3;
+		const double few_vals[3]={1, 2, 3};
+		const int32_t few_rows[3]={5, 0, 5};
+		const int32_t few_cols[3]={0, 5, 9};
+		const int32_t sizes10[2]={10, 10};
+		mat=TinyMATWriter_open("sparse_threshold_test.mat");
+		TinyMATWriter_setSparseThreshold(mat, 0.2);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "s", dense.data(), sizes, 2); // 12.5% non-zeros: sparse
+		TinyMATWriter_writeMatrixND_colmajor(mat, "z", zeros.data(), sizes, 2); // no non-zeros: sparse
+		TinyMATWriter_writeMatrixND_colmajor(mat, "f", few, sizes10, 2); // 3% non-zeros: sparse
+		TinyMATWriter_setSparseThreshold(mat, 0.1);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "d", dense.data(), sizes, 2); // 12.5% non-zeros: dense
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("sparse_threshold_test_ref.mat");
+		TinyMATWriter_writeSparseCOO(mat, "s", vals.data(), ri.data(), ci.data(), vals.size(), n, n);
+		TinyMATWriter_writeSparseCOO(mat, "z", vals.data(), ri.data(), ci.data(), 0, n, n);
+		TinyMATWriter_writeSparseCOO(mat, "f", few_vals, few_rows, few_cols, 3, 10, 10);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "d", dense.data(), sizes, 2);
+		TinyMATWriter_close(mat);
+		check(fileContents("sparse_threshold_test.mat").substr(128)==fileContents("sparse_threshold_test_ref.mat").substr(128), "sparse_threshold_test.mat: sparse, if below the threshold");
+	}
+
+	// complex matrices are written as the real part, followed by the imaginary part
+	{
+		const std::complex<double> cd[6]={{1,-1}, {2,-2}, {3,-3}, {4,-4}, {5,-5}, {6,-6}};
+		const double cd_re[6]={1,2,3,4,5,6};
+		const double cd_im[6]={-1,-2,-3,-4,-5,-6};
+		const double cd_re_t[6]={1,4,2,5,3,6};
+		const double cd_im_t[6]={-1,-4,-2,-5,-3,-6};
+		const std::complex<float> cf[3]={{1.5f,-0.5f}, {2.5f,-1.5f}, {3.5f,-2.5f}};
+		const float cf_re[3]={1.5f, 2.5f, 3.5f};
+		const float cf_im[3]={-0.5f, -1.5f, -2.5f};
+		const int32_t cd_sizes[2]={2, 3};
+		const int32_t cd_sizes_t[2]={3, 2};
+		const int32_t cf_sizes[2]={3, 1};
+		// a larger matrix, that is split into several blocks (row-major: 60 columns, 50 rows)
+		std::vector<std::complex<double> > cb(3000);
+		std::vector<double> cb_re(3000), cb_im(3000);
+		for (int32_t r=0; r<50; r++) {
+			for (int32_t c=0; c<60; c++) {
+				cb[r*60+c]=std::complex<double>(r, c);
+				cb_re[c*50+r]=r;
+				cb_im[c*50+r]=c;
+			}
+		}
+		const int32_t cb_sizes[2]={60, 50};
+		const int32_t cb_sizes_cm[2]={50, 60};
+		mat=TinyMATWriter_open("complex_test.mat");
+		TinyMATWriter_writeMatrixND_colmajor(mat, "cd", cd, cd_sizes, 2);
+		TinyMATWriter_writeMatrixND_rowmajor(mat, "cdr", cd, cd_sizes_t, 2);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "cf", cf, cf_sizes, 2);
+		TinyMATWriter_writeMatrixND_rowmajor(mat, "cb", cb.data(), cb_sizes, 2);
+		TinyMATWriter_close(mat);
+		const char* names[4]={"cd", "cdr", "cf", "cb"};
+		std::string expected;
+		for (int i=0; i<4; i++) {
+			mat=TinyMATWriter_open("complex_test_re.mat");
+			if (i==0) TinyMATWriter_writeMatrixND_colmajor(mat, names[i], cd_re, cd_sizes, 2);
+			if (i==1) TinyMATWriter_writeMatrixND_colmajor(mat, names[i], cd_re_t, cd_sizes, 2);
+			if (i==2) TinyMATWriter_writeMatrixND_colmajor(mat, names[i], cf_re, cf_sizes, 2);
+			if (i==3) TinyMATWriter_writeMatrixND_colmajor(mat, names[i], cb_re.data(), cb_sizes_cm, 2);
+			TinyMATWriter_close(mat);
+			const std::string re=fileContents("complex_test_re.mat").substr(128);
+			if (i==0) expected+=complexElement(re, cd_im, sizeof(cd_im), 9);
+			if (i==1) expected+=complexElement(re, cd_im_t, sizeof(cd_im_t), 9);
+			if (i==2) expected+=complexElement(re, cf_im, sizeof(cf_im), 7);
+			if (i==3) expected+=complexElement(re, cb_im.data(), 3000*sizeof(double), 9);
+		}
+		check(fileContents("complex_test.mat").substr(128)==expected, "complex_test.mat: complex matrices");
+	}
+
+	// several threads write into one concurrent MAT-file, each variable arrives complete
+	{
+		TinyMATWriterFile* shared=TinyMATWriter_openConcurrent("concurrent_test.mat", "concurrent");
+		check(shared!=NULL, "openConcurrent(concurrent_test.mat)");
+		std::vector<std::thread> threads;
+		for (int t=0; t<4; t++) {
+			threads.emplace_back([shared, t]() {
+				TinyMATWriterFile* w=TinyMATWriter_openThreadWriter(shared);
+				for (int k=0; k<50; k++) {
+					const std::string name="t"+std::to_string(t)+"_"+std::to_string(k);
+					std::vector<double> v(k+1, t*100+k);
+					TinyMATWriter_writeDoubleVector(w, name.c_str(), v);
+				}
+				TinyMATWriter_close(w);
+			});
+		}
+		for (auto& th: threads) th.join();
+		TinyMATWriter_close(shared);
+		const std::string concurrent=fileContents("concurrent_test.mat");
+		check(concurrent.find("concurrent")!=std::string::npos, "concurrent_test.mat: description");
+		size_t bytes=128;
+		bool found=true;
+		for (int t=0; t<4; t++) {
+			for (int k=0; k<50; k++) {
+				const std::string name="t"+std::to_string(t)+"_"+std::to_string(k);
+				std::vector<double> v(k+1, t*100+k);
+				mat=TinyMATWriter_open("concurrent_test_ref.mat");
+				TinyMATWriter_writeDoubleVector(mat, name.c_str(), v);
+				TinyMATWriter_close(mat);
+				const std::string element=fileContents("concurrent_test_ref.mat").substr(128);
+				bytes+=element.size();
+				if (concurrent.find(element)==std::string::npos) found=false;
+			}
+		}
+		check(concurrent.size()==bytes && found, "concurrent_test.mat: all variables");
+	}
+
+	// asynchronous writes appear in submission order and report their results through the futures and callbacks
+	{
+		const double a[6]={1,2,3,4,5,6};
+		const std::vector<int32_t> sizes={2, 3};
+		mat=TinyMATWriter_open("async_test.mat");
+		std::vector<std::future<void> > futures;
+		futures.push_back(TinyMATWriter_writeMatrixND_colmajorAsync(mat, "a1", std::vector<double>(a, a+6), sizes));
+		std::unique_ptr<double[]> a2(new double[6]);
+		for (int i=0; i<6; i++) a2[i]=a[i]*2;
+		futures.push_back(TinyMATWriter_writeMatrixND_colmajorAsync(mat, "a2", std::move(a2), sizes));
+		futures.push_back(TinyMATWriter_writeMatrixND_colmajorAsync(mat, "a3", std::make_shared<const std::vector<double> >(a, a+6), sizes));
+		int callbacks=0;
+		bool callbackError=false;
+		std::future<void> failed=TinyMATWriter_enqueue(mat, [](TinyMATWriterFile*) {
+			throw std::runtime_error("task failed");
+		}, [&callbackError, &callbacks](std::exception_ptr e) {
+			callbackError=(e!=nullptr);
+			callbacks++;
+		});
+		futures.push_back(TinyMATWriter_enqueue(mat, [](TinyMATWriterFile* m) {
+			TinyMATWriter_writeValue(m, "last", 4.0);
+		}, [&callbacks](std::exception_ptr e) {
+			if (!e) callbacks++;
+		}));
+		TinyMATWriter_waitForWrites(mat);
+		bool ok=true;
+		for (auto& f: futures) {
+			try {
+				f.get();
+			} catch (...) {
+				ok=false;
+			}
+		}
+		bool thrown=false;
+		try {
+			failed.get();
+		} catch (std::runtime_error&) {
+			thrown=true;
+		}
+		check(ok && thrown && callbacks==2 && callbackError, "async_test.mat: futures and callbacks");
+		// the synchronous API can be used again after waitForWrites()
+		TinyMATWriter_writeValue(mat, "sync", 5.0);
+		TinyMATWriter_close(mat);
+
+		mat=TinyMATWriter_open("async_test_ref.mat");
+		double a2ref[6];
+		for (int i=0; i<6; i++) a2ref[i]=a[i]*2;
+		TinyMATWriter_writeMatrixND_colmajor(mat, "a1", a, sizes.data(), 2);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "a2", a2ref, sizes.data(), 2);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "a3", a, sizes.data(), 2);
+		TinyMATWriter_writeValue(mat, "last", 4.0);
+		TinyMATWriter_writeValue(mat, "sync", 5.0);
+		TinyMATWriter_close(mat);
+		check(fileContents("async_test.mat").substr(128)==fileContents("async_test_ref.mat").substr(128), "async_test.mat: variables in submission order");
+	}
+
+	// column vectors grow in their free space, are moved behind the other variables and can be extended after openAppend()
+	{
+		double c[32];
+		for (int i=0; i<32; i++) c[i]=i+1;
+		mat=TinyMATWriter_open("column_test.mat");
+		TinyMATWriter_appendToColumn(mat, "c", c, 3);
+		TinyMATWriter_writeValue(mat, "x", 1.0);
+		TinyMATWriter_appendToColumn(mat, "c", c+3, 1);
+		const int32_t rowSize[2]={1, 3};
+		TinyMATWriter_writeMatrixND_colmajor(mat, "r", c, rowSize, 2);
+		TinyMATWriter_appendToColumn(mat, "c", c+4, 20);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("column_test_c24.mat");
+		const int32_t c24Size[2]={24, 1};
+		TinyMATWriter_writeMatrixND_colmajor(mat, "c", c, c24Size, 2);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("column_test_c32.mat");
+		const int32_t c32Size[2]={32, 1};
+		TinyMATWriter_writeMatrixND_colmajor(mat, "c", c, c32Size, 2);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("column_test_x.mat");
+		TinyMATWriter_writeValue(mat, "x", 1.0);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("column_test_r.mat");
+		const int32_t r2Size[2]={2, 1};
+		TinyMATWriter_writeMatrixND_colmajor(mat, "r", c+1, r2Size, 2);
+		TinyMATWriter_close(mat);
+		const std::string c24=fileContents("column_test_c24.mat").substr(128);
+		const std::string c32=fileContents("column_test_c32.mat").substr(128);
+		const std::string x=fileContents("column_test_x.mat").substr(128);
+		const std::string r2=fileContents("column_test_r.mat").substr(128);
+		const std::string before=fileContents("column_test.mat");
+		check(before.compare(128+48, 7, "tm_free")==0 && before.find(x)==128+64+24+88, "column_test.mat: values written in place, old column is a tombstone");
+		const size_t cpos=before.find(c24);
+		check(cpos!=std::string::npos && cpos>before.find(x) && before.size()==cpos+c24.size()+64 && before.compare(cpos+c24.size()+48, 7, "tm_free")==0, "column_test.mat: column moved behind the other variables");
+
+		// the column (followed by its free space) is extended in place after openAppend()
+		mat=TinyMATWriter_openAppend("column_test.mat");
+		check(mat!=NULL, "openAppend(column_test.mat)");
+		TinyMATWriter_appendToColumn(mat, "c", c+24, 8);
+		TinyMATWriter_close(mat);
+		const std::string extended=fileContents("column_test.mat");
+		check(extended.size()==before.size() && extended.find(c32)!=std::string::npos, "column_test.mat: column extended after openAppend()");
+
+		// a variable, which is not a column vector, is only replaced with setReplaceExisting()
+		mat=TinyMATWriter_openAppend("column_test.mat");
+		bool thrown=false;
+		try {
+			TinyMATWriter_appendToColumn(mat, "r", c+1, 2);
+		} catch (std::runtime_error&) {
+			thrown=true;
+		}
 		TinyMATWriter_close(mat);
+		check(thrown && fileContents("column_test.mat")==extended, "column_test.mat: row vector is not extended");
+		mat=TinyMATWriter_openAppend("column_test.mat");
+		TinyMATWriter_setReplaceExisting(mat, true);
+		TinyMATWriter_appendToColumn(mat, "r", c+1, 2);
+		TinyMATWriter_close(mat);
+		const std::string replaced=fileContents("column_test.mat");
+		check(replaced.size()==extended.size()+r2.size()+80 && replaced.compare(extended.size(), r2.size(), r2)==0, "column_test.mat: row vector replaced by a column");
+		check(replaced.compare(extended.find(x)+x.size()+48, 7, "tm_free")==0, "column_test.mat: tombstone of the row vector");
+	}
+
+	// a rotating writer switches to the next file, when the size limit is reached or on request
+	{
+		std::vector<double> v(100);
+		for (size_t i=0; i<v.size(); i++) v[i]=i;
+		remove("rotate_test_000004.mat");
+		TinyMATRotatingWriter* writer=TinyMATRotatingWriter_open("rotate_test.mat", NULL, 1500);
+		check(writer!=NULL, "TinyMATRotatingWriter_open(rotate_test)");
+		for (int i=0; i<5; i++) {
+			v[0]=i;
+			TinyMATWriter_writeDoubleVector(TinyMATRotatingWriter_file(writer), "v", v);
+		}
+		check(TinyMATRotatingWriter_getSequence(writer)==2, "rotate_test: sequence after the size limit");
+		check(TinyMATRotatingWriter_rotate(writer) && TinyMATRotatingWriter_getSequence(writer)==3, "rotate_test: rotate()");
+		TinyMATWriter_writeValue(TinyMATRotatingWriter_file(writer), "w", 1.0);
+		check(TinyMATRotatingWriter_close(writer), "rotate_test: close");
+		const int counts[4]={2, 2, 1, 0};
+		int first=0;
+		for (int f=0; f<4; f++) {
+			char name[64];
+			snprintf(name, sizeof(name), "rotate_test_%06d.mat", f);
+			mat=TinyMATWriter_open("rotate_test_ref.mat");
+			TinyMATWriter_writeValue(mat, "tinymat_sequence", double(f));
+			for (int i=first; i<first+counts[f]; i++) {
+				v[0]=i;
+				TinyMATWriter_writeDoubleVector(mat, "v", v);
+			}
+			if (f==3) TinyMATWriter_writeValue(mat, "w", 1.0);
+			TinyMATWriter_close(mat);
+			first+=counts[f];
+			const std::string data=fileContents(name);
+			check(data.size()>128 && data.substr(128)==fileContents("rotate_test_ref.mat").substr(128), name);
+		}
+		check(fileSize("rotate_test_000004.mat")<0, "rotate_test: no further file");
+	}
+
+	// a sharded writer distributes the variables round-robin or by their size and lists them in the manifest
+	{
+		const char* shardFiles[3]={"shard_test_0.mat", "shard_test_1.mat", "shard_test_2.mat"};
+		TinyMATShardedWriter* writer=TinyMATShardedWriter_open("shard_test_manifest.mat", shardFiles, 2);
+		check(writer!=NULL, "TinyMATShardedWriter_open(shard_test)");
+		TinyMATWriter_writeValue(TinyMATShardedWriter_file(writer, "a"), "a", 1.0);
+		std::future<void> b=TinyMATShardedWriter_enqueue(writer, "b", [](TinyMATWriterFile* m) {
+			TinyMATWriter_writeValue(m, "b", 2.0);
+		});
+		TinyMATWriter_writeValue(TinyMATShardedWriter_file(writer, "c"), "c", 3.0);
+		std::future<void> d=TinyMATShardedWriter_enqueue(writer, "d", [](TinyMATWriterFile* m) {
+			TinyMATWriter_writeValue(m, "d", 4.0);
+		});
+		check(TinyMATShardedWriter_close(writer), "shard_test: close");
+		b.get();
+		d.get();
+		const char* roundRobin[2][2]={{"a", "c"}, {"b", "d"}};
+		const double roundRobinValues[2][2]={{1, 3}, {2, 4}};
+		for (int sh=0; sh<2; sh++) {
+			mat=TinyMATWriter_open("shard_test_ref.mat");
+			for (int i=0; i<2; i++) TinyMATWriter_writeValue(mat, roundRobin[sh][i], roundRobinValues[sh][i]);
+			TinyMATWriter_close(mat);
+			check(fileContents(shardFiles[sh]).substr(128)==fileContents("shard_test_ref.mat").substr(128), shardFiles[sh]);
+		}
+		mat=TinyMATWriter_open("shard_test_ref.mat");
+		TinyMATWriter_writeStringVector(mat, "shards", std::vector<std::string>(shardFiles, shardFiles+2));
+		TinyMATWriter_writeStringVector(mat, "variables", std::vector<std::string>{"a", "b", "c", "d"});
+		TinyMATWriter_writeDoubleVector(mat, "shard", std::vector<double>{1, 2, 1, 2}, true);
+		TinyMATWriter_close(mat);
+		check(fileContents("shard_test_manifest.mat").substr(128)==fileContents("shard_test_ref.mat").substr(128), "shard_test_manifest.mat: round-robin");
+
+		// each variable goes to the shard with the fewest bytes so far: x->0, y->1, z->2, w->2, u->1
+		writer=TinyMATShardedWriter_open("shard_test_manifest.mat", shardFiles, 3, TinyMATShardPolicy::BySize);
+		const char* names[5]={"x", "y", "z", "w", "u"};
+		const uint64_t hints[5]={100, 50, 20, 40, 10};
+		for (int i=0; i<5; i++) {
+			TinyMATWriter_writeValue(TinyMATShardedWriter_file(writer, names[i], hints[i]), names[i], double(i));
+		}
+		check(TinyMATShardedWriter_close(writer), "shard_test: close (BySize)");
+		const int bySize[3][2]={{0, -1}, {1, 4}, {2, 3}};
+		for (int sh=0; sh<3; sh++) {
+			mat=TinyMATWriter_open("shard_test_ref.mat");
+			for (int i=0; i<2; i++) {
+				if (bySize[sh][i]>=0) TinyMATWriter_writeValue(mat, names[bySize[sh][i]], double(bySize[sh][i]));
+			}
+			TinyMATWriter_close(mat);
+			check(fileContents(shardFiles[sh]).substr(128)==fileContents("shard_test_ref.mat").substr(128), shardFiles[sh]);
+		}
+		mat=TinyMATWriter_open("shard_test_ref.mat");
+		TinyMATWriter_writeStringVector(mat, "shards", std::vector<std::string>(shardFiles, shardFiles+3));
+		TinyMATWriter_writeStringVector(mat, "variables", std::vector<std::string>(names, names+5));
+		TinyMATWriter_writeDoubleVector(mat, "shard", std::vector<double>{1, 2, 3, 3, 2}, true);
+		TinyMATWriter_close(mat);
+		check(fileContents("shard_test_manifest.mat").substr(128)==fileContents("shard_test_ref.mat").substr(128), "shard_test_manifest.mat: by size");
+	}
+
+	// temporary buffers of nested elements are released right away, the scratch arena does not grow with the nesting
+	{
+		static double scratchBuffer[512];
+		const double m[6]={1,2,3,4,5,6};
+		mat=TinyMATWriter_open("scratch_test.mat");
+		TinyMATWriter_setScratchBuffer(mat, scratchBuffer, sizeof(scratchBuffer));
+		TinyMATWriter_startStruct(mat, "s");
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "a", m, 3, 2);
+		TinyMATWriter_writeContainerAsColumn(mat, "b", std::list<double>(m, m+6));
+		void* p=TinyMATWriter_scratch(mat, 8);
+		check(p==static_cast<void*>(scratchBuffer), "scratch_test.mat: buffers of the struct fields released");
+		{
+			TinyMATWriterScratchScope scope(mat);
+			check(TinyMATWriter_scratch(mat, 100)==static_cast<void*>(scratchBuffer+8), "scratch_test.mat: scratch inside a scope");
+		}
+		const TinyMATWriterScratchMark mark=TinyMATWriter_scratchMark(mat);
+		TinyMATWriter_scratch(mat, 100000);
+		TinyMATWriter_scratchRelease(mat, mark);
+		check(TinyMATWriter_scratch(mat, 8)==static_cast<void*>(scratchBuffer+8), "scratch_test.mat: scratchRelease()");
+		TinyMATWriter_endStruct(mat);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("scratch_test_ref.mat");
+		TinyMATWriter_startStruct(mat, "s");
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "a", m, 3, 2);
+		TinyMATWriter_writeContainerAsColumn(mat, "b", std::list<double>(m, m+6));
+		TinyMATWriter_endStruct(mat);
+		TinyMATWriter_close(mat);
+		check(fileContents("scratch_test.mat").substr(128)==fileContents("scratch_test_ref.mat").substr(128), "scratch_test.mat: struct written with a user buffer");
+	}
+
+	// a sizer computes the exact size of the same variables in a MAT-file
+	{
+		TinyMATWriterFile* sizer=TinyMATWriter_openSizer();
+		check(TinyMATWriter_isSizer(sizer), "isSizer()");
+		writeMixedVariables(sizer);
+		const uint64_t size=TinyMATWriter_getSize(sizer);
+		TinyMATWriter_close(sizer);
+		mat=TinyMATWriter_open("sizer_test.mat");
+		check(!TinyMATWriter_isSizer(mat), "isSizer() of a file");
+		writeMixedVariables(mat);
+		TinyMATWriter_close(mat);
+		check(size>128 && long(size)==fileSize("sizer_test.mat"), "sizer_test.mat: sizer == file size");
+	}
+
+	// space reserved for a file (from a sizer or too large) does not change the file
+	{
+		TinyMATWriterFile* sizer=TinyMATWriter_openSizer();
+		writeMixedVariables(sizer);
+		const uint64_t size=TinyMATWriter_getSize(sizer);
+		TinyMATWriter_close(sizer);
+		mat=TinyMATWriter_openWithSizeHint("reserve_test.mat", size);
+		check(mat!=NULL, "openWithSizeHint(reserve_test.mat)");
+		writeMixedVariables(mat);
+		TinyMATWriter_close(mat);
+		const std::string sized=fileContents("sizer_test.mat").substr(128);
+		check(fileContents("reserve_test.mat").substr(128)==sized, "reserve_test.mat: size hint from a sizer");
+		mat=TinyMATWriter_open("reserve_test.mat");
+		TinyMATWriter_writeValue(mat, "value", 1.5);
+		TinyMATWriter_reserve(mat, 4*size);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("reserve_test_ref.mat");
+		TinyMATWriter_writeValue(mat, "value", 1.5);
+		TinyMATWriter_close(mat);
+		check(fileContents("reserve_test.mat").substr(128)==fileContents("reserve_test_ref.mat").substr(128), "reserve_test.mat: unused reserved space is removed");
+	}
+	// the files written above are read back with TinyMATReader
+	{
+		TinyMATReaderFile* r=TinyMATReader_open("basic_test.mat");
+		check(r!=NULL, "TinyMATReader_open(basic_test.mat)");
+		if (r) {
+			TinyMATReaderArray a;
+			check(TinyMATReader_find(r, "matrix1", &a) && a.mxClass==TinyMATClass::Double && a.ndims==2 && a.dims[0]==3 && a.dims[1]==2, "basic_test.mat: dimensions of matrix1");
+			const std::vector<double> m1=readDoubles(r, "matrix1");
+			check(m1==std::vector<double>({1,3,5,2,4,6}), "basic_test.mat: matrix1 (column-major)");
+			check(readDoubles(r, "matrix1_fromcolmajor")==m1 && readDoubles(r, "matrix1_ver2")==m1, "basic_test.mat: matrix1_fromcolmajor, matrix1_ver2");
+			check(readDoubles(r, "vector1")==std::vector<double>({1,2,3,4,5,6,7,8}), "basic_test.mat: vector1");
+			// mat432i16 is stored as int16, in the same order as matrix432d_rowmajor
+			const std::vector<double> d432=readDoubles(r, "matrix432d_rowmajor");
+			const int16_t* i16=NULL;
+			if (TinyMATReader_find(r, "mat432i16", &a)) i16=TinyMATReader_data<int16_t>(a);
+			bool same=(i16!=NULL && TinyMATReader_data<double>(a)==NULL && TinyMATReader_numel(a)==24 && d432.size()==24);
+			for (size_t i=0; same && i<d432.size(); i++) same=(std::abs(double(i16[i]))==d432[i]);
+			check(same, "basic_test.mat: mat432i16");
+			check(TinyMATReader_find(r, "boolmatrix", &a) && a.logical && TinyMATReader_numel(a)==24, "basic_test.mat: boolmatrix");
+			check(isStruct1(r, "struct1"), "basic_test.mat: struct1");
+			const int32_t sp_ir[4]={0, 3, 1, 2};
+			const int32_t sp_jc[4]={0, 2, 3, 4};
+			check(TinyMATReader_find(r, "sparse1", &a) && a.mxClass==TinyMATClass::Sparse && a.irCount==4 && a.jcCount==4
+				  && memcmp(a.ir, sp_ir, sizeof(sp_ir))==0 && memcmp(a.jc, sp_jc, sizeof(sp_jc))==0
+				  && readDoubles(r, "sparse1")==std::vector<double>({1,6,3,5}), "basic_test.mat: sparse1");
+			check(!TinyMATReader_find(r, "nonexistent", &a), "basic_test.mat: unknown variable");
+			TinyMATReader_close(r);
+		}
+
+		// the same file from memory
+		const std::string basic=fileContents("basic_test.mat");
+		r=TinyMATReader_openBuffer(basic.data(), basic.size());
+		check(r!=NULL && TinyMATReader_listVariables(r).size()==13 && isStruct1(r, "struct1"), "TinyMATReader_openBuffer(basic_test.mat)");
+		TinyMATReader_close(r);
+		check(TinyMATReader_openBuffer(basic.data(), 100)==NULL, "TinyMATReader_openBuffer(): truncated header");
+
+		// elements, which are no variables, are skipped
+		r=TinyMATReader_open("append_test.mat");
+		check(r!=NULL && TinyMATReader_listVariables(r)==std::vector<std::string>({"a", "b", "c"}), "append_test.mat: listVariables()");
+		if (r) {
+			check(readDoubles(r, "a")==std::vector<double>({1}) && readDoubles(r, "b")==std::vector<double>({2}) && readDoubles(r, "c")==std::vector<double>({3}), "append_test.mat: values");
+			TinyMATReader_close(r);
+		}
+		r=TinyMATReader_open("replace_test.mat");
+		check(r!=NULL, "TinyMATReader_open(replace_test.mat)");
+		if (r) {
+			check(readDoubles(r, "counter")==std::vector<double>({2}) && readDoubles(r, "vec")==std::vector<double>(vec8, vec8+8) && readDoubles(r, "last")==std::vector<double>({5}), "replace_test.mat: values");
+			TinyMATReader_close(r);
+		}
+
+		// complex matrices
+		r=TinyMATReader_open("complex_test.mat");
+		check(r!=NULL, "TinyMATReader_open(complex_test.mat)");
+		if (r) {
+			TinyMATReaderArray a;
+			const double cd_im[6]={-1,-2,-3,-4,-5,-6};
+			check(TinyMATReader_find(r, "cd", &a) && a.complex && TinyMATReader_imagData<double>(a)!=NULL && a.imagBytes==sizeof(cd_im)
+				  && memcmp(TinyMATReader_imagData<double>(a), cd_im, sizeof(cd_im))==0 && readDoubles(r, "cd")==std::vector<double>({1,2,3,4,5,6}), "complex_test.mat: cd");
+			const float* cf_im=NULL;
+			if (TinyMATReader_find(r, "cf", &a) && a.complex) cf_im=TinyMATReader_imagData<float>(a);
+			check(cf_im!=NULL && cf_im[0]==-0.5f && cf_im[2]==-2.5f, "complex_test.mat: cf");
+			TinyMATReader_close(r);
+		}
+
+		// the column vector, which grew in several steps
+		r=TinyMATReader_open("column_test.mat");
+		check(r!=NULL, "TinyMATReader_open(column_test.mat)");
+		if (r) {
+			std::vector<double> c(32);
+			for (int i=0; i<32; i++) c[i]=i+1;
+			TinyMATReaderArray a;
+			check(TinyMATReader_find(r, "c", &a) && a.dims[0]==32 && a.dims[1]==1 && readDoubles(r, "c")==c, "column_test.mat: c");
+			check(readDoubles(r, "r")==std::vector<double>({2,3}) && readDoubles(r, "x")==std::vector<double>({1}), "column_test.mat: r, x");
+			TinyMATReader_close(r);
+		}
+		check(TinyMATReader_open("nonexistent.mat")==NULL, "TinyMATReader_open(): missing file");
+	}
+	// a struct lists only its direct children as fields, not the cells of a nested string vector
+	{
+		mat=TinyMATWriter_open("struct_fields_test.mat");
+		TinyMATWriter_startStruct(mat, "s");
+		TinyMATWriter_writeStringVector(mat, "names", std::vector<std::string>{"a", "bc"});
+		TinyMATWriter_writeValue(mat, "v", 1.0);
+		TinyMATWriter_endStruct(mat);
+		TinyMATWriter_close(mat);
+		TinyMATReaderFile* r=TinyMATReader_open("struct_fields_test.mat");
+		TinyMATReaderArray s, names;
+		check(r!=NULL && TinyMATReader_find(r, "s", &s) && TinyMATReader_getFieldNames(r, s)==std::vector<std::string>({"names", "v"})
+			  && TinyMATReader_getField(r, s, "names", &names) && names.mxClass==TinyMATClass::Cell && TinyMATReader_numel(names)==2, "struct_fields_test.mat: fields of s");
+		TinyMATReader_close(r);
+	}
+	// an index of all variables is written on close, used by the reader and rewritten after openAppend()
+	{
+		mat=TinyMATWriter_open("index_test.mat");
+		TinyMATWriter_setWriteIndex(mat, true);
+		TinyMATWriter_writeValue(mat, "a", 1.0);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "vec", vec4, 1,4);
+		TinyMATWriter_writeValue(mat, "b", 2.0);
+		TinyMATWriter_close(mat);
+		const std::string indexed=fileContents("index_test.mat");
+		uint64_t self=0;
+		if (indexed.size()>=8) memcpy(&self, indexed.data()+indexed.size()-8, 8);
+		TinyMATReaderFile* r=TinyMATReader_open("index_test.mat");
+		check(r!=NULL && TinyMATReader_listVariables(r)==std::vector<std::string>({"a", "vec", "b", TINYMAT_INDEX_NAME}), "index_test.mat: index is the last variable");
+		if (r) {
+			TinyMATReaderArray a;
+			check(TinyMATReader_buildIndex(r) && TinyMATReader_find(r, TINYMAT_INDEX_NAME, &a) && a.offset==self, "index_test.mat: last 8 bytes point to the index");
+			check(readDoubles(r, "a")==std::vector<double>({1}) && readDoubles(r, "vec")==std::vector<double>(vec4, vec4+4) && readDoubles(r, "b")==std::vector<double>({2}), "index_test.mat: values");
+			check(TinyMATReader_saveIndex(r, "index_test_sidecar.mat"), "index_test.mat: saveIndex()");
+			TinyMATReader_close(r);
+		}
+		r=TinyMATReader_open("index_test.mat");
+		check(r!=NULL && TinyMATReader_loadIndex(r, "index_test_sidecar.mat") && readDoubles(r, "b")==std::vector<double>({2}), "index_test.mat: loadIndex()");
+		TinyMATReader_close(r);
+		r=TinyMATReader_open("basic_test.mat");
+		check(r!=NULL && !TinyMATReader_loadIndex(r, "index_test_sidecar.mat"), "basic_test.mat: sidecar of another file is rejected");
+		TinyMATReader_close(r);
+
+		// the index is replaced by a new one, that lists the replaced and the new variables
+		mat=TinyMATWriter_openAppend("index_test.mat");
+		TinyMATWriter_setReplaceExisting(mat, true);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "vec", vec8, 1,8);
+		TinyMATWriter_writeValue(mat, "c", 3.0);
+		TinyMATWriter_close(mat);
+		r=TinyMATReader_open("index_test.mat");
+		check(r!=NULL && TinyMATReader_listVariables(r)==std::vector<std::string>({"a", "tm_free", "b", "vec", "c", TINYMAT_INDEX_NAME}), "index_test.mat: index rewritten after openAppend()");
+		if (r) {
+			check(readDoubles(r, "vec")==std::vector<double>(vec8, vec8+8) && readDoubles(r, "c")==std::vector<double>({3}), "index_test.mat: values after openAppend()");
+			TinyMATReader_close(r);
+		}
+
+		// an index, that is followed by another element, is kept as it is
+		{
+			FILE* f=fopen("index_test.mat", "ab");
+			const std::string c=fileContents("append_test_c.mat");
+			fwrite(c.data()+128, 1, c.size()-128, f);
+			fclose(f);
+		}
+		const std::string followed=fileContents("index_test.mat");
+		TinyMATWriter_close(TinyMATWriter_openAppend("index_test.mat"));
+		check(fileContents("index_test.mat")==followed, "index_test.mat: index in the middle of the file is kept");
+	}
+	// hyperslabs of numeric variables, also of compressed variables, if zlib is available
+	{
+		double h[4*3*2];
+		std::complex<double> hc[4*3];
+		int16_t hi[4*3];
+		for (int i=0; i<24; i++) h[i]=i;
+		for (int i=0; i<12; i++) {
+			hc[i]=std::complex<double>(i, -i);
+			hi[i]=int16_t(-i);
+		}
+		const int32_t hSize[3]={4, 3, 2};
+		mat=TinyMATWriter_open("hyperslab_test.mat");
+		TinyMATWriter_writeMatrixND_colmajor(mat, "h", h, hSize, 3);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "hc", hc, hSize, 2);
+		TinyMATWriter_writeMatrixND_colmajor(mat, "hi", hi, hSize, 2);
+		TinyMATWriter_close(mat);
+		std::vector<std::string> files(1, "hyperslab_test.mat");
+#ifdef TINYMAT_USES_ZLIB
+		check(compressFile("hyperslab_test.mat", "hyperslab_test_z.mat"), "hyperslab_test_z.mat: compressed");
+		files.push_back("hyperslab_test_z.mat");
+#endif
+		for (const std::string& file: files) {
+			TinyMATReaderFile* r=TinyMATReader_open(file.c_str());
+			check(r!=NULL, file.c_str());
+			if (!r) continue;
+			TinyMATReaderArray a;
+			// h(i,j,k) is the element i+4*j+12*k
+			const int32_t start[3]={1, 0, 1};
+			const int32_t count[3]={2, 3, 1};
+			double slab[6]={0,0,0,0,0,0};
+			check(TinyMATReader_find(r, "h", &a) && a.ndims==3 && TinyMATReader_readHyperslab(r, a, start, count, NULL, slab, sizeof(slab))
+				  && std::vector<double>(slab, slab+6)==std::vector<double>({13,14,17,18,21,22}), (file+": hyperslab").c_str());
+			const int32_t start2[3]={0, 0, 0};
+			const int32_t count2[3]={2, 2, 2};
+			const int32_t stride2[3]={3, 2, 1};
+			double slab2[8]={0,0,0,0,0,0,0,0};
+			check(TinyMATReader_readHyperslab(r, a, start2, count2, stride2, slab2, sizeof(slab2))
+				  && std::vector<double>(slab2, slab2+8)==std::vector<double>({0,3,8,11,12,15,20,23}), (file+": strided hyperslab").c_str());
+			const int32_t outside[3]={3, 0, 0};
+			check(!TinyMATReader_readHyperslab(r, a, outside, count, NULL, slab, sizeof(slab)), (file+": hyperslab outside of the array").c_str());
+			check(!TinyMATReader_readHyperslab(r, a, start, count, NULL, slab, sizeof(slab)-8), (file+": destination too small").c_str());
+			const int32_t start3[2]={1, 1};
+			const int32_t count3[2]={2, 1};
+			double im[2]={0,0};
+			check(TinyMATReader_find(r, "hc", &a) && a.complex && TinyMATReader_readHyperslab(r, a, start3, count3, NULL, im, sizeof(im), true)
+				  && im[0]==-5 && im[1]==-6, (file+": imaginary part").c_str());
+			int16_t i16[2]={0,0};
+			check(TinyMATReader_find(r, "hi", &a) && TinyMATReader_dataTypeSize(a.type)==sizeof(int16_t) && TinyMATReader_readHyperslab(r, a, start3, count3, NULL, i16, sizeof(i16))
+				  && i16[0]==-5 && i16[1]==-6, (file+": int16").c_str());
+			TinyMATReader_close(r);
+		}
+	}
+	// all variables are read on several threads, a large array in chunks (also compressed, if zlib is available)
+	{
+		std::vector<double> big(100000);
+		for (size_t i=0; i<big.size(); i++) big[i]=double(i);
+		mat=TinyMATWriter_open("parallel_test.mat");
+		TinyMATWriter_writeValue(mat, "a", 1.0);
+		TinyMATWriter_writeContainerAsColumn(mat, "big", big);
+		TinyMATWriter_startStruct(mat, "s");
+		TinyMATWriter_writeValue(mat, "x", 100.0);
+		TinyMATWriter_endStruct(mat);
+		for (int i=0; i<20; i++) TinyMATWriter_writeValue(mat, ("v"+std::to_string(i)).c_str(), double(i));
+		TinyMATWriter_close(mat);
+		std::vector<std::string> files(1, "parallel_test.mat");
+#ifdef TINYMAT_USES_ZLIB
+		check(compressFile("parallel_test.mat", "parallel_test_z.mat"), "parallel_test_z.mat: compressed");
+		files.push_back("parallel_test_z.mat");
+#endif
+		for (const std::string& file: files) {
+			TinyMATReaderFile* r=TinyMATReader_open(file.c_str());
+			check(r!=NULL, file.c_str());
+			if (!r) continue;
+			std::mutex m;
+			std::vector<std::string> names;
+			bool valuesOK=true;
+			const bool ok=TinyMATReader_readVariables(r, [&](const TinyMATReaderFile* data, const TinyMATReaderArray& a) {
+				const std::string name=TinyMATReader_getName(a);
+				bool valueOK=true;
+				if (name=="big") {
+					const double* d=TinyMATReader_data<double>(a);
+					valueOK=(d!=NULL && TinyMATReader_numel(a)==big.size() && memcmp(d, big.data(), big.size()*sizeof(double))==0);
+				} else if (name=="s") {
+					TinyMATReaderArray x;
+					valueOK=(TinyMATReader_getField(data, a, "x", &x) && TinyMATReader_data<double>(x) && TinyMATReader_data<double>(x)[0]==100);
+				}
+				std::lock_guard<std::mutex> lock(m);
+				names.push_back(name);
+				valuesOK=valuesOK && valueOK;
+			}, 4);
+			std::vector<std::string> all=TinyMATReader_listVariables(r);
+			std::sort(names.begin(), names.end());
+			std::sort(all.begin(), all.end());
+			check(ok && all.size()==23 && names==all && valuesOK, (file+": readVariables()").c_str());
+			const std::vector<std::string> some={"v3", "big"};
+			names.clear();
+			check(TinyMATReader_readVariables(r, [&](const TinyMATReaderFile*, const TinyMATReaderArray& a) {
+				std::lock_guard<std::mutex> lock(m);
+				names.push_back(TinyMATReader_getName(a));
+			}, 2, &some), (file+": readVariables(names)").c_str());
+			std::sort(names.begin(), names.end());
+			check(names==std::vector<std::string>({"big", "v3"}), (file+": only the requested variables").c_str());
+
+			// the chunks follow each other and contain the values
+			TinyMATReaderArray a;
+			uint64_t next=0;
+			bool chunksOK=TinyMATReader_find(r, "big", &a);
+			check(chunksOK && TinyMATReader_readChunked(r, a, [&](const void* data, uint64_t first, uint64_t count) {
+				chunksOK=chunksOK && first==next && count>0 && count<=1000 && memcmp(data, big.data()+first, count*sizeof(double))==0;
+				next=first+count;
+				return true;
+			}, 8000) && chunksOK && next==big.size(), (file+": readChunked()").c_str());
+			int calls=0;
+			check(!TinyMATReader_readChunked(r, a, [&](const void*, uint64_t, uint64_t) {
+				calls++;
+				return false;
+			}, 8000) && calls==1, (file+": readChunked() stopped by the callback").c_str());
+			TinyMATReader_close(r);
+		}
+	}
+	// the visitor walks structs, cells, arrays and strings in file order and skips the contents on request
+	{
+		mat=TinyMATWriter_open("visitor_test.mat");
+		TinyMATWriter_startStruct(mat, "s");
+		TinyMATWriter_writeValue(mat, "a", 1.0);
+		TinyMATWriter_writeStringVector(mat, "names", std::vector<std::string>{"x", "yz"});
+		TinyMATWriter_startStruct(mat, "t");
+		TinyMATWriter_writeValue(mat, "b", 2.0);
+		TinyMATWriter_endStruct(mat);
+		TinyMATWriter_startStruct(mat, "skip");
+		TinyMATWriter_writeValue(mat, "c", 3.0);
+		TinyMATWriter_endStruct(mat);
+		TinyMATWriter_endStruct(mat);
+		TinyMATWriter_writeValue(mat, "skip", 4.0);
+		TinyMATWriter_writeString(mat, "text", "hello");
+		TinyMATWriter_close(mat);
+		const std::string expected="var(s) struct(4) field(a,0) array(1) field(names,0) cell(2) string(x) string(yz) endcell "
+			"field(t,0) struct(1) field(b,0) array(2) endstruct field(skip,0) endstruct var(skip) var(text) string(hello) ";
+		std::vector<std::string> files(1, "visitor_test.mat");
+#ifdef TINYMAT_USES_ZLIB
+		check(compressFile("visitor_test.mat", "visitor_test_z.mat"), "visitor_test_z.mat: compressed");
+		files.push_back("visitor_test_z.mat");
+#endif
+		for (const std::string& file: files) {
+			TinyMATReaderFile* r=TinyMATReader_open(file.c_str());
+			check(r!=NULL, file.c_str());
+			if (!r) continue;
+			TraceVisitor visitor;
+			check(TinyMATReader_visit(r, visitor) && visitor.trace==expected, (file+": visit()").c_str());
+			if (visitor.trace!=expected) cout<<"  "<<visitor.trace<<endl;
+			TraceVisitor arrayVisitor;
+			TinyMATReaderArray a;
+			check(TinyMATReader_find(r, "s", &a) && TinyMATReader_visitArray(r, a, arrayVisitor)
+				  && arrayVisitor.trace==expected.substr(7, expected.find("var(skip)")-7), (file+": visitArray()").c_str());
+			TinyMATReader_close(r);
+		}
+	}
+	// numeric data is converted to the requested type while reading
+	{
+		std::vector<int16_t> i16(1003);
+		for (size_t i=0; i<i16.size(); i++) i16[i]=int16_t(int(i)-500);
+		std::vector<double> d(i16.size());
+		std::vector<float> f(i16.size());
+		bool same=TinyMATReader_convert(i16.data(), TinyMATDataType::Int16, d.data(), TinyMATDataType::Double, i16.size())
+			   && TinyMATReader_convert(i16.data(), TinyMATDataType::Int16, f.data(), TinyMATDataType::Single, i16.size());
+		for (size_t i=0; same && i<i16.size(); i++) same=(d[i]==i16[i] && f[i]==i16[i]);
+		check(same, "TinyMATReader_convert(): int16 to double and single");
+		const double dv[7]={1.5, -1.5, 2.4, 300, -300, NAN, 127.5};
+		int8_t i8[7];
+		uint8_t u8[7];
+		check(TinyMATReader_convert(dv, TinyMATDataType::Double, i8, TinyMATDataType::Int8, 7) && TinyMATReader_convert(dv, TinyMATDataType::Double, u8, TinyMATDataType::UInt8, 7)
+			  && std::vector<int>(i8, i8+7)==std::vector<int>({2, -2, 2, 127, -128, 0, 127}) && std::vector<int>(u8, u8+7)==std::vector<int>({2, 0, 2, 255, 0, 0, 128}),
+			  "TinyMATReader_convert(): to integers with rounding and saturation");
+		check(!TinyMATReader_convert(dv, TinyMATDataType::Double, i8, TinyMATDataType::Matrix, 7), "TinyMATReader_convert(): non-numeric type");
+
+		TinyMATReaderFile* r=TinyMATReader_open("basic_test.mat");
+		check(r!=NULL, "TinyMATReader_open(basic_test.mat)");
+		if (r) {
+			TinyMATReaderArray a, b;
+			std::vector<double> m(24), ref(24);
+			check(TinyMATReader_find(r, "mat432i16", &a) && TinyMATReader_readAs(r, a, m.data(), m.size())
+				  && TinyMATReader_find(r, "matrix432d_rowmajor", &b) && TinyMATReader_readAs(r, b, ref.data(), ref.size()), "basic_test.mat: readAs()");
+			same=true;
+			for (size_t i=0; i<m.size(); i++) same=same && (std::abs(m[i])==ref[i]);
+			check(same, "basic_test.mat: mat432i16 read as double");
+			check(!TinyMATReader_readAs(r, a, m.data(), m.size()-1), "basic_test.mat: readAs() into a too small buffer");
+			TinyMATReader_close(r);
+		}
+		r=TinyMATReader_open("complex_test.mat");
+		if (r) {
+			TinyMATReaderArray a;
+			double cf[3]={0,0,0};
+			check(TinyMATReader_find(r, "cf", &a) && TinyMATReader_readAs(r, a, cf, 3, true) && cf[0]==-0.5 && cf[1]==-1.5 && cf[2]==-2.5, "complex_test.mat: imaginary part of cf read as double");
+			TinyMATReader_close(r);
+		}
+		std::vector<std::string> files(1, "hyperslab_test.mat");
+#ifdef TINYMAT_USES_ZLIB
+		files.push_back("hyperslab_test_z.mat");
+#endif
+		for (const std::string& file: files) {
+			r=TinyMATReader_open(file.c_str());
+			if (!r) continue;
+			TinyMATReaderArray a;
+			const int32_t start[2]={1, 1};
+			const int32_t count[2]={3, 2};
+			float slab[6]={0,0,0,0,0,0};
+			check(TinyMATReader_find(r, "hi", &a) && TinyMATReader_readHyperslabAs(r, a, start, count, NULL, TinyMATDataType::Single, slab, sizeof(slab))
+				  && std::vector<float>(slab, slab+6)==std::vector<float>({-5,-6,-7,-9,-10,-11}), (file+": int16 hyperslab read as single").c_str());
+			TinyMATReader_close(r);
+		}
+	}
+	// a big-endian file contains the same bytes as a little-endian file, with every value swapped
+	{
+		const int16_t vec_i16[4]={1,-2,300,-4000};
+		const double vec1[8]={1,2,3,4,5,6,7,8};
+		std::map<std::string, double> mp1;
+		mp1["x"]=100;
+		mp1["y"]=200;
+		mp1["z"]=300;
+		mp1["longname"]=10000*M_PI;
+		std::vector<double> col(200);
+		for (size_t i=0; i<col.size(); i++) col[i]=double(i);
+		const char* byteOrderFiles[2]={"basic_test_bigendian.mat", "basic_test_littleendian.mat"};
+		for (int f=0; f<2; f++) {
+			mat=TinyMATWriter_open(byteOrderFiles[f]);
+			TinyMATWriter_setByteOrder(mat, (f==0)?TinyMATByteOrder::BigEndian:TinyMATByteOrder::LittleEndian);
+			writeMixedVariables(mat);
+			// ignored, after the first variable
+			TinyMATWriter_setByteOrder(mat, (f==0)?TinyMATByteOrder::LittleEndian:TinyMATByteOrder::BigEndian);
+			TinyMATWriter_writeMatrix2D_rowmajor(mat, "vector1", vec1, 1,8);
+			TinyMATWriter_writeMatrix2D_rowmajor(mat, "vector_i16", vec_i16, 1,4);
+			TinyMATWriter_writeStruct(mat, "struct1", mp1);
+			TinyMATWriter_writeString(mat, "text", "big-endian");
+			TinyMATWriter_appendToColumn(mat, "col", col.data(), 3);
+			TinyMATWriter_writeValue(mat, "after_col", 1.0);
+			TinyMATWriter_appendToColumn(mat, "col", col.data()+3, 100);
+			TinyMATWriter_appendToColumn(mat, "col", col.data()+103, 97);
+			TinyMATWriter_close(mat);
+		}
+		const std::string be=fileContents(byteOrderFiles[0]);
+		const std::string le=fileContents(byteOrderFiles[1]);
+		check(be.size()==le.size() && be.size()>128 && be.compare(124, 4, std::string("\x01\x00MI", 4))==0 && le.compare(124, 4, std::string("\x00\x01IM", 4))==0,
+			  "basic_test_bigendian.mat: version and endian indicator");
+		std::string swapped=be.substr(128);
+		std::string native=le.substr(128);
+		const bool swappedOK=TinyMAT_swapElements(&(swapped[0]), swapped.size(), true);
+		// the payload of a tombstone is free space and keeps the stale bytes of the moved column
+		for (std::string* d: {&swapped, &native}) {
+			for (size_t p=d->find("tm_free"); p!=std::string::npos && p+16<=d->size(); p=d->find("tm_free", p+1)) {
+				uint32_t bytes=0;
+				memcpy(&bytes, d->data()+p+12, 4);
+				std::fill(d->begin()+p+16, d->begin()+std::min<size_t>(d->size(), p+16+bytes), '\0');
+			}
+		}
+		check(swappedOK && swapped==native, "basic_test_bigendian.mat: every value swapped");
+
+		TinyMATReaderFile* r=TinyMATReader_open(byteOrderFiles[0]);
+		check(r!=NULL, "TinyMATReader_open(basic_test_bigendian.mat)");
+		if (r) {
+			TinyMATReaderArray a;
+			check(readDoubles(r, "vector1")==std::vector<double>(vec1, vec1+8) && readDoubles(r, "col")==col, "basic_test_bigendian.mat: vector1, col");
+			const int16_t* i16=NULL;
+			if (TinyMATReader_find(r, "vector_i16", &a)) i16=TinyMATReader_data<int16_t>(a);
+			check(i16 && memcmp(i16, vec_i16, sizeof(vec_i16))==0, "basic_test_bigendian.mat: vector_i16");
+			check(isStruct1(r, "struct1"), "basic_test_bigendian.mat: struct1");
+			check(TinyMATReader_find(r, "text", &a) && TinyMATReader_getString(a)=="big-endian", "basic_test_bigendian.mat: text");
+			TinyMATReader_close(r);
+		}
+	}
+	// TinyMATReader_verify() accepts the files written above and finds a malformed element, checking on close reports it
+	{
+		const char* verifyFiles[2]={"basic_test.mat", "basic_test_bigendian.mat"};
+		for (int f=0; f<2; f++) {
+			TinyMATReaderFile* r=TinyMATReader_open(verifyFiles[f]);
+			std::string error;
+			check(r!=NULL && TinyMATReader_verify(r, NULL, &error), (std::string(verifyFiles[f])+": TinyMATReader_verify() "+error).c_str());
+			TinyMATReader_close(r);
+		}
+
+		// a 2x2 matrix, that claims to be 2x3 (written after "good", its data element starts at byte 256)
+		const double m22[4]={1,2,3,4};
+		uint8_t bad[TinyMATSmallMatrixEncoder<double,2,2>::maxBytes];
+		const uint32_t badSize=TinyMATSmallMatrixEncoder<double,2,2>::encode(bad, "bad", 3, m22);
+		const int32_t cols=3;
+		memcpy(bad+36, &cols, 4);
+
+		mat=TinyMATWriter_open("verify_test.mat");
+		TinyMATWriter_setVerifyOnClose(mat, true);
+		TinyMATWriter_writeValue(mat, "good", 1.0);
+		std::string error="x";
+		check(TinyMATWriter_closeChecked(mat, &error) && error.empty(), "verify_test.mat: TinyMATWriter_closeChecked() of a valid file");
+
+		mat=TinyMATWriter_open("verify_test.mat");
+		TinyMATWriter_setVerifyOnClose(mat, true);
+		TinyMATWriter_writeValue(mat, "good", 1.0);
+		TinyMATWriter_writeElement(mat, "bad", bad, badSize);
+		check(!TinyMATWriter_closeChecked(mat, &error) && error.find("byte offset 256")!=std::string::npos, ("verify_test.mat: TinyMATWriter_closeChecked() of a malformed file: "+error).c_str());
+		TinyMATReaderFile* r=TinyMATReader_open("verify_test.mat");
+		uint64_t offset=0;
+		check(r!=NULL && !TinyMATReader_verify(r, &offset) && offset==256, "verify_test.mat: TinyMATReader_verify() finds the malformed element");
+		TinyMATReader_close(r);
+
+		mat=TinyMATWriter_open("verify_test.mat");
+		TinyMATWriter_setVerifyOnClose(mat, true);
+		TinyMATWriter_writeElement(mat, "bad", bad, badSize);
+		bool thrown=false;
+		try {
+			TinyMATWriter_close(mat);
+		} catch (std::runtime_error&) {
+			thrown=true;
+		}
+		check(thrown, "verify_test.mat: TinyMATWriter_close() throws for a malformed file");
+
+		// the closer threads of the sharded and the rotating writer report the failure
+		const char* shardFiles[2]={"verify_test_0.mat", "verify_test_1.mat"};
+		TinyMATShardedWriter* writer=TinyMATShardedWriter_open("verify_test_manifest.mat", shardFiles, 2);
+		for (int i=0; i<2; i++) TinyMATWriter_setVerifyOnClose(TinyMATShardedWriter_file(writer, "good"), true);
+		TinyMATWriter_writeElement(TinyMATShardedWriter_file(writer, "bad"), "bad", bad, badSize);
+		check(!TinyMATShardedWriter_close(writer), "verify_test: TinyMATShardedWriter_close() fails for a malformed shard");
+		TinyMATRotatingWriter* rotating=TinyMATRotatingWriter_open("verify_test_r.mat");
+		TinyMATWriter_setVerifyOnClose(TinyMATRotatingWriter_file(rotating), true);
+		TinyMATWriter_writeElement(TinyMATRotatingWriter_file(rotating), "bad", bad, badSize);
+		TinyMATRotatingWriter_rotate(rotating);
+		check(!TinyMATRotatingWriter_close(rotating), "verify_test_r.mat: TinyMATRotatingWriter_close() fails for a malformed file");
+	}
+	// checksums match the bytes of all variables (in both byte orders), until one byte of a variable is changed
+	for (int f=0; f<2; f++) {
+		const char* filename=(f==0)?"checksum_test.mat":"checksum_test_bigendian.mat";
+		const double vec1[8]={1,2,3,4,5,6,7,8};
+		std::vector<double> col(100);
+		for (size_t i=0; i<col.size(); i++) col[i]=double(i);
+		mat=TinyMATWriter_open(filename);
+		if (f==1) TinyMATWriter_setByteOrder(mat, TinyMATByteOrder::BigEndian);
+		// written before the checksums are enabled, so it is read on close
+		TinyMATWriter_writeValue(mat, "early", 0.5);
+		TinyMATWriter_setWriteChecksums(mat, true);
+		writeMixedVariables(mat);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "vector1", vec1, 1,8);
+		TinyMATWriter_appendToColumn(mat, "col", col.data(), 3);
+		TinyMATWriter_writeValue(mat, "after_col", 1.0);
+		TinyMATWriter_appendToColumn(mat, "col", col.data()+3, 97);
+		TinyMATWriter_close(mat);
+
+		uint64_t offset=0;
+		TinyMATReaderFile* r=TinyMATReader_open(filename);
+		check(r!=NULL, (std::string("TinyMATReader_open(")+filename+")").c_str());
+		if (r) {
+			const std::vector<TinyMATReaderChecksum> sums=TinyMATReader_getChecksums(r);
+			bool hasEarly=false;
+			for (size_t i=0; i<sums.size(); i++) {
+				if (sums[i].name=="vector1") offset=sums[i].offset+sums[i].size-8;
+				if (sums[i].name=="early") hasEarly=true;
+			}
+			check(sums.size()>10 && hasEarly && offset>0, (std::string(filename)+": TinyMATReader_getChecksums()").c_str());
+			std::vector<std::string> corrupted;
+			check(TinyMATReader_verifyChecksums(r, &corrupted) && corrupted.empty(), (std::string(filename)+": TinyMATReader_verifyChecksums()").c_str());
+			check(readDoubles(r, "col")==col, (std::string(filename)+": col").c_str());
+			TinyMATReader_close(r);
+		}
+		// change the last value of vector1
+		FILE* fh=fopen(filename, "rb+");
+		if (fh && offset>0) {
+			const double v=9;
+			fseek(fh, static_cast<long>(offset), SEEK_SET);
+			fwrite(&v, sizeof(v), 1, fh);
+		}
+		if (fh) fclose(fh);
+		r=TinyMATReader_open(filename);
+		if (r) {
+			std::vector<std::string> corrupted;
+			check(!TinyMATReader_verifyChecksums(r, &corrupted) && corrupted.size()==1 && corrupted[0]=="vector1", (std::string(filename)+": corrupted vector1 found").c_str());
+			TinyMATReader_close(r);
+		}
+	}
+	// merge two files, that both contain a variable x (the first file also has an index and a tombstone)
+	{
+		const double vec4[4]={1,2,3,4};
+		mat=TinyMATWriter_open("merge_test_a.mat");
+		TinyMATWriter_setWriteIndex(mat, true);
+		TinyMATWriter_setReplaceExisting(mat, true);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "y", vec4, 1,4);
+		TinyMATWriter_writeValue(mat, "x", 1.0);
+		TinyMATWriter_writeMatrix2D_rowmajor(mat, "y", vec4, 1,3);
+		TinyMATWriter_close(mat);
+		mat=TinyMATWriter_open("merge_test_b.mat");
+		TinyMATWriter_writeValue(mat, "x", 2.0);
+		TinyMATWriter_writeString(mat, "z", "merged");
+		TinyMATWriter_close(mat);
+
+		const char* inputs[2]={"merge_test_a.mat", "merge_test_b.mat"};
+		TinyMATMergeOptions options;
+		options.description="merged by basic_test";
+		options.writeIndex=true;
+		TinyMATMergeResult result;
+		check(TinyMAT_mergeFiles("merge_test.mat", inputs, 2, options, &result), ("TinyMAT_mergeFiles() "+result.error).c_str());
+		check(result.variables==4 && result.dropped==2, "TinyMAT_mergeFiles(): number of variables");
+		check(result.renamed.size()==1 && result.renamed[0].oldName=="x" && result.renamed[0].newName=="x_2", "TinyMAT_mergeFiles(): renamed variables");
+		TinyMATReaderFile* r=TinyMATReader_open("merge_test.mat");
+		check(r!=NULL, "TinyMATReader_open(merge_test.mat)");
+		if (r) {
+			TinyMATReaderArray a;
+			const std::vector<std::string> names=TinyMATReader_listVariables(r);
+			check(TinyMATReader_verify(r), "merge_test.mat: TinyMATReader_verify()");
+			check(TinyMATReader_getDescription(r).find("merged by basic_test")!=std::string::npos, "merge_test.mat: description");
+			check(std::count(names.begin(), names.end(), std::string(TINYMAT_TOMBSTONE_NAME))==0, "merge_test.mat: no tombstones");
+			check(readDoubles(r, "x")==std::vector<double>({1}) && readDoubles(r, "x_2")==std::vector<double>({2}), "merge_test.mat: x, x_2");
+			check(readDoubles(r, "y")==std::vector<double>({1,2,3}), "merge_test.mat: y");
+			check(TinyMATReader_find(r, "z", &a) && TinyMATReader_getString(a)=="merged", "merge_test.mat: z");
+			TinyMATReader_close(r);
+		}
+
+		// inputs in different byte orders are rejected
+		const char* mixed[2]={"merge_test_b.mat", "basic_test_bigendian.mat"};
+		result=TinyMATMergeResult();
+		check(!TinyMAT_mergeFiles("merge_test_mixed.mat", mixed, 2, options, &result) && !result.error.empty(), "TinyMAT_mergeFiles(): different byte orders");
 	}
-    return 0;
+    return (failures>0)?1:0;
 }
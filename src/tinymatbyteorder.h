@@ -0,0 +1,201 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATBYTEORDER_H
+#define TINYMATBYTEORDER_H
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#  include <emmintrin.h>
+#  define TINYMAT_BYTEORDER_SSE2
+#endif
+#ifdef _MSC_VER
+#  include <stdlib.h>
+#endif
+
+/*! \defgroup tinymatbyteorder Byte order conversion
+    \ingroup tinymatwriter
+
+    MAT-files are written in the byte order of the machine, that wrote them. The endian indicator in the file header
+    (\c "IM" for little-endian, \c "MI" for big-endian files) tells the reader, which order was used. The functions in
+    this group reverse the byte order of complete data elements: TinyMATWriter_setByteOrder() uses them to write
+    files for the other byte order and TinyMATReader_open() to read such files.
+
+ */
+
+/** \brief reverses the byte order of \a v \ingroup tinymatbyteorder */
+inline uint16_t TinyMAT_bswap16(uint16_t v) {
+    return static_cast<uint16_t>((v>>8)|(v<<8));
+}
+
+/** \brief reverses the byte order of \a v \ingroup tinymatbyteorder */
+inline uint32_t TinyMAT_bswap32(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_bswap32(v);
+#elif defined(_MSC_VER)
+    return _byteswap_ulong(v);
+#else
+    return (v>>24)|((v>>8)&0x0000FF00u)|((v<<8)&0x00FF0000u)|(v<<24);
+#endif
+}
+
+/** \brief reverses the byte order of \a v \ingroup tinymatbyteorder */
+inline uint64_t TinyMAT_bswap64(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_bswap64(v);
+#elif defined(_MSC_VER)
+    return _byteswap_uint64(v);
+#else
+    return (static_cast<uint64_t>(TinyMAT_bswap32(static_cast<uint32_t>(v)))<<32)|TinyMAT_bswap32(static_cast<uint32_t>(v>>32));
+#endif
+}
+
+/*! \brief reverses the byte order of each of the \a count values of \a size bytes at \a data (which may be unaligned)
+    \ingroup tinymatbyteorder
+
+    \a size may be 2, 4 or 8, other sizes are left unchanged. With SSE2, 16 bytes are swapped per step.
+ */
+inline void TinyMAT_swapBytes(void* data, uint64_t count, uint32_t size) {
+    uint8_t* d=static_cast<uint8_t*>(data);
+    uint64_t i=0;
+    if (size!=2 && size!=4 && size!=8) return;
+#ifdef TINYMAT_BYTEORDER_SSE2
+    // swap the bytes in each 16-bit word, after reordering the words within each value
+    const uint64_t perVector=16/size;
+    for (; i+perVector<=count; i+=perVector) {
+        __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(d+i*size));
+        if (size==4) {
+            v=_mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1)), _MM_SHUFFLE(2,3,0,1));
+        } else if (size==8) {
+            v=_mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3)), _MM_SHUFFLE(0,1,2,3));
+        }
+        v=_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d+i*size), v);
+    }
+#endif
+    for (; i<count; i++) {
+        uint8_t* p=d+i*size;
+        if (size==2) {
+            uint16_t v;
+            memcpy(&v, p, 2);
+            v=TinyMAT_bswap16(v);
+            memcpy(p, &v, 2);
+        } else if (size==4) {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            v=TinyMAT_bswap32(v);
+            memcpy(p, &v, 4);
+        } else {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            v=TinyMAT_bswap64(v);
+            memcpy(p, &v, 8);
+        }
+    }
+}
+
+/*! \brief returns the size of the values of the MAT data type \a miType, whose bytes have to be reversed to change the byte order (0 for none)
+    \ingroup tinymatbyteorder
+ */
+inline uint32_t TinyMAT_swapSize(uint32_t miType) {
+    switch (miType) {
+        case 3: case 4: case 17: return 2;  // miINT16, miUINT16, miUTF16
+        case 5: case 6: case 7: case 18: return 4; // miINT32, miUINT32, miSINGLE, miUTF32
+        case 9: case 12: case 13: return 8; // miDOUBLE, miINT64, miUINT64
+        default: return 0;
+    }
+}
+
+/*! \brief finds everything, that has to be swapped to change the byte order of the data elements between \a offset and \a end
+    \ingroup tinymatbyteorder
+
+    \param offset position of the first data element
+    \param end end of the data elements
+    \param readU32 \c readU32(pos) returns the uint32 at \a pos in the byte order of this machine, i.e. swapped, if the
+                   elements are still in the other byte order
+    \param swap \c swap(pos,count,size) is called for each run of \a count values of \a size bytes, starting at \a pos,
+                   including the tags. For each position, \a readU32 is called before \a swap.
+    \param topLevel if \c true, the elements are not padded (as top-level elements, see TinyMATReader_nextElement() )
+    \return \c false, if the last element extends beyond \a end. Everything before \a end is still reported, so a
+            truncated element (e.g. the inflated beginning of a compressed variable) can be swapped as far as it goes.
+
+    miMATRIX elements are swapped recursively. The contents of miCOMPRESSED elements are not touched, as they are a
+    byte stream, that has to be swapped after inflating it.
+ */
+template<typename READ, typename SWAP>
+inline bool TinyMAT_forEachSwap(uint64_t offset, uint64_t end, READ readU32, SWAP swap, bool topLevel=true, int depth=0) {
+    while (offset<end && end-offset>=8) {
+        const uint32_t t=readU32(offset);
+        if ((t>>16)!=0) {
+            // small data element format: type and size share the first 32 bits
+            const uint32_t type=t&0xFFFF;
+            const uint32_t bytes=t>>16;
+            const uint32_t size=TinyMAT_swapSize(type);
+            swap(offset, 1, 4);
+            if (size>0 && bytes<=4) swap(offset+4, bytes/size, size);
+            offset+=8;
+            continue;
+        }
+        const uint32_t type=t;
+        const uint64_t bytes=readU32(offset+4);
+        swap(offset, 2, 4);
+        const uint64_t data=offset+8;
+        const uint64_t avail=(bytes<=end-data)?bytes:(end-data);
+        if (type==14) {
+            // miMATRIX, nesting is limited, as the elements may come from a damaged file
+            if (depth<1024) TinyMAT_forEachSwap(data, data+avail, readU32, swap, false, depth+1);
+        } else if (type!=15) {
+            const uint32_t size=TinyMAT_swapSize(type);
+            if (size>0 && avail>=size) swap(data, avail/size, size);
+        }
+        if (bytes>end-data) return false;
+        const uint64_t padded=topLevel?bytes:((bytes+7)&~static_cast<uint64_t>(7));
+        if (padded>end-data) return true;
+        offset=data+padded;
+    }
+    return true;
+}
+
+/*! \brief reverses the byte order of all data elements in the \a size bytes at \a data
+    \ingroup tinymatbyteorder
+
+    \param data the data elements, e.g. the inflated contents of a miCOMPRESSED element
+    \param size number of bytes at \a data
+    \param foreign \c true, if the elements are in the other byte order (i.e. they are converted to the order of this
+                   machine), \c false if they are converted from the order of this machine
+    \param topLevel if \c true, the elements are not padded
+
+    \see TinyMAT_forEachSwap()
+ */
+inline bool TinyMAT_swapElements(void* data, uint64_t size, bool foreign, bool topLevel=true) {
+    uint8_t* d=static_cast<uint8_t*>(data);
+    return TinyMAT_forEachSwap(0, size, [d, foreign](uint64_t pos) {
+        uint32_t v;
+        memcpy(&v, d+pos, 4);
+        return foreign?TinyMAT_bswap32(v):v;
+    }, [d](uint64_t pos, uint64_t count, uint32_t s) {
+        TinyMAT_swapBytes(d+pos, count, s);
+    }, topLevel);
+}
+
+#endif // TINYMATBYTEORDER_H
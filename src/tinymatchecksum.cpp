@@ -0,0 +1,247 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+#include "tinymatchecksum.h"
+#include <string.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  include <nmmintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#  define TINYMAT_CRC32C_X64
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
+#  define TINYMAT_CRC32C_ARM64
+#endif
+
+#if defined(TINYMAT_CRC32C_X64) && (defined(__GNUC__) || defined(__clang__))
+   // only these functions use SSE4.2, the rest of the library does not require it
+#  define TINYMAT_CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#  define TINYMAT_CRC32C_TARGET
+#endif
+
+/** \brief the CRC32C (Castagnoli) polynomial, in reversed bit order */
+#define TINYMAT_CRC32C_POLY 0x82F63B78u
+
+/** \brief size of each of the three streams, that are computed in parallel by TinyMAT_crc32cHW() */
+#define TINYMAT_CRC32C_LANE 4096
+
+/*! \brief multiplies \a a and \a b modulo the CRC polynomial (\a a must not be 0)
+    \internal
+ */
+static uint32_t TinyMAT_crc32cMultModP(uint32_t a, uint32_t b) {
+    uint32_t m=1u<<31;
+    uint32_t p=0;
+    for (;;) {
+        if (a&m) {
+            p^=b;
+            if ((a&(m-1))==0) break;
+        }
+        m>>=1;
+        b=(b&1)?((b>>1)^TINYMAT_CRC32C_POLY):(b>>1);
+    }
+    return p;
+}
+
+/*! \brief tables for the CRC32C: the powers x^(2^k) modulo the polynomial and the tables for slicing-by-8
+    \internal
+ */
+struct TinyMATCRC32CTables {
+    TinyMATCRC32CTables() {
+        for (uint32_t i=0; i<256; i++) {
+            uint32_t c=i;
+            for (int j=0; j<8; j++) c=(c&1)?((c>>1)^TINYMAT_CRC32C_POLY):(c>>1);
+            slice[0][i]=c;
+        }
+        for (int k=1; k<8; k++) {
+            for (uint32_t i=0; i<256; i++) {
+                slice[k][i]=(slice[k-1][i]>>8)^slice[0][slice[k-1][i]&0xFF];
+            }
+        }
+        // x^1
+        x2n[0]=1u<<30;
+        for (int k=1; k<64; k++) x2n[k]=TinyMAT_crc32cMultModP(x2n[k-1], x2n[k-1]);
+    }
+    uint32_t slice[8][256];
+    uint32_t x2n[64];
+};
+
+/** \brief returns the tables (initialized on first use) \internal */
+static const TinyMATCRC32CTables& TinyMAT_crc32cTables() {
+    static const TinyMATCRC32CTables tables;
+    return tables;
+}
+
+/*! \brief returns x^(\a n * 2^\a k) modulo the polynomial
+    \internal
+ */
+static uint32_t TinyMAT_crc32cX2NModP(uint64_t n, unsigned k) {
+    const TinyMATCRC32CTables& tables=TinyMAT_crc32cTables();
+    uint32_t p=1u<<31;
+    while (n) {
+        if (n&1) p=TinyMAT_crc32cMultModP(tables.x2n[k&63], p);
+        n>>=1;
+        k++;
+    }
+    return p;
+}
+
+/*! \brief advances the CRC register \a state over \a bytes zero bytes
+    \internal
+ */
+static inline uint32_t TinyMAT_crc32cShift(uint32_t state, uint64_t bytes) {
+    if (bytes==0 || state==0) return state;
+    return TinyMAT_crc32cMultModP(TinyMAT_crc32cX2NModP(bytes, 3), state);
+}
+
+/*! \brief table-driven update (slicing-by-8) of the CRC register \a state (without the inversions at start and end)
+    \internal
+ */
+static uint32_t TinyMAT_crc32cSW(uint32_t state, const uint8_t* p, uint64_t size) {
+    const TinyMATCRC32CTables& tables=TinyMAT_crc32cTables();
+    for (; size>0 && (reinterpret_cast<uintptr_t>(p)&7)!=0; size--, p++) {
+        state=tables.slice[0][(state^*p)&0xFF]^(state>>8);
+    }
+    for (; size>=8; size-=8, p+=8) {
+        const uint32_t lo=state^(static_cast<uint32_t>(p[0])|(static_cast<uint32_t>(p[1])<<8)|(static_cast<uint32_t>(p[2])<<16)|(static_cast<uint32_t>(p[3])<<24));
+        const uint32_t hi=static_cast<uint32_t>(p[4])|(static_cast<uint32_t>(p[5])<<8)|(static_cast<uint32_t>(p[6])<<16)|(static_cast<uint32_t>(p[7])<<24);
+        state=tables.slice[7][lo&0xFF]^tables.slice[6][(lo>>8)&0xFF]^tables.slice[5][(lo>>16)&0xFF]^tables.slice[4][lo>>24]
+             ^tables.slice[3][hi&0xFF]^tables.slice[2][(hi>>8)&0xFF]^tables.slice[1][(hi>>16)&0xFF]^tables.slice[0][hi>>24];
+    }
+    for (; size>0; size--, p++) {
+        state=tables.slice[0][(state^*p)&0xFF]^(state>>8);
+    }
+    return state;
+}
+
+#if defined(TINYMAT_CRC32C_X64) || defined(TINYMAT_CRC32C_ARM64)
+/** \brief reads 8 bytes from \a p (which may be unaligned) \internal */
+static inline uint64_t TinyMAT_crc32cLoad64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+#  ifdef TINYMAT_CRC32C_X64
+#    define TINYMAT_CRC32C_U8(c, v) _mm_crc32_u8(c, v)
+#    define TINYMAT_CRC32C_U64(c, v) static_cast<uint32_t>(_mm_crc32_u64(c, v))
+#  else
+#    define TINYMAT_CRC32C_U8(c, v) __crc32cb(c, v)
+#    define TINYMAT_CRC32C_U64(c, v) __crc32cd(c, v)
+#  endif
+
+/*! \brief updates the CRC register \a state with the \c crc32 instruction (without the inversions at start and end)
+    \internal
+
+    The instruction has a latency of 3 cycles, but a throughput of 1 per cycle, so long inputs are split into three streams,
+    which are computed in parallel and combined afterwards.
+ */
+TINYMAT_CRC32C_TARGET static uint32_t TinyMAT_crc32cHW(uint32_t state, const uint8_t* p, uint64_t size) {
+    for (; size>0 && (reinterpret_cast<uintptr_t>(p)&7)!=0; size--, p++) {
+        state=TINYMAT_CRC32C_U8(state, *p);
+    }
+    if (size>=3*TINYMAT_CRC32C_LANE) {
+        static const uint32_t shift1=TinyMAT_crc32cX2NModP(TINYMAT_CRC32C_LANE, 3);
+        static const uint32_t shift2=TinyMAT_crc32cX2NModP(2*TINYMAT_CRC32C_LANE, 3);
+        for (; size>=3*TINYMAT_CRC32C_LANE; size-=3*TINYMAT_CRC32C_LANE, p+=3*TINYMAT_CRC32C_LANE) {
+            uint32_t c0=state, c1=0, c2=0;
+            for (int i=0; i<TINYMAT_CRC32C_LANE; i+=8) {
+                c0=TINYMAT_CRC32C_U64(c0, TinyMAT_crc32cLoad64(p+i));
+                c1=TINYMAT_CRC32C_U64(c1, TinyMAT_crc32cLoad64(p+TINYMAT_CRC32C_LANE+i));
+                c2=TINYMAT_CRC32C_U64(c2, TinyMAT_crc32cLoad64(p+2*TINYMAT_CRC32C_LANE+i));
+            }
+            state=TinyMAT_crc32cMultModP(shift2, c0)^TinyMAT_crc32cMultModP(shift1, c1)^c2;
+        }
+    }
+    for (; size>=8; size-=8, p+=8) {
+        state=TINYMAT_CRC32C_U64(state, TinyMAT_crc32cLoad64(p));
+    }
+    for (; size>0; size--, p++) {
+        state=TINYMAT_CRC32C_U8(state, *p);
+    }
+    return state;
+}
+#endif
+
+/** \brief checks, whether the CPU has a \c crc32 instruction \internal */
+static bool TinyMAT_crc32cDetectHardware() {
+#if defined(TINYMAT_CRC32C_X64) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2]&(1<<20))!=0;
+#elif defined(TINYMAT_CRC32C_X64)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+#elif defined(TINYMAT_CRC32C_ARM64)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TinyMAT_crc32cHardware() {
+    static const bool hardware=TinyMAT_crc32cDetectHardware();
+    return hardware;
+}
+
+/** \brief updates the CRC register \a state (without the inversions at start and end) \internal */
+static inline uint32_t TinyMAT_crc32cUpdate(uint32_t state, const uint8_t* p, uint64_t size) {
+#if defined(TINYMAT_CRC32C_X64) || defined(TINYMAT_CRC32C_ARM64)
+    if (TinyMAT_crc32cHardware()) return TinyMAT_crc32cHW(state, p, size);
+#endif
+    return TinyMAT_crc32cSW(state, p, size);
+}
+
+uint32_t TinyMAT_crc32c(uint32_t crc, const void* data, uint64_t size) {
+    if (!data || size==0) return crc;
+    return ~TinyMAT_crc32cUpdate(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+uint32_t TinyMAT_crc32cZeros(uint32_t crc, uint64_t count) {
+    return ~TinyMAT_crc32cShift(~crc, count);
+}
+
+uint32_t TinyMAT_crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t size2) {
+    return TinyMAT_crc32cShift(crc1, size2)^crc2;
+}
+
+uint32_t TinyMAT_crc32cPatch(uint32_t crc, uint64_t size, uint64_t offset, const void* oldData, const void* newData, uint64_t count) {
+    if (count==0 || offset>size || count>size-offset) return crc;
+    // the CRC (without the inversions) is linear: the CRC of the changed bits, shifted to the end of the block, is added
+    const uint8_t* o=static_cast<const uint8_t*>(oldData);
+    const uint8_t* n=static_cast<const uint8_t*>(newData);
+    uint8_t delta[512];
+    uint32_t state=0;
+    for (uint64_t i=0; i<count; i+=sizeof(delta)) {
+        const size_t cnt=static_cast<size_t>(std::min<uint64_t>(sizeof(delta), count-i));
+        if (o && n) {
+            for (size_t j=0; j<cnt; j++) delta[j]=o[i+j]^n[i+j];
+        } else if (o || n) {
+            memcpy(delta, (o?o:n)+i, cnt);
+        } else {
+            return crc;
+        }
+        state=TinyMAT_crc32cUpdate(state, delta, cnt);
+    }
+    return crc^TinyMAT_crc32cShift(state, size-offset-count);
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATCHECKSUM_H
+#define TINYMATCHECKSUM_H
+
+#include "tinymat_export.h"
+
+#include <stdint.h>
+
+/*! \defgroup tinymatchecksum CRC32C checksums
+    \ingroup tinymatwriter
+
+    The checksums of the top-level variables in a MAT-file (see TinyMATWriter_setWriteChecksums() ) are CRC32C
+    (Castagnoli polynomial, as used by iSCSI, ext4 or SSE4.2) over the bytes of the complete element, as they are
+    stored in the file. They are computed with the \c crc32 instruction (SSE4.2 on x86-64, ARMv8 CRC extension),
+    if the CPU supports it, or with a table-driven implementation otherwise.
+
+    As a CRC is linear, a CRC can be updated for bytes that are changed after they were included (see
+    TinyMAT_crc32cPatch() ), so the writer computes the checksums while the data is written, even though it
+    patches the sizes of elements afterwards.
+
+\code
+    uint32_t crc=TinyMAT_crc32c(0, data, size);
+\endcode
+
+ */
+
+/*! \brief updates the CRC32C \a crc with the \a size bytes at \a data and returns the new CRC
+    \ingroup tinymatchecksum
+
+    Start with \a crc = 0. TinyMAT_crc32c(TinyMAT_crc32c(0, a, na), b, nb) is the CRC of the concatenation of \a a and \a b.
+ */
+TINYMAT_EXPORT uint32_t TinyMAT_crc32c(uint32_t crc, const void* data, uint64_t size);
+
+/*! \brief updates the CRC32C \a crc with \a count zero bytes (in \c O(log(count)) time)
+    \ingroup tinymatchecksum
+ */
+TINYMAT_EXPORT uint32_t TinyMAT_crc32cZeros(uint32_t crc, uint64_t count);
+
+/*! \brief returns the CRC32C of the concatenation of two blocks, from the CRC \a crc1 of the first and the CRC \a crc2 of the second block with \a size2 bytes
+    \ingroup tinymatchecksum
+ */
+TINYMAT_EXPORT uint32_t TinyMAT_crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
+/*! \brief updates the CRC32C \a crc of a block of \a size bytes, after the \a count bytes at \a offset were changed from \a oldData to \a newData
+    \ingroup tinymatchecksum
+
+    \param crc the CRC of the block with \a oldData
+    \param size size of the block
+    \param offset position of the changed bytes in the block
+    \param oldData the old bytes (\c NULL for zeros)
+    \param newData the new bytes (\c NULL for zeros)
+    \param count number of changed bytes
+    \return the CRC of the block with \a newData
+
+    Only the changed bytes are read, the rest of the block is not needed.
+ */
+TINYMAT_EXPORT uint32_t TinyMAT_crc32cPatch(uint32_t crc, uint64_t size, uint64_t offset, const void* oldData, const void* newData, uint64_t count);
+
+/*! \brief returns \c true, if the CRC32C is computed with the \c crc32 instruction of the CPU
+    \ingroup tinymatchecksum
+ */
+TINYMAT_EXPORT bool TinyMAT_crc32cHardware();
+
+#endif // TINYMATCHECKSUM_H
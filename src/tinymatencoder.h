@@ -0,0 +1,118 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATENCODER_H
+#define TINYMATENCODER_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*! \defgroup tinymatencoder Compile-time encoders for small MAT elements
+    \ingroup tinymatwriter
+
+    These templates compose complete miMATRIX elements of a fixed size (e.g. scalars or 3x3 matrices) in a buffer
+    on the stack. All type codes, sizes and padding are compile-time constants, so the encoder inlines into the
+    caller and only the name and the values are copied at runtime. The finished element is written with
+    TinyMATWriter_writeElement().
+
+ */
+
+/*! \brief maps a C++ type to its MAT array class and data type
+    \ingroup tinymatencoder
+
+    Only the types, for which TinyMATWriter_writeMatrixND_colmajor() has an overload, are specialized.
+ */
+template<typename T>
+struct TinyMATTypeTraits;
+
+/** \brief defines TinyMATTypeTraits for \a TYPE, stored as \a STORAGE with the array flags \a ARRAYFLAGS and MAT data type \a MITYPE */
+#define TINYMAT_DECLARE_TYPETRAITS(TYPE, STORAGE, ARRAYFLAGS, MITYPE) \
+template<> \
+struct TinyMATTypeTraits<TYPE> { \
+    typedef STORAGE storage_type; \
+    static constexpr uint32_t arrayflags=ARRAYFLAGS; \
+    static constexpr uint32_t miType=MITYPE; \
+    static constexpr uint32_t size=sizeof(STORAGE); \
+    static inline storage_type encode(TYPE v) { return static_cast<storage_type>(v); } \
+};
+
+TINYMAT_DECLARE_TYPETRAITS(double, double, 0x06, 9)
+TINYMAT_DECLARE_TYPETRAITS(float, float, 0x07, 7)
+TINYMAT_DECLARE_TYPETRAITS(int8_t, int8_t, 0x08, 1)
+TINYMAT_DECLARE_TYPETRAITS(uint8_t, uint8_t, 0x09, 2)
+TINYMAT_DECLARE_TYPETRAITS(int16_t, int16_t, 0x0A, 3)
+TINYMAT_DECLARE_TYPETRAITS(uint16_t, uint16_t, 0x0B, 4)
+TINYMAT_DECLARE_TYPETRAITS(int32_t, int32_t, 0x0C, 5)
+TINYMAT_DECLARE_TYPETRAITS(uint32_t, uint32_t, 0x0D, 6)
+TINYMAT_DECLARE_TYPETRAITS(int64_t, int64_t, 0x0E, 12)
+TINYMAT_DECLARE_TYPETRAITS(uint64_t, uint64_t, 0x0F, 13)
+// logical arrays are stored as bytes with the value 0 or 1
+TINYMAT_DECLARE_TYPETRAITS(bool, int8_t, 0x0209, 1)
+
+#undef TINYMAT_DECLARE_TYPETRAITS
+
+/** \brief longest variable name, that is encoded by TinyMATSmallMatrixEncoder (longer names use the generic writer) */
+#define TINYMAT_SMALLENCODER_MAXNAME 63
+
+/*! \brief composes a complete miMATRIX element for a ROWS x COLS matrix of type T
+    \ingroup tinymatencoder
+ */
+template<typename T, int32_t ROWS, int32_t COLS>
+struct TinyMATSmallMatrixEncoder {
+    typedef TinyMATTypeTraits<T> traits;
+    /** \brief number of data bytes */
+    static constexpr uint32_t dataBytes=static_cast<uint32_t>(ROWS*COLS)*traits::size;
+    /** \brief number of data bytes, including the padding to 8 bytes */
+    static constexpr uint32_t dataPadded=(dataBytes+7)&~7u;
+    /** \brief size of the element without the name: tag, array flags, 2 dimensions, tag of the name, tag of the data, data */
+    static constexpr uint32_t fixedBytes=8+16+16+8+8+dataPadded;
+    /** \brief maximum size of an element */
+    static constexpr uint32_t maxBytes=fixedBytes+((TINYMAT_SMALLENCODER_MAXNAME+7)&~7u);
+
+    /*! \brief encodes the element with the name \a name (of length \a nameBytes <= TINYMAT_SMALLENCODER_MAXNAME)
+               and the column-major values \a data into \a buf and returns its size */
+    static inline uint32_t encode(uint8_t* buf, const char* name, uint32_t nameBytes, const T* data) {
+        const uint32_t namePadded=(nameBytes+7)&~7u;
+        const uint32_t header[10]={
+            14, fixedBytes-8+namePadded,     // miMATRIX
+            6, 8, traits::arrayflags, 0,     // array flags
+            5, 8, static_cast<uint32_t>(ROWS), static_cast<uint32_t>(COLS) // dimensions
+        };
+        memcpy(buf, header, sizeof(header));
+        const uint32_t nameTag[2]={1, nameBytes};
+        memcpy(buf+40, nameTag, sizeof(nameTag));
+        memset(buf+48, 0, namePadded);
+        memcpy(buf+48, name, nameBytes);
+        uint8_t* d=buf+48+namePadded;
+        const uint32_t dataTag[2]={traits::miType, dataBytes};
+        memcpy(d, dataTag, sizeof(dataTag));
+        d=d+8;
+        for (int32_t i=0; i<ROWS*COLS; i++) {
+            const typename traits::storage_type v=traits::encode(data[i]);
+            memcpy(d+i*traits::size, &v, traits::size);
+        }
+        if (dataPadded>dataBytes) memset(d+dataBytes, 0, dataPadded-dataBytes);
+        return fixedBytes+namePadded;
+    }
+};
+
+#endif // TINYMATENCODER_H
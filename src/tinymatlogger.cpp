@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+#include "tinymatlogger.h"
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/*! \brief consumer side of a TinyMATLogger
+    \ingroup tinymatlogger
+    \internal
+ */
+struct TinyMATLoggerPrivate {
+    TinyMATLoggerPrivate() :
+      mat(NULL),
+      flushInterval(100),
+      stop(false)
+    {
+    }
+    /** \brief the MAT-file to write into */
+    TinyMATWriterFile* mat;
+    /** \brief names of the channels */
+    std::vector<std::string> names;
+    /** \brief samples of each channel, that are not yet written */
+    std::vector<std::vector<double> > batches;
+    /** \brief maximum time between two flushes */
+    std::chrono::milliseconds flushInterval;
+    /** \brief signals the consumer thread to write all remaining samples and stop */
+    std::atomic<bool> stop;
+    /** \brief the consumer thread */
+    std::thread thread;
+};
+
+/** \brief appends all batched samples to their column vectors */
+static void TinyMATLogger_flush(TinyMATLogger* logger) {
+    TinyMATLoggerPrivate* d=logger->d;
+    for (size_t c=0; c<d->batches.size(); c++) {
+        if (d->batches[c].size()>0) {
+            TinyMATWriter_appendToColumn(d->mat, d->names[c].c_str(), d->batches[c].data(), d->batches[c].size());
+            d->batches[c].clear();
+        }
+    }
+}
+
+/** \brief moves all samples from the ring buffer into the per-channel batches, returns the number of samples */
+static uint64_t TinyMATLogger_drain(TinyMATLogger* logger) {
+    TinyMATLoggerPrivate* d=logger->d;
+    const uint64_t t=logger->tail.load(std::memory_order_relaxed);
+    const uint64_t h=logger->head.load(std::memory_order_acquire);
+    for (uint64_t i=t; i<h; i++) {
+        const TinyMATLoggerSample& s=logger->buffer[i&logger->mask];
+        if (s.channel<d->batches.size()) d->batches[s.channel].push_back(s.value);
+    }
+    logger->tail.store(h, std::memory_order_release);
+    return h-t;
+}
+
+/** \brief main loop of the consumer thread */
+static void TinyMATLogger_run(TinyMATLogger* logger) {
+    TinyMATLoggerPrivate* d=logger->d;
+    auto lastFlush=std::chrono::steady_clock::now();
+    while (!d->stop.load(std::memory_order_acquire)) {
+        const uint64_t n=TinyMATLogger_drain(logger);
+        const auto now=std::chrono::steady_clock::now();
+        if (now-lastFlush>=d->flushInterval) {
+            TinyMATLogger_flush(logger);
+            lastFlush=now;
+        }
+        if (n==0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+    TinyMATLogger_drain(logger);
+    TinyMATLogger_flush(logger);
+}
+
+TinyMATLogger* TinyMATLogger_open(TinyMATWriterFile* mat, const char* const* channelNames, uint32_t channels, size_t capacity, uint32_t flushIntervalMS) {
+    if (!TinyMATWriter_fOK(mat) || !channelNames || channels==0) return NULL;
+    size_t cap=64;
+    while (cap<capacity) cap=cap*2;
+
+    TinyMATLogger* logger=new TinyMATLogger;
+    logger->buffer=new TinyMATLoggerSample[cap];
+    logger->mask=cap-1;
+    logger->dropped=0;
+    logger->head=0;
+    logger->cachedTail=0;
+    logger->tail=0;
+    logger->d=new TinyMATLoggerPrivate;
+    logger->d->mat=mat;
+    for (uint32_t c=0; c<channels; c++) {
+        logger->d->names.push_back(channelNames[c]?channelNames[c]:"");
+    }
+    logger->d->batches.resize(channels);
+    logger->d->flushInterval=std::chrono::milliseconds(flushIntervalMS);
+    logger->d->thread=std::thread(TinyMATLogger_run, logger);
+    return logger;
+}
+
+uint64_t TinyMATLogger_getDropped(const TinyMATLogger* logger) {
+    if (!logger) return 0;
+    return logger->dropped.load(std::memory_order_relaxed);
+}
+
+void TinyMATLogger_close(TinyMATLogger* logger) {
+    if (!logger) return;
+    logger->d->stop.store(true, std::memory_order_release);
+    logger->d->thread.join();
+    delete logger->d;
+    delete[] logger->buffer;
+    delete logger;
+}
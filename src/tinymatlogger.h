@@ -0,0 +1,136 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+#ifndef TINYMATLOGGER_H
+#define TINYMATLOGGER_H
+
+#include "tinymat_export.h"
+#include "tinymatwriter.h"
+
+#include <stdint.h>
+#include <atomic>
+
+/*! \defgroup tinymatlogger Lock-free logger for high-rate scalar data
+    \ingroup tinymatwriter
+
+    A TinyMATLogger collects scalar samples of several channels from one producer thread in a lock-free ring buffer.
+    A consumer thread batches the samples per channel and periodically appends them to one column vector per channel
+    in a TinyMATWriterFile (see TinyMATWriter_appendToColumn() ). Logging a sample only writes it into the ring buffer,
+    so it costs a few nanoseconds and never blocks.
+
+\code
+    TinyMATWriterFile* mat=TinyMATWriter_open("telemetry.mat");
+    const char* channels[2]={"voltage", "current"};
+    TinyMATLogger* logger=TinyMATLogger_open(mat, channels, 2);
+    for (...) {
+        TinyMATLogger_log(logger, 0, u);
+        TinyMATLogger_log(logger, 1, i);
+    }
+    TinyMATLogger_close(logger);
+    TinyMATWriter_close(mat);
+\endcode
+
+ */
+
+/** \brief a single sample in the ring buffer of a TinyMATLogger
+    \ingroup tinymatlogger
+ */
+struct TinyMATLoggerSample {
+    double value;
+    uint32_t channel;
+};
+
+struct TinyMATLoggerPrivate; // forward
+
+/** \brief a logger for scalar samples, see \ref tinymatlogger
+    \ingroup tinymatlogger
+
+    The members are only public, so TinyMATLogger_log() can be inlined into the producer, do not access them directly.
+ */
+struct TinyMATLogger {
+    /** \brief ring buffer with capacity (a power of 2) entries */
+    TinyMATLoggerSample* buffer;
+    /** \brief capacity-1 */
+    uint64_t mask;
+    /** \brief number of samples dropped, because the ring buffer was full */
+    std::atomic<uint64_t> dropped;
+    char pad0[64];
+    /** \brief number of samples written by the producer */
+    std::atomic<uint64_t> head;
+    /** \brief the producer's copy of tail, only re-read when the buffer seems full */
+    uint64_t cachedTail;
+    char pad1[64];
+    /** \brief number of samples read by the consumer */
+    std::atomic<uint64_t> tail;
+    char pad2[64];
+    /** \brief consumer thread and batches */
+    TinyMATLoggerPrivate* d;
+};
+
+/*! \brief create a logger, that writes into \a mat
+    \ingroup tinymatlogger
+
+    \param mat the MAT-file to write into, it must not be used by other threads until TinyMATLogger_close() was called
+    \param channelNames names of the column vectors, that are written for each channel
+    \param channels number of channels
+    \param capacity number of samples in the ring buffer (rounded up to a power of 2)
+    \param flushIntervalMS the samples are appended to the MAT-file at least every \a flushIntervalMS milliseconds
+    \return a new logger, or NULL on errors
+
+ */
+TINYMAT_EXPORT TinyMATLogger* TinyMATLogger_open(TinyMATWriterFile* mat, const char* const* channelNames, uint32_t channels, size_t capacity=65536, uint32_t flushIntervalMS=100);
+
+/*! \brief log \a value for \a channel
+    \ingroup tinymatlogger
+
+    \param logger the logger
+    \param channel index of the channel (in the \c channelNames given to TinyMATLogger_open() )
+    \param value the sample
+    \return \c false, if the sample was dropped, because the ring buffer is full
+
+    This function must only be called from one thread (the producer).
+ */
+inline bool TinyMATLogger_log(TinyMATLogger* logger, uint32_t channel, double value) {
+    const uint64_t h=logger->head.load(std::memory_order_relaxed);
+    if (h-logger->cachedTail>logger->mask) {
+        logger->cachedTail=logger->tail.load(std::memory_order_acquire);
+        if (h-logger->cachedTail>logger->mask) {
+            logger->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    TinyMATLoggerSample& s=logger->buffer[h&logger->mask];
+    s.value=value;
+    s.channel=channel;
+    logger->head.store(h+1, std::memory_order_release);
+    return true;
+}
+
+/*! \brief returns the number of samples, that were dropped, because the ring buffer was full
+    \ingroup tinymatlogger
+ */
+TINYMAT_EXPORT uint64_t TinyMATLogger_getDropped(const TinyMATLogger* logger);
+
+/*! \brief stops the consumer thread, writes all remaining samples and destroys the logger (the MAT-file stays open)
+    \ingroup tinymatlogger
+ */
+TINYMAT_EXPORT void TinyMATLogger_close(TinyMATLogger* logger);
+
+#endif // TINYMATLOGGER_H
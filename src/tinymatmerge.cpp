@@ -0,0 +1,445 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+#include "tinymatmerge.h"
+#include "tinymatwriter.h"
+#include "tinymatbyteorder.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#ifdef TINYMAT_USES_ZLIB
+#  include <zlib.h>
+#endif
+
+#ifndef __WINDOWS__
+# if defined(WIN32) || defined(WIN64) || defined(_MSC_VER) || defined(_WIN32)
+#  define __WINDOWS__
+# endif
+#endif
+
+#ifndef __WINDOWS__
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#define TINYMAT_MERGE_HEADERSIZE 128
+#define TINYMAT_MERGE_miINT8 1
+#define TINYMAT_MERGE_miMATRIX 14
+#define TINYMAT_MERGE_miCOMPRESSED 15
+/** \brief maximum length of a variable name in MATLAB (\c namelengthmax ) */
+#define TINYMAT_MERGE_MAXNAMELENGTH 63
+/** \brief number of bytes, that are read to find the name of an element (its flags, dimensions and name have to fit) */
+#define TINYMAT_MERGE_MAXHEADER (64*1024)
+/** \brief buffer size for copying data, where \c copy_file_range() is not available */
+#define TINYMAT_MERGE_COPYBLOCK (1024*1024)
+
+/*! \brief an input file of TinyMAT_mergeFiles()
+    \ingroup tinymatmerge
+    \internal
+ */
+struct TinyMATMergeInput {
+    inline TinyMATMergeInput():
+        file(NULL),
+        size(0),
+        swapped(false)
+    {}
+    inline ~TinyMATMergeInput() {
+        if (file) fclose(file);
+    }
+    /** \brief the open file */
+    FILE* file;
+    /** \brief size of \a file in bytes */
+    uint64_t size;
+    /** \brief \c true, if the file is in the other byte order */
+    bool swapped;
+    /** \brief the byte order indicator from the header (\c "IM" or \c "MI" ) */
+    char endian[2];
+    /** \brief reads a uint32 in the byte order of the file from \a p */
+    inline uint32_t U32(const uint8_t* p) const {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return swapped?TinyMAT_bswap32(v):v;
+    }
+};
+
+/** \brief moves the file position of \a file to \a pos (64-bit, \c long and thus fseek() only has 32 bits on Windows) */
+static bool TinyMAT_mergeSeek(FILE* file, uint64_t pos) {
+#if defined(HAVE_FSEEKI64)
+    return _fseeki64(file, static_cast<int64_t>(pos), SEEK_SET)==0;
+#elif defined(HAVE_FSEEKO64)
+    return fseeko64(file, static_cast<off64_t>(pos), SEEK_SET)==0;
+#elif defined(__WINDOWS__)
+    return _fseeki64(file, static_cast<int64_t>(pos), SEEK_SET)==0;
+#else
+    return fseeko(file, static_cast<off_t>(pos), SEEK_SET)==0;
+#endif
+}
+
+/** \brief returns the size of \a file in bytes */
+static uint64_t TinyMAT_mergeFileSize(FILE* file) {
+#if defined(HAVE_FSEEKI64) && defined(HAVE_FTELLI64)
+    if (_fseeki64(file, 0, SEEK_END)!=0) return 0;
+    const int64_t size=_ftelli64(file);
+#elif defined(HAVE_FSEEKO64) && defined(HAVE_FTELLO64)
+    if (fseeko64(file, 0, SEEK_END)!=0) return 0;
+    const int64_t size=ftello64(file);
+#elif defined(__WINDOWS__)
+    if (_fseeki64(file, 0, SEEK_END)!=0) return 0;
+    const int64_t size=_ftelli64(file);
+#else
+    if (fseeko(file, 0, SEEK_END)!=0) return 0;
+    const int64_t size=static_cast<int64_t>(ftello(file));
+#endif
+    return (size>0)?static_cast<uint64_t>(size):0;
+}
+
+/** \brief reads \a size bytes at \a pos from \a file into \a data */
+static bool TinyMAT_mergeRead(FILE* file, uint64_t pos, void* data, uint64_t size) {
+    return TinyMAT_mergeSeek(file, pos) && fread(data, 1, static_cast<size_t>(size), file)==size;
+}
+
+/** \brief writes \a size bytes from \a data at \a pos into \a file */
+static bool TinyMAT_mergeWrite(FILE* file, uint64_t pos, const void* data, uint64_t size) {
+    return TinyMAT_mergeSeek(file, pos) && fwrite(data, 1, static_cast<size_t>(size), file)==size;
+}
+
+/*! \brief copies \a size bytes at \a inPos in \a in to \a outPos in \a out
+    \ingroup tinymatmerge
+    \internal
+
+    With \c copy_file_range() the data does not pass through user space. If it is not supported for the two files
+    (e.g. on another filesystem with an old kernel), the (rest of the) data is copied through \a buffer.
+ */
+static bool TinyMAT_mergeCopy(FILE* in, uint64_t inPos, FILE* out, uint64_t outPos, uint64_t size, std::vector<uint8_t>& buffer) {
+#ifdef HAVE_COPY_FILE_RANGE
+    if (size>0 && fflush(out)==0) {
+        loff_t inOffset=static_cast<loff_t>(inPos);
+        loff_t outOffset=static_cast<loff_t>(outPos);
+        while (size>0) {
+            const ssize_t copied=copy_file_range(fileno(in), &inOffset, fileno(out), &outOffset, static_cast<size_t>(std::min<uint64_t>(size, 1024*1024*1024)), 0);
+            if (copied<=0) break;
+            size-=static_cast<uint64_t>(copied);
+        }
+        inPos=static_cast<uint64_t>(inOffset);
+        outPos=static_cast<uint64_t>(outOffset);
+    }
+#endif
+    if (size>0 && buffer.size()<TINYMAT_MERGE_COPYBLOCK) buffer.resize(TINYMAT_MERGE_COPYBLOCK);
+    while (size>0) {
+        const uint64_t n=std::min<uint64_t>(size, buffer.size());
+        if (!TinyMAT_mergeRead(in, inPos, buffer.data(), n) || !TinyMAT_mergeWrite(out, outPos, buffer.data(), n)) return false;
+        inPos+=n;
+        outPos+=n;
+        size-=n;
+    }
+    return true;
+}
+
+/*! \brief finds the name of the miMATRIX element, whose first \a size bytes (starting with its tag) are at \a data
+    \ingroup tinymatmerge
+    \internal
+
+    \param data the beginning of the element
+    \param size number of bytes at \a data
+    \param elementSize size of the complete element (including the tag)
+    \param in the file, which contains the element (for its byte order)
+    \param[out] name the name of the element
+    \param[out] nameTag offset of the tag of the name sub-element in the element
+    \param[out] nameEnd offset behind the (padded) name sub-element in the element
+    \return 1, if the name was found, 0 if it is not within the first \a size bytes, -1 if the element is invalid
+ */
+static int TinyMAT_mergeFindName(const uint8_t* data, uint64_t size, uint64_t elementSize, const TinyMATMergeInput& in, std::string& name, uint64_t& nameTag, uint64_t& nameEnd) {
+    // skip the array flags and dimensions sub-elements to the name
+    uint64_t pos=8;
+    for (int i=0; i<3; i++) {
+        if (pos+8>elementSize) return -1;
+        if (pos+8>size) return 0;
+        const uint32_t t=in.U32(data+pos);
+        uint32_t type=t;
+        uint64_t bytes=0, start=pos+8, next=0;
+        if ((t>>16)!=0) {
+            // small data element format
+            type=t&0xFFFF;
+            bytes=t>>16;
+            start=pos+4;
+            next=pos+8;
+            if (bytes>4) return -1;
+        } else {
+            bytes=in.U32(data+pos+4);
+            next=start+((bytes+7)&~static_cast<uint64_t>(7));
+            if (next>elementSize) return -1;
+        }
+        if (i==2) {
+            if (type!=TINYMAT_MERGE_miINT8) return -1;
+            if (start+bytes>size) return 0;
+            const char* n=reinterpret_cast<const char*>(data+start);
+            name.assign(n, std::find(n, n+bytes, '\0'));
+            nameTag=pos;
+            nameEnd=next;
+        }
+        pos=next;
+    }
+    return 1;
+}
+
+#ifdef TINYMAT_USES_ZLIB
+/*! \brief inflates the compressed element with \a bytes bytes of data at \a offset in \a in into \a dest, until it holds \a wanted bytes (or the complete element)
+    \ingroup tinymatmerge
+    \internal
+ */
+static bool TinyMAT_mergeInflate(const TinyMATMergeInput& in, uint64_t offset, uint64_t bytes, uint64_t wanted, std::vector<uint8_t>& dest) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs)!=Z_OK) return false;
+    std::vector<uint8_t> src(64*1024);
+    uint64_t pos=offset+8;
+    const uint64_t end=pos+bytes;
+    dest.clear();
+    int res=Z_OK;
+    while (res==Z_OK && dest.size()<wanted) {
+        if (zs.avail_in==0) {
+            const uint64_t n=std::min<uint64_t>(src.size(), end-pos);
+            if (n==0 || !TinyMAT_mergeRead(in.file, pos, src.data(), n)) break;
+            pos+=n;
+            zs.next_in=src.data();
+            zs.avail_in=static_cast<uInt>(n);
+        }
+        const size_t have=dest.size();
+        const uint64_t chunk=std::min<uint64_t>(wanted-have, 1024*1024);
+        dest.resize(have+static_cast<size_t>(chunk));
+        zs.next_out=dest.data()+have;
+        zs.avail_out=static_cast<uInt>(chunk);
+        res=inflate(&zs, Z_NO_FLUSH);
+        dest.resize(dest.size()-zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return res==Z_OK || res==Z_STREAM_END;
+}
+#endif
+
+/*! \brief returns \a name with the suffix \c _2 , \c _3 , ... that is not in \a used
+    \ingroup tinymatmerge
+    \internal
+
+    \a nextSuffix remembers the last suffix for each name, so many collisions of the same name do not try all suffixes again.
+ */
+static std::string TinyMAT_mergeUniqueName(const std::string& name, const std::unordered_set<std::string>& used, std::unordered_map<std::string, uint64_t>& nextSuffix) {
+    uint64_t& suffix=nextSuffix[name];
+    if (suffix<2) suffix=2;
+    for (;; suffix++) {
+        const std::string s="_"+std::to_string(suffix);
+        const std::string n=name.substr(0, TINYMAT_MERGE_MAXNAMELENGTH-s.size())+s;
+        if (used.count(n)==0) return n;
+    }
+}
+
+/** \brief returns \c true, if \a a and \a b are the same file */
+static bool TinyMAT_mergeSameFile(const char* a, const char* b) {
+#ifdef __WINDOWS__
+    return _stricmp(a, b)==0;
+#else
+    struct stat sa, sb;
+    if (stat(a, &sa)!=0 || stat(b, &sb)!=0) return strcmp(a, b)==0;
+    return sa.st_dev==sb.st_dev && sa.st_ino==sb.st_ino;
+#endif
+}
+
+/*! \brief opens \a filename and checks its header
+    \ingroup tinymatmerge
+    \internal
+
+    \return an empty string, or the error
+ */
+static std::string TinyMAT_mergeOpen(const char* filename, TinyMATMergeInput& in) {
+    in.file=fopen(filename, "rb");
+    if (!in.file) return "could not open the file";
+    in.size=TinyMAT_mergeFileSize(in.file);
+    uint8_t header[TINYMAT_MERGE_HEADERSIZE];
+    if (in.size<TINYMAT_MERGE_HEADERSIZE || !TinyMAT_mergeRead(in.file, 0, header, TINYMAT_MERGE_HEADERSIZE)) return "the file is too short for a MAT-file";
+    if (strncmp(reinterpret_cast<const char*>(header), "MATLAB 5.0 MAT-file", 19)!=0) return "the file is not a MAT-file";
+    in.endian[0]=static_cast<char>(header[126]);
+    in.endian[1]=static_cast<char>(header[127]);
+    const uint16_t one=1;
+    const bool littleEndianMachine=(reinterpret_cast<const uint8_t*>(&one)[0]==1);
+    if (in.endian[0]=='I' && in.endian[1]=='M') in.swapped=!littleEndianMachine;
+    else if (in.endian[0]=='M' && in.endian[1]=='I') in.swapped=littleEndianMachine;
+    else return "invalid byte order indicator";
+    uint16_t version=0;
+    memcpy(&version, header+124, sizeof(version));
+    if ((in.swapped?TinyMAT_bswap16(version):version)!=0x0100) return "the file is not a MAT v5 file";
+    // no subsystem data: the offset is 0 or filled with spaces
+    for (int i=116; i<124; i++) {
+        if (header[i]!=0 && header[i]!=' ') return "the file contains subsystem data (e.g. objects or function handles), which cannot be merged";
+    }
+    return std::string();
+}
+
+/*! \brief copies the top-level elements of \a in to \a out, starting at \a outPos
+    \ingroup tinymatmerge
+    \internal
+
+    \return an empty string, or the error
+ */
+static std::string TinyMAT_mergeElements(const char* filename, const TinyMATMergeInput& in, FILE* out, uint64_t& outPos, std::unordered_set<std::string>& used, std::unordered_map<std::string, uint64_t>& nextSuffix, std::vector<uint8_t>& buffer, TinyMATMergeResult& res) {
+    std::vector<uint8_t> head, element;
+    uint64_t offset=TINYMAT_MERGE_HEADERSIZE;
+    while (offset<in.size) {
+        const std::string at=" at offset "+std::to_string(offset);
+        uint8_t tag[8];
+        if (in.size-offset<8 || !TinyMAT_mergeRead(in.file, offset, tag, 8)) return "truncated element"+at;
+        const uint32_t type=in.U32(tag);
+        const uint64_t bytes=in.U32(tag+4);
+        if (type!=TINYMAT_MERGE_miMATRIX && type!=TINYMAT_MERGE_miCOMPRESSED) return "unexpected element type "+std::to_string(type)+at;
+        if (bytes==0 || (type==TINYMAT_MERGE_miMATRIX && bytes%8!=0)) return "invalid element size"+at;
+        if (bytes>in.size-offset-8) return "the element"+at+" extends beyond the end of the file";
+        const uint64_t end=offset+8+bytes;
+
+        // read the beginning of the element to find its name
+        std::string name;
+        uint64_t nameTag=0, nameEnd=0, elementSize=8+bytes;
+        int found=-1;
+        if (type==TINYMAT_MERGE_miMATRIX) {
+            for (uint64_t n=4096; ; n*=16) {
+                head.resize(static_cast<size_t>(std::min<uint64_t>(n, elementSize)));
+                if (!TinyMAT_mergeRead(in.file, offset, head.data(), head.size())) return "could not read the element"+at;
+                found=TinyMAT_mergeFindName(head.data(), head.size(), elementSize, in, name, nameTag, nameEnd);
+                if (found!=0 || head.size()>=elementSize || n>=TINYMAT_MERGE_MAXHEADER) break;
+            }
+        } else {
+#ifdef TINYMAT_USES_ZLIB
+            if (!TinyMAT_mergeInflate(in, offset, bytes, TINYMAT_MERGE_MAXHEADER, head) || head.size()<8 || in.U32(head.data())!=TINYMAT_MERGE_miMATRIX) {
+                return "could not inflate the compressed element"+at;
+            }
+            elementSize=8+static_cast<uint64_t>(in.U32(head.data()+4));
+            found=TinyMAT_mergeFindName(head.data(), head.size(), elementSize, in, name, nameTag, nameEnd);
+#else
+            return "the compressed element"+at+" can only be merged with zlib support";
+#endif
+        }
+        if (found<=0) return "could not read the name of the element"+at;
+
+        if (name==TINYMAT_INDEX_NAME || name==TINYMAT_TOMBSTONE_NAME) {
+            res.dropped++;
+        } else if (name.size()>0 && used.count(name)>0) {
+            // rename: copy flags and dimensions, write the new name, then copy the rest of the element
+            const std::string newName=TinyMAT_mergeUniqueName(name, used, nextSuffix);
+            const uint8_t* data=head.data();
+            if (type==TINYMAT_MERGE_miCOMPRESSED) {
+#ifdef TINYMAT_USES_ZLIB
+                if (!TinyMAT_mergeInflate(in, offset, bytes, elementSize, element) || element.size()!=elementSize) return "could not inflate the compressed element"+at;
+                data=element.data();
+#endif
+            }
+            const uint32_t newNameBytes=static_cast<uint32_t>(newName.size());
+            const uint64_t newSize=elementSize-(nameEnd-nameTag)+8+((newNameBytes+7)&~7u);
+            if (newSize-8>0xFFFFFFFFu) return "the renamed element"+at+" is too large";
+            std::vector<uint8_t> renamed(static_cast<size_t>(nameTag+8+((newNameBytes+7)&~7u)), 0);
+            uint32_t u[4]={TINYMAT_MERGE_miMATRIX, static_cast<uint32_t>(newSize-8), TINYMAT_MERGE_miINT8, newNameBytes};
+            if (in.swapped) TinyMAT_swapBytes(u, 4, 4);
+            memcpy(renamed.data(), u, 8);
+            memcpy(renamed.data()+8, data+8, static_cast<size_t>(nameTag-8));
+            memcpy(renamed.data()+nameTag, u+2, 8);
+            memcpy(renamed.data()+nameTag+8, newName.data(), newName.size());
+            if (!TinyMAT_mergeWrite(out, outPos, renamed.data(), renamed.size())) return "could not write the merged file";
+            outPos+=renamed.size();
+            const uint64_t rest=elementSize-nameEnd;
+            const bool ok=(type==TINYMAT_MERGE_miCOMPRESSED)?TinyMAT_mergeWrite(out, outPos, data+nameEnd, rest):TinyMAT_mergeCopy(in.file, offset+nameEnd, out, outPos, rest, buffer);
+            if (!ok) return "could not write the merged file";
+            outPos+=rest;
+            used.insert(newName);
+            res.renamed.push_back(TinyMATMergeRename{filename, name, newName});
+            res.variables++;
+        } else {
+            if (!TinyMAT_mergeCopy(in.file, offset, out, outPos, end-offset, buffer)) return "could not write the merged file";
+            outPos+=end-offset;
+            used.insert(name);
+            res.variables++;
+        }
+        offset=end;
+    }
+    return std::string();
+}
+
+bool TinyMAT_mergeFiles(const char* outputFilename, const char* const* inputFilenames, uint32_t inputs, const TinyMATMergeOptions& options, TinyMATMergeResult* result) {
+    TinyMATMergeResult res;
+    auto fail=[&](const std::string& error) {
+        res.error=error;
+        if (result) *result=res;
+        return false;
+    };
+    if (!outputFilename || (inputs>0 && !inputFilenames)) return fail("no files given");
+
+    // check all headers first, so nothing is written for invalid input files
+    char endian[2]={0,0};
+    for (uint32_t i=0; i<inputs; i++) {
+        TinyMATMergeInput in;
+        const std::string error=TinyMAT_mergeOpen(inputFilenames[i], in);
+        if (error.size()>0) return fail(std::string(inputFilenames[i])+": "+error);
+        if (i==0) {
+            memcpy(endian, in.endian, 2);
+        } else if (memcmp(endian, in.endian, 2)!=0) {
+            return fail(std::string(inputFilenames[i])+": the file is in a different byte order than "+inputFilenames[0]);
+        }
+        if (TinyMAT_mergeSameFile(outputFilename, inputFilenames[i])) return fail(std::string(inputFilenames[i])+": the output file cannot be one of the input files");
+    }
+
+    // the header of the merged file is written by TinyMATWriter, in the byte order of the input files
+    TinyMATWriterFile* mat=TinyMATWriter_open(outputFilename, options.description);
+    if (!mat) return fail(std::string(outputFilename)+": could not create the file");
+    if (endian[0]=='I') TinyMATWriter_setByteOrder(mat, TinyMATByteOrder::LittleEndian);
+    else if (endian[0]=='M') TinyMATWriter_setByteOrder(mat, TinyMATByteOrder::BigEndian);
+    TinyMATWriter_close(mat);
+    FILE* out=fopen(outputFilename, "rb+");
+    if (!out) return fail(std::string(outputFilename)+": could not create the file");
+
+    std::unordered_set<std::string> used;
+    std::unordered_map<std::string, uint64_t> nextSuffix;
+    std::vector<uint8_t> buffer;
+    uint64_t outPos=TINYMAT_MERGE_HEADERSIZE;
+    for (uint32_t i=0; i<inputs; i++) {
+        TinyMATMergeInput in;
+        std::string error=TinyMAT_mergeOpen(inputFilenames[i], in);
+        if (error.size()==0) error=TinyMAT_mergeElements(inputFilenames[i], in, out, outPos, used, nextSuffix, buffer, res);
+        if (error.size()>0) {
+            fclose(out);
+            remove(outputFilename);
+            return fail(std::string(inputFilenames[i])+": "+error);
+        }
+    }
+    if (fclose(out)!=0) {
+        remove(outputFilename);
+        return fail(std::string(outputFilename)+": could not write the file");
+    }
+    res.bytes=outPos;
+
+    if (options.writeIndex) {
+        // TinyMATWriter_openAppend() only reads the tags and names of the variables
+        mat=TinyMATWriter_openAppend(outputFilename);
+        if (mat) {
+            TinyMATWriter_setWriteIndex(mat, true);
+            TinyMATWriter_close(mat);
+        }
+    }
+    if (result) *result=res;
+    return true;
+}
@@ -0,0 +1,120 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATMERGE_H
+#define TINYMATMERGE_H
+
+#include "tinymat_export.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*! \defgroup tinymatmerge Merging MAT-files
+    \ingroup tinymatwriter
+
+    TinyMAT_mergeFiles() concatenates the top-level variables of several MAT-files (e.g. written by one worker
+    process each) into a single file. The variables are copied as they are: only the 128-byte headers of the
+    files and the tag and name of each top-level element are read, the data itself is never parsed. On Linux the
+    bytes are copied with \c copy_file_range() , so the kernel copies them without passing them through user space
+    (and filesystems like Btrfs or XFS may share the blocks instead of copying them, where the offsets allow it).
+
+    The command line tool \c tinymat_merge (in \c ./tools/ ) gives access to this function:
+\code{.sh}
+    $ tinymat_merge --index result.mat worker_*.mat
+\endcode
+
+ */
+
+/*! \brief options for TinyMAT_mergeFiles()
+    \ingroup tinymatmerge
+ */
+struct TinyMATMergeOptions {
+    inline TinyMATMergeOptions():
+        description(NULL),
+        writeIndex(false)
+    {}
+    /** \brief description in the header of the merged file (see TinyMATWriter_open() ) */
+    const char* description;
+    /** \brief if \c true, an index of all variables is appended to the merged file (see TinyMATWriter_setWriteIndex() ) */
+    bool writeIndex;
+};
+
+/*! \brief a variable, that was renamed by TinyMAT_mergeFiles(), as its name was already used by an earlier variable
+    \ingroup tinymatmerge
+ */
+struct TinyMATMergeRename {
+    /** \brief the input file, which contains the variable */
+    std::string filename;
+    /** \brief name of the variable in \a filename */
+    std::string oldName;
+    /** \brief name of the variable in the merged file */
+    std::string newName;
+};
+
+/*! \brief what TinyMAT_mergeFiles() did
+    \ingroup tinymatmerge
+ */
+struct TinyMATMergeResult {
+    inline TinyMATMergeResult():
+        variables(0),
+        dropped(0),
+        bytes(0)
+    {}
+    /** \brief number of variables in the merged file (without the index) */
+    uint64_t variables;
+    /** \brief number of dropped elements (indexes and tombstones of the input files) */
+    uint64_t dropped;
+    /** \brief size of the merged file in bytes (without the index) */
+    uint64_t bytes;
+    /** \brief the renamed variables */
+    std::vector<TinyMATMergeRename> renamed;
+    /** \brief describes the error, if TinyMAT_mergeFiles() failed */
+    std::string error;
+};
+
+/*! \brief concatenates the top-level variables of the MAT-files \a inputFilenames into the new MAT-file \a outputFilename
+    \ingroup tinymatmerge
+
+    \param outputFilename filename of the merged file (overwritten, if it exists)
+    \param inputFilenames filenames of the files to merge, their variables are written in this order
+    \param inputs number of entries in \a inputFilenames
+    \param options options for the merged file
+    \param result if not \c NULL, receives the renamed variables and statistics (or the error)
+    \return \c true on success. On failure the incomplete \a outputFilename is removed.
+
+    All input files have to be MAT v5 files in the same byte order, which is also used for the merged file. For
+    each top-level element, the tag and the name are checked, then the element is copied without looking at its
+    data. A variable, whose name is already used by an earlier variable, is renamed by appending \c _2 , \c _3 , ...
+    (shortened to 63 characters, as required by MATLAB). Its flags and dimensions are copied, a new name is written
+    and the rest of the element is copied as usual. A renamed compressed variable is inflated and written
+    uncompressed (this needs zlib, see \c TinyMAT_ZLIB_SUPPORT ), other compressed variables are copied as they are.
+
+    Indexes (see TinyMATWriter_setWriteIndex() ) and tombstones (see TinyMATWriter_setReplaceExisting() ) in the
+    input files are dropped, as the offsets in an index are no longer valid. Files with subsystem data (which MATLAB
+    writes for objects and function handles) cannot be merged, as the subsystem data refers to the variables of
+    its own file. If \a options.writeIndex is set, a new index is written (only for files in the byte order of this
+    machine, see TinyMATWriter_openAppend() ).
+ */
+TINYMAT_EXPORT bool TinyMAT_mergeFiles(const char* outputFilename, const char* const* inputFilenames, uint32_t inputs, const TinyMATMergeOptions& options=TinyMATMergeOptions(), TinyMATMergeResult* result=NULL);
+
+#endif // TINYMATMERGE_H
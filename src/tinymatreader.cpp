@@ -0,0 +1,1761 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#include "tinymatreader.h"
+#include "tinymatwriter.h"
+#include "tinymatbyteorder.h"
+#include "tinymatchecksum.h"
+#include <string.h>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <type_traits>
+#include <cmath>
+#ifdef TINYMAT_USES_ZLIB
+#  include <zlib.h>
+#endif
+
+#ifndef __WINDOWS__
+# if defined(WIN32) || defined(WIN64) || defined(_MSC_VER) || defined(_WIN32)
+#  define __WINDOWS__
+# endif
+#endif
+
+#ifdef __WINDOWS__
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#  define TINYMAT_HAS_SSE2
+#  include <emmintrin.h>
+#endif
+
+#define TINYMAT_READER_HEADERSIZE 128
+#define TINYMAT_READER_miINT8 1
+#define TINYMAT_READER_miINT32 5
+#define TINYMAT_READER_miUINT32 6
+#define TINYMAT_READER_miMATRIX 14
+#define TINYMAT_READER_miCOMPRESSED 15
+
+/*! \brief a data element tag, as read by TinyMATReader_readTag()
+    \ingroup tinymatreader
+    \internal
+ */
+struct TinyMATReaderTag {
+    /** \brief data type */
+    uint32_t type;
+    /** \brief number of data bytes */
+    uint64_t bytes;
+    /** \brief offset of the data */
+    uint64_t data;
+    /** \brief offset of the next element (after the padding) */
+    uint64_t next;
+};
+
+/*! \brief the inflated header of a compressed top-level element
+    \ingroup tinymatreader
+    \internal
+ */
+struct TinyMATReaderCompressedHeader {
+    /** \brief the first bytes of the inflated element (up to the tag of the real part) */
+    std::vector<uint8_t> header;
+    /** \brief description of the element, the pointers point into \a header */
+    TinyMATReaderArray array;
+    /** \brief tag of the real part (offsets in the inflated element) */
+    TinyMATReaderTag real;
+};
+
+/*! \brief state of a MAT-file, opened for reading
+    \ingroup tinymatreader
+    \internal
+ */
+struct TinyMATReaderFile {
+    TinyMATReaderFile():
+        data(NULL),
+        size(0),
+        mapped(false),
+        swapped(false),
+        indexed(false)
+#ifdef __WINDOWS__
+        , hFile(INVALID_HANDLE_VALUE),
+        hMapping(NULL)
+#endif
+    {
+    }
+    /** \brief contents of the file */
+    const uint8_t* data;
+    /** \brief size of \a data in bytes */
+    uint64_t size;
+    /** \brief \c true, if \a data is a mapping, which is owned by this object */
+    bool mapped;
+    /** \brief \c true, if the file is in the other byte order: \a data has been swapped, but compressed elements have to be swapped after inflating them */
+    bool swapped;
+    /** \brief a swapped copy of the buffer, passed to TinyMATReader_openBuffer(), for files in the other byte order */
+    std::vector<uint8_t> ownedData;
+    /** \brief maps the variable names to their byte offsets (the first variable, if a name occurs several times) */
+    std::unordered_map<std::string, uint64_t> index;
+    /** \brief \c true, once \a index is complete */
+    bool indexed;
+    /** \brief protects \a index and \a indexed */
+    std::mutex indexMutex;
+    /** \brief inflated headers of the compressed elements, by their offset */
+    mutable std::unordered_map<uint64_t, std::unique_ptr<TinyMATReaderCompressedHeader> > compressedHeaders;
+    /** \brief protects \a compressedHeaders */
+    mutable std::mutex compressedMutex;
+#ifdef __WINDOWS__
+    HANDLE hFile;
+    HANDLE hMapping;
+#endif
+};
+
+/** \brief reads a uint32 from \a p (which may be unaligned) */
+static inline uint32_t TinyMATReader_U32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*! \brief reads the tag of the data element at \a offset, which has to end before \a end
+    \internal
+
+    Both, the normal (8 bytes) and the small (4 bytes) element format are supported. If the padding of the
+    element extends beyond \a end (e.g. for unpadded compressed elements), \a tag.next is \a end.
+ */
+static bool TinyMATReader_readTag(const TinyMATReaderFile* mat, uint64_t offset, uint64_t end, TinyMATReaderTag& tag) {
+    if (end>mat->size || offset>end || end-offset<8) return false;
+    const uint32_t t=TinyMATReader_U32(mat->data+offset);
+    if ((t>>16)!=0) {
+        // small data element format
+        tag.type=t&0xFFFF;
+        tag.bytes=t>>16;
+        tag.data=offset+4;
+        tag.next=offset+8;
+        return tag.bytes<=4;
+    }
+    tag.type=t;
+    tag.bytes=TinyMATReader_U32(mat->data+offset+4);
+    tag.data=offset+8;
+    if (tag.bytes>end-tag.data) return false;
+    const uint64_t padded=(tag.bytes+7)&~static_cast<uint64_t>(7);
+    tag.next=(padded<=end-tag.data)?(tag.data+padded):end;
+    return true;
+}
+
+/*! \brief converts all elements of \a mat (which is in the other byte order) to the byte order of this machine
+    \internal
+
+    A mapping is private (copy-on-write), so only the pages in memory are changed, a buffer is copied.
+ */
+static bool TinyMATReader_swapToNative(TinyMATReaderFile* mat) {
+    uint8_t* d=NULL;
+    if (mat->mapped) {
+#ifndef __WINDOWS__
+        if (mprotect(const_cast<uint8_t*>(mat->data), static_cast<size_t>(mat->size), PROT_READ|PROT_WRITE)!=0) return false;
+#endif
+        d=const_cast<uint8_t*>(mat->data);
+    } else {
+        try {
+            mat->ownedData.assign(mat->data, mat->data+mat->size);
+        } catch (std::bad_alloc&) {
+            return false;
+        }
+        d=mat->ownedData.data();
+        mat->data=d;
+    }
+    TinyMAT_swapElements(d+TINYMAT_READER_HEADERSIZE, mat->size-TINYMAT_READER_HEADERSIZE, true);
+#ifndef __WINDOWS__
+    if (mat->mapped) mprotect(d, static_cast<size_t>(mat->size), PROT_READ);
+#endif
+    mat->swapped=true;
+    return true;
+}
+
+/** \brief checks the header and sets up a TinyMATReaderFile for \a data, returns NULL if the header is invalid */
+static TinyMATReaderFile* TinyMATReader_init(TinyMATReaderFile* mat) {
+    if (mat->size<TINYMAT_READER_HEADERSIZE) return NULL;
+    uint16_t version=0, endian=0;
+    memcpy(&version, mat->data+124, 2);
+    memcpy(&endian, mat->data+126, 2);
+    // 'MI' written as 16-bit value in the byte order of this machine reads as 'MI', in the other byte order as 'IM'
+    if (version==0x0100 && endian==(('M'<<8)|'I')) return mat;
+    if (version==0x0001 && endian==(('I'<<8)|'M') && TinyMATReader_swapToNative(mat)) return mat;
+    return NULL;
+}
+
+TinyMATReaderFile* TinyMATReader_open(const char* filename) {
+    if (!filename) return NULL;
+    TinyMATReaderFile* mat=new TinyMATReaderFile;
+#ifdef __WINDOWS__
+    mat->hFile=CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER fsize;
+    if (mat->hFile!=INVALID_HANDLE_VALUE && GetFileSizeEx(mat->hFile, &fsize) && fsize.QuadPart>0) {
+        // a copy-on-write view, so files in the other byte order can be swapped in memory
+        mat->hMapping=CreateFileMappingA(mat->hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mat->hMapping) {
+            mat->data=static_cast<const uint8_t*>(MapViewOfFile(mat->hMapping, FILE_MAP_COPY, 0, 0, 0));
+            mat->size=static_cast<uint64_t>(fsize.QuadPart);
+        }
+    }
+#else
+    const int fd=::open(filename, O_RDONLY);
+    if (fd>=0) {
+        struct stat st;
+        if (fstat(fd, &st)==0 && st.st_size>0) {
+            void* p=mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p!=MAP_FAILED) {
+                mat->data=static_cast<const uint8_t*>(p);
+                mat->size=static_cast<uint64_t>(st.st_size);
+            }
+        }
+        // the mapping stays valid after closing the file descriptor
+        ::close(fd);
+    }
+#endif
+    mat->mapped=(mat->data!=NULL);
+    if (!mat->data || !TinyMATReader_init(mat)) {
+        TinyMATReader_close(mat);
+        return NULL;
+    }
+    return mat;
+}
+
+TinyMATReaderFile* TinyMATReader_openBuffer(const void* data, uint64_t size) {
+    if (!data) return NULL;
+    TinyMATReaderFile* mat=new TinyMATReaderFile;
+    mat->data=static_cast<const uint8_t*>(data);
+    mat->size=size;
+    if (!TinyMATReader_init(mat)) {
+        delete mat;
+        return NULL;
+    }
+    return mat;
+}
+
+void TinyMATReader_close(TinyMATReaderFile* mat) {
+    if (!mat) return;
+    if (mat->mapped) {
+#ifdef __WINDOWS__
+        UnmapViewOfFile(mat->data);
+#else
+        munmap(const_cast<uint8_t*>(mat->data), static_cast<size_t>(mat->size));
+#endif
+    }
+#ifdef __WINDOWS__
+    if (mat->hMapping) CloseHandle(mat->hMapping);
+    if (mat->hFile!=INVALID_HANDLE_VALUE) CloseHandle(mat->hFile);
+#endif
+    delete mat;
+}
+
+std::string TinyMATReader_getDescription(const TinyMATReaderFile* mat) {
+    if (!mat) return std::string();
+    const char* d=reinterpret_cast<const char*>(mat->data);
+    size_t len=0;
+    while (len<116 && d[len]!='\0') len++;
+    while (len>0 && d[len-1]==' ') len--;
+    return std::string(d, len);
+}
+
+uint64_t TinyMATReader_getSize(const TinyMATReaderFile* mat) {
+    return mat?mat->size:0;
+}
+
+uint64_t TinyMATReader_firstElement(const TinyMATReaderFile* mat) {
+    if (!mat || mat->size<TINYMAT_READER_HEADERSIZE+8) return 0;
+    return TINYMAT_READER_HEADERSIZE;
+}
+
+uint64_t TinyMATReader_nextElement(const TinyMATReaderFile* mat, uint64_t offset) {
+    TinyMATReaderTag tag;
+    if (!mat || offset<TINYMAT_READER_HEADERSIZE || !TinyMATReader_readTag(mat, offset, mat->size, tag)) return 0;
+    // top-level elements are not padded (MATLAB does not pad compressed elements)
+    const uint64_t next=tag.data+tag.bytes;
+    if (next>mat->size || mat->size-next<8) return 0;
+    return next;
+}
+
+/*! \brief fills \a array from the miMATRIX element, described by \a tag (without \a offset and \a size)
+    \internal
+
+    If \a dataTag is given, \a mat may contain only the beginning of the element (e.g. the inflated header of a compressed
+    element): Then the data is not read, only the tag of the real part is returned in \a dataTag.
+ */
+static bool TinyMATReader_parseMatrix(const TinyMATReaderFile* mat, const TinyMATReaderTag& tag, TinyMATReaderArray* array, TinyMATReaderTag* dataTag=NULL) {
+    const uint64_t end=dataTag?std::min<uint64_t>(tag.data+tag.bytes, mat->size):(tag.data+tag.bytes);
+    array->compressed=false;
+    array->mxClass=TinyMATClass::Unknown;
+    array->complex=false;
+    array->logical=false;
+    array->global=false;
+    array->name="";
+    array->nameLength=0;
+    array->ndims=0;
+    array->dims=NULL;
+    array->type=TinyMATDataType::Unknown;
+    array->real=NULL;
+    array->realBytes=0;
+    array->imagType=TinyMATDataType::Unknown;
+    array->imag=NULL;
+    array->imagBytes=0;
+    array->ir=NULL;
+    array->irCount=0;
+    array->jc=NULL;
+    array->jcCount=0;
+    array->contentOffset=end;
+    // an empty miMATRIX element is an empty array (e.g. an empty cell)
+    if (tag.bytes==0) {
+        array->mxClass=TinyMATClass::Double;
+        return true;
+    }
+
+    TinyMATReaderTag sub;
+    // array flags
+    if (!TinyMATReader_readTag(mat, tag.data, end, sub) || sub.type!=TINYMAT_READER_miUINT32 || sub.bytes<8) return false;
+    const uint32_t flags=TinyMATReader_U32(mat->data+sub.data);
+    array->mxClass=static_cast<TinyMATClass>(flags&0xFF);
+    array->complex=(flags&0x0800)!=0;
+    array->global=(flags&0x0400)!=0;
+    array->logical=(flags&0x0200)!=0;
+    // dimensions
+    if (!TinyMATReader_readTag(mat, sub.next, end, sub) || sub.type!=TINYMAT_READER_miINT32 || (sub.bytes%4)!=0) return false;
+    array->ndims=static_cast<uint32_t>(sub.bytes/4);
+    array->dims=reinterpret_cast<const int32_t*>(mat->data+sub.data);
+    // name
+    if (!TinyMATReader_readTag(mat, sub.next, end, sub) || sub.type!=TINYMAT_READER_miINT8) return false;
+    array->name=reinterpret_cast<const char*>(mat->data+sub.data);
+    array->nameLength=static_cast<uint32_t>(sub.bytes);
+    array->contentOffset=sub.next;
+
+    switch (array->mxClass) {
+        case TinyMATClass::Cell:
+        case TinyMATClass::Struct:
+        case TinyMATClass::Object:
+            return true;
+        case TinyMATClass::Sparse:
+            if (dataTag) return true;
+            if (!TinyMATReader_readTag(mat, sub.next, end, sub) || (sub.bytes%4)!=0) return false;
+            array->ir=reinterpret_cast<const int32_t*>(mat->data+sub.data);
+            array->irCount=sub.bytes/4;
+            if (!TinyMATReader_readTag(mat, sub.next, end, sub) || (sub.bytes%4)!=0) return false;
+            array->jc=reinterpret_cast<const int32_t*>(mat->data+sub.data);
+            array->jcCount=sub.bytes/4;
+            break;
+        case TinyMATClass::Unknown:
+            return false;
+        default:
+            if (static_cast<uint8_t>(array->mxClass)>static_cast<uint8_t>(TinyMATClass::UInt64)) return false;
+            break;
+    }
+    if (dataTag) {
+        // only the tag of the real part is available
+        if (sub.next>mat->size || mat->size-sub.next<8) return false;
+        const uint64_t offset=sub.next;
+        const uint32_t t=TinyMATReader_U32(mat->data+offset);
+        if ((t>>16)!=0) {
+            dataTag->type=t&0xFFFF;
+            dataTag->bytes=t>>16;
+            dataTag->data=offset+4;
+            dataTag->next=offset+8;
+        } else {
+            dataTag->type=t;
+            dataTag->bytes=TinyMATReader_U32(mat->data+offset+4);
+            dataTag->data=offset+8;
+            dataTag->next=offset+8+((dataTag->bytes+7)&~static_cast<uint64_t>(7));
+        }
+        if (dataTag->data+dataTag->bytes>tag.data+tag.bytes) return false;
+        array->type=static_cast<TinyMATDataType>(dataTag->type);
+        array->realBytes=dataTag->bytes;
+        return true;
+    }
+    // real and imaginary part
+    if (!TinyMATReader_readTag(mat, sub.next, end, sub)) return false;
+    array->type=static_cast<TinyMATDataType>(sub.type);
+    array->real=mat->data+sub.data;
+    array->realBytes=sub.bytes;
+    if (array->complex) {
+        if (!TinyMATReader_readTag(mat, sub.next, end, sub)) return false;
+        array->imagType=static_cast<TinyMATDataType>(sub.type);
+        array->imag=mat->data+sub.data;
+        array->imagBytes=sub.bytes;
+    }
+    return true;
+}
+
+/** \brief reads the miMATRIX element at \a offset, which has to end before \a end, and returns the offset of the next element in \a next */
+static bool TinyMATReader_readSubArray(const TinyMATReaderFile* mat, uint64_t offset, uint64_t end, TinyMATReaderArray* array, uint64_t* next) {
+    TinyMATReaderTag tag;
+    if (!TinyMATReader_readTag(mat, offset, end, tag) || tag.type!=TINYMAT_READER_miMATRIX) return false;
+    if (next) *next=tag.next;
+    if (!array) return true;
+    array->offset=offset;
+    array->size=tag.next-offset;
+    return TinyMATReader_parseMatrix(mat, tag, array);
+}
+
+#ifdef TINYMAT_USES_ZLIB
+/** \brief largest header of a compressed element, that is inflated by TinyMATReader_getCompressedHeader() */
+#define TINYMAT_READER_MAXHEADER (1024*1024)
+
+/*! \brief inflates a compressed element step by step
+    \ingroup tinymatreader
+    \internal
+ */
+struct TinyMATReaderInflater {
+    /** \brief starts inflating the \a size bytes at \a data */
+    inline TinyMATReaderInflater(const uint8_t* data, uint64_t size):
+        in(data),
+        inLeft(size),
+        pos(0),
+        finished(false)
+    {
+        memset(&zs, 0, sizeof(zs));
+        ok=(inflateInit(&zs)==Z_OK);
+    }
+    inline ~TinyMATReaderInflater() {
+        inflateEnd(&zs);
+    }
+    /** \brief inflates the next (up to) \a bytes bytes into \a dest and returns their number */
+    uint64_t read(void* dest, uint64_t bytes) {
+        uint8_t* d=static_cast<uint8_t*>(dest);
+        uint64_t done=0;
+        while (ok && !finished && done<bytes) {
+            if (zs.avail_in==0 && inLeft>0) {
+                // zlib counts in uInt, so huge elements are passed in chunks
+                const uInt chunk=static_cast<uInt>(std::min<uint64_t>(inLeft, 1u<<30));
+                zs.next_in=const_cast<Bytef*>(in);
+                zs.avail_in=chunk;
+                in+=chunk;
+                inLeft-=chunk;
+            }
+            const uInt n=static_cast<uInt>(std::min<uint64_t>(bytes-done, 1u<<30));
+            zs.next_out=d+done;
+            zs.avail_out=n;
+            const int res=inflate(&zs, Z_NO_FLUSH);
+            done+=n-zs.avail_out;
+            if (res==Z_STREAM_END) finished=true;
+            else if (res!=Z_OK && res!=Z_BUF_ERROR) ok=false;
+            else if (res==Z_BUF_ERROR && zs.avail_in==0 && inLeft==0) ok=false;
+        }
+        pos+=done;
+        return done;
+    }
+    /** \brief skips to the position \a target in the inflated data */
+    bool skipTo(uint64_t target) {
+        uint8_t buf[16*1024];
+        while (pos<target) {
+            const uint64_t n=std::min<uint64_t>(target-pos, sizeof(buf));
+            if (read(buf, n)!=n) return false;
+        }
+        return pos==target;
+    }
+    z_stream zs;
+    const uint8_t* in;
+    uint64_t inLeft;
+    /** \brief number of bytes inflated so far */
+    uint64_t pos;
+    bool ok;
+    bool finished;
+};
+#endif
+
+/*! \brief returns the inflated header of the compressed top-level element at \a offset, or NULL (e.g. without zlib)
+    \internal
+
+    The header is inflated on the first call and kept until the file is closed.
+ */
+static const TinyMATReaderCompressedHeader* TinyMATReader_getCompressedHeader(const TinyMATReaderFile* mat, uint64_t offset) {
+#ifdef TINYMAT_USES_ZLIB
+    std::lock_guard<std::mutex> lock(mat->compressedMutex);
+    auto it=mat->compressedHeaders.find(offset);
+    if (it!=mat->compressedHeaders.end()) return it->second.get();
+    TinyMATReaderTag tag;
+    if (!TinyMATReader_readTag(mat, offset, mat->size, tag) || tag.type!=TINYMAT_READER_miCOMPRESSED) return NULL;
+    std::unique_ptr<TinyMATReaderCompressedHeader> h(new TinyMATReaderCompressedHeader);
+    TinyMATReaderInflater inflater(mat->data+tag.data, tag.bytes);
+    // inflate more and more, until the header can be parsed
+    uint64_t size=256;
+    bool ok=false;
+    std::vector<uint8_t> raw;
+    while (!ok && inflater.ok) {
+        const uint64_t have=raw.size();
+        raw.resize(static_cast<size_t>(size));
+        raw.resize(static_cast<size_t>(have+inflater.read(raw.data()+have, size-have)));
+        h->header=raw;
+        if (mat->swapped) TinyMAT_swapElements(h->header.data(), h->header.size(), true);
+        TinyMATReaderFile view;
+        view.data=h->header.data();
+        view.size=h->header.size();
+        TinyMATReaderTag element;
+        if (view.size>=8) {
+            element.type=TinyMATReader_U32(view.data);
+            element.bytes=TinyMATReader_U32(view.data+4);
+            element.data=8;
+            element.next=8+element.bytes;
+            if (element.type!=TINYMAT_READER_miMATRIX) break;
+            h->real.bytes=0;
+            ok=TinyMATReader_parseMatrix(&view, element, &(h->array), &(h->real));
+        }
+        if (ok || inflater.finished || size>=TINYMAT_READER_MAXHEADER) break;
+        size=size*4;
+    }
+    if (!ok) return NULL;
+    const TinyMATReaderCompressedHeader* res=h.get();
+    mat->compressedHeaders[offset]=std::move(h);
+    return res;
+#else
+    (void)mat;
+    (void)offset;
+    return NULL;
+#endif
+}
+
+bool TinyMATReader_readArray(const TinyMATReaderFile* mat, uint64_t offset, TinyMATReaderArray* array) {
+    TinyMATReaderTag tag;
+    if (!mat || !array || offset<TINYMAT_READER_HEADERSIZE || !TinyMATReader_readTag(mat, offset, mat->size, tag)) return false;
+    array->offset=offset;
+    array->size=tag.data+tag.bytes-offset;
+    if (tag.type==TINYMAT_READER_miCOMPRESSED) {
+        const TinyMATReaderCompressedHeader* h=TinyMATReader_getCompressedHeader(mat, offset);
+        if (h) {
+            *array=h->array;
+        } else {
+            memset(array, 0, sizeof(TinyMATReaderArray));
+            array->name="";
+        }
+        array->offset=offset;
+        array->size=tag.data+tag.bytes-offset;
+        array->compressed=true;
+        return true;
+    }
+    if (tag.type!=TINYMAT_READER_miMATRIX) return false;
+    return TinyMATReader_parseMatrix(mat, tag, array);
+}
+
+/*! \brief reads only the name of the top-level miMATRIX element at \a offset (without touching its data)
+    \internal
+ */
+static bool TinyMATReader_readName(const TinyMATReaderFile* mat, uint64_t offset, const char** name, uint32_t* nameLength) {
+    TinyMATReaderTag tag, sub;
+    if (!TinyMATReader_readTag(mat, offset, mat->size, tag) || tag.type!=TINYMAT_READER_miMATRIX) return false;
+    const uint64_t end=tag.data+tag.bytes;
+    // skip array flags and dimensions
+    if (!TinyMATReader_readTag(mat, tag.data, end, sub) || !TinyMATReader_readTag(mat, sub.next, end, sub)) return false;
+    if (!TinyMATReader_readTag(mat, sub.next, end, sub) || sub.type!=TINYMAT_READER_miINT8) return false;
+    *name=reinterpret_cast<const char*>(mat->data+sub.data);
+    *nameLength=static_cast<uint32_t>(strnlen(*name, static_cast<size_t>(sub.bytes)));
+    return true;
+}
+
+/*! \brief loads the index from the variable TINYMAT_INDEX_NAME at the end of the file (see TinyMATWriter_setWriteIndex() )
+    \internal
+ */
+static bool TinyMATReader_loadTrailingIndex(TinyMATReaderFile* mat) {
+    if (mat->size<TINYMAT_READER_HEADERSIZE+8) return false;
+    uint64_t self=0;
+    memcpy(&self, mat->data+mat->size-8, sizeof(self));
+    TinyMATReaderArray idx, names, offsets;
+    if (self<TINYMAT_READER_HEADERSIZE || self>=mat->size-8 || !TinyMATReader_readArray(mat, self, &idx)) return false;
+    if (idx.offset+idx.size!=mat->size || TinyMATReader_getName(idx)!=TINYMAT_INDEX_NAME) return false;
+    if (!TinyMATReader_getField(mat, idx, "names", &names) || !TinyMATReader_getField(mat, idx, "offsets", &offsets)) return false;
+    const uint64_t* o=TinyMATReader_data<uint64_t>(offsets);
+    const uint64_t n=TinyMATReader_numel(offsets);
+    if (names.mxClass!=TinyMATClass::Cell || TinyMATReader_numel(names)!=n || (n>0 && !o)) return false;
+    // walk the cells one after the other (TinyMATReader_getCell() would start at the first cell every time)
+    const uint64_t end=names.offset+names.size;
+    uint64_t offset=names.contentOffset;
+    TinyMATReaderArray name;
+    for (uint64_t i=0; i<n; i++) {
+        if (!TinyMATReader_readSubArray(mat, offset, end, &name, &offset) || o[i]<TINYMAT_READER_HEADERSIZE || o[i]>=self) {
+            mat->index.clear();
+            return false;
+        }
+        mat->index.emplace(TinyMATReader_getString(name), o[i]);
+    }
+    // the index does not list itself
+    mat->index.emplace(TINYMAT_INDEX_NAME, self);
+    return true;
+}
+
+/** \brief builds the index of \a mat by walking all top-level tags (only the names are read) */
+static void TinyMATReader_scanIndex(TinyMATReaderFile* mat) {
+    const char* name=NULL;
+    uint32_t nameLength=0;
+    for (uint64_t offset=TinyMATReader_firstElement(mat); offset>0; offset=TinyMATReader_nextElement(mat, offset)) {
+        if (TinyMATReader_readName(mat, offset, &name, &nameLength)) {
+            mat->index.emplace(std::string(name, nameLength), offset);
+        } else if (const TinyMATReaderCompressedHeader* h=TinyMATReader_getCompressedHeader(mat, offset)) {
+            mat->index.emplace(TinyMATReader_getName(h->array), offset);
+        }
+    }
+}
+
+bool TinyMATReader_buildIndex(TinyMATReaderFile* mat) {
+    if (!mat) return false;
+    std::lock_guard<std::mutex> lock(mat->indexMutex);
+    if (mat->indexed) return true;
+    if (!TinyMATReader_loadTrailingIndex(mat)) {
+        TinyMATReader_scanIndex(mat);
+    }
+    mat->indexed=true;
+    return true;
+}
+
+bool TinyMATReader_find(TinyMATReaderFile* mat, const char* name, TinyMATReaderArray* array) {
+    if (!mat || !name) return false;
+    TinyMATReader_buildIndex(mat);
+    auto it=mat->index.find(name);
+    if (it==mat->index.end()) return false;
+    TinyMATReaderArray a;
+    if (!TinyMATReader_readArray(mat, it->second, &a) || TinyMATReader_getName(a)!=name) return false;
+    if (array) *array=a;
+    return true;
+}
+
+bool TinyMATReader_saveIndex(TinyMATReaderFile* mat, const char* filename) {
+    if (!mat || !filename) return false;
+    TinyMATReader_buildIndex(mat);
+    std::vector<std::pair<uint64_t, std::string> > entries;
+    entries.reserve(mat->index.size());
+    for (const auto& e: mat->index) entries.push_back(std::make_pair(e.second, e.first));
+    std::sort(entries.begin(), entries.end());
+    std::vector<std::string> names;
+    std::vector<uint64_t> offsets;
+    names.reserve(entries.size());
+    offsets.reserve(entries.size());
+    for (const auto& e: entries) {
+        offsets.push_back(e.first);
+        names.push_back(e.second);
+    }
+    TinyMATWriterFile* sidecar=TinyMATWriter_open(filename);
+    if (!sidecar) return false;
+    const int32_t dims[2]={static_cast<int32_t>(offsets.size()), 1};
+    const int32_t scalar[2]={1, 1};
+    TinyMATWriter_writeStringVector(sidecar, "names", names);
+    TinyMATWriter_writeMatrixND_colmajor(sidecar, "offsets", offsets.data(), dims, 2);
+    TinyMATWriter_writeMatrixND_colmajor(sidecar, "filesize", &(mat->size), scalar, 2);
+    return TinyMATWriter_closeChecked(sidecar);
+}
+
+bool TinyMATReader_loadIndex(TinyMATReaderFile* mat, const char* filename) {
+    if (!mat || !filename) return false;
+    TinyMATReaderFile* sidecar=TinyMATReader_open(filename);
+    if (!sidecar) return false;
+    bool ok=false;
+    TinyMATReaderArray names, offsets, filesize;
+    if (TinyMATReader_find(sidecar, "names", &names) && TinyMATReader_find(sidecar, "offsets", &offsets) && TinyMATReader_find(sidecar, "filesize", &filesize)) {
+        const uint64_t* o=TinyMATReader_data<uint64_t>(offsets);
+        const uint64_t* fs=TinyMATReader_data<uint64_t>(filesize);
+        const uint64_t n=TinyMATReader_numel(offsets);
+        // an index for a different version of the file is not used
+        ok=(fs && *fs==mat->size && names.mxClass==TinyMATClass::Cell && TinyMATReader_numel(names)==n && (n==0 || o));
+        std::unordered_map<std::string, uint64_t> index;
+        const uint64_t end=names.offset+names.size;
+        uint64_t offset=names.contentOffset;
+        TinyMATReaderArray name;
+        for (uint64_t i=0; ok && i<n; i++) {
+            ok=TinyMATReader_readSubArray(sidecar, offset, end, &name, &offset) && o[i]>=TINYMAT_READER_HEADERSIZE && o[i]<mat->size;
+            if (ok) index.emplace(TinyMATReader_getString(name), o[i]);
+        }
+        if (ok) {
+            std::lock_guard<std::mutex> lock(mat->indexMutex);
+            mat->index.swap(index);
+            mat->indexed=true;
+        }
+    }
+    TinyMATReader_close(sidecar);
+    return ok;
+}
+
+std::vector<std::string> TinyMATReader_listVariables(const TinyMATReaderFile* mat) {
+    std::vector<std::string> res;
+    TinyMATReaderArray a;
+    for (uint64_t offset=TinyMATReader_firstElement(mat); offset>0; offset=TinyMATReader_nextElement(mat, offset)) {
+        if (TinyMATReader_readArray(mat, offset, &a) && a.nameLength>0) res.push_back(TinyMATReader_getName(a));
+    }
+    return res;
+}
+
+bool TinyMATReader_getCell(const TinyMATReaderFile* mat, const TinyMATReaderArray& cell, uint64_t index, TinyMATReaderArray* element) {
+    if (!mat || cell.mxClass!=TinyMATClass::Cell || index>=TinyMATReader_numel(cell)) return false;
+    const uint64_t end=cell.offset+cell.size;
+    uint64_t offset=cell.contentOffset;
+    for (uint64_t i=0; i<index; i++) {
+        if (!TinyMATReader_readSubArray(mat, offset, end, NULL, &offset)) return false;
+    }
+    return TinyMATReader_readSubArray(mat, offset, end, element, NULL);
+}
+
+/** \brief reads the field name table of \a str: returns the length of each name, their number and the offset of the first field */
+static bool TinyMATReader_readFieldTable(const TinyMATReaderFile* mat, const TinyMATReaderArray& str, uint32_t* nameLength, const char** names, uint64_t* fields, uint64_t* first) {
+    if (!mat || (str.mxClass!=TinyMATClass::Struct && str.mxClass!=TinyMATClass::Object)) return false;
+    const uint64_t end=str.offset+str.size;
+    TinyMATReaderTag tag;
+    uint64_t offset=str.contentOffset;
+    // objects have a class name before the field names
+    if (str.mxClass==TinyMATClass::Object) {
+        if (!TinyMATReader_readTag(mat, offset, end, tag) || tag.type!=TINYMAT_READER_miINT8) return false;
+        offset=tag.next;
+    }
+    if (!TinyMATReader_readTag(mat, offset, end, tag) || tag.type!=TINYMAT_READER_miINT32 || tag.bytes!=4) return false;
+    *nameLength=TinyMATReader_U32(mat->data+tag.data);
+    if (!TinyMATReader_readTag(mat, tag.next, end, tag) || tag.type!=TINYMAT_READER_miINT8) return false;
+    if (*nameLength==0) {
+        *fields=0;
+    } else {
+        if ((tag.bytes%(*nameLength))!=0) return false;
+        *fields=tag.bytes/(*nameLength);
+    }
+    *names=reinterpret_cast<const char*>(mat->data+tag.data);
+    *first=tag.next;
+    return true;
+}
+
+std::vector<std::string> TinyMATReader_getFieldNames(const TinyMATReaderFile* mat, const TinyMATReaderArray& str) {
+    std::vector<std::string> res;
+    uint32_t nameLength=0;
+    const char* names=NULL;
+    uint64_t fields=0, first=0;
+    if (TinyMATReader_readFieldTable(mat, str, &nameLength, &names, &fields, &first)) {
+        for (uint64_t f=0; f<fields; f++) {
+            const char* n=names+f*nameLength;
+            res.push_back(std::string(n, strnlen(n, nameLength)));
+        }
+    }
+    return res;
+}
+
+bool TinyMATReader_getField(const TinyMATReaderFile* mat, const TinyMATReaderArray& str, const char* field, TinyMATReaderArray* element, uint64_t index) {
+    uint32_t nameLength=0;
+    const char* names=NULL;
+    uint64_t fields=0, offset=0;
+    if (!field || !TinyMATReader_readFieldTable(mat, str, &nameLength, &names, &fields, &offset) || index>=TinyMATReader_numel(str)) return false;
+    const size_t len=strlen(field);
+    uint64_t f=0;
+    while (f<fields && !(strnlen(names+f*nameLength, nameLength)==len && memcmp(names+f*nameLength, field, len)==0)) f++;
+    if (f>=fields) return false;
+    // the fields are stored element by element
+    const uint64_t end=str.offset+str.size;
+    const uint64_t skip=index*fields+f;
+    for (uint64_t i=0; i<skip; i++) {
+        if (!TinyMATReader_readSubArray(mat, offset, end, NULL, &offset)) return false;
+    }
+    return TinyMATReader_readSubArray(mat, offset, end, element, NULL);
+}
+
+std::string TinyMATReader_getName(const TinyMATReaderArray& array) {
+    if (!array.name) return std::string();
+    return std::string(array.name, strnlen(array.name, array.nameLength));
+}
+
+/** \brief appends the character \a c to \a s, encoded as UTF-8 for \a c>255 */
+static void TinyMATReader_appendChar(std::string& s, uint32_t c) {
+    if (c<0x100) {
+        s.push_back(static_cast<char>(c));
+    } else if (c<0x800) {
+        s.push_back(static_cast<char>(0xC0|(c>>6)));
+        s.push_back(static_cast<char>(0x80|(c&0x3F)));
+    } else if (c<0x10000) {
+        s.push_back(static_cast<char>(0xE0|(c>>12)));
+        s.push_back(static_cast<char>(0x80|((c>>6)&0x3F)));
+        s.push_back(static_cast<char>(0x80|(c&0x3F)));
+    } else {
+        s.push_back(static_cast<char>(0xF0|(c>>18)));
+        s.push_back(static_cast<char>(0x80|((c>>12)&0x3F)));
+        s.push_back(static_cast<char>(0x80|((c>>6)&0x3F)));
+        s.push_back(static_cast<char>(0x80|(c&0x3F)));
+    }
+}
+
+std::string TinyMATReader_getString(const TinyMATReaderArray& array) {
+    std::string res;
+    if (array.mxClass!=TinyMATClass::Char || !array.real) return res;
+    const uint8_t* d=static_cast<const uint8_t*>(array.real);
+    switch (array.type) {
+        case TinyMATDataType::Int8:
+        case TinyMATDataType::UInt8:
+        case TinyMATDataType::UTF8:
+            res.assign(reinterpret_cast<const char*>(d), static_cast<size_t>(array.realBytes));
+            break;
+        case TinyMATDataType::Int16:
+        case TinyMATDataType::UInt16:
+        case TinyMATDataType::UTF16:
+            res.reserve(static_cast<size_t>(array.realBytes/2));
+            for (uint64_t i=0; i+1<array.realBytes; i+=2) {
+                uint16_t c;
+                memcpy(&c, d+i, 2);
+                TinyMATReader_appendChar(res, c);
+            }
+            break;
+        case TinyMATDataType::Int32:
+        case TinyMATDataType::UInt32:
+        case TinyMATDataType::UTF32:
+            res.reserve(static_cast<size_t>(array.realBytes/4));
+            for (uint64_t i=0; i+3<array.realBytes; i+=4) {
+                TinyMATReader_appendChar(res, TinyMATReader_U32(d+i));
+            }
+            break;
+        default:
+            break;
+    }
+    return res;
+}
+
+uint64_t TinyMATReader_numel(const TinyMATReaderArray& array) {
+    if (!array.dims || array.ndims==0) return 0;
+    uint64_t n=1;
+    for (uint32_t i=0; i<array.ndims; i++) {
+        if (array.dims[i]<=0) return 0;
+        n=n*static_cast<uint64_t>(array.dims[i]);
+    }
+    return n;
+}
+
+uint32_t TinyMATReader_dataTypeSize(TinyMATDataType type) {
+    switch (type) {
+        case TinyMATDataType::Int8:
+        case TinyMATDataType::UInt8:
+        case TinyMATDataType::UTF8:
+            return 1;
+        case TinyMATDataType::Int16:
+        case TinyMATDataType::UInt16:
+        case TinyMATDataType::UTF16:
+            return 2;
+        case TinyMATDataType::Int32:
+        case TinyMATDataType::UInt32:
+        case TinyMATDataType::Single:
+        case TinyMATDataType::UTF32:
+            return 4;
+        case TinyMATDataType::Int64:
+        case TinyMATDataType::UInt64:
+        case TinyMATDataType::Double:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/*! \brief converts a value to the integer type \a D, saturating (and rounding floating-point values), as Matlab does. NaN becomes 0.
+    \internal
+ */
+template<typename D, typename S>
+inline D TinyMATReader_castInt(S v, std::true_type /*S is integral*/) {
+    if (std::is_signed<S>::value && v<0) {
+        if (!std::is_signed<D>::value) return 0;
+        if (static_cast<int64_t>(v)<static_cast<int64_t>(std::numeric_limits<D>::min())) return std::numeric_limits<D>::min();
+        return static_cast<D>(v);
+    }
+    if (static_cast<uint64_t>(v)>static_cast<uint64_t>(std::numeric_limits<D>::max())) return std::numeric_limits<D>::max();
+    return static_cast<D>(v);
+}
+
+template<typename D, typename S>
+inline D TinyMATReader_castInt(S v, std::false_type /*S is floating-point*/) {
+    if (v!=v) return 0;
+    // both limits are powers of two (or off by one), so the comparisons are exact
+    if (v>=static_cast<S>(std::numeric_limits<D>::max())) return std::numeric_limits<D>::max();
+    if (v<=static_cast<S>(std::numeric_limits<D>::min())) return std::numeric_limits<D>::min();
+    return static_cast<D>(std::round(v));
+}
+
+template<typename D, typename S>
+inline D TinyMATReader_cast(S v, std::true_type /*D is integral*/) {
+    return TinyMATReader_castInt<D>(v, typename std::is_integral<S>::type());
+}
+
+template<typename D, typename S>
+inline D TinyMATReader_cast(S v, std::false_type /*D is floating-point*/) {
+    return static_cast<D>(v);
+}
+
+/*! \brief vectorized part of TinyMATReaderConverter: converts the first values and returns how many were converted
+    \internal
+ */
+template<typename S, typename D>
+struct TinyMATReaderSIMDConverter {
+    static uint64_t convert(const uint8_t* /*src*/, D* /*dest*/, uint64_t /*n*/) { return 0; }
+};
+
+#ifdef TINYMAT_HAS_SSE2
+/** \brief stores the 4 int32 values \a v as double \internal */
+inline void TinyMATReader_store4(double* dest, __m128i v) {
+    _mm_storeu_pd(dest, _mm_cvtepi32_pd(v));
+    _mm_storeu_pd(dest+2, _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,3,2))));
+}
+
+/** \brief stores the 4 int32 values \a v as float \internal */
+inline void TinyMATReader_store4(float* dest, __m128i v) {
+    _mm_storeu_ps(dest, _mm_cvtepi32_ps(v));
+}
+
+/** \brief stores the 8 int16 values \a v (sign- or zero-extended) \internal */
+template<bool SIGNED, typename D>
+inline void TinyMATReader_store8(D* dest, __m128i v) {
+    if (SIGNED) {
+        TinyMATReader_store4(dest, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        TinyMATReader_store4(dest+4, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    } else {
+        const __m128i zero=_mm_setzero_si128();
+        TinyMATReader_store4(dest, _mm_unpacklo_epi16(v, zero));
+        TinyMATReader_store4(dest+4, _mm_unpackhi_epi16(v, zero));
+    }
+}
+
+template<typename D>
+struct TinyMATReaderSIMDConverter<uint8_t, D> {
+    static uint64_t convert(const uint8_t* src, D* dest, uint64_t n) {
+        const __m128i zero=_mm_setzero_si128();
+        uint64_t i=0;
+        for (; i+16<=n; i+=16) {
+            const __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+i));
+            TinyMATReader_store8<false>(dest+i, _mm_unpacklo_epi8(v, zero));
+            TinyMATReader_store8<false>(dest+i+8, _mm_unpackhi_epi8(v, zero));
+        }
+        return i;
+    }
+};
+
+template<typename D>
+struct TinyMATReaderSIMDConverter<int8_t, D> {
+    static uint64_t convert(const uint8_t* src, D* dest, uint64_t n) {
+        uint64_t i=0;
+        for (; i+16<=n; i+=16) {
+            const __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+i));
+            TinyMATReader_store8<true>(dest+i, _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8));
+            TinyMATReader_store8<true>(dest+i+8, _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8));
+        }
+        return i;
+    }
+};
+
+template<typename D>
+struct TinyMATReaderSIMDConverter<int16_t, D> {
+    static uint64_t convert(const uint8_t* src, D* dest, uint64_t n) {
+        uint64_t i=0;
+        for (; i+8<=n; i+=8) {
+            TinyMATReader_store8<true>(dest+i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src+2*i)));
+        }
+        return i;
+    }
+};
+
+template<typename D>
+struct TinyMATReaderSIMDConverter<uint16_t, D> {
+    static uint64_t convert(const uint8_t* src, D* dest, uint64_t n) {
+        uint64_t i=0;
+        for (; i+8<=n; i+=8) {
+            TinyMATReader_store8<false>(dest+i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src+2*i)));
+        }
+        return i;
+    }
+};
+
+template<typename D>
+struct TinyMATReaderSIMDConverter<int32_t, D> {
+    static uint64_t convert(const uint8_t* src, D* dest, uint64_t n) {
+        uint64_t i=0;
+        for (; i+4<=n; i+=4) {
+            TinyMATReader_store4(dest+i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src+4*i)));
+        }
+        return i;
+    }
+};
+
+template<>
+struct TinyMATReaderSIMDConverter<float, double> {
+    static uint64_t convert(const uint8_t* src, double* dest, uint64_t n) {
+        uint64_t i=0;
+        for (; i+4<=n; i+=4) {
+            const __m128 v=_mm_loadu_ps(reinterpret_cast<const float*>(src+4*i));
+            _mm_storeu_pd(dest+i, _mm_cvtps_pd(v));
+            _mm_storeu_pd(dest+i+2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+        return i;
+    }
+};
+
+template<>
+struct TinyMATReaderSIMDConverter<double, float> {
+    static uint64_t convert(const uint8_t* src, float* dest, uint64_t n) {
+        uint64_t i=0;
+        for (; i+4<=n; i+=4) {
+            const __m128 lo=_mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double*>(src+8*i)));
+            const __m128 hi=_mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double*>(src+8*i+16)));
+            _mm_storeu_ps(dest+i, _mm_movelh_ps(lo, hi));
+        }
+        return i;
+    }
+};
+
+// the integer kernels above only exist for floating-point destinations
+#define TINYMAT_READER_NOSIMD(S, D) \
+template<> \
+struct TinyMATReaderSIMDConverter<S, D> { \
+    static uint64_t convert(const uint8_t* /*src*/, D* /*dest*/, uint64_t /*n*/) { return 0; } \
+};
+#define TINYMAT_READER_NOSIMD_INT(S) \
+    TINYMAT_READER_NOSIMD(S, int8_t) TINYMAT_READER_NOSIMD(S, uint8_t) TINYMAT_READER_NOSIMD(S, int16_t) TINYMAT_READER_NOSIMD(S, uint16_t) \
+    TINYMAT_READER_NOSIMD(S, int32_t) TINYMAT_READER_NOSIMD(S, uint32_t) TINYMAT_READER_NOSIMD(S, int64_t) TINYMAT_READER_NOSIMD(S, uint64_t)
+TINYMAT_READER_NOSIMD_INT(uint8_t)
+TINYMAT_READER_NOSIMD_INT(int8_t)
+TINYMAT_READER_NOSIMD_INT(int16_t)
+TINYMAT_READER_NOSIMD_INT(uint16_t)
+TINYMAT_READER_NOSIMD_INT(int32_t)
+#undef TINYMAT_READER_NOSIMD_INT
+#undef TINYMAT_READER_NOSIMD
+#endif
+
+/*! \brief converts \a n values of type \a S at \a src (not necessarily aligned) to \a D
+    \internal
+ */
+template<typename S, typename D>
+static void TinyMATReader_convertValues(const uint8_t* src, D* dest, uint64_t n) {
+    uint64_t i=TinyMATReaderSIMDConverter<S, D>::convert(src, dest, n);
+    for (; i<n; i++) {
+        S v;
+        memcpy(&v, src+i*sizeof(S), sizeof(S));
+        dest[i]=TinyMATReader_cast<D>(v, typename std::is_integral<D>::type());
+    }
+}
+
+template<typename S>
+static bool TinyMATReader_convertFrom(const uint8_t* src, void* dest, TinyMATDataType destType, uint64_t n) {
+    switch (destType) {
+        case TinyMATDataType::Int8: TinyMATReader_convertValues<S>(src, static_cast<int8_t*>(dest), n); return true;
+        case TinyMATDataType::UInt8: TinyMATReader_convertValues<S>(src, static_cast<uint8_t*>(dest), n); return true;
+        case TinyMATDataType::Int16: TinyMATReader_convertValues<S>(src, static_cast<int16_t*>(dest), n); return true;
+        case TinyMATDataType::UInt16: TinyMATReader_convertValues<S>(src, static_cast<uint16_t*>(dest), n); return true;
+        case TinyMATDataType::Int32: TinyMATReader_convertValues<S>(src, static_cast<int32_t*>(dest), n); return true;
+        case TinyMATDataType::UInt32: TinyMATReader_convertValues<S>(src, static_cast<uint32_t*>(dest), n); return true;
+        case TinyMATDataType::Int64: TinyMATReader_convertValues<S>(src, static_cast<int64_t*>(dest), n); return true;
+        case TinyMATDataType::UInt64: TinyMATReader_convertValues<S>(src, static_cast<uint64_t*>(dest), n); return true;
+        case TinyMATDataType::Single: TinyMATReader_convertValues<S>(src, static_cast<float*>(dest), n); return true;
+        case TinyMATDataType::Double: TinyMATReader_convertValues<S>(src, static_cast<double*>(dest), n); return true;
+        default: return false;
+    }
+}
+
+bool TinyMATReader_convert(const void* src, TinyMATDataType srcType, void* dest, TinyMATDataType destType, uint64_t count) {
+    if (!src || !dest || TinyMATReader_dataTypeSize(srcType)==0 || TinyMATReader_dataTypeSize(destType)==0) return false;
+    const uint8_t* s=static_cast<const uint8_t*>(src);
+    if (srcType==destType) {
+        memmove(dest, src, static_cast<size_t>(count*TinyMATReader_dataTypeSize(srcType)));
+        return true;
+    }
+    switch (srcType) {
+        case TinyMATDataType::Int8: return TinyMATReader_convertFrom<int8_t>(s, dest, destType, count);
+        case TinyMATDataType::UInt8:
+        case TinyMATDataType::UTF8: return TinyMATReader_convertFrom<uint8_t>(s, dest, destType, count);
+        case TinyMATDataType::Int16: return TinyMATReader_convertFrom<int16_t>(s, dest, destType, count);
+        case TinyMATDataType::UInt16:
+        case TinyMATDataType::UTF16: return TinyMATReader_convertFrom<uint16_t>(s, dest, destType, count);
+        case TinyMATDataType::Int32: return TinyMATReader_convertFrom<int32_t>(s, dest, destType, count);
+        case TinyMATDataType::UInt32:
+        case TinyMATDataType::UTF32: return TinyMATReader_convertFrom<uint32_t>(s, dest, destType, count);
+        case TinyMATDataType::Int64: return TinyMATReader_convertFrom<int64_t>(s, dest, destType, count);
+        case TinyMATDataType::UInt64: return TinyMATReader_convertFrom<uint64_t>(s, dest, destType, count);
+        case TinyMATDataType::Single: return TinyMATReader_convertFrom<float>(s, dest, destType, count);
+        case TinyMATDataType::Double: return TinyMATReader_convertFrom<double>(s, dest, destType, count);
+        default: return false;
+    }
+}
+
+/*! \brief calls \a run(first, n) for all runs of \a n contiguous elements (starting at the column-major index \a first),
+           that make up the hyperslab, in the order of the file. Adjacent runs are joined into one.
+    \internal
+
+    \return \c false, if the hyperslab does not fit into \a array, or if \a run returned \c false
+ */
+template<typename RUN>
+static bool TinyMATReader_forEachRun(const TinyMATReaderArray& array, const int32_t* start, const int32_t* count, const int32_t* stride, RUN run) {
+    const uint32_t nd=array.ndims;
+    if (nd==0 || !array.dims || !start || !count) return false;
+    std::vector<uint64_t> lin(nd, 1), idx(nd, 0);
+    for (uint32_t d=0; d<nd; d++) {
+        const int32_t st=stride?stride[d]:1;
+        if (start[d]<0 || count[d]<0 || st<1) return false;
+        if (count[d]==0) return true;
+        if (static_cast<int64_t>(start[d])+static_cast<int64_t>(count[d]-1)*st>=array.dims[d]) return false;
+        if (d>0) lin[d]=lin[d-1]*static_cast<uint64_t>(array.dims[d-1]);
+    }
+    const uint64_t stride0=stride?static_cast<uint64_t>(stride[0]):1;
+    const uint64_t count0=static_cast<uint64_t>(count[0]);
+    uint64_t pendingFirst=0, pendingN=0;
+    auto emit=[&](uint64_t first, uint64_t n) -> bool {
+        if (pendingN>0 && first==pendingFirst+pendingN) {
+            pendingN+=n;
+            return true;
+        }
+        if (pendingN>0 && !run(pendingFirst, pendingN)) return false;
+        pendingFirst=first;
+        pendingN=n;
+        return true;
+    };
+    while (true) {
+        uint64_t base=static_cast<uint64_t>(start[0]);
+        for (uint32_t d=1; d<nd; d++) {
+            base+=(static_cast<uint64_t>(start[d])+idx[d]*static_cast<uint64_t>(stride?stride[d]:1))*lin[d];
+        }
+        if (stride0==1) {
+            if (!emit(base, count0)) return false;
+        } else {
+            for (uint64_t k=0; k<count0; k++) {
+                if (!emit(base+k*stride0, 1)) return false;
+            }
+        }
+        uint32_t d=1;
+        while (d<nd) {
+            idx[d]++;
+            if (idx[d]<static_cast<uint64_t>(count[d])) break;
+            idx[d]=0;
+            d++;
+        }
+        if (d>=nd) break;
+    }
+    return pendingN==0 || run(pendingFirst, pendingN);
+}
+
+bool TinyMATReader_readHyperslab(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, const int32_t* start, const int32_t* count, const int32_t* stride, void* dest, uint64_t destBytes, bool imag) {
+    return TinyMATReader_readHyperslabAs(mat, array, start, count, stride, imag?(array.compressed?array.type:array.imagType):array.type, dest, destBytes, imag);
+}
+
+bool TinyMATReader_readHyperslabAs(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, const int32_t* start, const int32_t* count, const int32_t* stride, TinyMATDataType destType, void* dest, uint64_t destBytes, bool imag) {
+    if (!mat || !dest) return false;
+    const uint8_t c=static_cast<uint8_t>(array.mxClass);
+    if (c<static_cast<uint8_t>(TinyMATClass::Char) || c>static_cast<uint8_t>(TinyMATClass::UInt64) || array.mxClass==TinyMATClass::Sparse) return false;
+    if (imag && !array.complex) return false;
+    const TinyMATDataType srcType=imag?(array.compressed?array.type:array.imagType):array.type;
+    const uint64_t esize=TinyMATReader_dataTypeSize(srcType);
+    const uint64_t dsize=TinyMATReader_dataTypeSize(destType);
+    if (esize==0 || dsize==0 || TinyMATReader_numel(array)*esize>array.realBytes) return false;
+    uint64_t slab=1;
+    for (uint32_t d=0; d<array.ndims; d++) slab=slab*static_cast<uint64_t>(count[d]>0?count[d]:0);
+    if (slab*dsize>destBytes) return false;
+    uint8_t* out=static_cast<uint8_t*>(dest);
+
+    if (!array.compressed) {
+        const uint8_t* src=static_cast<const uint8_t*>(imag?array.imag:array.real);
+        if (!src) return false;
+        // converted directly from the mapped file
+        return TinyMATReader_forEachRun(array, start, count, stride, [&](uint64_t first, uint64_t n) {
+            TinyMATReader_convert(src+first*esize, srcType, out, destType, n);
+            out+=n*dsize;
+            return true;
+        });
+    }
+#ifdef TINYMAT_USES_ZLIB
+    const TinyMATReaderCompressedHeader* h=TinyMATReader_getCompressedHeader(mat, array.offset);
+    TinyMATReaderTag tag;
+    if (!h || !TinyMATReader_readTag(mat, array.offset, mat->size, tag)) return false;
+    // the data is inflated up to the last element of the hyperslab, everything before the first element is skipped
+    TinyMATReaderInflater inflater(mat->data+tag.data, tag.bytes);
+    uint64_t data=h->real.data;
+    if (imag) {
+        uint8_t t[8];
+        if (!inflater.skipTo(h->real.next) || inflater.read(t, 8)!=8) return false;
+        const uint32_t t0=mat->swapped?TinyMAT_bswap32(TinyMATReader_U32(t)):TinyMATReader_U32(t);
+        const uint32_t type=((t0>>16)!=0)?(t0&0xFFFF):t0;
+        if (static_cast<TinyMATDataType>(type)!=array.type) return false;
+        data=h->real.next+(((t0>>16)!=0)?4:8);
+    }
+    if (srcType==destType) {
+        return TinyMATReader_forEachRun(array, start, count, stride, [&](uint64_t first, uint64_t n) {
+            if (!inflater.skipTo(data+first*esize) || inflater.read(out, n*esize)!=n*esize) return false;
+            if (mat->swapped) TinyMAT_swapBytes(out, n, static_cast<uint32_t>(esize));
+            out+=n*esize;
+            return true;
+        });
+    }
+    // the inflated values are converted in blocks, that fit into the cache
+    uint8_t block[16*1024];
+    const uint64_t blockValues=sizeof(block)/esize;
+    return TinyMATReader_forEachRun(array, start, count, stride, [&](uint64_t first, uint64_t n) {
+        if (!inflater.skipTo(data+first*esize)) return false;
+        while (n>0) {
+            const uint64_t m=std::min(n, blockValues);
+            if (inflater.read(block, m*esize)!=m*esize) return false;
+            if (mat->swapped) TinyMAT_swapBytes(block, m, static_cast<uint32_t>(esize));
+            TinyMATReader_convert(block, srcType, out, destType, m);
+            out+=m*dsize;
+            n-=m;
+        }
+        return true;
+    });
+#else
+    return false;
+#endif
+}
+
+bool TinyMATReader_readAs(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATDataType destType, void* dest, uint64_t destBytes, bool imag) {
+    if (array.ndims==0 || !array.dims) return false;
+    std::vector<int32_t> start(array.ndims, 0);
+    return TinyMATReader_readHyperslabAs(mat, array, start.data(), array.dims, NULL, destType, dest, destBytes, imag);
+}
+
+/*! \brief inflates the complete compressed top-level element at \a offset into \a buf (which then starts with the miMATRIX tag)
+    \internal
+ */
+static bool TinyMATReader_inflateElement(const TinyMATReaderFile* mat, uint64_t offset, std::vector<uint8_t>& buf) {
+#ifdef TINYMAT_USES_ZLIB
+    TinyMATReaderTag tag;
+    if (!TinyMATReader_readTag(mat, offset, mat->size, tag) || tag.type!=TINYMAT_READER_miCOMPRESSED) return false;
+    TinyMATReaderInflater inflater(mat->data+tag.data, tag.bytes);
+    buf.resize(8);
+    if (inflater.read(buf.data(), 8)!=8) return false;
+    if (mat->swapped) TinyMAT_swapBytes(buf.data(), 2, 4);
+    if (TinyMATReader_U32(buf.data())!=TINYMAT_READER_miMATRIX) return false;
+    const uint64_t bytes=TinyMATReader_U32(buf.data()+4);
+    try {
+        buf.resize(static_cast<size_t>(8+bytes));
+    } catch (std::bad_alloc&) {
+        return false;
+    }
+    if (inflater.read(buf.data()+8, bytes)!=bytes) return false;
+    // the tag is swapped already
+    if (mat->swapped) TinyMAT_swapElements(buf.data()+8, bytes, true, false);
+    return true;
+#else
+    (void)mat;
+    (void)offset;
+    (void)buf;
+    return false;
+#endif
+}
+
+bool TinyMATReader_readVariables(const TinyMATReaderFile* mat, TinyMATReaderVariableCallback callback, unsigned threads, const std::vector<std::string>* names) {
+    if (!mat || !callback) return false;
+    std::vector<TinyMATReaderArray> tasks;
+    TinyMATReaderArray a;
+    for (uint64_t offset=TinyMATReader_firstElement(mat); offset>0; offset=TinyMATReader_nextElement(mat, offset)) {
+        if (!TinyMATReader_readArray(mat, offset, &a)) continue;
+        if (names && std::find(names->begin(), names->end(), TinyMATReader_getName(a))==names->end()) continue;
+        tasks.push_back(a);
+    }
+    // the largest elements first, so no thread is left with a large element at the end
+    std::stable_sort(tasks.begin(), tasks.end(), [](const TinyMATReaderArray& x, const TinyMATReaderArray& y) {
+        return x.compressed && (!y.compressed || x.size>y.size);
+    });
+    if (threads==0) threads=std::max<unsigned>(1, std::thread::hardware_concurrency());
+    threads=static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, tasks.size())));
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    auto worker=[&]() {
+        std::vector<uint8_t> buf;
+        for (size_t i=next++; i<tasks.size(); i=next++) {
+            const TinyMATReaderArray& t=tasks[i];
+            if (!t.compressed) {
+                callback(mat, t);
+                continue;
+            }
+            TinyMATReaderArray element;
+            TinyMATReaderFile view;
+            if (!TinyMATReader_inflateElement(mat, t.offset, buf)) {
+                ok=false;
+                continue;
+            }
+            view.data=buf.data();
+            view.size=buf.size();
+            if (TinyMATReader_readSubArray(&view, 0, view.size, &element, NULL)) callback(&view, element);
+            else ok=false;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i=1; i<threads; i++) pool.push_back(std::thread(worker));
+    worker();
+    for (std::thread& t: pool) t.join();
+    return ok;
+}
+
+bool TinyMATReader_readChunked(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATReaderChunkCallback callback, uint64_t chunkBytes, bool imag) {
+    if (!mat || !callback || (imag && !array.complex)) return false;
+    const uint64_t esize=TinyMATReader_dataTypeSize(imag?(array.compressed?array.type:array.imagType):array.type);
+    if (esize==0) return false;
+    const uint64_t count=(imag && !array.compressed)?(array.imagBytes/esize):(array.realBytes/esize);
+    const uint64_t chunk=std::max<uint64_t>(1, chunkBytes/esize);
+    if (!array.compressed) {
+        const uint8_t* src=static_cast<const uint8_t*>(imag?array.imag:array.real);
+        if (!src) return false;
+        for (uint64_t first=0; first<count; first+=chunk) {
+            if (!callback(src+first*esize, first, std::min(chunk, count-first))) return false;
+        }
+        return true;
+    }
+#ifdef TINYMAT_USES_ZLIB
+    const TinyMATReaderCompressedHeader* h=TinyMATReader_getCompressedHeader(mat, array.offset);
+    TinyMATReaderTag tag;
+    if (!h || !TinyMATReader_readTag(mat, array.offset, mat->size, tag)) return false;
+    // a background thread inflates into one buffer, while the callback processes the other ones
+    const size_t nbuffers=3;
+    std::vector<std::vector<uint8_t> > buffers(nbuffers, std::vector<uint8_t>(static_cast<size_t>(chunk*esize)));
+    std::deque<std::pair<size_t, uint64_t> > filled; // buffer and number of elements
+    std::deque<size_t> empty;
+    for (size_t i=0; i<nbuffers; i++) empty.push_back(i);
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool abort=false, failed=false, done=false;
+    std::thread producer([&]() {
+        TinyMATReaderInflater inflater(mat->data+tag.data, tag.bytes);
+        bool ok=true;
+        uint64_t data=h->real.data;
+        if (imag) {
+            uint8_t t[8];
+            ok=inflater.skipTo(h->real.next) && inflater.read(t, 8)==8;
+            const uint32_t t0=mat->swapped?TinyMAT_bswap32(TinyMATReader_U32(t)):TinyMATReader_U32(t);
+            ok=ok && static_cast<TinyMATDataType>(((t0>>16)!=0)?(t0&0xFFFF):t0)==array.type;
+            data=h->real.next+(((t0>>16)!=0)?4:8);
+        }
+        ok=ok && inflater.skipTo(data);
+        for (uint64_t first=0; ok && first<count; first+=chunk) {
+            size_t b=0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return abort || !empty.empty(); });
+                if (abort) break;
+                b=empty.front();
+                empty.pop_front();
+            }
+            const uint64_t n=std::min(chunk, count-first);
+            ok=(inflater.read(buffers[b].data(), n*esize)==n*esize);
+            if (ok && mat->swapped) TinyMAT_swapBytes(buffers[b].data(), n, static_cast<uint32_t>(esize));
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) filled.push_back(std::make_pair(b, n));
+            changed.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        failed=!ok;
+        done=true;
+        changed.notify_all();
+    });
+    uint64_t first=0;
+    bool ok=true;
+    while (true) {
+        std::pair<size_t, uint64_t> item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return done || !filled.empty(); });
+            if (filled.empty()) break;
+            item=filled.front();
+            filled.pop_front();
+        }
+        ok=callback(buffers[item.first].data(), first, item.second);
+        first+=item.second;
+        std::lock_guard<std::mutex> lock(mutex);
+        empty.push_back(item.first);
+        if (!ok) abort=true;
+        changed.notify_all();
+        if (!ok) break;
+    }
+    producer.join();
+    return ok && !failed && first==count;
+#else
+    return false;
+#endif
+}
+
+/** \brief maximum nesting depth of structs and cells, that TinyMATReader_visit() descends into */
+#define TINYMAT_READER_MAXDEPTH 1024
+
+/** \brief walks \a array and all its fields/cells, calling the methods of \a visitor */
+static bool TinyMATReader_visitTree(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATReaderVisitor& visitor, int depth) {
+    if (depth>TINYMAT_READER_MAXDEPTH) return false;
+    const uint64_t end=array.offset+array.size;
+    const uint64_t numel=TinyMATReader_numel(array);
+    TinyMATReaderArray sub;
+    switch (array.mxClass) {
+        case TinyMATClass::Struct:
+        case TinyMATClass::Object: {
+            uint32_t nameLength=0;
+            const char* names=NULL;
+            uint64_t fields=0, offset=0;
+            if (!TinyMATReader_readFieldTable(mat, array, &nameLength, &names, &fields, &offset)) return false;
+            if (visitor.beginStruct(array, fields)) {
+                for (uint64_t i=0; i<numel; i++) {
+                    for (uint64_t f=0; f<fields; f++) {
+                        const char* n=names+f*nameLength;
+                        if (!TinyMATReader_readSubArray(mat, offset, end, &sub, &offset)) return false;
+                        if (visitor.field(n, static_cast<uint32_t>(strnlen(n, nameLength)), i)) {
+                            if (!TinyMATReader_visitTree(mat, sub, visitor, depth+1)) return false;
+                        }
+                    }
+                }
+                visitor.endStruct(array);
+            }
+            return true;
+        }
+        case TinyMATClass::Cell: {
+            if (visitor.beginCell(array)) {
+                uint64_t offset=array.contentOffset;
+                for (uint64_t i=0; i<numel; i++) {
+                    if (!TinyMATReader_readSubArray(mat, offset, end, &sub, &offset)) return false;
+                    if (!TinyMATReader_visitTree(mat, sub, visitor, depth+1)) return false;
+                }
+                visitor.endCell(array);
+            }
+            return true;
+        }
+        case TinyMATClass::Char:
+            visitor.string(array);
+            return true;
+        default:
+            visitor.array(array);
+            return true;
+    }
+}
+
+bool TinyMATReader_visitArray(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATReaderVisitor& visitor) {
+    if (!mat) return false;
+    if (!array.compressed) return TinyMATReader_visitTree(mat, array, visitor, 0);
+    // a compressed variable is inflated as a whole
+    std::vector<uint8_t> buf;
+    TinyMATReaderFile view;
+    TinyMATReaderArray element;
+    if (!TinyMATReader_inflateElement(mat, array.offset, buf)) return false;
+    view.data=buf.data();
+    view.size=buf.size();
+    return TinyMATReader_readSubArray(&view, 0, view.size, &element, NULL) && TinyMATReader_visitTree(&view, element, visitor, 0);
+}
+
+bool TinyMATReader_visit(const TinyMATReaderFile* mat, TinyMATReaderVisitor& visitor) {
+    if (!mat) return false;
+    TinyMATReaderArray a;
+    std::vector<uint8_t> buf;
+    TinyMATReaderFile view;
+    TinyMATReaderArray element;
+    bool ok=true;
+    for (uint64_t offset=TinyMATReader_firstElement(mat); offset>0; offset=TinyMATReader_nextElement(mat, offset)) {
+        if (!TinyMATReader_readArray(mat, offset, &a)) {
+            ok=false;
+            continue;
+        }
+        if (!visitor.beginVariable(a)) continue;
+        if (!a.compressed) {
+            ok=TinyMATReader_visitTree(mat, a, visitor, 0) && ok;
+        } else if (TinyMATReader_inflateElement(mat, offset, buf)) {
+            // the buffer is reused for all compressed variables
+            view.data=buf.data();
+            view.size=buf.size();
+            ok=TinyMATReader_readSubArray(&view, 0, view.size, &element, NULL) && TinyMATReader_visitTree(&view, element, visitor, 0) && ok;
+        } else {
+            ok=false;
+        }
+    }
+    return ok;
+}
+
+/*! \brief checks the structure of all elements of a MAT-file, see TinyMATReader_verify()
+    \internal
+ */
+struct TinyMATReaderVerifier {
+    inline TinyMATReaderVerifier(const TinyMATReaderFile* mat_):
+        mat(mat_),
+        errorOffset(0)
+    {
+    }
+
+    /** \brief records the first error */
+    bool fail(uint64_t offset, const char* message) {
+        if (error.empty()) {
+            errorOffset=offset;
+            error=message;
+        }
+        return false;
+    }
+
+    /** \brief reads the tag at \a offset, checks that the element (including its padding) ends before \a end and that the padding is zero */
+    bool tag(uint64_t offset, uint64_t end, TinyMATReaderTag& t, const char* what) {
+        if (offset>end || end-offset<8) return fail(offset, (std::string("missing ")+what).c_str());
+        if (!TinyMATReader_readTag(mat, offset, end, t)) return fail(offset, (std::string("size of ")+what+" exceeds the enclosing element").c_str());
+        const uint64_t padded=((t.data-offset)==4)?(offset+8):(t.data+((t.bytes+7)&~static_cast<uint64_t>(7)));
+        if (padded>end) return fail(offset, (std::string("padding of ")+what+" exceeds the enclosing element").c_str());
+        for (uint64_t i=t.data+t.bytes; i<padded; i++) {
+            if (mat->data[i]!=0) return fail(i, (std::string("non-zero padding after ")+what).c_str());
+        }
+        return true;
+    }
+
+    /** \brief checks the data element at \a offset, that holds \a count values (of any numeric type, at least \a count values, if \a atLeast is set) */
+    bool data(uint64_t offset, uint64_t end, uint64_t count, TinyMATReaderTag& t, const char* what, bool atLeast=false) {
+        if (!tag(offset, end, t, what)) return false;
+        const uint32_t size=TinyMATReader_dataTypeSize(static_cast<TinyMATDataType>(t.type));
+        if (size==0) return fail(offset, (std::string("invalid data type of ")+what).c_str());
+        // UTF-8 characters need a variable number of bytes
+        if (static_cast<TinyMATDataType>(t.type)==TinyMATDataType::UTF8) return true;
+        if ((t.bytes%size)!=0 || (atLeast?(t.bytes/size<count):(t.bytes/size!=count))) return fail(offset, (std::string("size of ")+what+" does not match the array dimensions").c_str());
+        return true;
+    }
+
+    /** \brief checks the miMATRIX element at \a offset, which has to end before \a end, and returns the offset of the next element in \a next */
+    bool matrix(uint64_t offset, uint64_t end, uint64_t* next, int depth) {
+        TinyMATReaderTag t, sub;
+        if (depth>TINYMAT_READER_MAXDEPTH) return fail(offset, "arrays are nested too deeply");
+        if (!tag(offset, end, t, "array")) return false;
+        if (t.type!=TINYMAT_READER_miMATRIX) return fail(offset, "expected an array (miMATRIX)");
+        if (next) *next=t.next;
+        const uint64_t mend=t.data+t.bytes;
+        // an empty miMATRIX element is an empty array
+        if (t.bytes==0) return true;
+        if (!tag(t.data, mend, sub, "array flags")) return false;
+        if (sub.type!=TINYMAT_READER_miUINT32 || sub.bytes!=8) return fail(t.data, "invalid array flags");
+        const uint32_t flags=TinyMATReader_U32(mat->data+sub.data);
+        const TinyMATClass cls=static_cast<TinyMATClass>(flags&0xFF);
+        const bool complex=(flags&0x0800)!=0;
+        if (cls==TinyMATClass::Unknown || static_cast<uint8_t>(cls)>static_cast<uint8_t>(TinyMATClass::UInt64)) return fail(sub.data, "invalid array class");
+        const uint64_t dimsOffset=sub.next;
+        if (!tag(dimsOffset, mend, sub, "dimensions")) return false;
+        if (sub.type!=TINYMAT_READER_miINT32 || (sub.bytes%4)!=0 || sub.bytes<8) return fail(dimsOffset, "invalid dimensions");
+        uint64_t numel=1;
+        for (uint64_t i=0; i<sub.bytes; i+=4) {
+            const int32_t d=static_cast<int32_t>(TinyMATReader_U32(mat->data+sub.data+i));
+            if (d<0) return fail(sub.data+i, "negative dimension");
+            numel=numel*static_cast<uint64_t>(d);
+        }
+        const uint64_t cols=(sub.bytes==8)?TinyMATReader_U32(mat->data+sub.data+4):0;
+        const uint64_t nameOffset=sub.next;
+        if (!tag(nameOffset, mend, sub, "array name")) return false;
+        if (sub.type!=TINYMAT_READER_miINT8) return fail(nameOffset, "invalid array name");
+        uint64_t pos=sub.next;
+        switch (cls) {
+            case TinyMATClass::Cell:
+                for (uint64_t i=0; i<numel; i++) {
+                    if (!matrix(pos, mend, &pos, depth+1)) return false;
+                }
+                break;
+            case TinyMATClass::Object:
+            case TinyMATClass::Struct: {
+                // objects are stored like structs, after their class name
+                if (cls==TinyMATClass::Object) {
+                    if (!tag(pos, mend, sub, "class name")) return false;
+                    if (sub.type!=TINYMAT_READER_miINT8) return fail(pos, "invalid class name");
+                    pos=sub.next;
+                }
+                if (!tag(pos, mend, sub, "field name length")) return false;
+                if (sub.type!=TINYMAT_READER_miINT32 || sub.bytes!=4) return fail(pos, "invalid field name length");
+                const uint32_t nameLength=TinyMATReader_U32(mat->data+sub.data);
+                const uint64_t namesOffset=sub.next;
+                if (!tag(namesOffset, mend, sub, "field names")) return false;
+                if (sub.type!=TINYMAT_READER_miINT8 || (nameLength==0 && sub.bytes>0) || (nameLength>0 && (sub.bytes%nameLength)!=0)) return fail(namesOffset, "invalid field names");
+                const uint64_t fields=(nameLength>0)?(sub.bytes/nameLength):0;
+                pos=sub.next;
+                for (uint64_t i=0; i<numel*fields; i++) {
+                    if (!matrix(pos, mend, &pos, depth+1)) return false;
+                }
+            } break;
+            case TinyMATClass::Sparse: {
+                TinyMATReaderTag ir, jc;
+                if (!data(pos, mend, 0, ir, "row indices", true)) return false;
+                if (ir.type!=TINYMAT_READER_miINT32) return fail(pos, "invalid row indices");
+                const uint64_t jcOffset=ir.next;
+                if (!data(jcOffset, mend, cols+1, jc, "column indices")) return false;
+                if (jc.type!=TINYMAT_READER_miINT32) return fail(jcOffset, "invalid column indices");
+                // the last column index is the number of non-zero elements
+                const uint64_t nnz=TinyMATReader_U32(mat->data+jc.data+jc.bytes-4);
+                if (nnz>ir.bytes/4) return fail(jcOffset, "more non-zero elements than row indices");
+                pos=jc.next;
+                if (!data(pos, mend, nnz, sub, "values", true)) return false;
+                pos=sub.next;
+                if (complex) {
+                    if (!data(pos, mend, nnz, sub, "imaginary values", true)) return false;
+                    pos=sub.next;
+                }
+            } break;
+            default: {
+                if (!data(pos, mend, numel, sub, "real part")) return false;
+                pos=sub.next;
+                if (complex) {
+                    if (!data(pos, mend, numel, sub, "imaginary part")) return false;
+                    pos=sub.next;
+                }
+            } break;
+        }
+        if (pos!=mend) return fail(pos, "unexpected data at the end of the array");
+        return true;
+    }
+
+    const TinyMATReaderFile* mat;
+    uint64_t errorOffset;
+    std::string error;
+};
+
+bool TinyMATReader_verify(const TinyMATReaderFile* mat, uint64_t* errorOffset, std::string* errorMessage) {
+    if (!mat) return false;
+    TinyMATReaderVerifier verifier(mat);
+    std::vector<uint8_t> buf;
+    uint64_t offset=TINYMAT_READER_HEADERSIZE;
+    while (offset<mat->size && verifier.error.empty()) {
+        if (mat->size-offset<8) {
+            verifier.fail(offset, "truncated element at the end of the file");
+            break;
+        }
+        const uint32_t type=TinyMATReader_U32(mat->data+offset);
+        const uint64_t bytes=TinyMATReader_U32(mat->data+offset+4);
+        if (bytes>mat->size-offset-8) {
+            verifier.fail(offset, "element extends beyond the end of the file");
+        } else if (type==TINYMAT_READER_miMATRIX) {
+            verifier.matrix(offset, offset+8+bytes, NULL, 0);
+        } else if (type==TINYMAT_READER_miCOMPRESSED) {
+#ifdef TINYMAT_USES_ZLIB
+            TinyMATReaderFile view;
+            if (!TinyMATReader_inflateElement(mat, offset, buf)) {
+                verifier.fail(offset, "compressed element could not be inflated");
+            } else {
+                view.data=buf.data();
+                view.size=buf.size();
+                TinyMATReaderVerifier inner(&view);
+                if (!inner.matrix(0, view.size, NULL, 0)) {
+                    verifier.fail(offset, ("in compressed element, at offset "+std::to_string(inner.errorOffset)+" of the inflated data: "+inner.error).c_str());
+                }
+            }
+#endif
+        } else {
+            verifier.fail(offset, "invalid top-level element (neither miMATRIX nor miCOMPRESSED)");
+        }
+        offset=offset+8+bytes;
+    }
+    if (errorOffset) *errorOffset=verifier.errorOffset;
+    if (errorMessage) *errorMessage=verifier.error;
+    return verifier.error.empty();
+}
+
+std::vector<TinyMATReaderChecksum> TinyMATReader_getChecksums(const TinyMATReaderFile* mat) {
+    std::vector<TinyMATReaderChecksum> res;
+    if (!mat || mat->size<TINYMAT_READER_HEADERSIZE+8) return res;
+    uint64_t self=0;
+    memcpy(&self, mat->data+mat->size-8, sizeof(self));
+    TinyMATReaderArray idx, names, offsets, checksums;
+    if (self<TINYMAT_READER_HEADERSIZE || self>=mat->size-8 || !TinyMATReader_readArray(mat, self, &idx)) return res;
+    if (idx.offset+idx.size!=mat->size || TinyMATReader_getName(idx)!=TINYMAT_INDEX_NAME) return res;
+    if (!TinyMATReader_getField(mat, idx, "names", &names) || !TinyMATReader_getField(mat, idx, "offsets", &offsets) || !TinyMATReader_getField(mat, idx, "crc32c", &checksums)) return res;
+    const uint64_t* o=TinyMATReader_data<uint64_t>(offsets);
+    const uint32_t* c=TinyMATReader_data<uint32_t>(checksums);
+    const uint64_t n=TinyMATReader_numel(offsets);
+    if (names.mxClass!=TinyMATClass::Cell || TinyMATReader_numel(names)!=n || TinyMATReader_numel(checksums)!=n || (n>0 && (!o || !c))) return res;
+    const uint64_t end=names.offset+names.size;
+    uint64_t offset=names.contentOffset;
+    TinyMATReaderArray name;
+    for (uint64_t i=0; i<n; i++) {
+        if (!TinyMATReader_readSubArray(mat, offset, end, &name, &offset)) {
+            res.clear();
+            return res;
+        }
+        TinyMATReaderChecksum cs;
+        cs.name=TinyMATReader_getString(name);
+        cs.offset=o[i];
+        // the size is taken from the tag, as the variable may be damaged
+        cs.size=(o[i]>=TINYMAT_READER_HEADERSIZE && o[i]<=self-8)?(8+static_cast<uint64_t>(TinyMATReader_U32(mat->data+o[i]+4))):0;
+        cs.crc32c=c[i];
+        res.push_back(cs);
+    }
+    return res;
+}
+
+/*! \brief a block of a variable, whose CRC32C is computed by TinyMATReader_verifyChecksums()
+    \internal
+ */
+struct TinyMATReaderChecksumBlock {
+    /** \brief index of the variable */
+    size_t var;
+    /** \brief position of the block in the file */
+    uint64_t offset;
+    /** \brief size of the block */
+    uint64_t size;
+    /** \brief CRC32C of the block */
+    uint32_t crc;
+};
+
+/** \brief size of the blocks, into which TinyMATReader_verifyChecksums() splits large variables */
+#define TINYMAT_READER_CHECKSUMBLOCK (16*1024*1024)
+
+bool TinyMATReader_verifyChecksums(const TinyMATReaderFile* mat, std::vector<std::string>* corrupted, unsigned threads, const std::vector<std::string>* names) {
+    if (corrupted) corrupted->clear();
+    std::vector<TinyMATReaderChecksum> checksums=TinyMATReader_getChecksums(mat);
+    if (checksums.empty()) return false;
+    std::vector<bool> ok(checksums.size(), true);
+    std::vector<TinyMATReaderChecksumBlock> blocks;
+    for (size_t i=0; i<checksums.size(); i++) {
+        const TinyMATReaderChecksum& c=checksums[i];
+        if (names && std::find(names->begin(), names->end(), c.name)==names->end()) continue;
+        if (c.size<8 || c.offset>mat->size || c.size>mat->size-c.offset) {
+            ok[i]=false;
+            continue;
+        }
+        // the variables of a file in the other byte order have to be swapped back as a whole
+        const uint64_t blockSize=mat->swapped?c.size:TINYMAT_READER_CHECKSUMBLOCK;
+        for (uint64_t o=0; o<c.size; o+=blockSize) {
+            TinyMATReaderChecksumBlock b;
+            b.var=i;
+            b.offset=c.offset+o;
+            b.size=std::min(blockSize, c.size-o);
+            b.crc=0;
+            blocks.push_back(b);
+        }
+    }
+    if (threads==0) threads=std::max<unsigned>(1, std::thread::hardware_concurrency());
+    threads=static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, blocks.size())));
+    std::atomic<size_t> next(0);
+    auto worker=[&]() {
+        std::vector<uint8_t> buf;
+        for (size_t i=next++; i<blocks.size(); i=next++) {
+            TinyMATReaderChecksumBlock& b=blocks[i];
+            if (!mat->swapped) {
+                b.crc=TinyMAT_crc32c(0, mat->data+b.offset, b.size);
+                continue;
+            }
+            // the checksum is computed over the bytes in the file
+            try {
+                buf.assign(mat->data+b.offset, mat->data+b.offset+b.size);
+            } catch (std::bad_alloc&) {
+                continue;
+            }
+            TinyMAT_swapElements(buf.data(), buf.size(), false);
+            b.crc=TinyMAT_crc32c(0, buf.data(), buf.size());
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i=1; i<threads; i++) pool.push_back(std::thread(worker));
+    worker();
+    for (std::thread& t: pool) t.join();
+    // the blocks of each variable are in order, so their CRCs are combined into the CRC of the variable
+    std::vector<uint32_t> crc(checksums.size(), 0);
+    std::vector<bool> checked(checksums.size(), false);
+    for (const TinyMATReaderChecksumBlock& b: blocks) {
+        crc[b.var]=TinyMAT_crc32cCombine(crc[b.var], b.crc, b.size);
+        checked[b.var]=true;
+    }
+    bool res=true;
+    for (size_t i=0; i<checksums.size(); i++) {
+        if (!ok[i] || (checked[i] && crc[i]!=checksums[i].crc32c)) {
+            res=false;
+            if (corrupted) corrupted->push_back(checksums[i].name);
+        }
+    }
+    return res;
+}
@@ -0,0 +1,518 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATREADER_H
+#define TINYMATREADER_H
+
+#include "tinymat_export.h"
+#include "tinymatencoder.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+/*! \defgroup tinymatreader Tiny Matlab(r) MAT reader
+
+    The reader maps a MAT-file (version 5, as written by TinyMATWriter_open() ) into memory and walks its
+    elements. A variable is described by a TinyMATReaderArray, which points directly into the mapping, so
+    reading even large numeric arrays neither copies nor allocates. The views are valid until
+    TinyMATReader_close() is called.
+
+\code
+    TinyMATReaderFile* mat=TinyMATReader_open("test.mat");
+    if (mat) {
+        TinyMATReaderArray a;
+        if (TinyMATReader_find(mat, "matrix1", &a)) {
+            const double* d=TinyMATReader_data<double>(a); // NULL, if the variable is not stored as double
+            // a.dims[0] x a.dims[1] values in column-major order
+        }
+        TinyMATReader_close(mat);
+    }
+\endcode
+
+ */
+
+/** \brief array classes of MAT-file variables
+    \ingroup tinymatreader
+ */
+enum class TinyMATClass : uint8_t {
+    Unknown=0,
+    Cell=1,
+    Struct=2,
+    Object=3,
+    Char=4,
+    Sparse=5,
+    Double=6,
+    Single=7,
+    Int8=8,
+    UInt8=9,
+    Int16=10,
+    UInt16=11,
+    Int32=12,
+    UInt32=13,
+    Int64=14,
+    UInt64=15,
+};
+
+/** \brief data types of MAT-file data elements
+    \ingroup tinymatreader
+ */
+enum class TinyMATDataType : uint8_t {
+    Unknown=0,
+    Int8=1,
+    UInt8=2,
+    Int16=3,
+    UInt16=4,
+    Int32=5,
+    UInt32=6,
+    Single=7,
+    Double=9,
+    Int64=12,
+    UInt64=13,
+    Matrix=14,
+    Compressed=15,
+    UTF8=16,
+    UTF16=17,
+    UTF32=18,
+};
+
+/*! \brief describes a variable (or a field/cell of a variable) in a MAT-file
+    \ingroup tinymatreader
+
+    All pointers point into the memory of the TinyMATReaderFile. Note that \a name is NOT zero-terminated.
+ */
+struct TinyMATReaderArray {
+    /** \brief byte offset of the element in the file */
+    uint64_t offset;
+    /** \brief size of the complete element in bytes (including its tag) */
+    uint64_t size;
+    /*! \brief \c true, if this is a compressed top-level element
+
+        If the library is built with zlib (\c TinyMAT_ZLIB_SUPPORT ), the header of the element is inflated, so
+        \a mxClass, \a name, \a dims, \a type and \a realBytes are set, but \a real and \a imag are NULL. The data can be
+        read with TinyMATReader_readHyperslab(). Otherwise only \a offset and \a size are set. */
+    bool compressed;
+    /** \brief array class */
+    TinyMATClass mxClass;
+    /** \brief \c true for complex arrays, see \a imag */
+    bool complex;
+    /** \brief \c true for logical arrays */
+    bool logical;
+    /** \brief \c true for global variables */
+    bool global;
+    /** \brief name of the variable (not zero-terminated!) */
+    const char* name;
+    /** \brief length of \a name in bytes */
+    uint32_t nameLength;
+    /** \brief number of dimensions */
+    uint32_t ndims;
+    /** \brief the dimensions */
+    const int32_t* dims;
+    /** \brief data type of \a real and \a imag (may be narrower than the array class, e.g. a double array stored as uint8) */
+    TinyMATDataType type;
+    /** \brief the (real) values in column-major order, or the non-zero values of a sparse array */
+    const void* real;
+    /** \brief size of \a real in bytes */
+    uint64_t realBytes;
+    /** \brief data type of \a imag */
+    TinyMATDataType imagType;
+    /** \brief the imaginary values of a complex array */
+    const void* imag;
+    /** \brief size of \a imag in bytes */
+    uint64_t imagBytes;
+    /** \brief row indices of the non-zeros of a sparse array (\a irCount entries) */
+    const int32_t* ir;
+    uint64_t irCount;
+    /** \brief column start indices of a sparse array (\a jcCount entries) */
+    const int32_t* jc;
+    uint64_t jcCount;
+    /** \brief byte offset of the contents of a cell, struct or object array (see TinyMATReader_getCell(), TinyMATReader_getField() ) */
+    uint64_t contentOffset;
+};
+
+struct TinyMATReaderFile; // forward
+
+/*! \brief open a MAT-file for reading by mapping it into memory
+    \ingroup tinymatreader
+
+    \param filename the MAT-file
+    \return a new TinyMATReaderFile, or NULL if the file could not be mapped or has no valid MAT-file header
+
+    A file in the other byte order (e.g. a big-endian file on a little-endian machine) is converted to the byte order of
+    this machine in one pass over the private (copy-on-write) mapping, so all functions work on it as usual. Compressed
+    variables are converted after inflating them (see \ref tinymatbyteorder).
+ */
+TINYMAT_EXPORT TinyMATReaderFile* TinyMATReader_open(const char* filename);
+
+/*! \brief read a MAT-file from a memory buffer
+    \ingroup tinymatreader
+
+    \param data contents of a MAT-file. The buffer is not copied (except for files in the other byte order, which are
+                converted in a copy) and has to stay valid until TinyMATReader_close().
+    \param size size of \a data in bytes
+    \return a new TinyMATReaderFile, or NULL if \a data has no valid MAT-file header
+ */
+TINYMAT_EXPORT TinyMATReaderFile* TinyMATReader_openBuffer(const void* data, uint64_t size);
+
+/*! \brief close a MAT-file and unmap it. All views into the file become invalid.
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT void TinyMATReader_close(TinyMATReaderFile* mat);
+
+/*! \brief returns the description from the header of the file (with trailing spaces removed)
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT std::string TinyMATReader_getDescription(const TinyMATReaderFile* mat);
+
+/*! \brief returns the size of the file in bytes
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT uint64_t TinyMATReader_getSize(const TinyMATReaderFile* mat);
+
+/*! \brief returns the byte offset of the first top-level element, or 0 if the file contains no elements
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT uint64_t TinyMATReader_firstElement(const TinyMATReaderFile* mat);
+
+/*! \brief returns the byte offset of the top-level element after the one at \a offset, or 0 at the end of the file (or if it is malformed)
+    \ingroup tinymatreader
+
+    Only the tag of the element at \a offset is read, its contents are skipped.
+ */
+TINYMAT_EXPORT uint64_t TinyMATReader_nextElement(const TinyMATReaderFile* mat, uint64_t offset);
+
+/*! \brief describes the miMATRIX element at \a offset in \a array
+    \ingroup tinymatreader
+
+    \param mat the MAT-file
+    \param offset byte offset of the element, e.g. from TinyMATReader_firstElement() or TinyMATReader_nextElement()
+    \param[out] array the description of the element
+    \return \c true on success, \c false if the element is malformed. For a compressed element \c true is returned,
+            see TinyMATReaderArray::compressed.
+ */
+TINYMAT_EXPORT bool TinyMATReader_readArray(const TinyMATReaderFile* mat, uint64_t offset, TinyMATReaderArray* array);
+
+/*! \brief finds the first top-level variable called \a name
+    \ingroup tinymatreader
+
+    \return \c true, if the variable was found
+
+    The variable is looked up in a hash index of all variables, which is built on the first call
+    (see TinyMATReader_buildIndex() ), so every further call takes constant time.
+ */
+TINYMAT_EXPORT bool TinyMATReader_find(TinyMATReaderFile* mat, const char* name, TinyMATReaderArray* array);
+
+/*! \brief builds the index of all top-level variables, which is used by TinyMATReader_find()
+    \ingroup tinymatreader
+
+    If the file ends with an index, written by the TinyMATWriter (see TinyMATWriter_setWriteIndex() ), it is loaded.
+    Otherwise the index is built in one pass over the tags of the top-level elements, which reads only their names and
+    skips their contents. Nothing is done, if the index already exists (e.g. from TinyMATReader_loadIndex() ).
+    Compressed variables are only indexed, if the library is built with zlib. This function is thread-safe.
+ */
+TINYMAT_EXPORT bool TinyMATReader_buildIndex(TinyMATReaderFile* mat);
+
+/*! \brief saves the index of \a mat (see TinyMATReader_buildIndex() ) as a sidecar MAT-file \a filename
+    \ingroup tinymatreader
+
+    The sidecar contains the variables \c names (cell array of strings), \c offsets (uint64 byte offsets)
+    and \c filesize (the size of the indexed file).
+ */
+TINYMAT_EXPORT bool TinyMATReader_saveIndex(TinyMATReaderFile* mat, const char* filename);
+
+/*! \brief loads the index of \a mat from the sidecar MAT-file \a filename, written by TinyMATReader_saveIndex()
+    \ingroup tinymatreader
+
+    \return \c false, if the sidecar could not be read or was written for a file of a different size
+ */
+TINYMAT_EXPORT bool TinyMATReader_loadIndex(TinyMATReaderFile* mat, const char* filename);
+
+/*! \brief returns the names of all top-level variables in the order of the file (compressed variables are skipped without zlib)
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT std::vector<std::string> TinyMATReader_listVariables(const TinyMATReaderFile* mat);
+
+/*! \brief returns the element \a index (column-major, 0-based) of the cell array \a cell
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT bool TinyMATReader_getCell(const TinyMATReaderFile* mat, const TinyMATReaderArray& cell, uint64_t index, TinyMATReaderArray* element);
+
+/*! \brief returns the field names of the struct array (or object) \a str
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT std::vector<std::string> TinyMATReader_getFieldNames(const TinyMATReaderFile* mat, const TinyMATReaderArray& str);
+
+/*! \brief returns the field \a field of the element \a index (column-major, 0-based) of the struct array \a str
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT bool TinyMATReader_getField(const TinyMATReaderFile* mat, const TinyMATReaderArray& str, const char* field, TinyMATReaderArray* element, uint64_t index=0);
+
+/*! \brief returns the name of \a array as a string
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT std::string TinyMATReader_getName(const TinyMATReaderArray& array);
+
+/*! \brief returns the contents of the char array \a array as a string (UTF-16 characters beyond 255 are encoded as UTF-8)
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT std::string TinyMATReader_getString(const TinyMATReaderArray& array);
+
+/*! \brief returns the number of elements of \a array (the product of its dimensions)
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT uint64_t TinyMATReader_numel(const TinyMATReaderArray& array);
+
+/*! \brief returns the size of one element of the data type \a type in bytes (0 for non-numeric types)
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT uint32_t TinyMATReader_dataTypeSize(TinyMATDataType type);
+
+/*! \brief reads a part (hyperslab) of the numeric array \a array into \a dest
+    \ingroup tinymatreader
+
+    \param mat the MAT-file
+    \param array a numeric or char array (not sparse)
+    \param start first index in each of the \a array.ndims dimensions (0-based)
+    \param count number of elements to read in each dimension
+    \param stride distance between the elements in each dimension (NULL for 1)
+    \param[out] dest receives the elements in column-major order as type \a array.type (see TinyMATReader_dataTypeSize() )
+    \param destBytes size of \a dest in bytes
+    \param imag read the imaginary instead of the real part
+    \return \c false, if the hyperslab is outside of \a array, \a dest is too small or the data could not be read
+
+    Only the requested elements are copied from the mapped file, runs of contiguous elements are copied at once. For
+    a compressed variable, the data is inflated up to the last requested element, without keeping the skipped data.
+ */
+TINYMAT_EXPORT bool TinyMATReader_readHyperslab(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, const int32_t* start, const int32_t* count, const int32_t* stride, void* dest, uint64_t destBytes, bool imag=false);
+
+/*! \brief converts \a count values of type \a srcType at \a src into \a dest (of type \a destType)
+    \ingroup tinymatreader
+
+    \a src does not have to be aligned, so this can convert directly from the mapped file. Conversions from integer
+    types and single to single/double are vectorized. Conversions to integer types saturate and round, as in Matlab
+    (NaN becomes 0).
+
+    \return \c false, if one of the types is not numeric
+ */
+TINYMAT_EXPORT bool TinyMATReader_convert(const void* src, TinyMATDataType srcType, void* dest, TinyMATDataType destType, uint64_t count);
+
+/*! \brief reads a part (hyperslab) of the numeric array \a array into \a dest, converted to \a destType
+    \ingroup tinymatreader
+
+    Works like TinyMATReader_readHyperslab(), but converts the values to \a destType on the fly (see TinyMATReader_convert() ),
+    e.g. for double data, that is stored as miUINT8 or miINT16. Uncompressed values are converted directly from the mapped
+    file, inflated values in small blocks, so no buffer of the size of the hyperslab is needed.
+ */
+TINYMAT_EXPORT bool TinyMATReader_readHyperslabAs(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, const int32_t* start, const int32_t* count, const int32_t* stride, TinyMATDataType destType, void* dest, uint64_t destBytes, bool imag=false);
+
+/*! \brief reads all values of the numeric array \a array into \a dest, converted to \a destType (see TinyMATReader_readHyperslabAs() )
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT bool TinyMATReader_readAs(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATDataType destType, void* dest, uint64_t destBytes, bool imag=false);
+
+/*! \brief reads all values of the numeric array \a array into the \a count values at \a dest, converted to \a T
+    \ingroup tinymatreader
+
+\code
+    std::vector<double> v(TinyMATReader_numel(a));
+    TinyMATReader_readAs(mat, a, v.data(), v.size()); // whatever type a is stored as
+\endcode
+ */
+template<typename T>
+inline bool TinyMATReader_readAs(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, T* dest, uint64_t count, bool imag=false) {
+    return TinyMATReader_readAs(mat, array, static_cast<TinyMATDataType>(TinyMATTypeTraits<T>::miType), dest, count*sizeof(T), imag);
+}
+
+/*! \brief callback for TinyMATReader_readVariables()
+    \ingroup tinymatreader
+
+    \param data the file, that contains \a array: either the mapped MAT-file, or (for a compressed variable) a temporary
+                buffer with the inflated variable, that is only valid during the call. Use it to access fields and cells
+                (e.g. TinyMATReader_getField(data, array, ...) ).
+    \param array the variable
+ */
+typedef std::function<void(const TinyMATReaderFile* data, const TinyMATReaderArray& array)> TinyMATReaderVariableCallback;
+
+/*! \brief reads all top-level variables (or the ones in \a names) on \a threads threads and passes each one to \a callback
+    \ingroup tinymatreader
+
+    \param mat the MAT-file
+    \param callback is called once for every variable, from several threads at the same time and in any order
+    \param threads number of threads (0: one per CPU core)
+    \param names if not NULL, only the variables with these names are read
+    \return \c false, if a compressed variable could not be inflated (e.g. without zlib)
+
+    Compressed variables are inflated in parallel, each on one thread (the largest ones first). Uncompressed variables
+    are passed as zero-copy views into the mapped file.
+ */
+TINYMAT_EXPORT bool TinyMATReader_readVariables(const TinyMATReaderFile* mat, TinyMATReaderVariableCallback callback, unsigned threads=0, const std::vector<std::string>* names=NULL);
+
+/*! \brief callback for TinyMATReader_readChunked(): receives \a count elements, starting with the element \a first (column-major index).
+           Return \c false to stop reading.
+    \ingroup tinymatreader
+ */
+typedef std::function<bool(const void* data, uint64_t first, uint64_t count)> TinyMATReaderChunkCallback;
+
+/*! \brief passes the data of the numeric array \a array in chunks of about \a chunkBytes to \a callback
+    \ingroup tinymatreader
+
+    \param mat the MAT-file
+    \param array a numeric or char array
+    \param callback receives the data in the storage type \a array.type
+    \param chunkBytes size of the chunks in bytes
+    \param imag read the imaginary instead of the real part
+    \return \c true, if all data was passed to \a callback
+
+    For a compressed variable, a background thread inflates the next chunks, while \a callback processes (e.g. converts)
+    the current one, so inflating and processing overlap. For an uncompressed variable, the chunks point directly into
+    the mapped file.
+ */
+TINYMAT_EXPORT bool TinyMATReader_readChunked(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATReaderChunkCallback callback, uint64_t chunkBytes=4*1024*1024, bool imag=false);
+
+/*! \brief receives the events of TinyMATReader_visit()
+    \ingroup tinymatreader
+
+    Derive from this class and override the events you are interested in. The TinyMATReaderArray passed to the
+    events point into the file and are only valid during the call. The contents of a struct or cell array can be
+    skipped by returning \c false from beginStruct(), field() or beginCell(): As the size of every element is
+    stored in the file, skipping costs nothing.
+
+    For a struct array (or object) with \c N elements and \c F fields, the events are
+\verbatim
+    beginStruct(array, F)
+      field(name_1, element 0), <events of the value>, ..., field(name_F, element 0), <events of the value>
+      ...
+      field(name_1, element N-1), <events of the value>, ...
+    endStruct(array)
+\endverbatim
+ */
+class TINYMAT_EXPORT TinyMATReaderVisitor {
+    public:
+        virtual ~TinyMATReaderVisitor() {}
+        /** \brief called for each top-level variable (before its other events). Return \c false to skip the variable. */
+        virtual bool beginVariable(const TinyMATReaderArray& /*array*/) { return true; }
+        /** \brief a struct array (or object) with \a fields fields starts. Return \c false to skip its fields (endStruct() is not called then). */
+        virtual bool beginStruct(const TinyMATReaderArray& /*array*/, uint64_t /*fields*/) { return true; }
+        /** \brief the field \a name (not zero-terminated) of the struct element \a element follows. Return \c false to skip its value. */
+        virtual bool field(const char* /*name*/, uint32_t /*nameLength*/, uint64_t /*element*/) { return true; }
+        /** \brief the struct array \a array ends */
+        virtual void endStruct(const TinyMATReaderArray& /*array*/) {}
+        /** \brief a cell array starts, its elements follow in column-major order. Return \c false to skip them (endCell() is not called then). */
+        virtual bool beginCell(const TinyMATReaderArray& /*array*/) { return true; }
+        /** \brief the cell array \a array ends */
+        virtual void endCell(const TinyMATReaderArray& /*array*/) {}
+        /** \brief a numeric, logical or sparse array (see TinyMATReader_data() ) */
+        virtual void array(const TinyMATReaderArray& /*array*/) {}
+        /** \brief a char array (see TinyMATReader_getString() ) */
+        virtual void string(const TinyMATReaderArray& /*array*/) {}
+};
+
+/*! \brief walks all top-level variables of \a mat once and passes their contents to \a visitor
+    \ingroup tinymatreader
+
+    No tree is built, so the memory use does not depend on the number or nesting of the elements. Compressed variables
+    are inflated (one at a time) into a buffer, that is reused for all of them.
+
+    \return \c false, if a malformed or (without zlib) compressed variable was found. The remaining variables are still visited.
+ */
+TINYMAT_EXPORT bool TinyMATReader_visit(const TinyMATReaderFile* mat, TinyMATReaderVisitor& visitor);
+
+/*! \brief walks the variable \a array (e.g. from TinyMATReader_find() ) and passes its contents to \a visitor
+    \ingroup tinymatreader
+
+    beginVariable() is not called.
+ */
+TINYMAT_EXPORT bool TinyMATReader_visitArray(const TinyMATReaderFile* mat, const TinyMATReaderArray& array, TinyMATReaderVisitor& visitor);
+
+/*! \brief checks the structure of all elements in \a mat in one linear pass
+    \ingroup tinymatreader
+
+    \param mat the MAT-file
+    \param[out] errorOffset if not NULL, receives the byte offset of the first error in the file
+    \param[out] errorMessage if not NULL, receives a description of the first error (empty if there is none)
+    \return \c true, if no error was found
+
+    Every tag is checked against the enclosing element, the padding has to be zero and the sizes of the array flags,
+    dimensions, data parts, cells, struct fields and sparse indices have to match the array dimensions. No element may
+    follow the end of an array. Compressed elements are inflated and checked (with zlib support), errors in them are
+    reported at the offset of the compressed element.
+
+    \see TinyMATWriter_setVerifyOnClose()
+ */
+TINYMAT_EXPORT bool TinyMATReader_verify(const TinyMATReaderFile* mat, uint64_t* errorOffset=NULL, std::string* errorMessage=NULL);
+
+/** \brief the checksum of a top-level variable, as stored in the index of the file (see TinyMATWriter_setWriteChecksums() )
+    \ingroup tinymatreader
+ */
+struct TinyMATReaderChecksum {
+    /** \brief name of the variable */
+    std::string name;
+    /** \brief byte offset of the variable in the file */
+    uint64_t offset;
+    /** \brief size of the variable in bytes, including the tag */
+    uint64_t size;
+    /** \brief CRC32C of the \a size bytes at \a offset */
+    uint32_t crc32c;
+};
+
+/*! \brief returns the checksums of all variables, as stored in the index at the end of \a mat (an empty list, if there are none)
+    \ingroup tinymatreader
+ */
+TINYMAT_EXPORT std::vector<TinyMATReaderChecksum> TinyMATReader_getChecksums(const TinyMATReaderFile* mat);
+
+/*! \brief checks the stored checksums of the variables in \a mat (or of the ones in \a names) on \a threads threads
+    \ingroup tinymatreader
+
+    \param mat the MAT-file
+    \param[out] corrupted if not NULL, receives the names of the variables, whose checksum does not match
+    \param threads number of threads (0: one per CPU core)
+    \param names if not NULL, only the variables with these names are checked
+    \return \c true, if all checksums match, \c false if a checksum does not match or if the file has no checksums
+
+    Only the bytes of the variables are read, their contents are not parsed (compressed variables are not inflated).
+    Large variables are split into blocks of 16MB, so they are checked in parallel, too.
+ */
+TINYMAT_EXPORT bool TinyMATReader_verifyChecksums(const TinyMATReaderFile* mat, std::vector<std::string>* corrupted=NULL, unsigned threads=0, const std::vector<std::string>* names=NULL);
+
+/*! \brief returns the (real) values of \a array, if they are stored as type \a T, otherwise NULL
+    \ingroup tinymatreader
+
+    The returned pointer points into the mapped file, \a array.realBytes/sizeof(T) values are available.
+ */
+template<typename T>
+inline const T* TinyMATReader_data(const TinyMATReaderArray& array) {
+    if (!array.real || static_cast<uint32_t>(array.type)!=TinyMATTypeTraits<T>::miType || sizeof(T)!=TinyMATTypeTraits<T>::size) return NULL;
+    return static_cast<const T*>(array.real);
+}
+
+/*! \brief returns the imaginary values of \a array, if they are stored as type \a T, otherwise NULL
+    \ingroup tinymatreader
+ */
+template<typename T>
+inline const T* TinyMATReader_imagData(const TinyMATReaderArray& array) {
+    if (!array.imag || static_cast<uint32_t>(array.imagType)!=TinyMATTypeTraits<T>::miType || sizeof(T)!=TinyMATTypeTraits<T>::size) return NULL;
+    return static_cast<const T*>(array.imag);
+}
+
+#endif // TINYMATREADER_H
@@ -0,0 +1,180 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#include "tinymatrotatingwriter.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <stdio.h>
+
+/*! \brief state of a rotating writer
+    \ingroup tinymatrotatingwriter
+    \internal
+ */
+struct TinyMATRotatingWriter {
+    TinyMATRotatingWriter() :
+      maxBytes(0),
+      maxSeconds(0),
+      bufSize(0),
+      sequence(0),
+      current(NULL),
+      emptySize(0),
+      stop(false),
+      closeFailed(false)
+    {
+    }
+    /** \brief filename without the sequence number and extension */
+    std::string basename;
+    /** \brief description for the file headers */
+    std::string description;
+    uint64_t maxBytes;
+    uint32_t maxSeconds;
+    size_t bufSize;
+    /** \brief number of the current file */
+    uint32_t sequence;
+    /** \brief the current file */
+    TinyMATWriterFile* current;
+    /** \brief size of the current file before the first user variable was written */
+    uint64_t emptySize;
+    /** \brief time, when the current file was opened */
+    std::chrono::steady_clock::time_point opened;
+
+    /** \brief files, that wait to be closed by closer */
+    std::deque<TinyMATWriterFile*> closeQueue;
+    std::mutex closeMutex;
+    std::condition_variable closeCondition;
+    /** \brief signals closer to close all queued files and stop */
+    bool stop;
+    /** \brief set by closer, if a file could not be closed (or failed its check, see TinyMATWriter_setVerifyOnClose() ) */
+    bool closeFailed;
+    /** \brief thread, that closes the previous files */
+    std::thread closer;
+};
+
+/** \brief main loop of the thread, which closes the previous files */
+static void TinyMATRotatingWriter_runCloser(TinyMATRotatingWriter* writer) {
+    std::unique_lock<std::mutex> lock(writer->closeMutex);
+    while (true) {
+        writer->closeCondition.wait(lock, [writer]() { return writer->stop || !writer->closeQueue.empty(); });
+        if (writer->closeQueue.empty()) {
+            if (writer->stop) return;
+            continue;
+        }
+        TinyMATWriterFile* mat=writer->closeQueue.front();
+        writer->closeQueue.pop_front();
+        lock.unlock();
+        const bool ok=TinyMATWriter_closeChecked(mat);
+        lock.lock();
+        if (!ok) writer->closeFailed=true;
+    }
+}
+
+/** \brief opens the file number \a sequence and writes the sequence variable, returns NULL on errors */
+static TinyMATWriterFile* TinyMATRotatingWriter_openFile(TinyMATRotatingWriter* writer, uint32_t sequence) {
+    char num[32];
+    snprintf(num, sizeof(num), "_%06u.mat", static_cast<unsigned>(sequence));
+    const std::string filename=writer->basename+num;
+    TinyMATWriterFile* mat=TinyMATWriter_open(filename.c_str(), writer->description.size()>0?writer->description.c_str():NULL, writer->bufSize);
+    if (mat) {
+        TinyMATWriter_writeValue<double>(mat, TINYMAT_SEQUENCE_NAME, static_cast<double>(sequence));
+    }
+    return mat;
+}
+
+/** \brief makes \a mat the current file */
+static void TinyMATRotatingWriter_setCurrent(TinyMATRotatingWriter* writer, TinyMATWriterFile* mat, uint32_t sequence) {
+    writer->current=mat;
+    writer->sequence=sequence;
+    writer->emptySize=TinyMATWriter_getSize(mat);
+    writer->opened=std::chrono::steady_clock::now();
+}
+
+TinyMATRotatingWriter* TinyMATRotatingWriter_open(const char* basename, const char* description, uint64_t maxBytes, uint32_t maxSeconds, size_t bufSize) {
+    if (!basename) return NULL;
+    TinyMATRotatingWriter* writer=new TinyMATRotatingWriter;
+    writer->basename=basename;
+    if (writer->basename.size()>4 && writer->basename.compare(writer->basename.size()-4, 4, ".mat")==0) {
+        writer->basename.resize(writer->basename.size()-4);
+    }
+    if (description) writer->description=description;
+    writer->maxBytes=maxBytes;
+    writer->maxSeconds=maxSeconds;
+    writer->bufSize=bufSize;
+    TinyMATWriterFile* mat=TinyMATRotatingWriter_openFile(writer, 0);
+    if (!mat) {
+        delete writer;
+        return NULL;
+    }
+    TinyMATRotatingWriter_setCurrent(writer, mat, 0);
+    writer->closer=std::thread(TinyMATRotatingWriter_runCloser, writer);
+    return writer;
+}
+
+bool TinyMATRotatingWriter_rotate(TinyMATRotatingWriter* writer) {
+    if (!writer) return false;
+    TinyMATWriterFile* mat=TinyMATRotatingWriter_openFile(writer, writer->sequence+1);
+    if (!mat) return false;
+    {
+        std::lock_guard<std::mutex> lock(writer->closeMutex);
+        writer->closeQueue.push_back(writer->current);
+    }
+    writer->closeCondition.notify_one();
+    TinyMATRotatingWriter_setCurrent(writer, mat, writer->sequence+1);
+    return true;
+}
+
+TinyMATWriterFile* TinyMATRotatingWriter_file(TinyMATRotatingWriter* writer) {
+    if (!writer) return NULL;
+    if (writer->maxBytes>0 || writer->maxSeconds>0) {
+        const uint64_t size=TinyMATWriter_getSize(writer->current);
+        if (size>writer->emptySize) {
+            bool full=(writer->maxBytes>0 && size>=writer->maxBytes);
+            if (!full && writer->maxSeconds>0) {
+                full=(std::chrono::steady_clock::now()-writer->opened>=std::chrono::seconds(writer->maxSeconds));
+            }
+            if (full) TinyMATRotatingWriter_rotate(writer);
+        }
+    }
+    return writer->current;
+}
+
+uint32_t TinyMATRotatingWriter_getSequence(const TinyMATRotatingWriter* writer) {
+    if (!writer) return 0;
+    return writer->sequence;
+}
+
+bool TinyMATRotatingWriter_close(TinyMATRotatingWriter* writer) {
+    if (!writer) return false;
+    {
+        std::lock_guard<std::mutex> lock(writer->closeMutex);
+        writer->closeQueue.push_back(writer->current);
+        writer->stop=true;
+    }
+    writer->closeCondition.notify_one();
+    writer->closer.join();
+    const bool ok=!writer->closeFailed;
+    delete writer;
+    return ok;
+}
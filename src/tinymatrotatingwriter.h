@@ -0,0 +1,99 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATROTATINGWRITER_H
+#define TINYMATROTATINGWRITER_H
+
+#include "tinymat_export.h"
+#include "tinymatwriter.h"
+
+#include <stdint.h>
+
+/*! \defgroup tinymatrotatingwriter Rotating MAT-files for long-running recordings
+    \ingroup tinymatwriter
+
+    A TinyMATRotatingWriter writes a sequence of MAT-files \c <basename>_000000.mat, \c <basename>_000001.mat, ...
+    It switches to the next file, when the current file exceeds a given size or was opened longer than a given time.
+    The previous file is closed on a background thread, so the writing thread does not wait for the data to be
+    flushed to disk. Each file contains a variable \c tinymat_sequence with its number in the sequence.
+
+    Request the current file with TinyMATRotatingWriter_file() before each top-level variable (the switch to the
+    next file only happens in this function):
+\code
+    TinyMATRotatingWriter* writer=TinyMATRotatingWriter_open("recording", NULL, 512*1024*1024);
+    for (...) {
+        TinyMATWriter_writeMatrix2D_rowmajor(TinyMATRotatingWriter_file(writer), "frame", ...);
+    }
+    TinyMATRotatingWriter_close(writer);
+\endcode
+
+ */
+
+/** \brief name of the variable, which stores the number of a file in the sequence */
+#define TINYMAT_SEQUENCE_NAME "tinymat_sequence"
+
+struct TinyMATRotatingWriter; // forward
+
+/*! \brief open the first file of a rotating writer
+    \ingroup tinymatrotatingwriter
+
+    \param basename base of the filenames, a trailing \c ".mat" is removed
+    \param description description for the header of each file
+    \param maxBytes switch to the next file, when the current file has at least this size (0: no size limit)
+    \param maxSeconds switch to the next file, when the current file was opened at least this many seconds ago (0: no time limit)
+    \param bufSize buffer size for each file, see TinyMATWriter_open()
+    \return a new rotating writer, or NULL if the first file could not be opened
+ */
+TINYMAT_EXPORT TinyMATRotatingWriter* TinyMATRotatingWriter_open(const char* basename, const char* description=NULL, uint64_t maxBytes=0, uint32_t maxSeconds=0, size_t bufSize=1024*100);
+
+/*! \brief returns the file, the next top-level variable should be written into
+    \ingroup tinymatrotatingwriter
+
+    If the size or time limit of the current file is reached, the next file is opened and the current file is closed in the background.
+    Files are only switched, if the current file contains data. If the next file cannot be opened, the current file
+    is returned (and the switch is attempted again on the next call).
+
+    Use the returned file for one complete top-level variable (including all members of a struct or cell array)
+    and request it again for the next variable. Do not close the returned file.
+ */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATRotatingWriter_file(TinyMATRotatingWriter* writer);
+
+/*! \brief switches to the next file now, independent of the limits
+    \ingroup tinymatrotatingwriter
+
+    \return \c true on success
+ */
+TINYMAT_EXPORT bool TinyMATRotatingWriter_rotate(TinyMATRotatingWriter* writer);
+
+/*! \brief returns the number of the current file in the sequence (starting at 0)
+    \ingroup tinymatrotatingwriter
+ */
+TINYMAT_EXPORT uint32_t TinyMATRotatingWriter_getSequence(const TinyMATRotatingWriter* writer);
+
+/*! \brief closes the current file, waits until all previous files are closed and destroys the writer
+    \ingroup tinymatrotatingwriter
+
+    \return \c false, if one of the files could not be closed or failed its check (see TinyMATWriter_setVerifyOnClose() )
+ */
+TINYMAT_EXPORT bool TinyMATRotatingWriter_close(TinyMATRotatingWriter* writer);
+
+#endif // TINYMATROTATINGWRITER_H
@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#include "tinymatshardedwriter.h"
+#include <thread>
+#include <algorithm>
+
+/*! \brief state of a sharded writer
+    \ingroup tinymatshardedwriter
+    \internal
+ */
+struct TinyMATShardedWriter {
+    TinyMATShardedWriter() :
+      policy(TinyMATShardPolicy::RoundRobin),
+      next(0)
+    {
+    }
+    std::string manifestFilename;
+    std::string description;
+    TinyMATShardPolicy policy;
+    /** \brief filenames of the shards */
+    std::vector<std::string> filenames;
+    /** \brief the shards */
+    std::vector<TinyMATWriterFile*> shards;
+    /** \brief bytes assigned to each shard (sum of the size hints) */
+    std::vector<uint64_t> assigned;
+    /** \brief next shard for TinyMATShardPolicy::RoundRobin */
+    uint32_t next;
+    /** \brief names of all variables */
+    std::vector<std::string> variables;
+    /** \brief 1-based shard index of each variable */
+    std::vector<double> variableShards;
+};
+
+/** \brief chooses the shard for the variable \a name and records it for the manifest */
+static uint32_t TinyMATShardedWriter_choose(TinyMATShardedWriter* writer, const char* name, uint64_t sizeHint) {
+    const uint32_t n=static_cast<uint32_t>(writer->shards.size());
+    uint32_t s=0;
+    if (writer->policy==TinyMATShardPolicy::BySize) {
+        for (uint32_t i=1; i<n; i++) {
+            if (writer->assigned[i]<writer->assigned[s]) s=i;
+        }
+    } else {
+        s=writer->next;
+        writer->next=(writer->next+1)%n;
+    }
+    writer->assigned[s]+=(sizeHint>0)?sizeHint:1;
+    writer->variables.push_back(name?name:"");
+    writer->variableShards.push_back(s+1);
+    return s;
+}
+
+TinyMATShardedWriter* TinyMATShardedWriter_open(const char* manifestFilename, const char* const* shardFilenames, uint32_t shards, TinyMATShardPolicy policy, const char* description, size_t bufSize) {
+    if (!manifestFilename || !shardFilenames || shards==0) return NULL;
+    TinyMATShardedWriter* writer=new TinyMATShardedWriter;
+    writer->manifestFilename=manifestFilename;
+    if (description) writer->description=description;
+    writer->policy=policy;
+    for (uint32_t i=0; i<shards; i++) {
+        TinyMATWriterFile* mat=shardFilenames[i]?TinyMATWriter_open(shardFilenames[i], description, bufSize):NULL;
+        if (!mat) {
+            for (TinyMATWriterFile* m: writer->shards) TinyMATWriter_closeChecked(m);
+            delete writer;
+            return NULL;
+        }
+        writer->filenames.push_back(shardFilenames[i]);
+        writer->shards.push_back(mat);
+    }
+    writer->assigned.resize(shards, 0);
+    return writer;
+}
+
+TinyMATWriterFile* TinyMATShardedWriter_file(TinyMATShardedWriter* writer, const char* name, uint64_t sizeHint) {
+    if (!writer) return NULL;
+    TinyMATWriterFile* mat=writer->shards[TinyMATShardedWriter_choose(writer, name, sizeHint)];
+    TinyMATWriter_waitForWrites(mat);
+    return mat;
+}
+
+std::future<void> TinyMATShardedWriter_enqueue(TinyMATShardedWriter* writer, const char* name, std::function<void(TinyMATWriterFile*)> task, uint64_t sizeHint) {
+    if (!writer) return TinyMATWriter_enqueue(NULL, task);
+    TinyMATWriterFile* mat=writer->shards[TinyMATShardedWriter_choose(writer, name, sizeHint)];
+    return TinyMATWriter_enqueue(mat, task);
+}
+
+bool TinyMATShardedWriter_close(TinyMATShardedWriter* writer) {
+    if (!writer) return false;
+    // close all shards in parallel (this also waits for their pending tasks)
+    std::vector<std::thread> closers;
+    std::vector<char> closed(writer->shards.size(), 0);
+    for (size_t i=1; i<writer->shards.size(); i++) {
+        closers.emplace_back([writer, &closed, i]() { closed[i]=TinyMATWriter_closeChecked(writer->shards[i])?1:0; });
+    }
+    closed[0]=TinyMATWriter_closeChecked(writer->shards[0])?1:0;
+    for (std::thread& t: closers) t.join();
+    bool ok=(std::find(closed.begin(), closed.end(), 0)==closed.end());
+
+    TinyMATWriterFile* manifest=TinyMATWriter_open(writer->manifestFilename.c_str(), writer->description.size()>0?writer->description.c_str():NULL);
+    if (manifest) {
+        TinyMATWriter_writeStringVector(manifest, "shards", writer->filenames);
+        TinyMATWriter_writeStringVector(manifest, "variables", writer->variables);
+        TinyMATWriter_writeDoubleVector(manifest, "shard", writer->variableShards, true);
+        if (!TinyMATWriter_closeChecked(manifest)) ok=false;
+    } else {
+        ok=false;
+    }
+    delete writer;
+    return ok;
+}
@@ -0,0 +1,135 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+
+
+#ifndef TINYMATSHARDEDWRITER_H
+#define TINYMATSHARDEDWRITER_H
+
+#include "tinymat_export.h"
+#include "tinymatwriter.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+#include <memory>
+
+/*! \defgroup tinymatshardedwriter Distributing variables over several MAT-files
+    \ingroup tinymatwriter
+
+    A TinyMATShardedWriter distributes the top-level variables over several MAT-files (shards), e.g. on different disks.
+    Each shard has its own background writer thread (see TinyMATWriter_enqueue() ), so variables written with
+    TinyMATShardedWriter_enqueue() are written to all shards in parallel.
+
+    On TinyMATShardedWriter_close() a small manifest MAT-file is written, which contains
+      - \c shards: the filenames of the shards (cell array of strings)
+      - \c variables: the names of all variables (cell array of strings)
+      - \c shard: for each variable the (1-based) index of the shard, which contains it
+    .
+
+\code
+    const char* shards[2]={"/mnt/disk1/data.mat", "/mnt/disk2/data.mat"};
+    TinyMATShardedWriter* writer=TinyMATShardedWriter_open("data_manifest.mat", shards, 2);
+    for (...) {
+        TinyMATShardedWriter_writeMatrixND_colmajorAsync(writer, name, std::move(frame), {rows, cols});
+    }
+    TinyMATShardedWriter_close(writer);
+\endcode
+
+ */
+
+/** \brief specifies, how a TinyMATShardedWriter chooses the shard for a variable
+    \ingroup tinymatshardedwriter
+ */
+enum class TinyMATShardPolicy {
+    RoundRobin, /*!< \brief the shards are used one after the other */
+    BySize, /*!< \brief each variable goes to the shard with the fewest bytes so far (according to the size hints) */
+};
+
+struct TinyMATShardedWriter; // forward
+
+/*! \brief open a sharded writer
+    \ingroup tinymatshardedwriter
+
+    \param manifestFilename filename of the manifest, written by TinyMATShardedWriter_close()
+    \param shardFilenames filenames of the shards
+    \param shards number of shards
+    \param policy how a shard is chosen for each variable
+    \param description description for the header of the manifest and all shards
+    \param bufSize buffer size for each shard, see TinyMATWriter_open()
+    \return a new sharded writer, or NULL if one of the shards could not be opened
+ */
+TINYMAT_EXPORT TinyMATShardedWriter* TinyMATShardedWriter_open(const char* manifestFilename, const char* const* shardFilenames, uint32_t shards, TinyMATShardPolicy policy=TinyMATShardPolicy::RoundRobin, const char* description=NULL, size_t bufSize=1024*100);
+
+/*! \brief chooses a shard for the variable \a name and returns its file for synchronous writing
+    \ingroup tinymatshardedwriter
+
+    \param writer the sharded writer
+    \param name name of the variable, that is written next
+    \param sizeHint estimated size of the variable in bytes (used by TinyMATShardPolicy::BySize, 0 counts as one byte)
+    \return the file to write the variable \a name into (do not close it)
+
+    The returned file may have tasks pending from TinyMATShardedWriter_enqueue(), this function waits until they are finished.
+ */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATShardedWriter_file(TinyMATShardedWriter* writer, const char* name, uint64_t sizeHint=0);
+
+/*! \brief chooses a shard for the variable \a name and runs \a task on the background thread of that shard
+    \ingroup tinymatshardedwriter
+
+    \param writer the sharded writer
+    \param name name of the variable, that \a task writes
+    \param task the function, that writes the variable \a name into the file, which it gets as parameter
+    \param sizeHint estimated size of the variable in bytes (used by TinyMATShardPolicy::BySize, 0 counts as one byte)
+    \return a future, that becomes ready when \a task has finished
+
+    \see TinyMATWriter_enqueue()
+ */
+TINYMAT_EXPORT std::future<void> TinyMATShardedWriter_enqueue(TinyMATShardedWriter* writer, const char* name, std::function<void(TinyMATWriterFile*)> task, uint64_t sizeHint=0);
+
+/*! \brief waits for all pending tasks, closes all shards (in parallel), writes the manifest and destroys the writer
+    \ingroup tinymatshardedwriter
+
+    \return \c true, if all shards were closed (and passed their check, see TinyMATWriter_setVerifyOnClose() ) and
+            the manifest could be written
+ */
+TINYMAT_EXPORT bool TinyMATShardedWriter_close(TinyMATShardedWriter* writer);
+
+/*! \brief asynchronously write a N-dimensional matrix in column-major form into one of the shards, taking ownership of the data
+    \ingroup tinymatshardedwriter
+
+    \param writer the sharded writer
+    \param name variable name for the new array
+    \param data the array to write (in column-major order), moved into the write task
+    \param sizes number of entries in each dimension {rows, cols, matrices, ...}
+    \return a future, that becomes ready when the matrix is written
+  */
+template<typename T>
+inline std::future<void> TinyMATShardedWriter_writeMatrixND_colmajorAsync(TinyMATShardedWriter* writer, const char* name, std::vector<T>&& data, const std::vector<int32_t>& sizes) {
+    const uint64_t bytes=static_cast<uint64_t>(data.size())*sizeof(T);
+    auto d=std::make_shared<std::vector<T> >(std::move(data));
+    const std::string n(name);
+    return TinyMATShardedWriter_enqueue(writer, name, [d, n, sizes](TinyMATWriterFile* m) {
+        TinyMATWriter_writeMatrixND_colmajor(m, n.c_str(), d->data(), sizes.data(), static_cast<uint32_t>(sizes.size()));
+    }, bytes);
+}
+
+#endif // TINYMATSHARDEDWRITER_H
@@ -23,16 +23,30 @@
 #include <list>
 #include <algorithm>
 #include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 //#include <iostream>
 
 #include "tinymatwriter.h"
+#include "tinymatbyteorder.h"
+#include "tinymatchecksum.h"
+#include "tinymatreader.h"
 #include "tinymat_version.h"
 
 /** \brief if defined, files are beeing created in a memory buffer and are only written to disk at the end. 
 *          if undefined, the files are written directly to disk, including move operations on disk, which can be a factor 2-3 slower. */
 //#define TINYMAT_WRITE_VIA_MEMORY
 
+#ifdef TINYMAT_WRITE_VIA_MEMORY
+#  define TINYMAT_MEMORY_CACHE_DEFAULT true
+#else
+#  define TINYMAT_MEMORY_CACHE_DEFAULT false
+#endif
+
 #ifndef __WINDOWS__
 # if defined(WIN32) || defined(WIN64) || defined(_MSC_VER) || defined(_WIN32)
 #  define __WINDOWS__
@@ -40,10 +54,18 @@
 #endif
 
 #ifndef __LINUX__
-# if defined(linux)
+# if defined(linux) || defined(__linux__)
 #  define __LINUX__
 # endif
 #endif
+#ifdef __WINDOWS__
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
+#ifdef __LINUX__
+#  include <fcntl.h>
+#endif
 #ifdef TINYMAT_USES_QVARIANT
 //#  include <QDebug>
 #  include <QPoint>
@@ -63,6 +85,11 @@
 #define TINYMAT_inlineattrib inline
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#  define TINYMAT_HAS_SSE2
+#  include <emmintrin.h>
+#endif
+
 
 
 
@@ -78,6 +105,9 @@
 #define TINYMAT_mxINT64_CLASS_arrayflags 0x0000000E
 #define TINYMAT_mxUINT64_CLASS_arrayflags 0x0000000F
 #define TINYMAT_mxUINT8_LOGICAL_CLASS_arrayflags (TINYMAT_mxUINT8_CLASS_arrayflags+(0x0002<<8))
+#define TINYMAT_mxSPARSE_CLASS_arrayflags 0x00000005
+#define TINYMAT_COMPLEX_arrayflags (0x0008<<8)
+#define TINYMAT_mxSPARSE_LOGICAL_CLASS_arrayflags (TINYMAT_mxSPARSE_CLASS_arrayflags+(0x0002<<8))
 
 
 #define TINYMAT_miINT8 1
@@ -96,16 +126,38 @@
 #define TINYMAT_miUTF16 17
 #define TINYMAT_miUTF32 18
 
+// the compile-time encoders in tinymatencoder.h have to use the same codes
+static_assert(TinyMATTypeTraits<double>::arrayflags==TINYMAT_mxDOUBLE_CLASS_arrayflags && TinyMATTypeTraits<double>::miType==TINYMAT_miDOUBLE, "type traits for double");
+static_assert(TinyMATTypeTraits<float>::arrayflags==TINYMAT_mxSINGLE_CLASS_arrayflags && TinyMATTypeTraits<float>::miType==TINYMAT_miSINGLE, "type traits for float");
+static_assert(TinyMATTypeTraits<int64_t>::arrayflags==TINYMAT_mxINT64_CLASS_arrayflags && TinyMATTypeTraits<int64_t>::miType==TINYMAT_miINT64, "type traits for int64_t");
+static_assert(TinyMATTypeTraits<uint64_t>::arrayflags==TINYMAT_mxUINT64_CLASS_arrayflags && TinyMATTypeTraits<uint64_t>::miType==TINYMAT_miUINT64, "type traits for uint64_t");
+static_assert(TinyMATTypeTraits<int32_t>::arrayflags==TINYMAT_mxINT32_CLASS_arrayflags && TinyMATTypeTraits<int32_t>::miType==TINYMAT_miINT32, "type traits for int32_t");
+static_assert(TinyMATTypeTraits<uint32_t>::arrayflags==TINYMAT_mxUINT32_CLASS_arrayflags && TinyMATTypeTraits<uint32_t>::miType==TINYMAT_miUINT32, "type traits for uint32_t");
+static_assert(TinyMATTypeTraits<int16_t>::arrayflags==TINYMAT_mxINT16_CLASS_arrayflags && TinyMATTypeTraits<int16_t>::miType==TINYMAT_miINT16, "type traits for int16_t");
+static_assert(TinyMATTypeTraits<uint16_t>::arrayflags==TINYMAT_mxUINT16_CLASS_arrayflags && TinyMATTypeTraits<uint16_t>::miType==TINYMAT_miUINT16, "type traits for uint16_t");
+static_assert(TinyMATTypeTraits<int8_t>::arrayflags==TINYMAT_mxINT8_CLASS_arrayflags && TinyMATTypeTraits<int8_t>::miType==TINYMAT_miINT8, "type traits for int8_t");
+static_assert(TinyMATTypeTraits<uint8_t>::arrayflags==TINYMAT_mxUINT8_CLASS_arrayflags && TinyMATTypeTraits<uint8_t>::miType==TINYMAT_miUINT8, "type traits for uint8_t");
+static_assert(TinyMATTypeTraits<bool>::arrayflags==TINYMAT_mxUINT8_LOGICAL_CLASS_arrayflags && TinyMATTypeTraits<bool>::miType==TINYMAT_miINT8, "type traits for bool");
+
 struct TinyMATWriterStruct {
   inline TinyMATWriterStruct() :
     sizepos(-1),
-    data_start(-1)
+    data_start(-1),
+    depth(0),
+    checksum(0),
+    hasChecksum(false)
   {
   }
   /** \brief position of the size-data field */
-  long sizepos;
-  long data_start;
+  int64_t sizepos;
+  int64_t data_start;
+  /** \brief element depth of the fields (elements nested deeper, e.g. the cells of a string vector, are no fields) */
+  int depth;
   std::vector<std::string> itemnames;
+  /** \brief CRC32C of the top-level element up to data_start, so the checksum can be rewound, when the fields are moved in TinyMATWriter_endStruct() */
+  uint32_t checksum;
+  /** \brief \c true, if \a checksum is known */
+  bool hasChecksum;
 };
 
 struct TinyMATWriterCell {
@@ -115,8 +167,8 @@ struct TinyMATWriterCell {
   {
   }
   /** \brief position of the size-data field */
-  long sizepos;
-  long data_start;
+  int64_t sizepos;
+  int64_t data_start;
 };
 
 enum class TinyMATWriterStackItem {
@@ -124,6 +176,268 @@ enum class TinyMATWriterStackItem {
   Struct
 };
 
+/** \brief describes a top-level element in a MAT-file */
+struct TinyMATWriterVariable {
+  inline TinyMATWriterVariable(const std::string& name_=std::string(), int64_t offset_=-1, int64_t size_=0) :
+    name(name_),
+    offset(offset_),
+    size(size_),
+    checksum(0),
+    hasChecksum(false)
+  {
+  }
+  /** \brief name of the variable (empty for tombstones and compressed elements) */
+  std::string name;
+  /** \brief position of the tag of the element in the file */
+  int64_t offset;
+  /** \brief size of the element in bytes, including the tag */
+  int64_t size;
+  /** \brief CRC32C of the element (see TinyMATWriter_setWriteChecksums() ) */
+  uint32_t checksum;
+  /** \brief \c true, if \a checksum is known */
+  bool hasChecksum;
+};
+
+#ifndef TINYMAT_SCRATCH_RETAIN_LIMIT
+/** \brief a scratch arena keeps at most this many bytes between two top-level variables */
+#  define TINYMAT_SCRATCH_RETAIN_LIMIT (16*1024*1024)
+#endif
+
+/*! \brief scratch arena for temporary conversion buffers of a TinyMATWriterFile
+    \ingroup tinymatwriter
+    \internal
+
+    Memory is handed out from one block by advancing an offset. The write functions bracket their temporary buffers
+    with mark() and release(), so memory used by a nested element is returned as soon as the element is written, and the
+    peak usage does not grow with the nesting depth. Everything else is released by reset(), which is called after each
+    top-level variable. Requests, that do not fit into the block, are served by malloc(), and on the next reset() the
+    block is enlarged, so it can hold the peak usage (up to TINYMAT_SCRATCH_RETAIN_LIMIT bytes). Thus writing many
+    variables of similar size needs no allocations after the first one.
+ */
+struct TinyMATWriterScratch {
+  inline TinyMATWriterScratch() :
+    buffer(NULL),
+    size(0),
+    used(0),
+    owned(false),
+    extraBytes(0),
+    peak(0),
+    generation(0)
+  {
+  }
+  inline ~TinyMATWriterScratch() {
+    release();
+    if (owned) free(buffer);
+  }
+  /** \brief the current block */
+  uint8_t* buffer;
+  /** \brief size of buffer in bytes */
+  size_t size;
+  /** \brief bytes of buffer, that are handed out */
+  size_t used;
+  /** \brief \c true, if buffer was allocated by the arena (and not supplied by the user) */
+  bool owned;
+  /** \brief requests, that did not fit into buffer */
+  std::vector<void*> extra;
+  /** \brief size of all requests in extra */
+  size_t extraBytes;
+  /** \brief largest value of used+extraBytes since the last reset() */
+  size_t peak;
+  /** \brief counts the calls of reset() and setBuffer(), a mark from an earlier generation is void */
+  size_t generation;
+
+  /** \brief returns \a bytes of memory (aligned to 64 bytes if served from the block), valid until the next reset() */
+  inline void* alloc(size_t bytes) {
+    const size_t start=(used+63)&~static_cast<size_t>(63);
+    if (buffer && start+bytes<=size) {
+      used=start+bytes;
+      if (used+extraBytes>peak) peak=used+extraBytes;
+      return buffer+start;
+    }
+    void* p=malloc(bytes);
+    if (p) {
+      extra.push_back(p);
+      extraBytes+=bytes+64;
+      if (used+extraBytes>peak) peak=used+extraBytes;
+    }
+    return p;
+  }
+  /** \brief returns the current state, all memory handed out afterwards is returned by release(const TinyMATWriterScratchMark&) */
+  inline TinyMATWriterScratchMark mark() const {
+    TinyMATWriterScratchMark m;
+    m.used=used;
+    m.extraCount=extra.size();
+    m.extraBytes=extraBytes;
+    m.generation=generation;
+    return m;
+  }
+  /** \brief releases all memory handed out since \a m was returned by mark() (nothing, if reset() was called in between) */
+  inline void release(const TinyMATWriterScratchMark& m) {
+    if (m.generation!=generation) return;
+    for (size_t i=m.extraCount; i<extra.size(); i++) free(extra[i]);
+    if (extra.size()>m.extraCount) extra.resize(m.extraCount);
+    extraBytes=m.extraBytes;
+    used=m.used;
+  }
+  /** \brief releases all memory handed out so far */
+  inline void reset() {
+    const size_t needed=peak;
+    release();
+    if (needed>size && needed<=TINYMAT_SCRATCH_RETAIN_LIMIT) {
+      uint8_t* b=static_cast<uint8_t*>(malloc(needed));
+      if (b) {
+        if (owned) free(buffer);
+        buffer=b;
+        size=needed;
+        owned=true;
+      }
+    }
+    used=0;
+    peak=0;
+    generation++;
+  }
+  /** \brief uses \a b with \a s bytes as block (owned by the caller) */
+  inline void setBuffer(void* b, size_t s) {
+    release();
+    if (owned) free(buffer);
+    buffer=static_cast<uint8_t*>(b);
+    size=b?s:0;
+    used=0;
+    peak=0;
+    generation++;
+    owned=false;
+  }
+  /** \brief frees all requests, that did not fit into buffer */
+  inline void release() {
+    for (void* p: extra) free(p);
+    extra.clear();
+    extraBytes=0;
+  }
+};
+
+/*! \brief state of a column vector, that can be extended by TinyMATWriter_appendToColumn()
+    \ingroup TinyMATwriter
+    \internal
+
+    The column is followed by \a slack bytes of free space (a tombstone), into which new values are written.
+ */
+struct TinyMATWriterColumn {
+  inline TinyMATWriterColumn() :
+    offset(-1),
+    headerSize(0),
+    count(0),
+    slack(0),
+    varIndex(0),
+    checksum(0),
+    hasChecksum(false)
+  {
+  }
+  /** \brief position of the tag of the column element in the file */
+  int64_t offset;
+  /** \brief size of the element up to the first data value */
+  int64_t headerSize;
+  /** \brief number of values in the column */
+  uint32_t count;
+  /** \brief free bytes behind the column */
+  int64_t slack;
+  /** \brief index of the column in TinyMATWriterFile::variables */
+  size_t varIndex;
+  /** \brief CRC32C of the column element, updated with each append (see TinyMATWriter_setWriteChecksums() ) */
+  uint32_t checksum;
+  /** \brief \c true, if \a checksum is known */
+  bool hasChecksum;
+};
+
+/*! \brief the CRC32C of the top-level element, that is currently written (see TinyMATWriter_setWriteChecksums() )
+    \ingroup tinymatwriter
+    \internal
+
+    Every write into the element updates the CRC, so no second pass over the data is needed: bytes behind \a end extend
+    the CRC, bytes before \a end (e.g. sizes, that are patched when an element is finished) are patched into it with
+    TinyMAT_crc32cPatch().
+ */
+struct TinyMATWriterChecksum {
+  inline TinyMATWriterChecksum() :
+    active(false),
+    start(0),
+    end(0),
+    pos(0),
+    crc(0)
+  {
+  }
+  /** \brief \c true, while an element is tracked */
+  bool active;
+  /** \brief position of the tag of the element */
+  int64_t start;
+  /** \brief end of the bytes, that are included in \a crc */
+  int64_t end;
+  /** \brief the current write position */
+  int64_t pos;
+  /** \brief CRC32C of the bytes from \a start to \a end */
+  uint32_t crc;
+  /** \brief ranges before \a end, that were skipped (see TinyMAT_fskip() ) and are included as zeros in \a crc */
+  std::vector<std::pair<int64_t, int64_t> > holes;
+};
+
+/*! \brief a background thread, that executes write tasks for one TinyMATWriterFile in submission order
+    \ingroup TinyMATwriter
+    \internal
+ */
+struct TinyMATWriterExecutor {
+    TinyMATWriterExecutor() :
+      stop(false),
+      busy(false)
+    {
+      thread=std::thread([this]() { run(); });
+    }
+    ~TinyMATWriterExecutor() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop=true;
+      }
+      cond.notify_all();
+      thread.join();
+    }
+
+    /** \brief adds \a task to the end of the queue */
+    inline void enqueue(std::packaged_task<void()>&& task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+      }
+      cond.notify_all();
+    }
+    /** \brief blocks until the queue is empty and no task is running */
+    inline void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      idle.wait(lock, [this]() { return tasks.empty() && !busy; });
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable idle;
+    std::deque<std::packaged_task<void()> > tasks;
+    bool stop;
+    bool busy;
+  private:
+    inline void run() {
+      std::unique_lock<std::mutex> lock(mutex);
+      for (;;) {
+        cond.wait(lock, [this]() { return stop || !tasks.empty(); });
+        if (tasks.empty()) return;
+        std::packaged_task<void()> task=std::move(tasks.front());
+        tasks.pop_front();
+        busy=true;
+        lock.unlock();
+        task();
+        lock.lock();
+        busy=false;
+        if (tasks.empty()) idle.notify_all();
+      }
+    }
+};
+
 /*! \brief this struct represents a mat file
     \ingroup TinyMATwriter
     \internal
@@ -135,7 +449,20 @@ struct TinyMATWriterFile {
       filedata_size(0),
       filedata_current(0),
       filedata_count(0),
-      byteorder(TINYMAT_ORDER_UNKNOWN)
+      filedata_offset(0),
+      sizer(false),
+      byteorder(TINYMAT_ORDER_UNKNOWN),
+      swapBytes(false),
+      element_depth(0),
+      element_start(-1),
+      replaceExisting(false),
+      writeIndex(false),
+      writeChecksums(false),
+      verifyOnClose(false),
+      sparseThreshold(0),
+      concurrent(false),
+      appendOffset(0),
+      sharedFile(NULL)
     {
     }
 
@@ -149,16 +476,69 @@ struct TinyMATWriterFile {
     size_t filedata_current;
     /** \brief tatsächliche Datenbytes in filedata */
     size_t filedata_count;
+    /** \brief position in the file of the first byte in filedata (non-zero, if data is appended to an existing file) */
+    size_t filedata_offset;
+    /** \brief if \c true, nothing is stored, only filedata_current and filedata_count are tracked (see TinyMATWriter_openSizer() ) */
+    bool sizer;
 
-    /** \brief specifies the byte order of the system (and the written file!) */
+    /** \brief specifies the byte order of the system (all data is written in this order) */
     uint8_t byteorder;
+    /** \brief if \c true, the file is written in the other byte order, every value is swapped as it is written (see TinyMATWriter_setByteOrder() ) */
+    bool swapBytes;
 
     std::vector<TinyMATWriterStruct> structures;
     std::vector<TinyMATWriterCell> cells;
     std::vector<TinyMATWriterStackItem> stack;
 
+    /** \brief nesting depth of the element currently written (0 between top-level variables) */
+    int element_depth;
+    /** \brief position of the top-level element currently written */
+    int64_t element_start;
+    /** \brief name of the top-level element currently written */
+    std::string element_name;
+    /** \brief all top-level elements in the file, ordered by their position */
+    std::vector<TinyMATWriterVariable> variables;
+    /** \brief maps variable names to their index in variables */
+    std::map<std::string, size_t> variableIndex;
+    /** \brief if \c true, writing a top-level variable replaces an existing variable with the same name */
+    bool replaceExisting;
+    /** \brief if \c true, an index of all variables is appended on TinyMATWriter_close() (see TinyMATWriter_setWriteIndex() ) */
+    bool writeIndex;
+    /** \brief if \c true, the index contains the CRC32C of each variable (see TinyMATWriter_setWriteChecksums() ) */
+    bool writeChecksums;
+    /** \brief CRC32C of the top-level element, that is currently written */
+    TinyMATWriterChecksum checksum;
+    /** \brief if \c true, the finished file is checked on TinyMATWriter_close() (see TinyMATWriter_setVerifyOnClose() ) */
+    bool verifyOnClose;
+    /** \brief name of the file on disk (empty for memory buffers and sizers) */
+    std::string filename;
+    /** \brief column vectors, that can be extended by TinyMATWriter_appendToColumn() */
+    std::map<std::string, TinyMATWriterColumn> columns;
+    /** \brief if >0, 2D double matrices with at most this fraction of non-zero entries are written as sparse matrices */
+    double sparseThreshold;
+
+    /** \brief \c true, if this file is shared between several thread writers (see TinyMATWriter_openConcurrent() ) */
+    bool concurrent;
+    /** \brief for concurrent files: end of the file, i.e. the position of the next variable that is committed by a thread writer */
+    std::atomic<int64_t> appendOffset;
+#ifdef __WINDOWS__
+    /** \brief for concurrent files: serializes the positioned writes, as there is no pwrite() */
+    std::mutex appendMutex;
+#endif
+    /** \brief for thread writers: the concurrent file, this writer commits its variables to */
+    TinyMATWriterFile* sharedFile;
+
+    /** \brief temporary conversion buffers, released after each top-level variable */
+    TinyMATWriterScratch scratch;
+
+    /** \brief background thread for TinyMATWriter_enqueue(), started on first use */
+    std::unique_ptr<TinyMATWriterExecutor> executor;
+    /** \brief protects the creation of executor */
+    std::mutex executorMutex;
+
     inline void startStruct() {
       structures.push_back(TinyMATWriterStruct());
+      structures.back().depth=element_depth;
       stack.push_back(TinyMATWriterStackItem::Struct);
     }
 
@@ -172,7 +552,7 @@ struct TinyMATWriterFile {
     }
 
     inline void addStructItemName(const std::string& name) {
-      if (structures.size()>0 && stack.size()>0 && stack[stack.size()-1]==TinyMATWriterStackItem::Struct) {
+      if (structures.size()>0 && stack.size()>0 && stack[stack.size()-1]==TinyMATWriterStackItem::Struct && lastStruct().depth==element_depth) {
         lastStruct().itemnames.push_back(name);
       }
     }
@@ -195,7 +575,7 @@ struct TinyMATWriterFile {
 
 
 int TinyMATWriter_fOK(const TinyMATWriterFile* mat)  {
-    return (mat && (mat->file!=NULL));
+    return (mat && (mat->file!=NULL || mat->filedata!=NULL || mat->sizer));
 }
 
 
@@ -222,28 +602,67 @@ int TinyMATWriter_fOK(const TinyMATWriterFile* mat)  {
 }
 
 
+ /** \brief seeks in \a file with a 64-bit offset (\c long and thus fseek() only has 32 bits on Windows) */
+ TINYMAT_inlineattrib static int TinyMAT_fseek64(FILE* file, int64_t offset, int origin) {
+#ifdef __WINDOWS__
+     return _fseeki64(file, offset, origin);
+#else
+     return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+ }
+
+ /** \brief returns the current 64-bit position in \a file */
+ TINYMAT_inlineattrib static int64_t TinyMAT_ftell64(FILE* file) {
+#ifdef __WINDOWS__
+     return _ftelli64(file);
+#else
+     return static_cast<int64_t>(ftello(file));
+#endif
+ }
+
+
  TINYMAT_inlineattrib static int TinyMAT_fclose(TinyMATWriterFile* file) {
      //std::cout<<"TinyMAT_fclose()\n";
      //std::cout.flush();
      if (!file) return 0;
-     if (!file->file) {
-       delete file;
-       return 0;
-     }
-#ifdef TINYMAT_WRITE_VIA_MEMORY
-     if (file->filedata_count>0 && file->filedata) {
-       fseek(file->file, 0, SEEK_SET);
-       fwrite(file->filedata, 1, file->filedata_count, file->file);
-       file->filedata_size = 0;
-       file->filedata_current = 0;
-       file->filedata_count = 0;
-       free(file->filedata);
+     int ret=0;
+     if (file->file) {
+       if (file->filedata_count>0 && file->filedata) {
+         TinyMAT_fseek64(file->file, static_cast<int64_t>(file->filedata_offset), SEEK_SET);
+         fwrite(file->filedata, 1, file->filedata_count, file->file);
+       }
+       ret= fclose(file->file);
      }
-#endif
-     int ret= fclose(file->file);
+     file->filedata_size = 0;
+     file->filedata_current = 0;
+     file->filedata_count = 0;
+     free(file->filedata);
+     file->filedata = NULL;
      delete file;
      return ret;
  }
+
+ /** \brief asks the OS to allocate \a size bytes of disk space for \a file (without changing its size), if supported */
+ TINYMAT_inlineattrib static void TinyMAT_fpreallocate(FILE* file, uint64_t size) {
+     if (!file || size==0) return;
+#if defined(__LINUX__) && defined(FALLOC_FL_KEEP_SIZE)
+     // errors are ignored, e.g. if the filesystem does not support preallocation
+     (void)fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+#else
+     (void)size;
+#endif
+ }
+
+ /** \brief truncates the OS-file behind \a file to \a size bytes (a memory cache is not touched!) */
+ TINYMAT_inlineattrib static int TinyMAT_ftruncate(FILE* file, int64_t size) {
+     if (!file) return -1;
+     fflush(file);
+#ifdef __WINDOWS__
+     return _chsize_s(_fileno(file), size);
+#else
+     return ftruncate(fileno(file), size);
+#endif
+ }
  
  
 const char *TinyMATWriter_getVersion()
@@ -253,14 +672,14 @@ const char *TinyMATWriter_getVersion()
 }
 
 
- TINYMAT_inlineattrib static TinyMATWriterFile* TinyMAT_fopen(const char* filename, size_t bufSize=1024*100) {
+ TINYMAT_inlineattrib static TinyMATWriterFile* TinyMAT_fopen(const char* filename, size_t bufSize=1024*100, const char* mode="wb+", bool memoryCache=TINYMAT_MEMORY_CACHE_DEFAULT) {
      //std::cout<<"TinyMAT_fopen()\n";
      //std::cout.flush();
      TinyMATWriterFile* mat=new TinyMATWriterFile;
 #ifdef HAVE_FOPEN_S
-     if (fopen_s(&(mat->file), filename, "wb+") == 0) {
+     if (fopen_s(&(mat->file), filename, mode) == 0) {
 #else
-     if ((mat->file=fopen(filename, "wb+")) != NULL) {
+     if ((mat->file=fopen(filename, mode)) != NULL) {
 #endif
        if (mat->file) {
          if (bufSize > 0) {
@@ -271,36 +690,51 @@ const char *TinyMATWriter_getVersion()
          }
        }
        mat->byteorder = (uint8_t)TinyMAT_get_byteorder();
+       mat->filename = filename;
      }
-#ifdef TINYMAT_WRITE_VIA_MEMORY
+     if (memoryCache && mat->file) {
       mat->filedata_size = std::max<size_t>(bufSize, BUFSIZ);
       mat->filedata_current = 0;
       mat->filedata_count = 0;
       mat->filedata = (uint8_t*)malloc(mat->filedata_size);
       if (!mat->filedata) {
-        delete mat;
+        TinyMAT_fclose(mat);
         return NULL;
       }
-#endif
+     }
      return mat;
  }
 
-  TINYMAT_inlineattrib static long TinyMAT_ftell(TinyMATWriterFile* file) {
+ /** \brief creates a TinyMATWriterFile, that only writes into a memory buffer (no file is attached) */
+ TINYMAT_inlineattrib static TinyMATWriterFile* TinyMAT_bufopen(size_t bufSize=1024*100) {
+     TinyMATWriterFile* mat=new TinyMATWriterFile;
+     mat->byteorder = (uint8_t)TinyMAT_get_byteorder();
+     mat->filedata_size = std::max<size_t>(bufSize, BUFSIZ);
+     mat->filedata = (uint8_t*)malloc(mat->filedata_size);
+     if (!mat->filedata) {
+       delete mat;
+       return NULL;
+     }
+     return mat;
+ }
+
+  TINYMAT_inlineattrib static int64_t TinyMAT_ftell(TinyMATWriterFile* file) {
      //std::cout<<"TinyMAT_ftell()\n";
      //std::cout.flush();
-     if (!file || !file->file) return 0;
-#ifdef TINYMAT_WRITE_VIA_MEMORY
-     return static_cast<long>(file->filedata_current);
-#else
-     return ftell(file->file);
-#endif
+     if (!TinyMATWriter_fOK(file)) return 0;
+     if (file->filedata || file->sizer) {
+       return static_cast<int64_t>(file->filedata_offset + file->filedata_current);
+     } else {
+       return TinyMAT_ftell64(file->file);
+     }
  }
- TINYMAT_inlineattrib static int TinyMAT_fseek(TinyMATWriterFile* file, long offset) {
+ TINYMAT_inlineattrib static int TinyMAT_fseek(TinyMATWriterFile* file, int64_t offset) {
      //std::cout<<"TinyMAT_fseek()\n";
      //std::cout.flush();
-     if (!file || !file->file) return 0;
-#ifdef TINYMAT_WRITE_VIA_MEMORY
-       long start = 0;
+     if (!TinyMATWriter_fOK(file)) return 0;
+     if (file->checksum.active) file->checksum.pos=offset;
+     if (file->filedata || file->sizer) {
+       int64_t start = -static_cast<int64_t>(file->filedata_offset);
        int res = 0;
        if (start + offset < 0) {
          throw std::runtime_error("seek before start of file");
@@ -313,15 +747,14 @@ const char *TinyMATWriter_getVersion()
          res=0;
        }
        return res;
-#else
-       return fseek(file->file, offset, SEEK_SET);
-#endif
+     } else {
+       return TinyMAT_fseek64(file->file, offset, SEEK_SET);
+     }
  }
 
  /** \brief grows the internal memory array for file writing by \a size_increment bytes */
  TINYMAT_inlineattrib static void TinyMAT_growMem(uint32_t size_increment, TinyMATWriterFile* file) {
-#ifdef TINYMAT_WRITE_VIA_MEMORY
-   if (file->filedata_current + size_increment + 100 >= file->filedata_size) {
+   if (file->filedata && file->filedata_current + size_increment + 100 >= file->filedata_size) {
      size_t newsize = file->filedata_size;
      while (file->filedata_current + size_increment + 100 >= newsize) {
        if (newsize < 100 * 1024 * 1024) newsize = newsize * 2;
@@ -334,16 +767,113 @@ const char *TinyMATWriter_getVersion()
         file->filedata_size = newsize;
      }
    }
-#endif
  }
 
 
+TINYMAT_inlineattrib static void TinyMAT_pread(TinyMATWriterFile* mat, int64_t pos, void* data, size_t size);
+
+/*! \brief updates the checksum of the current top-level element for \a size bytes \a data, that are about to be written at \a pos
+    \ingroup tinymatwriter
+    \internal
+
+    Has to be called before the data is written, as bytes, that are overwritten, are read to patch the CRC (unless they are
+    in a skipped range, which is still zero). Writes before the element (e.g. tombstones) are ignored.
+ */
+static void TinyMAT_checksumWrite(TinyMATWriterFile* mat, int64_t pos, const void* data, size_t size) {
+    TinyMATWriterChecksum& c=mat->checksum;
+    const uint8_t* d=static_cast<const uint8_t*>(data);
+    const int64_t to=pos+static_cast<int64_t>(size);
+    if (to<=c.start) return;
+    if (pos<c.start) {
+        d+=c.start-pos;
+        pos=c.start;
+    }
+    const int64_t patchEnd=std::min(to, c.end);
+    while (pos<patchEnd) {
+        // split the range at the holes: in a hole the old bytes are zero, elsewhere they are read
+        int64_t segEnd=patchEnd;
+        size_t hole=c.holes.size();
+        for (size_t i=0; i<c.holes.size(); i++) {
+            if (c.holes[i].first<=pos && pos<c.holes[i].second) hole=i;
+            else if (c.holes[i].first>pos) segEnd=std::min(segEnd, c.holes[i].first);
+        }
+        if (hole<c.holes.size()) {
+            const std::pair<int64_t, int64_t> h=c.holes[hole];
+            segEnd=std::min(patchEnd, h.second);
+            c.crc=TinyMAT_crc32cPatch(c.crc, static_cast<uint64_t>(c.end-c.start), static_cast<uint64_t>(pos-c.start), NULL, d, static_cast<uint64_t>(segEnd-pos));
+            c.holes.erase(c.holes.begin()+static_cast<int64_t>(hole));
+            if (h.first<pos) c.holes.push_back(std::make_pair(h.first, pos));
+            if (segEnd<h.second) c.holes.push_back(std::make_pair(segEnd, h.second));
+        } else if (mat->filedata && pos>=static_cast<int64_t>(mat->filedata_offset)) {
+            c.crc=TinyMAT_crc32cPatch(c.crc, static_cast<uint64_t>(c.end-c.start), static_cast<uint64_t>(pos-c.start), &(mat->filedata[pos-mat->filedata_offset]), d, static_cast<uint64_t>(segEnd-pos));
+        } else {
+            uint8_t old[4096];
+            for (int64_t p=pos; p<segEnd; p+=static_cast<int64_t>(sizeof(old))) {
+                const size_t n=static_cast<size_t>(std::min<int64_t>(static_cast<int64_t>(sizeof(old)), segEnd-p));
+                TinyMAT_pread(mat, p, old, n);
+                c.crc=TinyMAT_crc32cPatch(c.crc, static_cast<uint64_t>(c.end-c.start), static_cast<uint64_t>(p-c.start), old, d+(p-pos), n);
+            }
+        }
+        d+=segEnd-pos;
+        pos=segEnd;
+    }
+    if (to>c.end) {
+        if (pos>c.end) {
+            c.crc=TinyMAT_crc32cZeros(c.crc, static_cast<uint64_t>(pos-c.end));
+            c.holes.push_back(std::make_pair(c.end, pos));
+        }
+        c.crc=TinyMAT_crc32c(c.crc, d, static_cast<uint64_t>(to-pos));
+        c.end=to;
+    }
+}
+
+/*! \brief starts computing the checksum of the top-level element at \a start, of which the bytes up to \a end (with the CRC32C \a crc) are already written
+    \ingroup tinymatwriter
+    \internal
+ */
+static void TinyMAT_checksumBegin(TinyMATWriterFile* mat, int64_t start, int64_t end, int64_t pos, uint32_t crc) {
+    TinyMATWriterChecksum& c=mat->checksum;
+    c.active=true;
+    c.start=start;
+    c.end=end;
+    c.pos=pos;
+    c.crc=crc;
+    c.holes.clear();
+}
+
+/*! \brief finishes the checksum of the current top-level element with \a size bytes
+    \ingroup tinymatwriter
+    \internal
+
+    \return \c false, if no checksum was computed
+ */
+static bool TinyMAT_checksumEnd(TinyMATWriterFile* mat, int64_t size, uint32_t* crc) {
+    TinyMATWriterChecksum& c=mat->checksum;
+    if (!c.active) return false;
+    c.active=false;
+    c.holes.clear();
+    if (c.start+size<c.end) return false;
+    // a skipped range at the end is still zero
+    *crc=TinyMAT_crc32cZeros(c.crc, static_cast<uint64_t>(c.start+size-c.end));
+    return true;
+}
+
 TINYMAT_inlineattrib static int TinyMAT_fwrite(const void* data, uint32_t size, uint32_t count, TinyMATWriterFile* file)
 {
      //std::cout<<"TinyMAT_fwrite()\n";
-     if (!file || !file->file || !data || size*count<=0) return 0;
+     if (file && file->sizer && size*count>0) {
+       // only count the bytes, data may be NULL
+       file->filedata_current = file->filedata_current + size*count;
+       file->filedata_count = std::max(file->filedata_count, file->filedata_current);
+       return size*count;
+     }
+     if (!TinyMATWriter_fOK(file) || !data || size*count<=0) return 0;
+     if (file->checksum.active) {
+       TinyMAT_checksumWrite(file, file->checksum.pos, data, size*count);
+       file->checksum.pos+=static_cast<int64_t>(size*count);
+     }
      int res = 0;
-#ifdef TINYMAT_WRITE_VIA_MEMORY
+     if (file->filedata) {
        if (file->filedata_current + size*count + 100 >= file->filedata_size) {
          TinyMAT_growMem(size*count, file);
        }
@@ -355,38 +885,88 @@ TINYMAT_inlineattrib static int TinyMAT_fwrite(const void* data, uint32_t size,
        file->filedata_current = file->filedata_current + size*count;
        file->filedata_count = std::max(file->filedata_count, file->filedata_current);
        res=size*count;
-#else
+     } else {
        res = (int)fwrite(data, 1, size*count, file->file);
-#endif
+     }
      return res;
 }
 
 template<typename T>
 TINYMAT_inlineattrib static int TinyMAT_fwritesmall(T data, TinyMATWriterFile* file)
 {
-     if (!file || !file->file) return 0;
+     if (!TinyMATWriter_fOK(file)) return 0;
+     if (sizeof(T)>1 && file->swapBytes) TinyMAT_swapBytes(&data, 1, sizeof(T));
+     if (file->checksum.active) {
+       TinyMAT_checksumWrite(file, file->checksum.pos, &data, sizeof(T));
+       file->checksum.pos+=static_cast<int64_t>(sizeof(T));
+     }
      int res = 0;
-#ifdef TINYMAT_WRITE_VIA_MEMORY
-     if (file->filedata_current + sizeof(T) + 100 >= file->filedata_size) {
-       TinyMAT_growMem(sizeof(T), file);
+     if (file->sizer) {
+       file->filedata_current = file->filedata_current + sizeof(T);
+       file->filedata_count = std::max(file->filedata_count, file->filedata_current);
+       res=sizeof(T);
+     } else if (file->filedata) {
+       if (file->filedata_current + sizeof(T) + 100 >= file->filedata_size) {
+         TinyMAT_growMem(sizeof(T), file);
+       }
+       T* datap = reinterpret_cast<T*>(&(file->filedata[file->filedata_current]));
+       *datap = data;
+       file->filedata_current = file->filedata_current + sizeof(T);
+       file->filedata_count = std::max(file->filedata_count, file->filedata_current);
+       res=sizeof(T);
+     } else {
+       res = (int)fwrite(&data, 1, sizeof(T), file->file);
+     }
+     return res;
+}
+
+/** \brief size of the stack buffer, in which values are swapped, if they are not written into a memory cache */
+#define TINYMAT_SWAP_BLOCKSIZE 4096
+
+/*! \brief writes \a count values of \a size bytes each in the byte order of the file (see TinyMATWriter_setByteOrder() )
+    \ingroup tinymatwriter
+    \internal
+
+    If the file is written in the other byte order, the values are swapped in the memory cache after copying them
+    there, or block by block in a small buffer on the stack. Otherwise this is the same as TinyMAT_fwrite().
+ */
+TINYMAT_inlineattrib static int TinyMAT_fwriteValues(const void* data, uint32_t size, uint32_t count, TinyMATWriterFile* file)
+{
+     if (!file || !file->swapBytes || size<2 || file->sizer || !data) return TinyMAT_fwrite(data, size, count, file);
+     // the checksum is computed from the swapped values, so they are not swapped in the memory cache
+     if (file->filedata && !file->checksum.active) {
+       const size_t start=file->filedata_current;
+       const int res=TinyMAT_fwrite(data, size, count, file);
+       if (res>0) TinyMAT_swapBytes(&(file->filedata[start]), count, size);
+       return res;
+     }
+     uint8_t block[TINYMAT_SWAP_BLOCKSIZE];
+     const uint32_t perBlock=static_cast<uint32_t>(sizeof(block))/size;
+     const uint8_t* src=static_cast<const uint8_t*>(data);
+     int res=0;
+     while (count>0) {
+       const uint32_t n=std::min(count, perBlock);
+       memcpy(block, src, n*size);
+       TinyMAT_swapBytes(block, n, size);
+       res+=TinyMAT_fwrite(block, size, n, file);
+       src+=n*size;
+       count-=n;
      }
-     T* datap = reinterpret_cast<T*>(&(file->filedata[file->filedata_current]));
-     *datap = data;
-     file->filedata_current = file->filedata_current + sizeof(T);
-     file->filedata_count = std::max(file->filedata_count, file->filedata_current);
-     res=sizeof(T);
-#else
-     res = (int)fwrite(&data, 1, sizeof(T), file->file);
-#endif
      return res;
 }
 
 TINYMAT_inlineattrib static int TinyMAT_fread(void* data, uint32_t size, uint32_t count, TinyMATWriterFile* file)
 {
      //std::cout<<"TinyMAT_fwrite()\n";
-     if (!file || !file->file || !data || size*count<=0) return 0;
+     if (!TinyMATWriter_fOK(file) || !data || size*count<=0) return 0;
+     if (file->checksum.active) file->checksum.pos+=static_cast<int64_t>(size*count);
      int res = 0;
-#ifdef TINYMAT_WRITE_VIA_MEMORY
+     if (file->sizer) {
+       // nothing was stored
+       memset(data, 0, size*count);
+       file->filedata_current = file->filedata_current + size*count;
+       res = size*count;
+     } else if (file->filedata) {
        int cnt = std::min<int>(size*count, static_cast<int>(file->filedata_size - file->filedata_current));
        if (static_cast<uint32_t>(cnt) != size*count) {
          throw std::runtime_error("read after end of file");
@@ -398,9 +978,9 @@ TINYMAT_inlineattrib static int TinyMAT_fread(void* data, uint32_t size, uint32_
 #endif
        file->filedata_current = file->filedata_current + cnt;
        res = cnt;
-#else
+     } else {
        res = (int)fread(data, 1, size*count, file->file);
-#endif
+     }
      return res;
 }
 
@@ -464,8 +1044,8 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_i32(TinyMATWriterFile*
 }
 
 TINYMAT_inlineattrib static void TinyMAT_writeDatElementS_i32(TinyMATWriterFile* mat, int32_t data) {
-    TinyMAT_writeU16(mat, static_cast<uint16_t>(TINYMAT_miINT32));
-    TinyMAT_writeU16(mat, static_cast<uint16_t>(sizeof(data)));
+    // small data element format: size and type share one 32-bit value
+    TinyMAT_writeU32(mat, (static_cast<uint32_t>(sizeof(data))<<16)|static_cast<uint32_t>(TINYMAT_miINT32));
     TinyMAT_write32(mat, data);
 }
 
@@ -496,7 +1076,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_dbla(TinyMATWriterFile*
     if (!data) items=0;
     TinyMAT_writeU32(mat, items*sizeof(*data));
     if (items>0 && data){
-        TinyMAT_fwrite(data, sizeof(*data), items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), items, mat);
     }
     // no padding required
 }
@@ -505,7 +1085,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_flta(TinyMATWriterFile*
     if (!data) items=0;
     TinyMAT_writeU32(mat, items*sizeof(*data));
     if (items>0 && data){
-        TinyMAT_fwrite(data, sizeof(*data), items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), items, mat);
         // write padding
         if (items%2==1) TinyMAT_write32(mat, static_cast<uint32_t>(0));
     }
@@ -515,7 +1095,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_u32a(TinyMATWriterFile*
     TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miUINT32));
     TinyMAT_writeU32(mat, static_cast<uint32_t>(items*sizeof(*data)));
     if (items>0) {
-        TinyMAT_fwrite(data, sizeof(*data), (uint32_t)items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), (uint32_t)items, mat);
         // write padding
         if (items%2==1) TinyMAT_writeU32(mat, static_cast<uint32_t>(0));
     }
@@ -524,7 +1104,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_i32a(TinyMATWriterFile*
     TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miINT32));
     TinyMAT_writeU32(mat, static_cast<uint32_t>(items*sizeof(*data)));
     if (items>0) {
-        TinyMAT_fwrite(data, sizeof(*data), (uint32_t)items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), (uint32_t)items, mat);
         // write padding
         if (items%2==1) TinyMAT_writeU32(mat, static_cast<uint32_t>(0));
     }
@@ -534,7 +1114,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_u16a(TinyMATWriterFile*
     TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miUINT16));
     TinyMAT_writeU32(mat, static_cast<uint32_t>(items*sizeof(*data)));
     if (items>0) {
-        TinyMAT_fwrite(data, sizeof(*data), (uint32_t)items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), (uint32_t)items, mat);
         // write padding
         if (items%4==1) {
             TinyMAT_writeU32(mat, static_cast<uint32_t>(0));
@@ -551,7 +1131,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_i16a(TinyMATWriterFile*
     TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miINT16));
     TinyMAT_writeU32(mat, static_cast<uint32_t>(items*sizeof(*data)));
     if (items>0) {
-        TinyMAT_fwrite(data, sizeof(*data), (uint32_t)items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), (uint32_t)items, mat);
         // write padding
         if (items%4==1) {
             TinyMAT_writeU32(mat, static_cast<uint32_t>(0));
@@ -569,7 +1149,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_u64a(TinyMATWriterFile*
     TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miUINT64));
     TinyMAT_writeU32(mat, static_cast<uint32_t>(items*sizeof(*data)));
     if (items>0) {
-        TinyMAT_fwrite(data, sizeof(*data), (uint32_t)items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), (uint32_t)items, mat);
         // no padding required
     }
 }
@@ -577,7 +1157,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_i64a(TinyMATWriterFile*
     TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miINT64));
     TinyMAT_writeU32(mat, static_cast<uint32_t>(items*sizeof(*data)));
     if (items>0) {
-        TinyMAT_fwrite(data, sizeof(*data), (uint32_t)items, mat);
+        TinyMAT_fwriteValues(data, sizeof(*data), (uint32_t)items, mat);
         // no padding required
     }
 }
@@ -615,9 +1195,10 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_stringas8bit(TinyMATWri
 
 TINYMAT_inlineattrib static void TinyMAT_writeDatElement_string(TinyMATWriterFile* mat, const char* data, uint32_t slen) {
     size_t pad=(2*slen)%8;
-    std::unique_ptr<int16_t[]> tmp;
+    TinyMATWriterScratchScope scope(mat);
+    int16_t* tmp=NULL;
     if (slen>0 && data) {
-        tmp=std::unique_ptr<int16_t[]>(new int16_t[slen]);
+        tmp=static_cast<int16_t*>(mat->scratch.alloc(slen*sizeof(int16_t)));
         if (tmp) {
             for (uint32_t i=0; i<slen; i++) {
                 tmp[i]=data[i];
@@ -628,7 +1209,7 @@ TINYMAT_inlineattrib static void TinyMAT_writeDatElement_string(TinyMATWriterFil
     TinyMAT_writeU32(mat, cla);
     TinyMAT_writeU32(mat, slen*2);
     if (slen>0 && tmp) {
-        TinyMAT_fwrite(tmp.get(), 2, slen, mat);
+        TinyMAT_fwriteValues(tmp, 2, slen, mat);
         // write padding
         if (pad>0) {
           static const uint8_t paddata[8] = { 0,0,0,0,0,0,0,0 };
@@ -668,235 +1249,558 @@ TINYMAT_inlineattrib static size_t TinyMAT_DatElement_realstringlen16bit(const c
 }
 
 
+/** \brief reads \a size bytes from the absolute file position \a pos, without changing the current write position */
+TINYMAT_inlineattrib static void TinyMAT_pread(TinyMATWriterFile* mat, int64_t pos, void* data, size_t size) {
+    if (!TinyMATWriter_fOK(mat) || !data || size<=0) return;
+    if (mat->sizer) {
+        // nothing was stored
+        memset(data, 0, size);
+    } else if (mat->filedata && pos>=static_cast<int64_t>(mat->filedata_offset)) {
+        if (static_cast<size_t>(pos)-mat->filedata_offset+size>mat->filedata_count) {
+            throw std::runtime_error("read after end of file");
+        }
+        memcpy(data, &(mat->filedata[pos-mat->filedata_offset]), size);
+    } else if (mat->filedata) {
+        // this data is only on disk (appending to an existing file)
+        TinyMAT_fseek64(mat->file, pos, SEEK_SET);
+        if (fread(data, 1, size, mat->file)!=size) {
+            throw std::runtime_error("read after end of file");
+        }
+    } else {
+        const int64_t cur=TinyMAT_ftell64(mat->file);
+        TinyMAT_fseek64(mat->file, pos, SEEK_SET);
+        const size_t cnt=fread(data, 1, size, mat->file);
+        TinyMAT_fseek64(mat->file, cur, SEEK_SET);
+        if (cnt!=size) {
+            throw std::runtime_error("read after end of file");
+        }
+    }
+}
 
 
+/** \brief writes \a size bytes to the absolute file position \a pos, without changing the current write position */
+TINYMAT_inlineattrib static void TinyMAT_pwrite(TinyMATWriterFile* mat, int64_t pos, const void* data, size_t size) {
+    if (!TinyMATWriter_fOK(mat) || !data || size<=0) return;
+    if (mat->checksum.active) TinyMAT_checksumWrite(mat, pos, data, size);
+    if (mat->sizer) {
+        if (static_cast<size_t>(pos)+size>mat->filedata_count) {
+            throw std::runtime_error("write after end of file");
+        }
+    } else if (mat->filedata && pos>=static_cast<int64_t>(mat->filedata_offset)) {
+        if (static_cast<size_t>(pos)-mat->filedata_offset+size>mat->filedata_count) {
+            throw std::runtime_error("write after end of file");
+        }
+        memmove(&(mat->filedata[pos-mat->filedata_offset]), data, size);
+    } else if (mat->filedata) {
+        // this data is only on disk (appending to an existing file), the memory cache is written in TinyMAT_fclose()
+        TinyMAT_fseek64(mat->file, pos, SEEK_SET);
+        fwrite(data, 1, size, mat->file);
+    } else {
+        const int64_t cur=TinyMAT_ftell64(mat->file);
+        TinyMAT_fseek64(mat->file, pos, SEEK_SET);
+        fwrite(data, 1, size, mat->file);
+        TinyMAT_fseek64(mat->file, cur, SEEK_SET);
+    }
+}
 
 
+/** \brief writes \a count values of \a size bytes each to the absolute file position \a pos in the byte order of the file (see TinyMAT_fwriteValues() ) */
+TINYMAT_inlineattrib static void TinyMAT_pwriteValues(TinyMATWriterFile* mat, int64_t pos, const void* data, uint32_t size, size_t count) {
+    if (!mat || !mat->swapBytes || size<2 || mat->sizer || !data) {
+        TinyMAT_pwrite(mat, pos, data, size*count);
+        return;
+    }
+    if (mat->filedata && pos>=static_cast<int64_t>(mat->filedata_offset) && !mat->checksum.active) {
+        TinyMAT_pwrite(mat, pos, data, size*count);
+        TinyMAT_swapBytes(&(mat->filedata[pos-mat->filedata_offset]), count, size);
+        return;
+    }
+    uint8_t block[TINYMAT_SWAP_BLOCKSIZE];
+    const size_t perBlock=sizeof(block)/size;
+    const uint8_t* src=static_cast<const uint8_t*>(data);
+    while (count>0) {
+        const size_t n=std::min(count, perBlock);
+        memcpy(block, src, n*size);
+        TinyMAT_swapBytes(block, n, size);
+        TinyMAT_pwrite(mat, pos, block, n*size);
+        src+=n*size;
+        pos+=static_cast<int64_t>(n*size);
+        count-=n;
+    }
+}
 
 
+/** \brief removes all data behind the absolute file position \a pos and continues writing there */
+TINYMAT_inlineattrib static void TinyMAT_truncateAt(TinyMATWriterFile* mat, int64_t pos) {
+    if (!TinyMATWriter_fOK(mat)) return;
+    if (mat->checksum.active) mat->checksum.pos=pos;
+    if ((mat->filedata || mat->sizer) && pos>=static_cast<int64_t>(mat->filedata_offset)) {
+        mat->filedata_count=static_cast<size_t>(pos)-mat->filedata_offset;
+        mat->filedata_current=mat->filedata_count;
+    } else if (mat->filedata) {
+        TinyMAT_ftruncate(mat->file, pos);
+        mat->filedata_offset=static_cast<size_t>(pos);
+        mat->filedata_count=0;
+        mat->filedata_current=0;
+    } else {
+        TinyMAT_ftruncate(mat->file, pos);
+        TinyMAT_fseek64(mat->file, pos, SEEK_SET);
+    }
+}
 
 
+/*! \brief overwrites the top-level element at \a offset (\a size bytes, including the tag) with a tombstone
+    \ingroup tinymatwriter
+    \internal
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const double *data_real, const int32_t *sizes, uint32_t ndims)
-{
-    if (!data_real || !sizes || ndims<=0) {
-        TinyMATWriter_writeEmptyMatrix(mat, name);
-    } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
-        }
+    The tombstone is a valid uint8 row-vector named TINYMAT_TOMBSTONE_NAME, that exactly covers the old element,
+    so the file stays readable. Only the 64 bytes of the header are written, the old payload is kept as vector data.
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxDOUBLE_CLASS_arrayflags, 0};
+    \return \c false if the element is too small to be replaced by a tombstone
+ */
+TINYMAT_inlineattrib static bool TinyMAT_writeTombstone(TinyMATWriterFile* mat, int64_t offset, int64_t size) {
+    if (size<64 || size%8!=0) return false;
+    uint32_t header[16]={
+        TINYMAT_miMATRIX, static_cast<uint32_t>(size-8),
+        TINYMAT_miUINT32, 8, TINYMAT_mxUINT8_CLASS_arrayflags, 0,
+        TINYMAT_miINT32, 8, 1, static_cast<uint32_t>(size-64),
+        TINYMAT_miINT8, static_cast<uint32_t>(strlen(TINYMAT_TOMBSTONE_NAME)), 0, 0,
+        TINYMAT_miUINT8, static_cast<uint32_t>(size-64)
+    };
+    if (mat->swapBytes) {
+        // everything but the name
+        for (int i=0; i<16; i++) {
+            if (i!=12 && i!=13) header[i]=TinyMAT_bswap32(header[i]);
+        }
+    }
+    memcpy(&(header[12]), TINYMAT_TOMBSTONE_NAME, strlen(TINYMAT_TOMBSTONE_NAME));
+    TinyMAT_pwrite(mat, offset, header, sizeof(header));
+    return true;
+}
 
+/** \brief adds a top-level element to the variable index of \a mat, with its CRC32C \a checksum (if not NULL) */
+TINYMAT_inlineattrib static void TinyMAT_registerVariable(TinyMATWriterFile* mat, const std::string& name, int64_t offset, int64_t size, const uint32_t* checksum=NULL) {
+    if (name.size()>0 && name!=TINYMAT_TOMBSTONE_NAME) {
+        mat->variableIndex[name]=mat->variables.size();
+        mat->variables.push_back(TinyMATWriterVariable(name, offset, size));
+        if (checksum) {
+            mat->variables.back().checksum=*checksum;
+            mat->variables.back().hasChecksum=true;
+        }
+    } else {
+        mat->variables.push_back(TinyMATWriterVariable(std::string(), offset, size));
+    }
+}
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+/*! \brief writes the buffer of the thread writer \a mat to the end of its concurrent file
+    \ingroup tinymatwriter
+    \internal
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+    The space in the shared file is reserved by an atomic increment of TinyMATWriterFile::appendOffset, so several
+    threads can commit at the same time, each into its own range of the file.
+ */
+static void TinyMAT_commitThreadWriter(TinyMATWriterFile* mat) {
+    TinyMATWriterFile* shared=mat->sharedFile;
+    if (!shared || mat->filedata_count==0) return;
+    const int64_t pos=shared->appendOffset.fetch_add(static_cast<int64_t>(mat->filedata_count));
+    const uint8_t* data=mat->filedata;
+    size_t size=mat->filedata_count;
+#ifdef __WINDOWS__
+    {
+        std::lock_guard<std::mutex> lock(shared->appendMutex);
+        _fseeki64(shared->file, pos, SEEK_SET);
+        fwrite(data, 1, size, shared->file);
+        fflush(shared->file);
+    }
+#else
+    const int fd=fileno(shared->file);
+    off_t offset=static_cast<off_t>(pos);
+    while (size>0) {
+        const ssize_t written=::pwrite(fd, data, size, offset);
+        if (written<=0) {
+            throw std::runtime_error("error writing to concurrent MAT-file");
+        }
+        data+=written;
+        offset+=written;
+        size-=static_cast<size_t>(written);
+    }
+#endif
+    mat->filedata_count=0;
+    mat->filedata_current=0;
+}
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+/** \brief has to be called, before an element (variable, struct field, cell item) is written to \a mat */
+TINYMAT_inlineattrib static void TinyMAT_beginElement(TinyMATWriterFile* mat, const char* name) {
+    if (mat->concurrent) {
+        throw std::runtime_error("variables have to be written to a concurrent MAT-file with a thread writer (see TinyMATWriter_openThreadWriter())");
+    }
+    mat->addStructItemName(name);
+    if (mat->element_depth==0) {
+        mat->element_start=TinyMAT_ftell(mat);
+        mat->element_name=name;
+        if (mat->writeChecksums) TinyMAT_checksumBegin(mat, mat->element_start, mat->element_start, mat->element_start, 0);
+    }
+    mat->element_depth++;
+}
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+/*! \brief has to be called, after an element, started with TinyMAT_beginElement() is completely written
+    \ingroup tinymatwriter
+    \internal
 
-        // write data type
-        TinyMAT_writeDatElement_dbla(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+    When a top-level element is finished, it is added to the variable index. If TinyMATWriterFile::replaceExisting
+    is set and a variable with the same name already exists, the new element replaces the old one: If both have
+    the same size, the new element is copied over the old one and removed from the end of the file. Otherwise
+    the old element is overwritten by a tombstone (see TinyMAT_writeTombstone() ). If the old element is too small
+    for a tombstone, the new element is removed again and a \c std::runtime_error is thrown.
+ */
+TINYMAT_inlineattrib static void TinyMAT_endElement(TinyMATWriterFile* mat) {
+    if (mat->element_depth<=0) return;
+    mat->element_depth--;
+    if (mat->element_depth>0) return;
+    mat->scratch.reset();
+
+    if (mat->sharedFile) {
+        TinyMAT_commitThreadWriter(mat);
+        return;
     }
-}
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const float *data_real, const int32_t *sizes, uint32_t ndims)
-{
-    if (!data_real || !sizes || ndims<=0) {
-        TinyMATWriter_writeEmptyMatrix(mat, name);
-    } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
+    const int64_t start=mat->element_start;
+    const int64_t size=TinyMAT_ftell(mat)-start;
+    uint32_t checksum=0;
+    const bool hasChecksum=TinyMAT_checksumEnd(mat, size, &checksum);
+    auto it=mat->variableIndex.find(mat->element_name);
+    // a column vector with this name can not be extended any more (see TinyMATWriter_appendToColumn() )
+    if (it!=mat->variableIndex.end()) mat->columns.erase(mat->element_name);
+    if (mat->replaceExisting && it!=mat->variableIndex.end()) {
+        TinyMATWriterVariable& old=mat->variables[it->second];
+        if (old.size==size) {
+            old.checksum=checksum;
+            old.hasChecksum=hasChecksum;
+            if (mat->filedata) {
+                TinyMAT_pwrite(mat, old.offset, &(mat->filedata[start-mat->filedata_offset]), static_cast<size_t>(size));
+            } else if (mat->sizer) {
+                // nothing to copy
             } else {
-                nentries=nentries*sizes[i];
+                auto tmp=std::unique_ptr<uint8_t[]>(new uint8_t[size]);
+                TinyMAT_pread(mat, start, tmp.get(), static_cast<size_t>(size));
+                TinyMAT_pwrite(mat, old.offset, tmp.get(), static_cast<size_t>(size));
             }
+            TinyMAT_truncateAt(mat, start);
+            return;
         }
+        if (!TinyMAT_writeTombstone(mat, old.offset, old.size)) {
+            // the old element stays valid, so the new one has to go
+            TinyMAT_truncateAt(mat, start);
+            throw std::runtime_error("variable '"+mat->element_name+"' is too small to be replaced by a variable of a different size");
+        }
+        old.name.clear();
+    }
+    TinyMAT_registerVariable(mat, mat->element_name, start, size, hasChecksum?&checksum:NULL);
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxSINGLE_CLASS_arrayflags, 0};
+/** \brief rounds \a bytes up to a multiple of 8 */
+TINYMAT_inlineattrib static uint32_t TinyMAT_pad8(uint32_t bytes) {
+    return (bytes+7)&~static_cast<uint32_t>(7);
+}
 
+/** \brief size of the stack buffer, in which TinyMAT_writeMatrixHeader() composes a header (larger headers are composed in the scratch arena) */
+#define TINYMAT_HEADER_STACKSIZE 256
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+/*! \brief writes the header of a numeric matrix with a single TinyMAT_fwrite()
+    \ingroup tinymatwriter
+    \internal
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
-
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+    The miMATRIX tag, the array flags, the dimensions, the name and the tag of the real part are composed in a buffer on the
+    stack. As the size of the data (\a dataBytes) is known in advance, the size of the element is written directly (no seek
+    back to patch it afterwards). The caller has to write \a dataBytes bytes of data, followed by TinyMAT_pad8(dataBytes)-dataBytes
+    zero bytes.
+ */
+TINYMAT_inlineattrib static void TinyMAT_writeMatrixHeader(TinyMATWriterFile* mat, const char* name, uint32_t arrayflags, const int32_t* sizes, uint32_t ndims, uint32_t miType, uint32_t dataBytes) {
+    const uint32_t nameBytes=name?static_cast<uint32_t>(strlen(name)):0;
+    const uint32_t headerBytes=8+16+8+TinyMAT_pad8(ndims*4)+8+TinyMAT_pad8(nameBytes)+8;
+    uint8_t stackbuf[TINYMAT_HEADER_STACKSIZE];
+    TinyMATWriterScratchScope scope(mat);
+    uint8_t* buf=stackbuf;
+    if (headerBytes>TINYMAT_HEADER_STACKSIZE) {
+        buf=static_cast<uint8_t*>(mat->scratch.alloc(headerBytes));
+        if (!buf) throw std::bad_alloc();
+    }
+    memset(buf, 0, headerBytes);
+    uint32_t* u=reinterpret_cast<uint32_t*>(buf);
+    u[0]=TINYMAT_miMATRIX;
+    u[1]=headerBytes-8+TinyMAT_pad8(dataBytes);
+    u[2]=TINYMAT_miUINT32;
+    u[3]=8;
+    u[4]=arrayflags;
+    u[5]=0;
+    u[6]=TINYMAT_miINT32;
+    u[7]=ndims*4;
+    memcpy(buf+32, sizes, ndims*4);
+    uint32_t pos=32+TinyMAT_pad8(ndims*4);
+    u=reinterpret_cast<uint32_t*>(buf+pos);
+    u[0]=TINYMAT_miINT8;
+    u[1]=nameBytes;
+    if (nameBytes>0) memcpy(buf+pos+8, name, nameBytes);
+    pos=pos+8+TinyMAT_pad8(nameBytes);
+    u=reinterpret_cast<uint32_t*>(buf+pos);
+    u[0]=miType;
+    u[1]=dataBytes;
+    if (mat->swapBytes) {
+        // tag, array flags and dimensions, then the tag of the name and the tag of the data
+        TinyMAT_swapBytes(buf, 8+ndims, sizeof(uint32_t));
+        TinyMAT_swapBytes(buf+32+TinyMAT_pad8(ndims*4), 2, sizeof(uint32_t));
+        TinyMAT_swapBytes(buf+pos, 2, sizeof(uint32_t));
+    }
+    TinyMAT_fwrite(buf, 1, headerBytes, mat);
+}
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+/*! \brief writes the numeric matrix \a data (column-major, \a sizes with \a ndims entries) as a top-level variable or struct/cell member
+    \ingroup tinymatwriter
+    \internal
 
-        // write data type
-        TinyMAT_writeDatElement_flta(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+    \param arrayflags the first word of the array flags (class and flags)
+    \param miType the MAT data type of the elements of \a data
+ */
+template<typename T>
+TINYMAT_inlineattrib static void TinyMAT_writeNumericMatrix(TinyMATWriterFile* mat, const char* name, uint32_t arrayflags, uint32_t miType, const T* data, const int32_t* sizes, uint32_t ndims) {
+    static const uint8_t zeros[8]={0,0,0,0,0,0,0,0};
+    uint32_t nentries=1;
+    for (uint32_t i=0; i<ndims; i++) {
+        nentries=nentries*sizes[i];
+    }
+    const uint32_t dataBytes=nentries*static_cast<uint32_t>(sizeof(T));
+    TinyMAT_beginElement(mat, name);
+    TinyMAT_writeMatrixHeader(mat, name, arrayflags, sizes, ndims, miType, dataBytes);
+    if (dataBytes>0) {
+        TinyMAT_fwriteValues(data, static_cast<uint32_t>(sizeof(T)), nentries, mat);
+        if (TinyMAT_pad8(dataBytes)>dataBytes) TinyMAT_fwrite(zeros, 1, TinyMAT_pad8(dataBytes)-dataBytes, mat);
     }
+    TinyMAT_endElement(mat);
 }
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint64_t *data_real, const int32_t *sizes, uint32_t ndims)
-{
-    if (!data_real || !sizes || ndims<=0) {
-        TinyMATWriter_writeEmptyMatrix(mat, name);
+/** \brief advances the write position by \a size bytes, the skipped range has to be filled with TinyMAT_pwrite() afterwards */
+TINYMAT_inlineattrib static void TinyMAT_fskip(TinyMATWriterFile* mat, size_t size) {
+    if (!TinyMATWriter_fOK(mat) || size<=0) return;
+    if (mat->checksum.active) mat->checksum.pos+=static_cast<int64_t>(size);
+    if (mat->filedata || mat->sizer) {
+        TinyMAT_growMem(static_cast<uint32_t>(size), mat);
+        mat->filedata_current=mat->filedata_current+size;
+        mat->filedata_count=std::max(mat->filedata_count, mat->filedata_current);
     } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
+        TinyMAT_fseek64(mat->file, static_cast<int64_t>(size), SEEK_CUR);
+    }
+}
+
+/** \brief returns an array of \a n (at least 1) elements from the scratch arena of \a mat, throws \c std::bad_alloc on errors */
+template<typename T>
+static T* TinyMAT_scratchArray(TinyMATWriterFile* mat, size_t n) {
+    T* p=static_cast<T*>(mat->scratch.alloc(std::max<size_t>(1, n)*sizeof(T)));
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+/*! \brief counts the non-zero entries in the column-major matrix \a data (\a rows * \a cols)
+    \ingroup tinymatwriter
+    \internal
+
+    \return the number of non-zero entries, the counting stops early (returning a value \c >maxnnz), if more than \a maxnnz entries are found.
+ */
+static size_t TinyMAT_countNonZeros(const double* data, int32_t rows, int32_t cols, size_t maxnnz) {
+    size_t nnz=0;
+    for (int32_t c=0; c<cols; c++) {
+        const double* col=data+static_cast<size_t>(c)*static_cast<size_t>(rows);
+        int32_t r=0;
+        size_t cnt=0;
+#ifdef TINYMAT_HAS_SSE2
+        const __m128d zero=_mm_setzero_pd();
+        for (; r+4<=rows; r+=4) {
+            // NaN!=0, but -0.0==0, as in Matlab
+            const int m=_mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd(col+r), zero)) | (_mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd(col+r+2), zero))<<2);
+            cnt+=static_cast<size_t>((m&1)+((m>>1)&1)+((m>>2)&1)+((m>>3)&1));
+        }
+#endif
+        for (; r<rows; r++) {
+            if (col[r]!=0) cnt++;
         }
+        nnz+=cnt;
+        if (nnz>maxnnz) return nnz;
+    }
+    return nnz;
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxUINT64_CLASS_arrayflags, 0};
+/*! \brief writes the dense column-major double matrix \a data as a sparse matrix, if this is allowed by TinyMATWriterFile::sparseThreshold
+           and the sparse form is smaller than the dense form
+    \ingroup tinymatwriter
+    \internal
 
+    After counting the non-zeros, the sizes of all parts of the sparse element are known, so the row indices (ir) and values (pr)
+    are collected in small blocks during a single pass over \a data and written directly to their final positions. No intermediate
+    copy of the sparse matrix is created. The column pointers (jc) are collected during the same pass, so nothing is allocated,
+    if the matrix is written in dense form.
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+    \return \c true, if the matrix was written
+ */
+static bool TinyMAT_writeDenseAsSparse(TinyMATWriterFile *mat, const char *name, const double *data, int32_t rows, int32_t cols)
+{
+    if (mat->sparseThreshold<=0 || rows<=0 || cols<=0) return false;
+    const size_t n=static_cast<size_t>(rows)*static_cast<size_t>(cols);
+    // sizes of the parts, that differ between dense and sparse form: sparse needs ir, jc and pr, dense only pr
+    const size_t sizeDense=8+n*8;
+    size_t maxnnz=static_cast<size_t>(mat->sparseThreshold*static_cast<double>(n));
+    const size_t jcsize=8+(static_cast<size_t>(cols)+1+1)/2*8;
+    if (sizeDense<=jcsize+16) return false;
+    maxnnz=std::min(maxnnz, (sizeDense-jcsize-16)/12);
+
+    const size_t nnz=TinyMAT_countNonZeros(data, rows, cols, maxnnz);
+    if (nnz>maxnnz || (8+(nnz*4+7)/8*8)+jcsize+(8+nnz*8)>=sizeDense) return false;
+
+    TinyMAT_beginElement(mat, name);
+    uint32_t size_bytes=0;
+    // nzmax is at least 1, also for an all-zero matrix (as in files written by Matlab)
+    uint32_t arrayflags[2]={TINYMAT_mxSPARSE_CLASS_arrayflags, static_cast<uint32_t>(std::max<size_t>(1, nnz))};
+    const int32_t sizes[2]={rows, cols};
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+    // write tag header
+    TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
+    int64_t sizepos=TinyMAT_ftell(mat);
+    TinyMAT_writeU32(mat, size_bytes);
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+    // write arrayflags (incl. nzmax)
+    TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+    // write field dimensions
+    TinyMAT_writeDatElement_i32a(mat, sizes, 2);
 
-        // write data type
-        TinyMAT_writeDatElement_u64a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+    // write field name
+    TinyMAT_writeDatElement_stringas8bit(mat, name);
+
+    // write the tag of ir and reserve space for the data
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miINT32));
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(nnz*4));
+    int64_t irpos=TinyMAT_ftell(mat);
+    TinyMAT_fskip(mat, (nnz*4+7)/8*8);
+    if (nnz%2==1) {
+        const int32_t pad=0;
+        TinyMAT_pwrite(mat, irpos+static_cast<int64_t>(nnz*4), &pad, sizeof(pad));
     }
-}
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const int64_t *data_real, const int32_t *sizes, uint32_t ndims)
-{
-    if (!data_real || !sizes || ndims<=0) {
-        TinyMATWriter_writeEmptyMatrix(mat, name);
-    } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
+    // write the tag of jc and reserve space for the data
+    TinyMATWriterScratchScope scope(mat);
+    const size_t njc=static_cast<size_t>(cols)+1;
+    int32_t* jc=TinyMAT_scratchArray<int32_t>(mat, njc);
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miINT32));
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(njc*4));
+    const int64_t jcpos=TinyMAT_ftell(mat);
+    TinyMAT_fskip(mat, (njc*4+7)/8*8);
+    if (njc%2==1) {
+        const int32_t pad=0;
+        TinyMAT_pwrite(mat, jcpos+static_cast<int64_t>(njc*4), &pad, sizeof(pad));
+    }
+
+    // write the tag of pr and reserve space for the data
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(TINYMAT_miDOUBLE));
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(nnz*8));
+    int64_t prpos=TinyMAT_ftell(mat);
+    TinyMAT_fskip(mat, nnz*8);
+    int64_t endpos=TinyMAT_ftell(mat);
+
+    // collect ir and pr in blocks and write them to their final position
+    const size_t blocksize=4096;
+    int32_t irblock[blocksize];
+    double prblock[blocksize];
+    size_t cnt=0;
+    int32_t p=0;
+    jc[0]=0;
+    for (int32_t c=0; c<cols; c++) {
+        const double* col=data+static_cast<size_t>(c)*static_cast<size_t>(rows);
+        for (int32_t r=0; r<rows; r++) {
+            if (col[r]!=0) {
+                irblock[cnt]=r;
+                prblock[cnt]=col[r];
+                cnt++;
+                p++;
+                if (cnt==blocksize) {
+                    TinyMAT_pwriteValues(mat, irpos, irblock, sizeof(int32_t), cnt);
+                    TinyMAT_pwriteValues(mat, prpos, prblock, sizeof(double), cnt);
+                    irpos+=static_cast<int64_t>(cnt*sizeof(int32_t));
+                    prpos+=static_cast<int64_t>(cnt*sizeof(double));
+                    cnt=0;
+                }
             }
         }
+        jc[c+1]=p;
+    }
+    if (cnt>0) {
+        TinyMAT_pwriteValues(mat, irpos, irblock, sizeof(int32_t), cnt);
+        TinyMAT_pwriteValues(mat, prpos, prblock, sizeof(double), cnt);
+    }
+    TinyMAT_pwriteValues(mat, jcpos, jc, sizeof(int32_t), njc);
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxINT64_CLASS_arrayflags, 0};
+    TinyMAT_fseek(mat, sizepos);
+    size_bytes=endpos-sizepos-4;
+    TinyMAT_writeU32(mat, size_bytes);
+    TinyMAT_fseek(mat, endpos);
+    TinyMAT_endElement(mat);
+    return true;
+}
 
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
 
-        // write data type
-        TinyMAT_writeDatElement_i64a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
-    }
-}
 
 
 
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint32_t *data_real, const int32_t *sizes, uint32_t ndims)
+
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const double *data_real, const int32_t *sizes, uint32_t ndims)
 {
     if (!data_real || !sizes || ndims<=0) {
         TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else if (ndims==2 && TinyMAT_writeDenseAsSparse(mat, name, data_real, sizes[0], sizes[1])) {
+        return;
     } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
-        }
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxDOUBLE_CLASS_arrayflags, TINYMAT_miDOUBLE, data_real, sizes, ndims);
+    }
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxUINT32_CLASS_arrayflags, 0};
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const float *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxSINGLE_CLASS_arrayflags, TINYMAT_miSINGLE, data_real, sizes, ndims);
+    }
+}
 
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint64_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxUINT64_CLASS_arrayflags, TINYMAT_miUINT64, data_real, sizes, ndims);
+    }
+}
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const int64_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxINT64_CLASS_arrayflags, TINYMAT_miINT64, data_real, sizes, ndims);
+    }
+}
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
 
-        // write data type
-        TinyMAT_writeDatElement_u32a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint32_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxUINT32_CLASS_arrayflags, TINYMAT_miUINT32, data_real, sizes, ndims);
     }
 }
 
@@ -905,346 +1809,835 @@ void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *na
     if (!data_real || !sizes || ndims<=0) {
         TinyMATWriter_writeEmptyMatrix(mat, name);
     } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
-        }
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxINT32_CLASS_arrayflags, TINYMAT_miINT32, data_real, sizes, ndims);
+    }
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxINT32_CLASS_arrayflags, 0};
 
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint16_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxUINT16_CLASS_arrayflags, TINYMAT_miUINT16, data_real, sizes, ndims);
+    }
+}
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const int16_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxINT16_CLASS_arrayflags, TINYMAT_miINT16, data_real, sizes, ndims);
+    }
+}
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
 
-        // write data type
-        TinyMAT_writeDatElement_i32a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint8_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxUINT8_CLASS_arrayflags, TINYMAT_miUINT8, data_real, sizes, ndims);
     }
 }
 
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const int8_t *data_real, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data_real || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxINT8_CLASS_arrayflags, TINYMAT_miINT8, data_real, sizes, ndims);
+    }
+}
 
-
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint16_t *data_real, const int32_t *sizes, uint32_t ndims)
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const bool *data_real, const int32_t *sizes, uint32_t ndims)
 {
     if (!data_real || !sizes || ndims<=0) {
         TinyMATWriter_writeEmptyMatrix(mat, name);
     } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
+        uint32_t nentries=1;
         for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
+            nentries=nentries*sizes[i];
+        }
+        // logical arrays are stored as bytes with the value 0 or 1 (a sizer does not need the data)
+        TinyMATWriterScratchScope scope(mat);
+        int8_t* tmp=NULL;
+        if (!TinyMATWriter_isSizer(mat)) {
+            tmp=static_cast<int8_t*>(TinyMATWriter_scratch(mat, nentries));
+            if (!tmp && nentries>0) return;
+            for (uint32_t i=0; i<nentries; i++) {
+                tmp[i]=(data_real[i]?1:0);
             }
         }
+        TinyMAT_writeNumericMatrix(mat, name, TINYMAT_mxUINT8_LOGICAL_CLASS_arrayflags, TINYMAT_miINT8, tmp, sizes, ndims);
+    }
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxUINT16_CLASS_arrayflags, 0};
+/** \brief splits \a n interleaved complex values from \a data into \a re and \a im */
+TINYMAT_inlineattrib static void TinyMAT_deinterleave(const std::complex<double>* data, double* re, double* im, size_t n) {
+    const double* d=reinterpret_cast<const double*>(data);
+    size_t i=0;
+#ifdef TINYMAT_HAS_SSE2
+    for (; i+2<=n; i+=2) {
+        const __m128d a=_mm_loadu_pd(d+2*i);
+        const __m128d b=_mm_loadu_pd(d+2*i+2);
+        _mm_storeu_pd(re+i, _mm_unpacklo_pd(a, b));
+        _mm_storeu_pd(im+i, _mm_unpackhi_pd(a, b));
+    }
+#endif
+    for (; i<n; i++) {
+        re[i]=d[2*i];
+        im[i]=d[2*i+1];
+    }
+}
+TINYMAT_inlineattrib static void TinyMAT_deinterleave(const std::complex<float>* data, float* re, float* im, size_t n) {
+    const float* d=reinterpret_cast<const float*>(data);
+    size_t i=0;
+#ifdef TINYMAT_HAS_SSE2
+    for (; i+4<=n; i+=4) {
+        const __m128 a=_mm_loadu_ps(d+2*i);
+        const __m128 b=_mm_loadu_ps(d+2*i+4);
+        _mm_storeu_ps(re+i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+        _mm_storeu_ps(im+i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+    }
+#endif
+    for (; i<n; i++) {
+        re[i]=d[2*i];
+        im[i]=d[2*i+1];
+    }
+}
 
+/** \brief MAT-file class (arrayflags) and data type of the real/imaginary parts of a complex matrix */
+TINYMAT_inlineattrib static void TinyMAT_complexTypes(const std::complex<double>*, uint32_t& arrayflags, uint32_t& datatype) {
+    arrayflags=TINYMAT_mxDOUBLE_CLASS_arrayflags|TINYMAT_COMPLEX_arrayflags;
+    datatype=TINYMAT_miDOUBLE;
+}
+TINYMAT_inlineattrib static void TinyMAT_complexTypes(const std::complex<float>*, uint32_t& arrayflags, uint32_t& datatype) {
+    arrayflags=TINYMAT_mxSINGLE_CLASS_arrayflags|TINYMAT_COMPLEX_arrayflags;
+    datatype=TINYMAT_miSINGLE;
+}
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+/*! \brief writes a complex matrix, the real and imaginary parts are streamed into the pr and pi sub-elements
+    \ingroup tinymatwriter
+    \internal
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+    \a data is read twice and split in blocks (with a SIMD kernel for column-major data): first all blocks of the real part
+    are written, then all blocks of the imaginary part, so the file is written sequentially through the IO-buffer.
+    If \a transpose is \c true, \a data is in row-major order (with the conventions of TinyMATWriter_writeMatrixND_rowmajor(),
+    i.e. \a sizes is {columns, rows, ...}) and transposed on the fly.
+ */
+template<typename T>
+static void TinyMAT_writeComplexMatrix(TinyMATWriterFile *mat, const char *name, const std::complex<T> *data, const int32_t *sizes, uint32_t ndims, bool transpose)
+{
+    TinyMAT_beginElement(mat, name);
+    size_t nentries=0;
+    for (uint32_t i=0; i<ndims; i++) {
+        if (i==0) {
+            nentries=sizes[0];
+        } else {
+            nentries=nentries*sizes[i];
+        }
+    }
+    std::vector<int32_t> dims(sizes, sizes+ndims);
+    if (transpose) std::swap(dims[0], dims[1]);
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+    uint32_t size_bytes=0;
+    uint32_t arrayflags[2]={0, 0};
+    uint32_t datatype=0;
+    TinyMAT_complexTypes(data, arrayflags[0], datatype);
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+    // write tag header
+    TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
+    int64_t sizepos=TinyMAT_ftell(mat);
+    TinyMAT_writeU32(mat, size_bytes);
 
-        // write data type
-        TinyMAT_writeDatElement_u16a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+    // write arrayflags
+    TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+
+    // write field dimensions
+    TinyMAT_writeDatElement_i32a(mat, dims.data(), ndims);
+
+    // write field name
+    TinyMAT_writeDatElement_stringas8bit(mat, name);
+
+    // write the real part, then the imaginary part, both sequentially
+    const size_t partsize=nentries*sizeof(T);
+    const size_t partsize_padded=(partsize+7)/8*8;
+    const size_t blocksize=2048;
+    T part[2][blocksize];
+    const size_t cols=(transpose?static_cast<size_t>(sizes[0]):1);
+    const size_t rows=(transpose?static_cast<size_t>(sizes[1]):1);
+    for (int p=0; p<2; p++) {
+        TinyMAT_writeU32(mat, datatype);
+        TinyMAT_writeU32(mat, static_cast<uint32_t>(partsize));
+        // split the data in blocks (a sizer does not need the data, it only counts the bytes)
+        const size_t ndata=mat->sizer?0:nentries;
+        if (mat->sizer) TinyMAT_fwrite(NULL, sizeof(T), static_cast<uint32_t>(nentries), mat);
+        size_t c=0, r=0, m=0;
+        for (size_t o=0; o<ndata; o+=blocksize) {
+            const size_t cnt=std::min(blocksize, ndata-o);
+            if (!transpose) {
+                TinyMAT_deinterleave(data+o, part[0], part[1], cnt);
+            } else {
+                // output is column-major: o=m*cols*rows+c*rows+r, input is row-major: m*cols*rows+r*cols+c
+                for (size_t i=0; i<cnt; i++) {
+                    const std::complex<T>& v=data[m*cols*rows+r*cols+c];
+                    part[p][i]=(p==0)?v.real():v.imag();
+                    if (++r==rows) {
+                        r=0;
+                        if (++c==cols) {
+                            c=0;
+                            m++;
+                        }
+                    }
+                }
+            }
+            TinyMAT_fwriteValues(part[p], sizeof(T), static_cast<uint32_t>(cnt), mat);
+        }
+        if (partsize_padded>partsize) {
+            static const uint8_t paddata[8] = { 0,0,0,0,0,0,0,0 };
+            TinyMAT_fwrite(paddata, 1, partsize_padded-partsize, mat);
+        }
+    }
+    int64_t endpos=TinyMAT_ftell(mat);
+
+    TinyMAT_fseek(mat, sizepos);
+    size_bytes=endpos-sizepos-4;
+    TinyMAT_writeU32(mat, size_bytes);
+    TinyMAT_fseek(mat, endpos);
+    TinyMAT_endElement(mat);
+}
+
+/** \brief returns \c true, if a row-major matrix with the given \a sizes has to be transposed (see TinyMATWriter_writeMatrixND_rowmajor() ) */
+static bool TinyMAT_rowmajorNeedsTranspose(const int32_t *sizes, uint32_t ndims) {
+    if (ndims<=1) return false;
+    uint32_t nonSingularDimensions=0;
+    for (uint32_t i=0; i<ndims; i++) {
+        if (sizes[i]<=0) return false;
+        if (sizes[i]>1) nonSingularDimensions++;
     }
+    return nonSingularDimensions>1;
 }
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const int16_t *data_real, const int32_t *sizes, uint32_t ndims)
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const std::complex<double> *data, const int32_t *sizes, uint32_t ndims)
 {
-    if (!data_real || !sizes || ndims<=0) {
+    if (!data || !sizes || ndims<=0) {
         TinyMATWriter_writeEmptyMatrix(mat, name);
     } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
-        }
+        TinyMAT_writeComplexMatrix(mat, name, data, sizes, ndims, false);
+    }
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxINT16_CLASS_arrayflags, 0};
+void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const std::complex<float> *data, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeComplexMatrix(mat, name, data, sizes, ndims, false);
+    }
+}
 
+void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile *mat, const char *name, const std::complex<double> *data, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeComplexMatrix(mat, name, data, sizes, ndims, TinyMAT_rowmajorNeedsTranspose(sizes, ndims));
+    }
+}
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile *mat, const char *name, const std::complex<float> *data, const int32_t *sizes, uint32_t ndims)
+{
+    if (!data || !sizes || ndims<=0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMAT_writeComplexMatrix(mat, name, data, sizes, ndims, TinyMAT_rowmajorNeedsTranspose(sizes, ndims));
+    }
+}
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+/*! \brief writes a sparse matrix (mxSPARSE_CLASS) in CSC form, i.e. the storage format of MAT-files
+    \ingroup tinymatwriter
+    \internal
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+    \a jc has to start with 0 and contains \a cols+1 entries. Exactly one of \a pr (double matrix) and \a prLogical (logical matrix) is used.
+ */
+static void TinyMAT_writeSparse(TinyMATWriterFile *mat, const char *name, const int32_t* ir, const int32_t* jc, const double* pr, const uint8_t* prLogical, int32_t rows, int32_t cols)
+{
+    TinyMAT_beginElement(mat, name);
+    const uint32_t nnz=static_cast<uint32_t>(jc[cols]);
+    uint32_t size_bytes=0;
+    // nzmax is at least 1, also for an all-zero matrix (as in files written by Matlab)
+    uint32_t arrayflags[2]={static_cast<uint32_t>(prLogical?TINYMAT_mxSPARSE_LOGICAL_CLASS_arrayflags:TINYMAT_mxSPARSE_CLASS_arrayflags), std::max<uint32_t>(1, nnz)};
+    const int32_t sizes[2]={rows, cols};
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+    // write tag header
+    TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
+    int64_t sizepos=TinyMAT_ftell(mat);
+    TinyMAT_writeU32(mat, size_bytes);
 
-        // write data type
-        TinyMAT_writeDatElement_i16a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+    // write arrayflags (incl. nzmax)
+    TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+
+    // write field dimensions
+    TinyMAT_writeDatElement_i32a(mat, sizes, 2);
+
+    // write field name
+    TinyMAT_writeDatElement_stringas8bit(mat, name);
+
+    // write row indices (ir), column pointers (jc) and values (pr)
+    TinyMAT_writeDatElement_i32a(mat, ir, nnz);
+    TinyMAT_writeDatElement_i32a(mat, jc, static_cast<size_t>(cols)+1);
+    if (prLogical) TinyMAT_writeDatElement_u8a(mat, prLogical, nnz);
+    else TinyMAT_writeDatElement_dbla(mat, pr, nnz);
+
+    int64_t endpos;
+    endpos=TinyMAT_ftell(mat);
+    TinyMAT_fseek(mat, sizepos);
+    size_bytes=endpos-sizepos-4;
+    TinyMAT_writeU32(mat, size_bytes);
+    TinyMAT_fseek(mat, endpos);
+    TinyMAT_endElement(mat);
+}
+
+/** \brief runs \c f(t) for \c t=0..nthreads-1, each call in a separate thread (\c t=0 in the calling thread) */
+template<typename F>
+static void TinyMAT_parallelFor(unsigned nthreads, F f) {
+    if (nthreads<=1) {
+        f(0u);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads-1);
+    for (unsigned t=1; t<nthreads; t++) {
+        threads.emplace_back(f, t);
     }
+    f(0u);
+    for (auto& th: threads) th.join();
 }
 
+/** \brief selects the number of threads for a sparse conversion with \a nnz entries and \a cols columns (each thread needs a histogram over all columns) */
+static unsigned TinyMAT_sparseThreads(unsigned nthreads, size_t nnz, int32_t cols) {
+    if (nthreads==0) {
+        nthreads=std::max(1u, std::thread::hardware_concurrency());
+        // at least 64k entries per thread
+        nthreads=static_cast<unsigned>(std::min<size_t>(nthreads, std::max<size_t>(1, nnz/65536)));
+    }
+    // the per-thread histograms should not be much larger than the data
+    if (cols>0) {
+        nthreads=static_cast<unsigned>(std::min<size_t>(nthreads, std::max<size_t>(1, 4*nnz/static_cast<size_t>(cols))));
+    }
+    return std::max(1u, nthreads);
+}
 
+/** \brief converts the value of a sparse matrix entry to the value type of the MAT-file (\c NULL values mean all \c true) */
+template<typename TIN>
+TINYMAT_inlineattrib static double TinyMAT_sparseValue(const TIN* values, size_t i, double*) {
+    return values?static_cast<double>(values[i]):1.0;
+}
+template<typename TIN>
+TINYMAT_inlineattrib static uint8_t TinyMAT_sparseValue(const TIN* values, size_t i, uint8_t*) {
+    return (!values || values[i])?1:0;
+}
 
+/*! \brief converts a CSR sparse matrix into CSC form (\a jc, \a ir, \a pr from the scratch arena of \a mat), using a parallel counting sort
+    \ingroup tinymatwriter
+    \internal
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const uint8_t *data_real, const int32_t *sizes, uint32_t ndims)
+    The rows are split into \a nthreads blocks with about the same number of entries. Each thread counts the entries per column
+    in its block, from these counts every thread gets its own output position in each column, so the final scatter can run in
+    parallel without any synchronization. As each thread visits its rows in ascending order and the blocks are ordered, the row
+    indices within each column are sorted.
+ */
+template<typename TIN, typename TOUT>
+static void TinyMAT_csrToCsc(TinyMATWriterFile* mat, const TIN* values, const int32_t* colIndices, const int32_t* rowPointers, int32_t rows, int32_t cols, unsigned nthreads, int32_t*& jc, int32_t*& ir, TOUT*& pr)
 {
-    if (!data_real || !sizes || ndims<=0) {
-        TinyMATWriter_writeEmptyMatrix(mat, name);
-    } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
+    const int32_t base=rowPointers[0];
+    const size_t nnz=static_cast<size_t>(rowPointers[rows]-base);
+    nthreads=TinyMAT_sparseThreads(nthreads, nnz, cols);
+    nthreads=std::min<unsigned>(nthreads, static_cast<unsigned>(std::max(1, rows)));
+
+    // split the rows into blocks with about the same number of entries
+    std::vector<int32_t> rowstart(nthreads+1, rows);
+    rowstart[0]=0;
+    for (unsigned t=1; t<nthreads; t++) {
+        const int32_t target=base+static_cast<int32_t>(nnz*t/nthreads);
+        rowstart[t]=static_cast<int32_t>(std::lower_bound(rowPointers, rowPointers+rows, target)-rowPointers);
+    }
+
+    // count entries per column in each block (one histogram per thread)
+    int32_t* pos=TinyMAT_scratchArray<int32_t>(mat, static_cast<size_t>(nthreads)*static_cast<size_t>(cols));
+    TinyMAT_parallelFor(nthreads, [&](unsigned t) {
+        int32_t* cnt=pos+static_cast<size_t>(t)*static_cast<size_t>(cols);
+        std::fill(cnt, cnt+cols, 0);
+        for (int32_t r=rowstart[t]; r<rowstart[t+1]; r++) {
+            for (int32_t k=rowPointers[r]; k<rowPointers[r+1]; k++) {
+                const int32_t c=colIndices[k-base];
+                if (c>=0 && c<cols) cnt[c]++;
+            }
+        }
+    });
+
+    // turn counts into output positions
+    jc=TinyMAT_scratchArray<int32_t>(mat, static_cast<size_t>(cols)+1);
+    jc[0]=0;
+    int32_t p=0;
+    for (int32_t c=0; c<cols; c++) {
+        for (unsigned t=0; t<nthreads; t++) {
+            int32_t& cp=pos[static_cast<size_t>(t)*static_cast<size_t>(cols)+c];
+            const int32_t n=cp;
+            cp=p;
+            p+=n;
+        }
+        jc[c+1]=p;
+    }
+
+    // scatter
+    ir=TinyMAT_scratchArray<int32_t>(mat, p);
+    pr=TinyMAT_scratchArray<TOUT>(mat, p);
+    pr[0]=0;
+    TinyMAT_parallelFor(nthreads, [&](unsigned t) {
+        int32_t* cpos=pos+static_cast<size_t>(t)*static_cast<size_t>(cols);
+        for (int32_t r=rowstart[t]; r<rowstart[t+1]; r++) {
+            for (int32_t k=rowPointers[r]; k<rowPointers[r+1]; k++) {
+                const int32_t c=colIndices[k-base];
+                if (c>=0 && c<cols) {
+                    const int32_t o=cpos[c]++;
+                    ir[o]=r;
+                    pr[o]=TinyMAT_sparseValue(values, static_cast<size_t>(k-base), static_cast<TOUT*>(nullptr));
+                }
+            }
+        }
+    });
+}
+
+/** \brief combines two values of a sparse matrix with the same coordinates */
+TINYMAT_inlineattrib static void TinyMAT_sparseAccumulate(double& a, double b) {
+    a+=b;
+}
+TINYMAT_inlineattrib static void TinyMAT_sparseAccumulate(uint8_t& a, uint8_t b) {
+    a=(a||b)?1:0;
+}
+
+/*! \brief converts a COO sparse matrix (triplets) into CSC form (\a jc, \a ir, \a pr from the scratch arena of \a mat)
+    \ingroup tinymatwriter
+    \internal
+
+    The triplets are distributed into columns with a (stable) counting sort, then each column is sorted by row index (in parallel)
+    and finally duplicate coordinates are merged and zeros are removed.
+ */
+template<typename TIN, typename TOUT>
+static void TinyMAT_cooToCsc(TinyMATWriterFile* mat, const TIN* values, const int32_t* rowIndices, const int32_t* colIndices, size_t nnz, int32_t rows, int32_t cols, unsigned nthreads, int32_t*& jc, int32_t*& ir, TOUT*& pr)
+{
+    // bucket the (valid) triplets by column
+    int32_t* colstart=TinyMAT_scratchArray<int32_t>(mat, static_cast<size_t>(cols)+1);
+    std::fill(colstart, colstart+cols+1, 0);
+    for (size_t i=0; i<nnz; i++) {
+        if (rowIndices[i]>=0 && rowIndices[i]<rows && colIndices[i]>=0 && colIndices[i]<cols) colstart[colIndices[i]+1]++;
+    }
+    for (int32_t c=0; c<cols; c++) colstart[c+1]+=colstart[c];
+    const int32_t nvalid=colstart[cols];
+    uint32_t* perm=TinyMAT_scratchArray<uint32_t>(mat, nvalid);
+    {
+        int32_t* cpos=TinyMAT_scratchArray<int32_t>(mat, cols);
+        std::copy(colstart, colstart+cols, cpos);
+        for (size_t i=0; i<nnz; i++) {
+            if (rowIndices[i]>=0 && rowIndices[i]<rows && colIndices[i]>=0 && colIndices[i]<cols) perm[cpos[colIndices[i]]++]=static_cast<uint32_t>(i);
+        }
+    }
+
+    // sort each column by row index, the columns are split into blocks with about the same number of entries
+    nthreads=TinyMAT_sparseThreads(nthreads, nnz, cols);
+    nthreads=std::min<unsigned>(nthreads, static_cast<unsigned>(std::max(1, cols)));
+    std::vector<int32_t> blockstart(nthreads+1, cols);
+    blockstart[0]=0;
+    for (unsigned t=1; t<nthreads; t++) {
+        const int32_t target=static_cast<int32_t>(static_cast<size_t>(nvalid)*t/nthreads);
+        blockstart[t]=static_cast<int32_t>(std::lower_bound(colstart, colstart+cols, target)-colstart);
+    }
+    TinyMAT_parallelFor(nthreads, [&](unsigned t) {
+        for (int32_t c=blockstart[t]; c<blockstart[t+1]; c++) {
+            if (colstart[c+1]-colstart[c]>1) {
+                std::sort(perm+colstart[c], perm+colstart[c+1], [&](uint32_t a, uint32_t b) {
+                    return (rowIndices[a]<rowIndices[b]) || (rowIndices[a]==rowIndices[b] && a<b);
+                });
+            }
+        }
+    });
+
+    // merge duplicates and remove zeros (in place in the arrays for all valid triplets)
+    jc=TinyMAT_scratchArray<int32_t>(mat, static_cast<size_t>(cols)+1);
+    jc[0]=0;
+    ir=TinyMAT_scratchArray<int32_t>(mat, nvalid);
+    pr=TinyMAT_scratchArray<TOUT>(mat, nvalid);
+    pr[0]=0;
+    int32_t p=0;
+    for (int32_t c=0; c<cols; c++) {
+        for (int32_t k=colstart[c]; k<colstart[c+1]; k++) {
+            const uint32_t i=perm[k];
+            const TOUT v=TinyMAT_sparseValue(values, i, static_cast<TOUT*>(nullptr));
+            if (p>jc[c] && ir[p-1]==rowIndices[i]) {
+                TinyMAT_sparseAccumulate(pr[p-1], v);
             } else {
-                nentries=nentries*sizes[i];
+                if (p>jc[c] && pr[p-1]==0) p--;
+                ir[p]=rowIndices[i];
+                pr[p]=v;
+                p++;
             }
         }
+        if (p>jc[c] && pr[p-1]==0) p--;
+        jc[c+1]=p;
+    }
+}
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxUINT8_CLASS_arrayflags, 0};
+/** \brief rebases column pointers of a CSC matrix to start at 0 (in the scratch arena of \a mat), returns \a colPointers if no copy is necessary */
+static const int32_t* TinyMAT_rebaseCSC(TinyMATWriterFile* mat, const int32_t* colPointers, int32_t cols) {
+    if (colPointers[0]==0) return colPointers;
+    int32_t* jc=TinyMAT_scratchArray<int32_t>(mat, static_cast<size_t>(cols)+1);
+    for (int32_t c=0; c<=cols; c++) jc[c]=colPointers[c]-colPointers[0];
+    return jc;
+}
 
+/** \brief checks, that the \a n+1 pointers \a ptr of a CSC/CSR matrix start at 0 or above and never decrease */
+static bool TinyMAT_validPointers(const int32_t* ptr, int32_t n) {
+    if (ptr[0]<0) return false;
+    for (int32_t i=0; i<n; i++) {
+        if (ptr[i+1]<ptr[i]) return false;
+    }
+    return true;
+}
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+/** \brief checks a CSC matrix: valid \a colPointers and row indices in <code>0..rows-1</code>, strictly ascending within each column */
+static bool TinyMAT_validCSC(const int32_t* rowIndices, const int32_t* colPointers, int32_t rows, int32_t cols) {
+    if (!TinyMAT_validPointers(colPointers, cols)) return false;
+    for (int32_t c=0; c<cols; c++) {
+        int32_t last=-1;
+        for (int32_t k=colPointers[c]; k<colPointers[c+1]; k++) {
+            const int32_t r=rowIndices[k-colPointers[0]];
+            if (r<=last || r>=rows) return false;
+            last=r;
+        }
+    }
+    return true;
+}
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+void TinyMATWriter_writeSparseCSC(TinyMATWriterFile *mat, const char *name, const double *values, const int32_t *rowIndices, const int32_t *colPointers, int32_t rows, int32_t cols)
+{
+    if (!values || !rowIndices || !colPointers || rows<0 || cols<0 || !TinyMAT_validCSC(rowIndices, colPointers, rows, cols)) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMATWriterScratchScope scope(mat);
+        TinyMAT_writeSparse(mat, name, rowIndices, TinyMAT_rebaseCSC(mat, colPointers, cols), values, nullptr, rows, cols);
+    }
+}
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+void TinyMATWriter_writeSparseCSC(TinyMATWriterFile *mat, const char *name, const bool *values, const int32_t *rowIndices, const int32_t *colPointers, int32_t rows, int32_t cols)
+{
+    if (!rowIndices || !colPointers || rows<0 || cols<0 || !TinyMAT_validCSC(rowIndices, colPointers, rows, cols)) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMATWriterScratchScope scope(mat);
+        const size_t nnz=static_cast<size_t>(colPointers[cols]-colPointers[0]);
+        uint8_t* pr=TinyMAT_scratchArray<uint8_t>(mat, nnz);
+        pr[0]=0;
+        for (size_t i=0; i<nnz; i++) {
+            pr[i]=TinyMAT_sparseValue(values, i, static_cast<uint8_t*>(nullptr));
+        }
+        TinyMAT_writeSparse(mat, name, rowIndices, TinyMAT_rebaseCSC(mat, colPointers, cols), nullptr, pr, rows, cols);
+    }
+}
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+void TinyMATWriter_writeSparseCSR(TinyMATWriterFile *mat, const char *name, const double *values, const int32_t *colIndices, const int32_t *rowPointers, int32_t rows, int32_t cols, unsigned nthreads)
+{
+    if (!values || !colIndices || !rowPointers || rows<0 || cols<0 || !TinyMAT_validPointers(rowPointers, rows)) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMATWriterScratchScope scope(mat);
+        int32_t* jc=NULL;
+        int32_t* ir=NULL;
+        double* pr=NULL;
+        TinyMAT_csrToCsc(mat, values, colIndices, rowPointers, rows, cols, nthreads, jc, ir, pr);
+        TinyMAT_writeSparse(mat, name, ir, jc, pr, nullptr, rows, cols);
+    }
+}
 
-        // write data type
-        TinyMAT_writeDatElement_u8a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+void TinyMATWriter_writeSparseCSR(TinyMATWriterFile *mat, const char *name, const bool *values, const int32_t *colIndices, const int32_t *rowPointers, int32_t rows, int32_t cols, unsigned nthreads)
+{
+    if (!colIndices || !rowPointers || rows<0 || cols<0 || !TinyMAT_validPointers(rowPointers, rows)) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMATWriterScratchScope scope(mat);
+        int32_t* jc=NULL;
+        int32_t* ir=NULL;
+        uint8_t* pr=NULL;
+        TinyMAT_csrToCsc(mat, values, colIndices, rowPointers, rows, cols, nthreads, jc, ir, pr);
+        TinyMAT_writeSparse(mat, name, ir, jc, nullptr, pr, rows, cols);
+    }
+}
+
+void TinyMATWriter_writeSparseCOO(TinyMATWriterFile *mat, const char *name, const double *values, const int32_t *rowIndices, const int32_t *colIndices, size_t nnz, int32_t rows, int32_t cols, unsigned nthreads)
+{
+    if (!values || !rowIndices || !colIndices || rows<0 || cols<0) {
+        TinyMATWriter_writeEmptyMatrix(mat, name);
+    } else {
+        TinyMATWriterScratchScope scope(mat);
+        int32_t* jc=NULL;
+        int32_t* ir=NULL;
+        double* pr=NULL;
+        TinyMAT_cooToCsc(mat, values, rowIndices, colIndices, nnz, rows, cols, nthreads, jc, ir, pr);
+        TinyMAT_writeSparse(mat, name, ir, jc, pr, nullptr, rows, cols);
     }
 }
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const int8_t *data_real, const int32_t *sizes, uint32_t ndims)
+void TinyMATWriter_writeSparseCOO(TinyMATWriterFile *mat, const char *name, const bool *values, const int32_t *rowIndices, const int32_t *colIndices, size_t nnz, int32_t rows, int32_t cols, unsigned nthreads)
 {
-    if (!data_real || !sizes || ndims<=0) {
+    if (!rowIndices || !colIndices || rows<0 || cols<0) {
         TinyMATWriter_writeEmptyMatrix(mat, name);
     } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
-        }
-
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxINT8_CLASS_arrayflags, 0};
+        TinyMATWriterScratchScope scope(mat);
+        int32_t* jc=NULL;
+        int32_t* ir=NULL;
+        uint8_t* pr=NULL;
+        TinyMAT_cooToCsc(mat, values, rowIndices, colIndices, nnz, rows, cols, nthreads, jc, ir, pr);
+        TinyMAT_writeSparse(mat, name, ir, jc, nullptr, pr, rows, cols);
+    }
+}
 
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+/** \brief writes the 128-byte header of a MAT-file */
+static void TinyMAT_writeFileHeader(TinyMATWriterFile* mat, const char* description) {
+    // setup and write Description field (116 bytes)
+    char stdmsg[512];
+    for (int i=0; i<512; i++) stdmsg[i]='\0';
+    time_t rawtime;
+    ::time(&rawtime);
+    struct tm * timeinfo;
+#ifdef HAVE_GMTIME_S
+    struct tm ti;
+    ::gmtime_s(&ti, &rawtime);
+    timeinfo=&ti;
+#else
+    timeinfo = ::gmtime(&rawtime);
+#endif
+#ifdef HAVE_SPRINTF_S
+    sprintf_s(stdmsg, 512,"MATLAB 5.0 MAT-file, written by TinyMAT, %d-%02d-%02d %02d:%02d:%02d UTC", 1900+timeinfo->tm_year, timeinfo->tm_mon+1, timeinfo->tm_mday, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+#else
+    sprintf(stdmsg, "MATLAB 5.0 MAT-file, written by TinyMAT, %d-%02d-%02d %02d:%02d:%02d UTC", 1900+timeinfo->tm_year, timeinfo->tm_mon+1, timeinfo->tm_mday, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+#endif
+    size_t slstd=strlen(stdmsg);
+    char desc[116];
+    size_t sl=0;
+    if (description) sl=strlen(description);
+    if (slstd>0) {
+        for (size_t i=0; i<slstd; i++) {
+            desc[i]=stdmsg[i];
+        }
+    }
+    size_t maxv=slstd;
+    if (sl>0) {
+        maxv=maxv+2+sl;
+    }
+    if (maxv>116) maxv=116;
+    if (sl>0) {
+        desc[slstd]=':';
+        desc[slstd+1]=' ';
+        for (size_t i=0; i<sl && slstd+2+i<116; i++) {
+            desc[slstd+2+i]=description[i];
+        }
+    }
+    if (maxv<116) {
+        desc[maxv]='\0';
+        for (size_t i=maxv+1; i<116; i++) {
+            desc[i]=' ';
+        }
+    } else {
+        desc[115]='\0';
+    }
+    TinyMAT_fwrite(desc, 1, 116,mat);
+    
+    // write "Header Subsystem Data Offset Field" (not used, i.e. write 00000000)
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(0x00000000));
+    TinyMAT_writeU32(mat, static_cast<uint32_t>(0x00000000));
+    
+    // write "Header Flag Fields"
+    TinyMAT_writeU16(mat, static_cast<uint16_t>(0x0100)); // version
+    // endian indicator: 'MI' as 16-bit value, i.e. "IM" in little-endian and "MI" in big-endian files
+    TinyMAT_writeU16(mat, static_cast<uint16_t>(('M'<<8)|'I'));
+}
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+TinyMATWriterFile* TinyMATWriter_open(const char* filename, const char* description, size_t bufSize) {
+    return TinyMATWriter_openWithSizeHint(filename, 0, description, bufSize);
+}
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+TinyMATWriterFile* TinyMATWriter_openWithSizeHint(const char* filename, uint64_t sizeHint, const char* description, size_t bufSize) {
+    TinyMATWriterFile* mat=TinyMAT_fopen(filename, bufSize);
 
-        // write data type
-        TinyMAT_writeDatElement_i8a(mat, data_real, nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+    if (TinyMATWriter_fOK(mat)) {
+        TinyMATWriter_reserve(mat, sizeHint);
+        TinyMAT_writeFileHeader(mat, description);
+        return mat;
+    } else {
+        TinyMAT_fclose(mat);
+        return NULL;
     }
 }
 
-void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile *mat, const char *name, const bool *data_real, const int32_t *sizes, uint32_t ndims)
-{
-    if (!data_real || !sizes || ndims<=0) {
-        TinyMATWriter_writeEmptyMatrix(mat, name);
-    } else {
-        mat->addStructItemName(name);
-        uint32_t nentries=0;
-        for (uint32_t i=0; i<ndims; i++) {
-            if (i==0) {
-                nentries=sizes[0];
-            } else {
-                nentries=nentries*sizes[i];
-            }
-        }
+TinyMATWriterFile* TinyMATWriter_openConcurrent(const char* filename, const char* description) {
+    TinyMATWriterFile* mat=TinyMAT_fopen(filename, 0, "wb+", false);
 
-        uint32_t size_bytes=0;
-        uint32_t arrayflags[2]={TINYMAT_mxUINT8_LOGICAL_CLASS_arrayflags, 0};
+    if (TinyMATWriter_fOK(mat)) {
+        TinyMAT_writeFileHeader(mat, description);
+        fflush(mat->file);
+        mat->appendOffset=TinyMAT_ftell(mat);
+        mat->concurrent=true;
+        return mat;
+    } else {
+        TinyMAT_fclose(mat);
+        return NULL;
+    }
+}
 
+TinyMATWriterFile* TinyMATWriter_openThreadWriter(TinyMATWriterFile* sharedMat, size_t bufSize) {
+    if (!TinyMATWriter_fOK(sharedMat) || !sharedMat->concurrent) return NULL;
+    TinyMATWriterFile* mat=TinyMAT_bufopen(bufSize);
+    if (mat) {
+        mat->sharedFile=sharedMat;
+        mat->swapBytes=sharedMat->swapBytes;
+    }
+    return mat;
+}
 
-        // write tag header
-        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
-        TinyMAT_writeU32(mat, size_bytes);
+/*! \brief reads the name of the miMATRIX element at \a offset with \a size bytes from \a file
+    \ingroup tinymatwriter
+    \internal
 
-        // write arrayflags
-        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+    \return the name, or an empty string, if it could not be read
+ */
+static std::string TinyMAT_readElementName(FILE* file, int64_t offset, int64_t size) {
+    // skip the tag and the array flags sub-element
+    int64_t pos=offset+24;
+    uint32_t tag[2]={0,0};
+    TinyMAT_fseek64(file, pos, SEEK_SET);
+    if (fread(tag, sizeof(uint32_t), 2, file)!=2) return std::string();
+    // skip the dimensions sub-element (may be in small data element format)
+    if ((tag[0]>>16)!=0) pos=pos+8;
+    else pos=pos+8+static_cast<int64_t>((tag[1]+7)/8*8);
+    TinyMAT_fseek64(file, pos, SEEK_SET);
+    if (fread(tag, sizeof(uint32_t), 2, file)!=2) return std::string();
+    uint32_t len=0;
+    int64_t datapos=0;
+    if ((tag[0]>>16)!=0) {
+        len=tag[0]>>16;
+        datapos=pos+4;
+    } else {
+        len=tag[1];
+        datapos=pos+8;
+    }
+    if (len==0 || len>1024 || datapos+static_cast<int64_t>(len)>offset+size) return std::string();
+    std::string name(len, '\0');
+    TinyMAT_fseek64(file, datapos, SEEK_SET);
+    if (fread(&(name[0]), 1, len, file)!=len) return std::string();
+    return name;
+}
 
-        // write field dimensions
-        TinyMAT_writeDatElement_i32a(mat, sizes, ndims);
+/*! \brief checks the 128-byte header of a MAT-file, opened in \a mat and walks all top-level elements
+    \ingroup tinymatwriter
+    \internal
 
-        // write field name
-        TinyMAT_writeDatElement_stringas8bit(mat, name);
+    All complete miMATRIX and miCOMPRESSED elements are added to the variable index of \a mat, other complete
+    elements are skipped. Only the last element may be incomplete, i.e. its size may extend beyond the end of the file.
 
-        // write data type
-        std::unique_ptr<int8_t[]> tmp;
-        if (nentries>0) {
-            tmp=std::unique_ptr<int8_t[]>(new int8_t[nentries]);
-            if (tmp) {
-                for (uint32_t i=0; i<nentries; i++) {
-                    tmp[i]=(data_real[i]?1:0);
-                }
+    \return the file position directly behind the last complete top-level element, or -1 if the header is invalid or
+            an element is damaged
+ */
+static int64_t TinyMAT_scanExistingFile(TinyMATWriterFile* mat) {
+    FILE* file=mat->file;
+    uint8_t header[128];
+    TinyMAT_fseek64(file, 0, SEEK_SET);
+    if (fread(header, 1, 128, file)!=128) return -1;
+    if (strncmp(reinterpret_cast<const char*>(header), "MATLAB 5.0 MAT-file", 19)!=0) return -1;
+    uint16_t version=0, endian=0;
+    memcpy(&version, &(header[124]), sizeof(version));
+    memcpy(&endian, &(header[126]), sizeof(endian));
+    // files in the other byte order are not supported
+    if (version!=0x0100 || endian!=(('M'<<8)|'I')) return -1;
+
+    TinyMAT_fseek64(file, 0, SEEK_END);
+    const int64_t filesize=TinyMAT_ftell64(file);
+    int64_t endpos=128;
+    while (endpos+8<=filesize) {
+        uint32_t tag[2]={0,0};
+        TinyMAT_fseek64(file, endpos, SEEK_SET);
+        if (fread(tag, sizeof(uint32_t), 2, file)!=2) return -1;
+        if ((tag[0]>>16)!=0) {
+            // small data element format: the complete element fits into 8 bytes
+            endpos=endpos+8;
+            continue;
+        }
+        // an incomplete element at the end (e.g. left by a crashed writer)
+        if (endpos+8+tag[1]>filesize) break;
+        if (tag[0]==TINYMAT_miMATRIX || tag[0]==TINYMAT_miCOMPRESSED) {
+            if (tag[1]==0 || (tag[0]==TINYMAT_miMATRIX && tag[1]%8!=0)) return -1;
+            std::string name;
+            if (tag[0]==TINYMAT_miMATRIX) {
+                name=TinyMAT_readElementName(file, endpos, 8+static_cast<int64_t>(tag[1]));
             }
+            TinyMAT_registerVariable(mat, name, endpos, 8+static_cast<int64_t>(tag[1]));
         }
-        TinyMAT_writeDatElement_i8a(mat, tmp.get(), nentries);
-        long endpos;
-        endpos=TinyMAT_ftell(mat);
-        TinyMAT_fseek(mat, sizepos);
-        size_bytes=endpos-sizepos-4;
-        TinyMAT_writeU32(mat, size_bytes);
-        TinyMAT_fseek(mat, endpos);
+        endpos=endpos+8+static_cast<int64_t>(tag[1]);
     }
+    return endpos;
 }
 
+TinyMATWriterFile* TinyMATWriter_openAppend(const char* filename, const char* description, size_t bufSize) {
+    TinyMATWriterFile* mat=TinyMAT_fopen(filename, bufSize, "rb+");
+    if (!TinyMATWriter_fOK(mat)) {
+        // the file does not exist yet, so we start a new one
+        TinyMAT_fclose(mat);
+        return TinyMATWriter_open(filename, description, bufSize);
+    }
 
-TinyMATWriterFile* TinyMATWriter_open(const char* filename, const char* description, size_t bufSize) {
-    TinyMATWriterFile* mat=TinyMAT_fopen(filename, bufSize);
-
-    if (TinyMATWriter_fOK(mat)) {
-        // setup and write Description field (116 bytes)
-        char stdmsg[512];
-        for (int i=0; i<512; i++) stdmsg[i]='\0';
-        time_t rawtime;
-        ::time(&rawtime);
-        struct tm * timeinfo;
-#ifdef HAVE_GMTIME_S
-        struct tm ti;
-        ::gmtime_s(&ti, &rawtime);
-        timeinfo=&ti;
-#else
-        timeinfo = ::gmtime(&rawtime);
-#endif
-#ifdef HAVE_SPRINTF_S
-        sprintf_s(stdmsg, 512,"MATLAB 5.0 MAT-file, written by TinyMAT, %d-%02d-%02d %02d:%02d:%02d UTC", 1900+timeinfo->tm_year, timeinfo->tm_mon+1, timeinfo->tm_mday, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
-#else
-        sprintf(stdmsg, "MATLAB 5.0 MAT-file, written by TinyMAT, %d-%02d-%02d %02d:%02d:%02d UTC", 1900+timeinfo->tm_year, timeinfo->tm_mon+1, timeinfo->tm_mday, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
-#endif
-        size_t slstd=strlen(stdmsg);
-        char desc[116];
-        size_t sl=0;
-        if (description) sl=strlen(description);
-        if (slstd>0) {
-            for (size_t i=0; i<slstd; i++) {
-                desc[i]=stdmsg[i];
-            }
-        }
-        size_t maxv=slstd;
-        if (sl>0) {
-            maxv=maxv+2+sl;
-        }
-        if (maxv>116) maxv=116;
-        if (sl>0) {
-            desc[slstd]=':';
-            desc[slstd+1]=' ';
-            for (size_t i=slstd+2; i<sl; i++) {
-                desc[i]=description[i];
-            }
-        }
-        if (maxv<116) {
-            desc[maxv]='\0';
-            for (size_t i=maxv+1; i<116; i++) {
-                desc[i]=' ';
+    int64_t endpos=TinyMAT_scanExistingFile(mat);
+    if (endpos<0) {
+        TinyMAT_fclose(mat);
+        return NULL;
+    }
+    int64_t end=endpos;
+    if (mat->variables.size()>0 && mat->variables.back().name==TINYMAT_INDEX_NAME && mat->variables.back().offset+mat->variables.back().size==endpos) {
+        // drop the index, it is written again (including the new variables) on TinyMATWriter_close()
+        end=mat->variables.back().offset;
+        mat->variableIndex.erase(TINYMAT_INDEX_NAME);
+        mat->variables.pop_back();
+        mat->writeIndex=true;
+        // keep the checksums of the variables in the file
+        fflush(mat->file);
+        TinyMATReaderFile* rmat=TinyMATReader_open(filename);
+        const std::vector<TinyMATReaderChecksum> checksums=TinyMATReader_getChecksums(rmat);
+        TinyMATReader_close(rmat);
+        for (const TinyMATReaderChecksum& c: checksums) {
+            auto it=mat->variableIndex.find(c.name);
+            if (it!=mat->variableIndex.end() && static_cast<uint64_t>(mat->variables[it->second].offset)==c.offset) {
+                mat->variables[it->second].checksum=c.crc32c;
+                mat->variables[it->second].hasChecksum=true;
             }
-        } else {
-            desc[115]='\0';
         }
-        TinyMAT_fwrite(desc, 1, 116,mat);
-        
-        // write "Header Subsystem Data Offset Field" (not used, i.e. write 00000000)
-        TinyMAT_writeU32(mat, static_cast<uint32_t>(0x00000000));
-        TinyMAT_writeU32(mat, static_cast<uint32_t>(0x00000000));
-        
-        // write "Header Flag Fields"
-        TinyMAT_writeU16(mat, static_cast<uint16_t>(0x0100)); // version
-        TinyMAT_write8(mat, (int8_t)'I'); // endian indicator
-        TinyMAT_write8(mat, (int8_t)'M');
-        return mat;
-    } else {
-        delete mat;
-        return NULL;
+        if (checksums.size()>0) mat->writeChecksums=true;
     }
+    TinyMAT_fseek64(mat->file, 0, SEEK_END);
+    if (TinyMAT_ftell64(mat->file)>end) {
+        // drop an incomplete top-level element at the end (e.g. left by a crashed writer)
+        TinyMAT_ftruncate(mat->file, end);
+    }
+    endpos=end;
+    TinyMAT_fseek64(mat->file, endpos, SEEK_SET);
+    mat->filedata_offset = static_cast<size_t>(endpos);
+    mat->filedata_current = 0;
+    mat->filedata_count = 0;
+    return mat;
 }
 
 #define TINYMAT_mxCELL_CLASS_arrayflags 0x00000001
@@ -1253,7 +2646,7 @@ TinyMATWriterFile* TinyMATWriter_open(const char* filename, const char* descript
 
 void TinyMATWriter_writeDoubleList(TinyMATWriterFile *mat, const char *name, const std::list<double> &data, bool columnVector)
 {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     uint32_t size_bytes=0;
     uint32_t arrayflags[2]={TINYMAT_mxDOUBLE_CLASS_arrayflags, 0};
 
@@ -1284,9 +2677,10 @@ void TinyMATWriter_writeDoubleList(TinyMATWriterFile *mat, const char *name, con
     // write field name
     TinyMAT_writeDatElement_stringas8bit(mat, name);
 
-    std::unique_ptr<double[]> d;
+    TinyMATWriterScratchScope scope(mat);
+    double* d=NULL;
     if (data.size()>0) {
-        d=std::unique_ptr<double[]>(new double[data.size()]);
+        d=static_cast<double*>(mat->scratch.alloc(data.size()*sizeof(double)));
         if (d) {
             int i=0;
             for (std::list<double>::const_iterator it=data.begin(); it!=data.end(); it++) {
@@ -1297,13 +2691,14 @@ void TinyMATWriter_writeDoubleList(TinyMATWriterFile *mat, const char *name, con
     }
 
     // write data type
-    TinyMAT_writeDatElement_dbla(mat, d.get(), (uint32_t)data.size());
+    TinyMAT_writeDatElement_dbla(mat, d, (uint32_t)data.size());
+    TinyMAT_endElement(mat);
 }
 
 
 void TinyMATWriter_writeDoubleVector(TinyMATWriterFile *mat, const char *name, const std::vector<double> &data, bool columnVector)
 {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     uint32_t size_bytes=0;
     uint32_t arrayflags[2]={TINYMAT_mxDOUBLE_CLASS_arrayflags, 0};
 
@@ -1334,20 +2729,9 @@ void TinyMATWriter_writeDoubleVector(TinyMATWriterFile *mat, const char *name, c
     // write field name
     TinyMAT_writeDatElement_stringas8bit(mat, name);
 
-    std::unique_ptr<double[]> d;
-    if (data.size()>0) {
-        d=std::unique_ptr<double[]>(new double[data.size()]);
-        if (d) {
-            int i=0;
-            for (std::vector<double>::const_iterator it=data.begin(); it!=data.end(); it++) {
-                d[i]=*it;
-                i++;
-            }
-        }
-    }
-
-    // write data type
-    TinyMAT_writeDatElement_dbla(mat, d.get(), (uint32_t)data.size());
+    // write data type (a std::vector is contiguous, so no copy is needed)
+    TinyMAT_writeDatElement_dbla(mat, data.size()>0?data.data():NULL, (uint32_t)data.size());
+    TinyMAT_endElement(mat);
 }
 
 
@@ -1356,7 +2740,7 @@ void TinyMATWriter_writeDoubleVector(TinyMATWriterFile *mat, const char *name, c
 void TinyMATWriter_writeEmptyMatrix(TinyMATWriterFile *mat, const char *name)
 {
 
-  mat->addStructItemName(name);
+  TinyMAT_beginElement(mat, name);
   uint32_t size_bytes = 0;
   uint32_t arrayflags[2] = { TINYMAT_mxDOUBLE_CLASS_arrayflags, 0 };
 
@@ -1384,6 +2768,7 @@ void TinyMATWriter_writeEmptyMatrix(TinyMATWriterFile *mat, const char *name)
 
   // write no-double-data element
   TinyMAT_writeDatElement_dbla(mat, NULL, 0);
+  TinyMAT_endElement(mat);
 
 }
 
@@ -1400,7 +2785,7 @@ void TinyMATWriter_writeString(TinyMATWriterFile *mat, const char *name, const s
 
 void TinyMATWriter_writeString(TinyMATWriterFile *mat, const char *name, const char *data, uint32_t slen)
 {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     uint32_t size_bytes=0;
     uint32_t arrayflags[2];
     arrayflags[0]=TINYMAT_mxCHAR_CLASS_CLASS_arrayflags;
@@ -1432,19 +2817,477 @@ void TinyMATWriter_writeString(TinyMATWriterFile *mat, const char *name, const c
 
     // write data type
     TinyMAT_writeDatElement_string(mat, data, slen);
+    TinyMAT_endElement(mat);
 }
 
 
 
 
 
+/*! \brief appends the index of all top-level variables of \a mat as the struct TINYMAT_INDEX_NAME
+    \ingroup tinymatwriter
+    \internal
+
+    The struct has the fields \c names (cell array of strings), \c offsets (byte offsets of the variables as uint64 vector),
+    \c crc32c (only with TinyMATWriter_setWriteChecksums(): the CRC32C of each variable as uint32 vector) and \c self (the
+    offset of the index itself). \c self is the last field, so the last 8 bytes of the file point to the index.
+ */
+static void TinyMAT_writeIndex(TinyMATWriterFile* mat) {
+    std::vector<std::string> names;
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> checksums;
+    for (const TinyMATWriterVariable& v: mat->variables) {
+        if (v.name.size()>0) {
+            names.push_back(v.name);
+            offsets.push_back(static_cast<uint64_t>(v.offset));
+            checksums.push_back(v.checksum);
+        }
+    }
+    const uint64_t self=static_cast<uint64_t>(TinyMAT_ftell(mat));
+    const int32_t dims[2]={static_cast<int32_t>(offsets.size()), 1};
+    const int32_t scalar[2]={1, 1};
+    TinyMATWriter_startStruct(mat, TINYMAT_INDEX_NAME);
+    TinyMATWriter_writeStringVector(mat, "names", names);
+    TinyMATWriter_writeMatrixND_colmajor(mat, "offsets", offsets.data(), dims, 2);
+    if (mat->writeChecksums) TinyMATWriter_writeMatrixND_colmajor(mat, "crc32c", checksums.data(), dims, 2);
+    TinyMATWriter_writeMatrixND_colmajor(mat, "self", &self, scalar, 2);
+    TinyMATWriter_endStruct(mat);
+}
+
+/*! \brief computes the checksums of all variables, that were not written with TinyMATWriter_setWriteChecksums() enabled
+    \ingroup tinymatwriter
+    \internal
+
+    This reads the variables, so it is only needed for variables, that were written before the checksums were enabled,
+    or that were already in a file without checksums, when it was opened with TinyMATWriter_openAppend().
+ */
+static void TinyMAT_checksumMissing(TinyMATWriterFile* mat) {
+    std::vector<uint8_t> block;
+    for (TinyMATWriterVariable& v: mat->variables) {
+        if (v.name.empty() || v.hasChecksum) continue;
+        uint32_t crc=0;
+        for (int64_t pos=v.offset; pos<v.offset+v.size; ) {
+            const size_t n=static_cast<size_t>(std::min<int64_t>(1024*1024, v.offset+v.size-pos));
+            if (mat->filedata && pos>=static_cast<int64_t>(mat->filedata_offset)) {
+                crc=TinyMAT_crc32c(crc, &(mat->filedata[pos-mat->filedata_offset]), n);
+            } else {
+                block.resize(n);
+                TinyMAT_pread(mat, pos, block.data(), n);
+                crc=TinyMAT_crc32c(crc, block.data(), n);
+            }
+            pos+=static_cast<int64_t>(n);
+        }
+        v.checksum=crc;
+        v.hasChecksum=true;
+    }
+}
+
+/*! \brief checks the finished file \a rmat (see TinyMATWriter_setVerifyOnClose() ) and returns a description of the first error (or an empty string)
+    \internal
+ */
+static std::string TinyMAT_verify(const TinyMATReaderFile* rmat) {
+    if (!rmat) return "TinyMATWriter_close(): the file could not be re-read for checking";
+    uint64_t offset=0;
+    std::string message;
+    if (TinyMATReader_verify(rmat, &offset, &message)) return std::string();
+    return "TinyMATWriter_close(): malformed element at byte offset "+std::to_string(offset)+": "+message;
+}
+
+/*! \brief finishes and closes \a mat, stores the result of the check (see TinyMATWriter_setVerifyOnClose() ) in \a verifyError
+    \internal
+
+    \return \c false, if the file could not be closed or the check failed
+ */
+static bool TinyMAT_closeFile(TinyMATWriterFile* mat, std::string& verifyError) {
+    // finish all asynchronous writes
+    mat->executor.reset();
+    while (mat->stack.size()>0) {
+        if (mat->stack.back()==TinyMATWriterStackItem::Struct) TinyMATWriter_endStruct(mat);
+        else TinyMATWriter_endCellArray(mat);
+    }
+    if (mat->writeIndex && TinyMATWriter_fOK(mat) && !mat->concurrent && !mat->sharedFile) {
+        if (mat->writeChecksums) TinyMAT_checksumMissing(mat);
+        TinyMAT_writeIndex(mat);
+    }
+    int ret=0;
+    if (mat->verifyOnClose && TinyMATWriter_fOK(mat) && !mat->sizer && !mat->sharedFile) {
+        const std::string filename=mat->filename;
+        if (mat->filedata && mat->filedata_offset==0) {
+            // the memory cache holds the complete file
+            TinyMATReaderFile* rmat=TinyMATReader_openBuffer(mat->filedata, mat->filedata_count);
+            verifyError=TinyMAT_verify(rmat);
+            TinyMATReader_close(rmat);
+            ret=TinyMAT_fclose(mat);
+        } else {
+            ret=TinyMAT_fclose(mat);
+            TinyMATReaderFile* rmat=TinyMATReader_open(filename.c_str());
+            verifyError=TinyMAT_verify(rmat);
+            TinyMATReader_close(rmat);
+        }
+    } else {
+        ret=TinyMAT_fclose(mat);
+    }
+    return ret==0 && verifyError.empty();
+}
+
 void TinyMATWriter_close(TinyMATWriterFile* mat) {
     if (mat) {
-        while (mat->structures.size()>0) {
-            TinyMATWriter_endStruct(mat);
+        std::string error;
+        TinyMAT_closeFile(mat, error);
+        if (!error.empty()) throw std::runtime_error(error);
+    }
+}
+
+bool TinyMATWriter_closeChecked(TinyMATWriterFile* mat, std::string* error) {
+    if (!mat) return false;
+    std::string verifyError;
+    const bool ok=TinyMAT_closeFile(mat, verifyError);
+    if (error) {
+        if (!verifyError.empty()) *error=verifyError;
+        else if (!ok) *error="TinyMATWriter_close(): the file could not be closed";
+        else error->clear();
+    }
+    return ok;
+}
+
+std::future<void> TinyMATWriter_enqueue(TinyMATWriterFile* mat, std::function<void(TinyMATWriterFile*)> task, std::function<void(std::exception_ptr)> callback) {
+    if (!mat) {
+        std::promise<void> invalid;
+        invalid.set_exception(std::make_exception_ptr(std::runtime_error("no valid MAT-file given")));
+        return invalid.get_future();
+    }
+    std::packaged_task<void()> ptask([mat, task, callback]() {
+        std::exception_ptr error;
+        try {
+            task(mat);
+        } catch (...) {
+            error=std::current_exception();
+        }
+        if (callback) callback(error);
+        if (error) std::rethrow_exception(error);
+    });
+    std::future<void> result=ptask.get_future();
+    TinyMATWriterExecutor* executor=NULL;
+    {
+        std::lock_guard<std::mutex> lock(mat->executorMutex);
+        if (!mat->executor) mat->executor.reset(new TinyMATWriterExecutor);
+        executor=mat->executor.get();
+    }
+    executor->enqueue(std::move(ptask));
+    return result;
+}
+
+void TinyMATWriter_waitForWrites(TinyMATWriterFile* mat) {
+    if (!mat) return;
+    TinyMATWriterExecutor* executor=NULL;
+    {
+        std::lock_guard<std::mutex> lock(mat->executorMutex);
+        executor=mat->executor.get();
+    }
+    if (executor) executor->wait();
+}
+
+/** \brief writes \a size zero bytes at the current position */
+static void TinyMAT_writeZeros(TinyMATWriterFile* mat, size_t size) {
+    static const uint8_t zeros[1024]={0};
+    while (size>0) {
+        const size_t n=std::min<size_t>(size, sizeof(zeros));
+        TinyMAT_fwrite(zeros, 1, static_cast<uint32_t>(n), mat);
+        size-=n;
+    }
+}
+
+/** \brief updates the element size, the number of rows and the data size of the column \a col in the file */
+static void TinyMAT_patchColumn(TinyMATWriterFile* mat, const TinyMATWriterColumn& col) {
+    const uint32_t elementSize=static_cast<uint32_t>(col.headerSize-8+static_cast<int64_t>(col.count)*8);
+    const uint32_t rows=col.count;
+    const uint32_t dataSize=col.count*8;
+    TinyMAT_pwriteValues(mat, col.offset+4, &elementSize, sizeof(elementSize), 1);
+    // tag (8 bytes) + arrayflags (16 bytes) + tag of dimensions (8 bytes)
+    TinyMAT_pwriteValues(mat, col.offset+32, &rows, sizeof(rows), 1);
+    TinyMAT_pwriteValues(mat, col.offset+col.headerSize-4, &dataSize, sizeof(dataSize), 1);
+}
+
+/** \brief size of the free space behind a column with \a count values, if \a bytes more have to fit (grows with the column, so relocations are amortized) */
+TINYMAT_inlineattrib static int64_t TinyMAT_columnSlack(uint32_t count, size_t bytes) {
+    return static_cast<int64_t>(std::max<size_t>(bytes+64, (static_cast<size_t>(count)*8+bytes)));
+}
+
+/*! \brief reads the state of the existing top-level variable \a var into \a col
+    \ingroup tinymatwriter
+    \internal
+
+    \return \c false, if \a var is not a real \c double column vector
+ */
+static bool TinyMAT_loadColumn(TinyMATWriterFile* mat, const TinyMATWriterVariable& var, TinyMATWriterColumn& col) {
+    if (var.size<56) return false;
+    uint32_t header[10];
+    TinyMAT_pread(mat, var.offset, header, sizeof(header));
+    if (mat->swapBytes) TinyMAT_swapBytes(header, 10, sizeof(uint32_t));
+    if (header[0]!=TINYMAT_miMATRIX || header[2]!=TINYMAT_miUINT32 || header[3]!=8 || header[4]!=TINYMAT_mxDOUBLE_CLASS_arrayflags) return false;
+    if (header[6]!=TINYMAT_miINT32 || header[7]!=8 || header[9]!=1) return false;
+    const uint32_t rows=header[8];
+    // the name may be stored in the small data element format
+    int64_t headerSize=40;
+    TinyMAT_pread(mat, var.offset+headerSize, header, 8);
+    if (mat->swapBytes) TinyMAT_swapBytes(header, 2, sizeof(uint32_t));
+    if ((header[0]>>16)!=0) headerSize+=8;
+    else headerSize+=8+static_cast<int64_t>((header[1]+7)/8*8);
+    if (headerSize+8>var.size) return false;
+    TinyMAT_pread(mat, var.offset+headerSize, header, 8);
+    if (mat->swapBytes) TinyMAT_swapBytes(header, 2, sizeof(uint32_t));
+    headerSize+=8;
+    if (header[0]!=TINYMAT_miDOUBLE || header[1]!=rows*8 || headerSize+static_cast<int64_t>(rows)*8!=var.size) return false;
+    col.offset=var.offset;
+    col.headerSize=headerSize;
+    col.count=rows;
+    col.slack=0;
+    return true;
+}
+
+/*! \brief uses a tombstone directly behind the column \a col (variable record \a col.varIndex) as its free space
+    \ingroup tinymatwriter
+    \internal
+
+    The record of the tombstone is removed from TinyMATWriterFile::variables, as the free space belongs to the column.
+ */
+static void TinyMAT_claimColumnSlack(TinyMATWriterFile* mat, TinyMATWriterColumn& col) {
+    const size_t next=col.varIndex+1;
+    if (next>=mat->variables.size()) return;
+    const TinyMATWriterVariable& var=mat->variables[next];
+    if (var.name.size()>0 || var.offset!=col.offset+col.headerSize+static_cast<int64_t>(col.count)*8 || var.size<64) return;
+    uint8_t header[64];
+    TinyMAT_pread(mat, var.offset, header, sizeof(header));
+    if (memcmp(&(header[48]), TINYMAT_TOMBSTONE_NAME, strlen(TINYMAT_TOMBSTONE_NAME)+1)!=0) return;
+    col.slack=var.size;
+    mat->variables.erase(mat->variables.begin()+static_cast<std::ptrdiff_t>(next));
+    for (auto& v: mat->variableIndex) {
+        if (v.second>next) v.second--;
+    }
+    for (auto& c: mat->columns) {
+        if (c.second.varIndex>next) c.second.varIndex--;
+    }
+}
+
+void TinyMATWriter_appendToColumn(TinyMATWriterFile* mat, const char* name, const double* data, size_t count) {
+    if (!TinyMATWriter_fOK(mat) || !name || !data || count==0) return;
+    if (mat->element_depth>0 || mat->concurrent || mat->sharedFile) return;
+    const size_t bytes=count*sizeof(double);
+    auto it=mat->columns.find(name);
+    if (it==mat->columns.end()) {
+        auto vit=mat->variableIndex.find(name);
+        if (vit!=mat->variableIndex.end()) {
+            // the variable was written before (or read by TinyMATWriter_openAppend() ): extend it, if it is a column vector
+            TinyMATWriterVariable& var=mat->variables[vit->second];
+            TinyMATWriterColumn col;
+            if (TinyMAT_loadColumn(mat, var, col)) {
+                col.varIndex=vit->second;
+                TinyMAT_claimColumnSlack(mat, col);
+                it=mat->columns.insert(std::make_pair(std::string(name), col)).first;
+            } else if (!mat->replaceExisting) {
+                throw std::runtime_error(std::string("variable '")+name+"' exists and is not a double column vector");
+            } else if (!TinyMAT_writeTombstone(mat, var.offset, var.size)) {
+                throw std::runtime_error(std::string("variable '")+name+"' is too small to be replaced by a column vector");
+            } else {
+                var.name.clear();
+                mat->variableIndex.erase(vit);
+            }
+        }
+    }
+    if (it==mat->columns.end()) {
+        // write a new column, followed by free space for as many values
+        TinyMATWriterColumn col;
+        col.offset=TinyMAT_ftell(mat);
+        if (mat->writeChecksums) TinyMAT_checksumBegin(mat, col.offset, col.offset, col.offset, 0);
+        uint32_t arrayflags[2]={TINYMAT_mxDOUBLE_CLASS_arrayflags, 0};
+        const int32_t sizes[2]={0, 1};
+        TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
+        TinyMAT_writeU32(mat, 0);
+        TinyMAT_writeDatElement_u32a(mat, arrayflags, 2);
+        TinyMAT_writeDatElement_i32a(mat, sizes, 2);
+        TinyMAT_writeDatElement_stringas8bit(mat, name);
+        TinyMAT_writeDatElement_dbla(mat, data, 0);
+        col.headerSize=TinyMAT_ftell(mat)-col.offset;
+        TinyMAT_fwriteValues(data, sizeof(double), static_cast<uint32_t>(count), mat);
+        col.count=static_cast<uint32_t>(count);
+        TinyMAT_patchColumn(mat, col);
+        col.hasChecksum=TinyMAT_checksumEnd(mat, col.headerSize+static_cast<int64_t>(bytes), &col.checksum);
+        col.varIndex=mat->variables.size();
+        TinyMAT_registerVariable(mat, name, col.offset, col.headerSize+static_cast<int64_t>(bytes), col.hasChecksum?&col.checksum:NULL);
+        col.slack=TinyMAT_columnSlack(col.count, bytes);
+        const int64_t slackpos=TinyMAT_ftell(mat);
+        TinyMAT_writeZeros(mat, static_cast<size_t>(col.slack));
+        TinyMAT_writeTombstone(mat, slackpos, col.slack);
+        mat->columns[name]=col;
+        return;
+    }
+
+    TinyMATWriterColumn& col=it->second;
+    int64_t end=col.offset+col.headerSize+static_cast<int64_t>(col.count)*8;
+    if (col.slack!=static_cast<int64_t>(bytes) && col.slack<static_cast<int64_t>(bytes)+64) {
+        const int64_t newslack=TinyMAT_columnSlack(col.count, bytes);
+        if (end+col.slack==TinyMAT_ftell(mat)) {
+            // the column is the last element in the file: grow the free space
+            TinyMAT_writeZeros(mat, static_cast<size_t>(newslack-col.slack));
+        } else {
+            // move the column to the end of the file and turn the old column into a tombstone
+            std::vector<uint8_t> tmp(static_cast<size_t>(end-col.offset));
+            TinyMAT_pread(mat, col.offset, tmp.data(), tmp.size());
+            const int64_t newoffset=TinyMAT_ftell(mat);
+            TinyMAT_fwrite(tmp.data(), 1, static_cast<uint32_t>(tmp.size()), mat);
+            TinyMAT_writeZeros(mat, static_cast<size_t>(newslack));
+            TinyMAT_writeTombstone(mat, col.offset, end+col.slack-col.offset);
+            // the old record describes the tombstone now, the column is registered again at its new position (keeps the records ordered)
+            mat->variables[col.varIndex].name.clear();
+            mat->variables[col.varIndex].size=end+col.slack-col.offset;
+            col.varIndex=mat->variables.size();
+            TinyMAT_registerVariable(mat, name, newoffset, end-col.offset);
+            col.offset=newoffset;
+            end=col.offset+col.headerSize+static_cast<int64_t>(col.count)*8;
+        }
+        col.slack=newslack;
+    }
+
+    // write the values into the free space, the checksum is updated for the new values and the patched sizes
+    if (col.hasChecksum) TinyMAT_checksumBegin(mat, col.offset, end, TinyMAT_ftell(mat), col.checksum);
+    TinyMAT_pwriteValues(mat, end, data, sizeof(double), count);
+    col.count=col.count+static_cast<uint32_t>(count);
+    col.slack=col.slack-static_cast<int64_t>(bytes);
+    TinyMAT_patchColumn(mat, col);
+    TinyMATWriterVariable& var=mat->variables[col.varIndex];
+    var.size=col.headerSize+static_cast<int64_t>(col.count)*8;
+    if (col.hasChecksum) col.hasChecksum=TinyMAT_checksumEnd(mat, var.size, &col.checksum);
+    var.checksum=col.checksum;
+    var.hasChecksum=col.hasChecksum;
+    if (col.slack>0) TinyMAT_writeTombstone(mat, end+static_cast<int64_t>(bytes), col.slack);
+}
+
+void TinyMATWriter_setReplaceExisting(TinyMATWriterFile* mat, bool enabled) {
+    if (mat && !mat->sharedFile) mat->replaceExisting=enabled;
+}
+
+void TinyMATWriter_setWriteIndex(TinyMATWriterFile* mat, bool enabled) {
+    if (mat && !mat->sharedFile && !mat->concurrent) mat->writeIndex=enabled;
+}
+
+void TinyMATWriter_setByteOrder(TinyMATWriterFile* mat, TinyMATByteOrder order) {
+    if (!TinyMATWriter_fOK(mat) || mat->sharedFile || mat->element_depth>0) return;
+    // only possible as long as the file contains nothing but the header
+    if ((mat->concurrent?mat->appendOffset.load():TinyMAT_ftell(mat))!=128) return;
+    uint8_t fileorder=mat->byteorder;
+    if (order==TinyMATByteOrder::LittleEndian) fileorder=TINYMAT_ORDER_LITTLEENDIAN;
+    else if (order==TinyMATByteOrder::BigEndian) fileorder=TINYMAT_ORDER_BIGENDIAN;
+    if (mat->byteorder==TINYMAT_ORDER_UNKNOWN || fileorder==TINYMAT_ORDER_UNKNOWN) return;
+    mat->swapBytes=(fileorder!=mat->byteorder);
+    // version and endian indicator in the order of the file
+    const uint8_t flags[4]={
+        static_cast<uint8_t>((fileorder==TINYMAT_ORDER_BIGENDIAN)?0x01:0x00),
+        static_cast<uint8_t>((fileorder==TINYMAT_ORDER_BIGENDIAN)?0x00:0x01),
+        static_cast<uint8_t>((fileorder==TINYMAT_ORDER_BIGENDIAN)?'M':'I'),
+        static_cast<uint8_t>((fileorder==TINYMAT_ORDER_BIGENDIAN)?'I':'M')
+    };
+    TinyMAT_pwrite(mat, 124, flags, sizeof(flags));
+}
+
+void TinyMATWriter_setWriteChecksums(TinyMATWriterFile* mat, bool enabled) {
+    if (!mat || mat->sharedFile || mat->concurrent || mat->sizer) return;
+    mat->writeChecksums=enabled;
+    if (enabled) mat->writeIndex=true;
+}
+
+void TinyMATWriter_setVerifyOnClose(TinyMATWriterFile* mat, bool enabled) {
+    if (mat && !mat->sharedFile && !mat->sizer) mat->verifyOnClose=enabled;
+}
+
+void TinyMATWriter_setSparseThreshold(TinyMATWriterFile* mat, double maxDensity) {
+    if (mat) mat->sparseThreshold=maxDensity;
+}
+
+TinyMATWriterFile* TinyMATWriter_openSizer() {
+    TinyMATWriterFile* mat=new TinyMATWriterFile;
+    mat->byteorder = (uint8_t)TinyMAT_get_byteorder();
+    mat->sizer=true;
+    TinyMAT_writeFileHeader(mat, NULL);
+    return mat;
+}
+
+bool TinyMATWriter_isSizer(const TinyMATWriterFile* mat) {
+    return mat && mat->sizer;
+}
+
+void TinyMATWriter_writeElement(TinyMATWriterFile* mat, const char* name, const void* element, size_t size) {
+    if (!TinyMATWriter_fOK(mat) || !name || !element || size==0) return;
+    TinyMAT_beginElement(mat, name);
+    if (mat->swapBytes && !mat->sizer) {
+        TinyMATWriterScratchScope scope(mat);
+        void* swapped=mat->scratch.alloc(size);
+        if (!swapped) throw std::bad_alloc();
+        memcpy(swapped, element, size);
+        TinyMAT_swapElements(swapped, size, false);
+        TinyMAT_fwrite(swapped, 1, static_cast<uint32_t>(size), mat);
+    } else {
+        TinyMAT_fwrite(element, 1, static_cast<uint32_t>(size), mat);
+    }
+    TinyMAT_endElement(mat);
+}
+
+void* TinyMATWriter_scratch(TinyMATWriterFile* mat, size_t bytes) {
+    if (!mat) return NULL;
+    return mat->scratch.alloc(bytes);
+}
+
+TinyMATWriterScratchMark TinyMATWriter_scratchMark(const TinyMATWriterFile* mat) {
+    if (!mat) return TinyMATWriterScratchMark();
+    return mat->scratch.mark();
+}
+
+void TinyMATWriter_scratchRelease(TinyMATWriterFile* mat, const TinyMATWriterScratchMark& mark) {
+    if (mat) mat->scratch.release(mark);
+}
+
+void TinyMATWriter_setScratchBuffer(TinyMATWriterFile* mat, void* buffer, size_t size) {
+    if (mat) mat->scratch.setBuffer(buffer, size);
+}
+
+void TinyMATWriter_reserve(TinyMATWriterFile* mat, uint64_t bytes) {
+    if (mat && mat->sharedFile) mat=mat->sharedFile;
+    if (!TinyMATWriter_fOK(mat) || mat->sizer || bytes==0) return;
+    if (mat->filedata && bytes>mat->filedata_offset) {
+        // TinyMAT_growMem() keeps a margin of 100 bytes
+        const size_t needed=static_cast<size_t>(bytes-mat->filedata_offset)+101;
+        if (needed>mat->filedata_size) {
+            auto newMem=(uint8_t*)realloc(mat->filedata, needed);
+            if (newMem) {
+                mat->filedata=newMem;
+                mat->filedata_size=needed;
+            }
         }
-        if (mat) TinyMAT_fclose(mat);
     }
+    if (mat->file) TinyMAT_fpreallocate(mat->file, bytes);
+}
+
+uint64_t TinyMATWriter_getSize(TinyMATWriterFile* mat) {
+    if (mat && mat->sharedFile) mat=mat->sharedFile;
+    if (!TinyMATWriter_fOK(mat)) return 0;
+    if (mat->concurrent) return static_cast<uint64_t>(mat->appendOffset.load());
+    return static_cast<uint64_t>(TinyMAT_ftell(mat));
+}
+
+bool TinyMATWriter_hasVariable(const TinyMATWriterFile* mat, const char* name) {
+    if (!mat || !name) return false;
+    return mat->variableIndex.find(name)!=mat->variableIndex.end();
+}
+
+bool TinyMATWriter_removeVariable(TinyMATWriterFile* mat, const char* name) {
+    if (!TinyMATWriter_fOK(mat) || !name || mat->element_depth>0) return false;
+    auto it=mat->variableIndex.find(name);
+    if (it==mat->variableIndex.end()) return false;
+    TinyMATWriterVariable& var=mat->variables[it->second];
+    if (!TinyMAT_writeTombstone(mat, var.offset, var.size)) return false;
+    var.name.clear();
+    mat->columns.erase(it->first);
+    mat->variableIndex.erase(it);
+    return true;
 }
 
 std::string TinyMAT_combineStrings(const std::vector<std::string>& fieldnames, int32_t* maxlen_out=NULL, int32_t minlen=32) {
@@ -1474,7 +3317,7 @@ std::string TinyMAT_combineStrings(const std::vector<std::string>& fieldnames, i
 
 
 void TinyMATWriter_startStruct(TinyMATWriterFile *mat, const char *name) {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     mat->startStruct();
 
     uint32_t size_bytes=0;
@@ -1500,6 +3343,10 @@ void TinyMATWriter_startStruct(TinyMATWriterFile *mat, const char *name) {
     TinyMAT_writeDatElement_stringas8bit(mat, name);
 
     mat->lastStruct().data_start=TinyMAT_ftell(mat);
+    if (mat->checksum.active && mat->checksum.end==mat->lastStruct().data_start) {
+        mat->lastStruct().checksum=mat->checksum.crc;
+        mat->lastStruct().hasChecksum=true;
+    }
 }
 
 
@@ -1514,11 +3361,14 @@ void TinyMATWriter_endStruct(TinyMATWriterFile* mat) {
     */
     TinyMATWriterStruct& struc=mat->lastStruct();
 
-    long start=TinyMAT_ftell(mat);
-    long ssize=start-struc.data_start;
-    auto tmpdata=std::unique_ptr<uint8_t[]>(new uint8_t[ssize]);
+    int64_t start=TinyMAT_ftell(mat);
+    int64_t ssize=start-struc.data_start;
+    // a sizer only has to count the moved bytes, the copy is released before the enclosing element continues
+    TinyMATWriterScratchScope scope(mat);
+    uint8_t* tmpdata=mat->sizer?NULL:static_cast<uint8_t*>(mat->scratch.alloc(static_cast<size_t>(ssize)));
+    if (!tmpdata && !mat->sizer) throw std::bad_alloc();
     TinyMAT_fseek(mat, struc.data_start);
-    TinyMAT_fread(tmpdata.get(), ssize, 1, mat);
+    TinyMAT_fread(tmpdata, ssize, 1, mat);
 
 
     int32_t maxlen=0;
@@ -1526,28 +3376,33 @@ void TinyMATWriter_endStruct(TinyMATWriterFile* mat) {
 
 
     TinyMAT_fseek(mat, struc.data_start);
+    if (mat->checksum.active && struc.hasChecksum) {
+        // the fields are written again behind the names, so the checksum continues from the start of the fields
+        TinyMAT_checksumBegin(mat, mat->checksum.start, struc.data_start, struc.data_start, struc.checksum);
+    }
     // write field name length
     TinyMAT_writeDatElementS_i32(mat, maxlen);
 
     // write field names
     TinyMAT_writeDatElement_stringas8bit(mat, joinednames.c_str(), (uint32_t)joinednames.size());
     
-    TinyMAT_fwrite(tmpdata.get(), ssize, 1, mat);
+    TinyMAT_fwrite(tmpdata, ssize, 1, mat);
 
 
 
-    long endpos=TinyMAT_ftell(mat);
+    int64_t endpos=TinyMAT_ftell(mat);
     TinyMAT_fseek(mat, struc.sizepos);
     uint32_t size_bytes=endpos-struc.sizepos-4;
     TinyMAT_writeU32(mat, size_bytes);
     TinyMAT_fseek(mat, endpos);
     mat->endStruct();
+    TinyMAT_endElement(mat);
 }
 
 
 void TinyMATWriter_writeStruct(TinyMATWriterFile *mat, const char *name, const std::map<std::string, double> &data)
 {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     mat->startStruct();
     uint32_t size_bytes=0;
     uint32_t arrayflags[2]={TINYMAT_mxSTRUCT_CLASS_arrayflags, 0};
@@ -1576,7 +3431,7 @@ void TinyMATWriter_writeStruct(TinyMATWriterFile *mat, const char *name, const s
 
     // write tag header
     TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-    long sizepos;
+    int64_t sizepos;
     sizepos=TinyMAT_ftell(mat);
     TinyMAT_writeU32(mat, size_bytes);
 
@@ -1604,18 +3459,19 @@ void TinyMATWriter_writeStruct(TinyMATWriterFile *mat, const char *name, const s
         TinyMATWriter_writeMatrix2D_colmajor(mat, "", &v, 1, 1);
     }
 
-    long endpos;
+    int64_t endpos;
     endpos=TinyMAT_ftell(mat);
     TinyMAT_fseek(mat, sizepos);
     size_bytes=endpos-sizepos-4;
     TinyMAT_writeU32(mat, size_bytes);
     TinyMAT_fseek(mat, endpos);
     mat->endStruct();
+    TinyMAT_endElement(mat);
 }
 
 void TinyMATWriter_startCellArray(TinyMATWriterFile * mat, const char * name, const int32_t * sizes, uint32_t ndims)
 {
-  mat->addStructItemName(name);
+  TinyMAT_beginElement(mat, name);
   mat->startCell();
 
   uint32_t size_bytes = 0;
@@ -1645,25 +3501,26 @@ void TinyMATWriter_endCellArray(TinyMATWriterFile * mat)
 {
   TinyMATWriterCell& cell = mat->lastCell();
 
-  long endpos = TinyMAT_ftell(mat);
+  int64_t endpos = TinyMAT_ftell(mat);
   TinyMAT_fseek(mat, cell.sizepos);
   uint32_t size_bytes = endpos - cell.sizepos - 4;
   TinyMAT_writeU32(mat, size_bytes);
   TinyMAT_fseek(mat, endpos);
 
   mat->endCell();
+  TinyMAT_endElement(mat);
 }
 
 
 void TinyMATWriter_writeStringList(TinyMATWriterFile *mat, const char *name, const std::list<std::string> &data)
 {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     uint32_t size_bytes=0;
     uint32_t arrayflags[2]={TINYMAT_mxCELL_CLASS_arrayflags, 0};
 
     // write tag header
     TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-    long sizepos=TinyMAT_ftell(mat);
+    int64_t sizepos=TinyMAT_ftell(mat);
     TinyMAT_writeU32(mat, size_bytes);
 
     // write arrayflags
@@ -1684,23 +3541,24 @@ void TinyMATWriter_writeStringList(TinyMATWriterFile *mat, const char *name, con
         TinyMATWriter_writeString(mat, "", a.c_str(), (uint32_t)a.size());
     }
 
-    long endpos=TinyMAT_ftell(mat);
+    int64_t endpos=TinyMAT_ftell(mat);
     TinyMAT_fseek(mat, sizepos);
     size_bytes=endpos-sizepos-4;
     TinyMAT_writeU32(mat, size_bytes);
     TinyMAT_fseek(mat, endpos);
+    TinyMAT_endElement(mat);
 }
 
 
 void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, const std::vector<std::string> &data)
 {
-    mat->addStructItemName(name);
+    TinyMAT_beginElement(mat, name);
     uint32_t size_bytes=0;
     uint32_t arrayflags[2]={TINYMAT_mxCELL_CLASS_arrayflags, 0};
 
     // write tag header
     TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-    long sizepos=TinyMAT_ftell(mat);
+    int64_t sizepos=TinyMAT_ftell(mat);
     TinyMAT_writeU32(mat, size_bytes);
 
     // write arrayflags
@@ -1721,11 +3579,12 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
         TinyMATWriter_writeString(mat, "", a.c_str(), (uint32_t)a.size());
     }
 
-    long endpos=TinyMAT_ftell(mat);
+    int64_t endpos=TinyMAT_ftell(mat);
     TinyMAT_fseek(mat, sizepos);
     size_bytes=endpos-sizepos-4;
     TinyMAT_writeU32(mat, size_bytes);
     TinyMAT_fseek(mat, endpos);
+    TinyMAT_endElement(mat);
 }
 
 
@@ -1739,7 +3598,7 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
 
     void TinyMATWriter_writeQVariantList(TinyMATWriterFile *mat, const char *name, const QVariantList &data)
     {
-        mat->addStructItemName(name);
+        TinyMAT_beginElement(mat, name);
         uint32_t size_bytes=0;
         uint32_t arrayflags[2]={TINYMAT_mxCELL_CLASS_arrayflags, 0};
 
@@ -1749,7 +3608,7 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
 
         // write tag header
         TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
+        int64_t sizepos=TinyMAT_ftell(mat);
         TinyMAT_writeU32(mat, size_bytes);
 
         // write arrayflags
@@ -1829,22 +3688,23 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
             }
         }
 
-        long endpos=TinyMAT_ftell(mat);
+        int64_t endpos=TinyMAT_ftell(mat);
         TinyMAT_fseek(mat, sizepos);
         size_bytes=endpos-sizepos-4;
         TinyMAT_writeU32(mat, size_bytes);
         TinyMAT_fseek(mat, endpos);
+        TinyMAT_endElement(mat);
     }
 
     void TinyMATWriter_writeQStringList(TinyMATWriterFile *mat, const char *name, const QStringList &data)
     {
-        mat->addStructItemName(name);
+        TinyMAT_beginElement(mat, name);
         uint32_t size_bytes=0;
         uint32_t arrayflags[2]={TINYMAT_mxCELL_CLASS_arrayflags, 0};
 
         // write tag header
         TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos=TinyMAT_ftell(mat);
+        int64_t sizepos=TinyMAT_ftell(mat);
         TinyMAT_writeU32(mat, size_bytes);
 
         // write arrayflags
@@ -1865,16 +3725,17 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
             TinyMATWriter_writeString(mat, "", a.data(), a.size());
         }
 
-        long endpos=TinyMAT_ftell(mat);
+        int64_t endpos=TinyMAT_ftell(mat);
         TinyMAT_fseek(mat, sizepos);
         size_bytes=endpos-sizepos-4;
         TinyMAT_writeU32(mat, size_bytes);
         TinyMAT_fseek(mat, endpos);
+        TinyMAT_endElement(mat);
     }
 
     void TinyMATWriter_writeQVariantMatrix_listofcols(TinyMATWriterFile *mat, const char *name, const QList<QList<QVariant> > &data)
     {
-        mat->addStructItemName(name);
+        TinyMAT_beginElement(mat, name);
         uint32_t size_bytes=0;
         uint32_t arrayflags[2]={TINYMAT_mxCELL_CLASS_arrayflags, 0};
 
@@ -1889,7 +3750,7 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
 
         // write tag header
         TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos;
+        int64_t sizepos;
         sizepos=TinyMAT_ftell(mat);
         TinyMAT_writeU32(mat, size_bytes);
 
@@ -1984,13 +3845,14 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
             }
         }
 
-        long endpos;
+        int64_t endpos;
         endpos=TinyMAT_ftell(mat);
         TinyMAT_fseek(mat, sizepos);
         //fsetpos(mat->file, &sizepos);
         size_bytes=endpos-sizepos-4;
         TinyMAT_writeU32(mat, size_bytes);
         TinyMAT_fseek(mat, endpos);
+        TinyMAT_endElement(mat);
         //fsetpos(mat->file, &endpos);
         //std::cout<<endpos<<" "<<TinyMAT_ftell(mat)<<"\n";
     }
@@ -2000,7 +3862,7 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
 
     void TinyMATWriter_writeQVariantMap(TinyMATWriterFile *mat, const char *name, const QVariantMap &data)
     {
-        mat->addStructItemName(name);
+        TinyMAT_beginElement(mat, name);
         mat->startStruct();
         uint32_t size_bytes=0;
         uint32_t arrayflags[2]={TINYMAT_mxSTRUCT_CLASS_arrayflags, 0};
@@ -2026,7 +3888,7 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
 
         // write tag header
         TinyMAT_writeU32(mat, (uint32_t)TINYMAT_miMATRIX);
-        long sizepos;
+        int64_t sizepos;
         sizepos=TinyMAT_ftell(mat);
         TinyMAT_writeU32(mat, size_bytes);
 
@@ -2126,13 +3988,14 @@ void TinyMATWriter_writeStringVector(TinyMATWriterFile *mat, const char *name, c
             }
         }
 
-        long endpos;
+        int64_t endpos;
         endpos=TinyMAT_ftell(mat);
         TinyMAT_fseek(mat, sizepos);
         size_bytes=endpos-sizepos-4;
         TinyMAT_writeU32(mat, size_bytes);
         TinyMAT_fseek(mat, endpos);
         mat->endStruct();
+        TinyMAT_endElement(mat);
     }
 
 #endif
@@ -2171,7 +4034,9 @@ template <>
 void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name, const std::vector<cv::Point2d>& data_vec) {
   if (data_vec.size() <= 0) TinyMATWriter_writeEmptyMatrix(mat, name);
   int32_t siz[2] = { 2, (int32_t)data_vec.size() };
-  double* tmp = (double*)malloc(data_vec.size() * 2 * sizeof(double));
+  TinyMATWriterScratchScope scope(mat);
+  double* tmp = static_cast<double*>(TinyMATWriter_scratch(mat, data_vec.size() * 2 * sizeof(double)));
+  if (!tmp) return;
   int i = 0;
   for (auto& it : data_vec) {
 
@@ -2180,14 +4045,15 @@ void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name,
     i++;
   }
   TinyMATWriter_writeMatrix2D_rowmajor<double>(mat, name, tmp, (int32_t)data_vec.size(), 2);
-  free(tmp);
 }
 
 template <>
 void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name, const std::vector<cv::Point2i>& data_vec) {
   if (data_vec.size() <= 0) TinyMATWriter_writeEmptyMatrix(mat, name);
   int32_t siz[2] = { 2, (int32_t)data_vec.size() };
-  int* tmp = (int*)malloc(data_vec.size() * 2 * sizeof(int));
+  TinyMATWriterScratchScope scope(mat);
+  int* tmp = static_cast<int*>(TinyMATWriter_scratch(mat, data_vec.size() * 2 * sizeof(int)));
+  if (!tmp) return;
   int i = 0;
   for (auto& it : data_vec) {
 
@@ -2196,14 +4062,15 @@ void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name,
     i++;
   }
   TinyMATWriter_writeMatrix2D_rowmajor<int>(mat, name, tmp, (int32_t)data_vec.size(), 2);
-  free(tmp);
 }
 
 template <>
 void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name, const std::vector<cv::Point2f>& data_vec) {
   if (data_vec.size() <= 0) TinyMATWriter_writeEmptyMatrix(mat, name);
   int32_t siz[2] = { 2, (int32_t)data_vec.size() };
-  float* tmp = (float*)malloc(data_vec.size() * 2 * sizeof(float));
+  TinyMATWriterScratchScope scope(mat);
+  float* tmp = static_cast<float*>(TinyMATWriter_scratch(mat, data_vec.size() * 2 * sizeof(float)));
+  if (!tmp) return;
   int i = 0;
   for (auto& it : data_vec) {
 
@@ -2212,14 +4079,15 @@ void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name,
     i++;
   }
   TinyMATWriter_writeMatrix2D_rowmajor<float>(mat, name, tmp, (int32_t)data_vec.size(), 2);
-  free(tmp);
 }
 
 template <>
 void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name, const std::vector<cv::Point2l>& data_vec) {
   if (data_vec.size() <= 0) TinyMATWriter_writeEmptyMatrix(mat, name);
   int32_t siz[2] = { 2, (int32_t)data_vec.size() };
-  int64_t* tmp = (int64_t*)malloc(data_vec.size() * 2 * sizeof(int64_t));
+  TinyMATWriterScratchScope scope(mat);
+  int64_t* tmp = static_cast<int64_t*>(TinyMATWriter_scratch(mat, data_vec.size() * 2 * sizeof(int64_t)));
+  if (!tmp) return;
   int i = 0;
   for (auto& it : data_vec) {
 
@@ -2228,7 +4096,6 @@ void TinyMATWriter_writeContainerAsRow(TinyMATWriterFile* mat, const char* name,
     i++;
   }
   TinyMATWriter_writeMatrix2D_rowmajor<int64_t>(mat, name, tmp, (int32_t)data_vec.size(), 2);
-  free(tmp);
 }
 
 #endif
@@ -23,6 +23,7 @@
 #define TINYMATWRITER_H
 
 #include "tinymat_export.h"
+#include "tinymatencoder.h"
 
 #include <stdint.h>
 #include <memory>
@@ -30,6 +31,9 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <complex>
+#include <future>
+#include <functional>
 
 #ifdef TINYMAT_USES_QVARIANT
 #  include <QVariant>
@@ -136,9 +140,354 @@ TINYMAT_EXPORT int TinyMATWriter_fOK(const TinyMATWriterFile* mat);
                    The default-size is 100kB.
     \return a new TinyMATWriterFile pointer on success, or NULL on errors
 
+    \see TinyMATWriter_openWithSizeHint()
   */
 TINYMAT_EXPORT TinyMATWriterFile* TinyMATWriter_open(const char* filename, const char* description=NULL, size_t bufSize=1024*100);
 
+/*! \brief create a new MAT file, that is expected to grow to \a sizeHint bytes
+    \ingroup tinymatwriter
+
+    \param filename name of the new MAT file
+    \param sizeHint expected size of the file in bytes (e.g. from a sizer, see TinyMATWriter_openSizer() ), 0 if unknown.
+                    The memory cache and the disk space are allocated once for this size, see TinyMATWriter_reserve().
+    \param description description of the file (max. 115 characters)
+    \param bufSize size of the IO-Buffer used for the MAT-file (see TinyMATWriter_open() )
+    \return a new TinyMATWriterFile pointer on success, or NULL on errors
+
+  */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATWriter_openWithSizeHint(const char* filename, uint64_t sizeHint, const char* description=NULL, size_t bufSize=1024*100);
+
+/*! \brief create a sizer: a MAT-file, that only computes the size of the data written into it
+    \ingroup tinymatwriter
+
+    \return a new TinyMATWriterFile pointer
+
+    All write functions can be used with a sizer. Nothing is stored, only the positions are tracked, so after
+    writing, TinyMATWriter_getSize() returns the exact size of the same data in a real MAT-file (including the header,
+    struct field tables and padding). This can be used to preallocate space, choose a shard or reject a large save.
+    A sizer does not read the data, so its runtime depends on the number of variables, not on their size. Only some
+    conversions need the data: writing double matrices with a sparse threshold (see TinyMATWriter_setSparseThreshold() ),
+    sparse matrices in CSR or COO form and copies from containers.
+
+    Close the sizer with TinyMATWriter_close().
+ */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATWriter_openSizer();
+
+/*! \brief returns \c true, if \a mat was created by TinyMATWriter_openSizer()
+    \ingroup tinymatwriter
+ */
+TINYMAT_EXPORT bool TinyMATWriter_isSizer(const TinyMATWriterFile* mat);
+
+/*! \brief open an existing MAT file, so new top-level variables can be appended to it
+    \ingroup tinymatwriter
+
+    \param filename name of the MAT file
+    \param description description of the file (max. 115 characters), only used if the file does not exist yet
+    \param bufSize size of the IO-Buffer used for the MAT-file (see TinyMATWriter_open() )
+    \return a new TinyMATWriterFile pointer on success, or NULL on errors
+
+    The 128-byte header of the file (as written by TinyMATWriter_open() ) is checked and all variables
+    that are already in the file are kept. If the last top-level element in the file is incomplete, i.e. its
+    size extends beyond the end of the file (e.g. because the writing program crashed), it is removed before
+    any new data is written. Complete elements of other types than variables are kept as they are.
+    If the file does not exist, a new file is created, just as with TinyMATWriter_open().
+    If the file is not a MAT-file in the format written by TinyMAT, or a variable in it is damaged, \c NULL is returned.
+
+  */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATWriter_openAppend(const char* filename, const char* description=NULL, size_t bufSize=1024*100);
+
+/*! \brief create a new MAT file, that can be written concurrently by several threads
+    \ingroup tinymatwriter
+
+    \param filename name of the new MAT file
+    \param description description of the file (max. 115 characters)
+    \return a new TinyMATWriterFile pointer on success, or NULL on errors
+
+    Variables can not be written directly into the returned file. Instead each thread creates its own writer with
+    TinyMATWriter_openThreadWriter() and uses it like any other TinyMATWriterFile. Such a writer encodes each top-level
+    variable into a thread-local memory buffer and, as soon as the variable is complete, reserves space at the end of the
+    shared file with an atomic increment and writes the buffer there. So the threads never wait for each other while encoding
+    and the order of the variables in the file is the order in which they were completed.
+
+    Close all thread writers, before the shared file is closed with TinyMATWriter_close().
+
+  */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATWriter_openConcurrent(const char* filename, const char* description=NULL);
+
+/*! \brief create a writer for the calling thread, that writes into the MAT file \a sharedMat, opened by TinyMATWriter_openConcurrent()
+    \ingroup tinymatwriter
+
+    \param sharedMat the shared MAT file
+    \param bufSize initial size of the thread-local buffer
+    \return a new TinyMATWriterFile pointer on success, or NULL on errors
+
+    The writer must only be used by one thread at a time and is closed with TinyMATWriter_close(), which does not close \a sharedMat.
+    Functions that need to read back data from the file (e.g. TinyMATWriter_setReplaceExisting() ) are not supported for these writers.
+
+  */
+TINYMAT_EXPORT TinyMATWriterFile* TinyMATWriter_openThreadWriter(TinyMATWriterFile* sharedMat, size_t bufSize=1024*100);
+
+/*! \brief enables or disables the replacement of existing top-level variables
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param enabled if \c true, writing a top-level variable with a name that is already in the file replaces the old variable
+
+    If the replacement has the same encoded size as the old variable (e.g. a progress counter, or a small matrix
+    of fixed size), the old element is overwritten in place. Otherwise the old element is turned into an unused
+    variable named \c tm_free (a "tombstone", that covers exactly the old element) and the new variable is appended
+    to the file. The variables are found by an index, that is built when opening the file with TinyMATWriter_openAppend()
+    and updated with every top-level variable written. If replacement is disabled (default), variables with the same
+    name are simply appended, so the file contains both versions.
+
+    \note A tombstone needs at least 64 bytes, so a scalar of a 1-, 2- or 4-byte type (e.g. \c uint8_t or \c bool)
+          with a name of up to 4 characters can only be replaced by a variable of the same size. Otherwise the new
+          variable is not written and a \c std::runtime_error is thrown.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_setReplaceExisting(TinyMATWriterFile* mat, bool enabled);
+
+/** \brief name of the variable, that holds the index of all variables in a file (see TinyMATWriter_setWriteIndex() )
+  * \ingroup tinymatwriter
+  */
+#define TINYMAT_INDEX_NAME "tinymat_index"
+
+/** \brief name of the variables, which mark unused space in a file (see TinyMATWriter_setReplaceExisting() )
+  * \ingroup tinymatwriter
+  */
+#define TINYMAT_TOMBSTONE_NAME "tm_free"
+
+/*! \brief enables or disables writing an index of all variables, when the file is closed
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param enabled if \c true, TinyMATWriter_close() appends a struct variable named TINYMAT_INDEX_NAME with the
+                   names and byte offsets of all top-level variables
+
+    The index lets a reader (see TinyMATReader_find() ) find any variable without scanning the file: The index is
+    the last variable in the file and its last 8 bytes hold the byte offset of the index itself. Tombstones and
+    replaced variables are not listed. When a file with an index is opened with TinyMATWriter_openAppend(), the
+    index is removed and written again on TinyMATWriter_close(). Not supported for concurrent files.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_setWriteIndex(TinyMATWriterFile* mat, bool enabled);
+
+/*! \brief enables or disables storing a CRC32C checksum of each variable in the index
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param enabled if \c true, the index (see TinyMATWriter_setWriteIndex(), which is enabled as well) gets a field
+                   \c crc32c with the checksum of each variable
+
+    The checksum is the CRC32C (see \ref tinymatchecksum) over the bytes of the complete top-level element, as stored in
+    the file. It is computed while the variable is written, so the data is not read again. Enable the checksums before
+    writing any variables: variables, that were written before (or that were in a file without checksums, opened with
+    TinyMATWriter_openAppend() ) are read once, when the file is closed. Use TinyMATReader_verifyChecksums() to check the
+    variables in a file. Not supported for concurrent files.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_setWriteChecksums(TinyMATWriterFile* mat, bool enabled);
+
+/** \brief byte order of a MAT-file (see TinyMATWriter_setByteOrder() )
+  * \ingroup tinymatwriter
+  */
+enum class TinyMATByteOrder : uint8_t {
+    Native=0,       /*!< \brief the byte order of this machine (default) */
+    LittleEndian=1, /*!< \brief little-endian (e.g. x86/x64 and most ARM machines), the endian indicator in the header is \c "IM" */
+    BigEndian=2     /*!< \brief big-endian (e.g. PowerPC or SPARC machines), the endian indicator in the header is \c "MI" */
+};
+
+/*! \brief sets the byte order of the file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param order the byte order of the finished file
+
+    If \a order differs from the byte order of this machine, every value is swapped as it is written (see
+    \ref tinymatbyteorder), so no second pass over the file is needed. The endian indicator in the header is set
+    right away. Has to be called before the first variable is written, later calls are ignored. Ignored for thread
+    writers: set it on the concurrent file, before the thread writers are opened. Files in the other byte order
+    cannot be opened by TinyMATWriter_openAppend().
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_setByteOrder(TinyMATWriterFile* mat, TinyMATByteOrder order);
+
+/*! \brief enables or disables checking the finished file, when it is closed
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param enabled if \c true, TinyMATWriter_close() re-reads the finished file with TinyMATReader_verify()
+
+    The file is checked in its memory cache (if it holds the complete file) or read back from disk after closing it.
+    If it is malformed, TinyMATWriter_close() throws a \c std::runtime_error, which names the first malformed
+    element and its byte offset (TinyMATWriter_closeChecked() returns \c false instead). Ignored for sizers and
+    thread writers (set it on the concurrent file instead).
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_setVerifyOnClose(TinyMATWriterFile* mat, bool enabled);
+
+/*! \brief enables the automatic conversion of mostly-zero double matrices into sparse matrices
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param maxDensity maximum fraction of non-zero entries (e.g. 0.05 for 5%) of a matrix, that is written as sparse matrix, \c 0 disables the conversion (default)
+
+    If enabled, every 2-dimensional matrix, written by TinyMATWriter_writeMatrixND_colmajor() with \c double data (and all functions
+    based on it), is checked for non-zero entries. If it contains at most \a maxDensity non-zeros and the sparse form is smaller,
+    it is written as a sparse matrix (\c mxSPARSE_CLASS). Note that the variable then has the class \c sparse double when loaded in Matlab.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_setSparseThreshold(TinyMATWriterFile* mat, double maxDensity);
+
+/*! \brief append values to a double column vector \a name in a MAT-file, the vector is created on the first call
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name of the column vector
+    \param data the values to append
+    \param count number of values in \a data
+
+    The column vector is followed by free space in the file (an unused variable, see TinyMATWriter_setReplaceExisting() ),
+    so new values are written in place and only the size fields of the vector are updated. If the free space is exhausted
+    and other variables were written behind the vector, it is moved to the end of the file, with free space that grows with
+    the vector, so the amortized cost per value is constant. The file is valid after each call.
+    Other variables can be written between the calls, but not while a struct or cell array is open.
+    If the file already contains a variable \a name (e.g. in a file opened by TinyMATWriter_openAppend() ), it is extended, if it is
+    a real \c double column vector. Otherwise it is replaced by a new column, if TinyMATWriter_setReplaceExisting() is enabled, and
+    a \c std::runtime_error is thrown if not.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_appendToColumn(TinyMATWriterFile* mat, const char* name, const double* data, size_t count);
+
+/*! \brief returns \a bytes of temporary memory from the scratch arena of \a mat
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param bytes the number of bytes to allocate
+    \return the memory, or NULL on errors
+
+    The memory stays valid until the current top-level variable is completely written, afterwards it is reused.
+    It must not be freed. The write functions use this arena for all temporary conversion buffers, so writing
+    many small variables does (almost) no heap allocations.
+
+    \see TinyMATWriter_setScratchBuffer()
+  */
+TINYMAT_EXPORT void* TinyMATWriter_scratch(TinyMATWriterFile* mat, size_t bytes);
+
+/*! \brief state of the scratch arena of a MAT-file, see TinyMATWriter_scratchMark()
+    \ingroup tinymatwriter
+  */
+struct TinyMATWriterScratchMark {
+  inline TinyMATWriterScratchMark() :
+    used(0),
+    extraCount(0),
+    extraBytes(0),
+    generation(static_cast<size_t>(-1))
+  {
+  }
+  size_t used;
+  size_t extraCount;
+  size_t extraBytes;
+  size_t generation;
+};
+
+/*! \brief returns the current state of the scratch arena of \a mat
+    \ingroup tinymatwriter
+
+    All memory returned by TinyMATWriter_scratch() afterwards can be released with TinyMATWriter_scratchRelease(),
+    before the top-level variable is completely written, so nested elements do not accumulate temporary memory.
+
+    \see TinyMATWriterScratchScope
+  */
+TINYMAT_EXPORT TinyMATWriterScratchMark TinyMATWriter_scratchMark(const TinyMATWriterFile* mat);
+
+/*! \brief releases all scratch memory of \a mat, that was returned since \a mark was taken with TinyMATWriter_scratchMark()
+    \ingroup tinymatwriter
+
+    Nothing is released, if the top-level variable was finished in between.
+  */
+TINYMAT_EXPORT void TinyMATWriter_scratchRelease(TinyMATWriterFile* mat, const TinyMATWriterScratchMark& mark);
+
+/*! \brief releases the scratch memory of a MAT-file, that is allocated during its lifetime, when it goes out of scope
+    \ingroup tinymatwriter
+
+\code
+    {
+        TinyMATWriterScratchScope scope(mat);
+        double* tmp=static_cast<double*>(TinyMATWriter_scratch(mat, n*sizeof(double)));
+        ...
+    } // tmp is released here
+\endcode
+  */
+struct TinyMATWriterScratchScope {
+  inline explicit TinyMATWriterScratchScope(TinyMATWriterFile* mat_) :
+    mat(mat_),
+    mark(TinyMATWriter_scratchMark(mat_))
+  {
+  }
+  inline ~TinyMATWriterScratchScope() {
+    TinyMATWriter_scratchRelease(mat, mark);
+  }
+  TinyMATWriterFile* mat;
+  TinyMATWriterScratchMark mark;
+private:
+  TinyMATWriterScratchScope(const TinyMATWriterScratchScope&);
+  TinyMATWriterScratchScope& operator=(const TinyMATWriterScratchScope&);
+};
+
+/*! \brief lets the scratch arena of \a mat use the memory \a buffer with \a size bytes
+    \ingroup tinymatwriter
+
+    \a buffer is owned by the caller and has to stay valid until \a mat is closed (or another buffer is set).
+    Requests, that do not fit into \a buffer, are served from the heap, and if that happens the arena
+    switches to its own (larger) memory block.
+    Call this function only between two top-level variables.
+  */
+TINYMAT_EXPORT void TinyMATWriter_setScratchBuffer(TinyMATWriterFile* mat, void* buffer, size_t size);
+
+/*! \brief prepares \a mat for a total file size of \a bytes
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param bytes the expected size of the complete file in bytes (including the header and everything written so far)
+
+    If \a mat uses a memory cache, it is enlarged once to hold \a bytes, so writing up to this size does not reallocate
+    (and copy) the cache. If \a mat is written to disk, the disk space is preallocated without changing the file size
+    (only on Linux with \c fallocate(), elsewhere this has no effect on the file). Writing more than \a bytes is possible.
+  */
+TINYMAT_EXPORT void TinyMATWriter_reserve(TinyMATWriterFile* mat, uint64_t bytes);
+
+/*! \brief returns the current size of the MAT-file in bytes (including the header)
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \return the size, or 0 if \a mat is not valid
+
+    Call this function only between two top-level variables. For thread writers (see TinyMATWriter_openThreadWriter() )
+    this is the size of the shared file.
+  */
+TINYMAT_EXPORT uint64_t TinyMATWriter_getSize(TinyMATWriterFile* mat);
+
+/*! \brief returns \c true, if the MAT-file contains a top-level variable \a name
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param name variable name to look for
+
+  */
+TINYMAT_EXPORT bool TinyMATWriter_hasVariable(const TinyMATWriterFile* mat, const char* name);
+
+/*! \brief removes the top-level variable \a name from the MAT-file, by overwriting it with a tombstone
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file
+    \param name variable name to remove
+    \return \c true on success
+
+    \see TinyMATWriter_setReplaceExisting()
+  */
+TINYMAT_EXPORT bool TinyMATWriter_removeVariable(TinyMATWriterFile* mat, const char* name);
+
 /*! \brief write a string into a MAT-file
     \ingroup tinymatwriter
 
@@ -319,7 +668,206 @@ TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile* mat,
   */
 TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile* mat, const char* name, const bool* data_real, const int32_t* sizes, uint32_t ndims) ;
 
+/*! \brief write a N-dimensional complex double matrix in column-major form into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in column-major order)
+    \param sizes number of entries in each dimension {rows, cols, matrices, ...}
+    \param ndims number of dimensions
+
+    The interleaved complex values are split into the real and imaginary part of the MAT-file while writing,
+    so no separate copy of the data is required.
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile* mat, const char* name, const std::complex<double>* data, const int32_t* sizes, uint32_t ndims) ;
+
+/*! \brief write a N-dimensional complex float matrix in column-major form into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in column-major order)
+    \param sizes number of entries in each dimension {rows, cols, matrices, ...}
+    \param ndims number of dimensions
+
+    The interleaved complex values are split into the real and imaginary part of the MAT-file while writing,
+    so no separate copy of the data is required.
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile* mat, const char* name, const std::complex<float>* data, const int32_t* sizes, uint32_t ndims) ;
+
+/*! \brief write a N-dimensional complex double matrix in row-major form into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in row-major order)
+    \param sizes number of entries in each dimension {columns, rows, matrices, ...}
+    \param ndims number of dimensions
+
+    This is equivalent to the template TinyMATWriter_writeMatrixND_rowmajor(), but the data is transposed and split into
+    real and imaginary part in a single pass, without a temporary copy of the matrix.
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile* mat, const char* name, const std::complex<double>* data, const int32_t* sizes, uint32_t ndims) ;
+
+/*! \brief write a N-dimensional complex float matrix in row-major form into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in row-major order)
+    \param sizes number of entries in each dimension {columns, rows, matrices, ...}
+    \param ndims number of dimensions
+
+    This is equivalent to the template TinyMATWriter_writeMatrixND_rowmajor(), but the data is transposed and split into
+    real and imaginary part in a single pass, without a temporary copy of the matrix.
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile* mat, const char* name, const std::complex<float>* data, const int32_t* sizes, uint32_t ndims) ;
+
+/*! \brief write a sparse double matrix, given in compressed sparse column (CSC) form, into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param values the non-zero values (\c colPointers[cols]-colPointers[0] entries)
+    \param rowIndices the (0-based) row index of every value, sorted in ascending order within each column
+    \param colPointers \a cols+1 entries, the values of column \c c are at <code>colPointers[c]...colPointers[c+1]-1</code>
+    \param rows number of rows of the matrix
+    \param cols number of columns of the matrix
 
+    This is the storage format of sparse matrices in MAT-files, so the arrays are written as they are, without any conversion
+    or temporary copies. The matrix is stored as \c mxSPARSE_CLASS, so the file size is proportional to the number of non-zeros.
+    The input is checked before writing: If \a colPointers decrease, or a row index is outside <code>0..rows-1</code> or not
+    ascending within its column, an empty matrix is written instead.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeSparseCSC(TinyMATWriterFile* mat, const char* name, const double* values, const int32_t* rowIndices, const int32_t* colPointers, int32_t rows, int32_t cols);
+
+/*! \brief write a sparse logical matrix, given in compressed sparse column (CSC) form, into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param values the values (\c colPointers[cols]-colPointers[0] entries), if \c NULL, all given entries are \c true
+    \param rowIndices the (0-based) row index of every value, sorted in ascending order within each column
+    \param colPointers \a cols+1 entries, the values of column \c c are at <code>colPointers[c]...colPointers[c+1]-1</code>
+    \param rows number of rows of the matrix
+    \param cols number of columns of the matrix
+
+    The input is checked just as for the double version of TinyMATWriter_writeSparseCSC().
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeSparseCSC(TinyMATWriterFile* mat, const char* name, const bool* values, const int32_t* rowIndices, const int32_t* colPointers, int32_t rows, int32_t cols);
+
+/*! \brief write a sparse double matrix, given in compressed sparse row (CSR) form, into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param values the non-zero values (\c rowPointers[rows]-rowPointers[0] entries)
+    \param colIndices the (0-based) column index of every value
+    \param rowPointers \a rows+1 entries, the values of row \c r are at <code>rowPointers[r]...rowPointers[r+1]-1</code>
+    \param rows number of rows of the matrix
+    \param cols number of columns of the matrix
+    \param nthreads number of threads to use for the conversion to CSC, \c 0 selects a number, based on the CPU and the size of the matrix
+
+    The matrix is transposed into the CSC form of the MAT-file by a (parallel) counting sort, which runs in
+    O(nonzeros+cols) time. Entries with an invalid column index are ignored. If \a rowPointers decrease, an empty matrix is written.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeSparseCSR(TinyMATWriterFile* mat, const char* name, const double* values, const int32_t* colIndices, const int32_t* rowPointers, int32_t rows, int32_t cols, unsigned nthreads=0);
+
+/*! \brief write a sparse logical matrix, given in compressed sparse row (CSR) form, into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param values the values (\c rowPointers[rows]-rowPointers[0] entries), if \c NULL, all given entries are \c true
+    \param colIndices the (0-based) column index of every value
+    \param rowPointers \a rows+1 entries, the values of row \c r are at <code>rowPointers[r]...rowPointers[r+1]-1</code>
+    \param rows number of rows of the matrix
+    \param cols number of columns of the matrix
+    \param nthreads number of threads to use for the conversion to CSC, \c 0 selects a number, based on the CPU and the size of the matrix
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeSparseCSR(TinyMATWriterFile* mat, const char* name, const bool* values, const int32_t* colIndices, const int32_t* rowPointers, int32_t rows, int32_t cols, unsigned nthreads=0);
+
+/*! \brief write a sparse double matrix, given as coordinate list (COO, triplets), into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param values the \a nnz values
+    \param rowIndices the (0-based) row index of every value
+    \param colIndices the (0-based) column index of every value
+    \param nnz number of triplets
+    \param rows number of rows of the matrix
+    \param cols number of columns of the matrix
+    \param nthreads number of threads to use for sorting, \c 0 selects a number, based on the CPU and the size of the matrix
+
+    The triplets may be given in any order. They are sorted into CSC form and, like Matlab's \c sparse(i,j,v) does,
+    values with the same coordinates are summed and resulting zeros are removed. Entries with invalid indices are ignored.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeSparseCOO(TinyMATWriterFile* mat, const char* name, const double* values, const int32_t* rowIndices, const int32_t* colIndices, size_t nnz, int32_t rows, int32_t cols, unsigned nthreads=0);
+
+/*! \brief write a sparse logical matrix, given as coordinate list (COO, triplets), into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param values the \a nnz values, if \c NULL, all given entries are \c true
+    \param rowIndices the (0-based) row index of every value
+    \param colIndices the (0-based) column index of every value
+    \param nnz number of triplets
+    \param rows number of rows of the matrix
+    \param cols number of columns of the matrix
+    \param nthreads number of threads to use for sorting, \c 0 selects a number, based on the CPU and the size of the matrix
+
+    Values with the same coordinates are combined by a logical OR.
+
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeSparseCOO(TinyMATWriterFile* mat, const char* name, const bool* values, const int32_t* rowIndices, const int32_t* colIndices, size_t nnz, int32_t rows, int32_t cols, unsigned nthreads=0);
+
+
+
+/*! \brief writes a complete, encoded miMATRIX element (tag, array flags, dimensions, name and data) as variable \a name
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name, it has to be the same as the name encoded in \a element
+    \param element the encoded element
+    \param size size of \a element in bytes
+
+    This is the backend of the compile-time encoders (see \ref tinymatencoder ), it writes \a element with a single call
+    and takes care of the variable index, replacing existing variables, struct field names and thread writers.
+  */
+TINYMAT_EXPORT void TinyMATWriter_writeElement(TinyMATWriterFile* mat, const char* name, const void* element, size_t size);
+
+/*! \brief write a ROWS x COLS matrix of fixed size in column-major form into a MAT-file
+    \ingroup tinymatencoder
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the ROWS*COLS values to write (in column-major order)
+
+    The element is composed on the stack by TinyMATSmallMatrixEncoder, so this function is fully inlined and
+    only the name and the values are copied at runtime. In contrast to TinyMATWriter_writeMatrixND_colmajor(),
+    these matrices are never written as sparse matrices (see TinyMATWriter_setSparseThreshold() ).
+  */
+template<typename T, int32_t ROWS, int32_t COLS>
+inline void TinyMATWriter_writeSmallMatrix_colmajor(TinyMATWriterFile* mat, const char* name, const T* data) {
+    typedef TinyMATSmallMatrixEncoder<T, ROWS, COLS> Encoder;
+    const size_t nameBytes=name?strlen(name):0;
+    if (!name || nameBytes>TINYMAT_SMALLENCODER_MAXNAME) {
+        const int32_t siz[2]={ROWS, COLS};
+        TinyMATWriter_writeMatrixND_colmajor(mat, name, data, siz, 2);
+        return;
+    }
+    uint8_t buf[Encoder::maxBytes];
+    const uint32_t size=Encoder::encode(buf, name, static_cast<uint32_t>(nameBytes), data);
+    TinyMATWriter_writeElement(mat, name, buf, size);
+}
 
 /*! \brief write a single (numeric) value (as 1x1 matrix) into a MAT-file
     \ingroup tinymatwriter
@@ -331,7 +879,20 @@ TINYMAT_EXPORT void TinyMATWriter_writeMatrixND_colmajor(TinyMATWriterFile* mat,
   */
 template<typename T>
 inline void TinyMATWriter_writeValue(TinyMATWriterFile* mat, const char* name, T data_real) {
-  TinyMATWriter_writeVectorAsColumn(mat, name, &data_real, 1);
+  TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 1>(mat, name, &data_real);
+}
+
+/*! \brief write a single complex value (as 1x1 matrix) into a MAT-file
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the value to write
+
+  */
+template<typename T>
+inline void TinyMATWriter_writeValue(TinyMATWriterFile* mat, const char* name, std::complex<T> data) {
+  TinyMATWriter_writeVectorAsColumn(mat, name, &data, 1);
 }
 
 
@@ -347,10 +908,11 @@ inline void TinyMATWriter_writeValue(TinyMATWriterFile* mat, const char* name, T
   */
 template<typename T>
 inline void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile* mat, const char* name, const T* data_real, const int32_t* sizes, uint32_t ndims) {
+    // the transposed copy is released, as soon as it is written (also inside a struct or cell array)
+    TinyMATWriterScratchScope scope(mat);
     T* dat=NULL;
     const T* datOut=NULL;
     int32_t* siz=NULL;
-    bool freeDat=false;
     if (data_real && sizes && ndims>1) {
         uint32_t nentries=1;
         uint32_t cols=1;
@@ -372,7 +934,9 @@ inline void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile* mat, const c
             if (sizes[i]>1) nonSingularDimensions++;
         }
         if (nentries>0) {
-            siz=new int32_t[ndims];//=(int32_t*)malloc(ndims*sizeof(int32_t));
+            siz=static_cast<int32_t*>(TinyMATWriter_scratch(mat, ndims*sizeof(int32_t)));
+        }
+        if (siz) {
             for (uint32_t i=0; i<ndims; i++) siz[i]=sizes[i];
             if (ndims>1) {
                 siz[0]=sizes[1];
@@ -381,12 +945,14 @@ inline void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile* mat, const c
             if (nonSingularDimensions<=1) {
               // this is not a matrix, but a simple vector
               datOut=data_real;
-              freeDat=false;
+            } else if (TinyMATWriter_isSizer(mat)) {
+              // a sizer only needs the dimensions, not the transposed data
+              TinyMATWriter_writeMatrixND_colmajor(mat, name, data_real, siz, ndims);
+              return;
             } else {
-              dat=new T[nentries];//(T*)malloc(nentries*sizeof(T));
+              dat=static_cast<T*>(TinyMATWriter_scratch(mat, nentries*sizeof(T)));
               if (dat) {
                   datOut=dat;
-                  freeDat=true;
                   for (uint32_t m=0; m<nmatrices; m++) {
                       for(uint32_t r=0; r<rows; r++) {
                           for (uint32_t c=0; c<cols; c++) {
@@ -401,14 +967,9 @@ inline void TinyMATWriter_writeMatrixND_rowmajor(TinyMATWriterFile* mat, const c
     }
     if (dat) {
         TinyMATWriter_writeMatrixND_colmajor(mat, name, datOut, siz, ndims);
-        //free(dat);
-        //free(siz);
-        
     } else {
         TinyMATWriter_writeMatrixND_colmajor(mat, name, data_real, sizes, ndims);
     }
-    if (freeDat && dat) delete[] dat;
-    if (siz) delete[] siz;
 }
 
 
@@ -434,7 +995,9 @@ inline void TinyMATWriter_writeMultiChannelMatrixND_rowmajor(TinyMATWriterFile*
       TinyMATWriter_writeMatrixND_rowmajor( mat, name, data_real, sizes, ndims);
     } else {
         uint32_t nentries=1;
-        int32_t* siz=(int32_t*)malloc((ndims+1)*sizeof(int32_t));
+        TinyMATWriterScratchScope scope(mat);
+        int32_t* siz=static_cast<int32_t*>(TinyMATWriter_scratch(mat, (ndims+1)*sizeof(int32_t)));
+        if (!siz) return;
         for (uint32_t i=0; i<ndims; i++) {
             if (i==0) {
                 nentries=sizes[0];
@@ -444,7 +1007,12 @@ inline void TinyMATWriter_writeMultiChannelMatrixND_rowmajor(TinyMATWriterFile*
             siz[i]=sizes[i];
         }
         siz[ndims]=c;
-        T* dat=(T*)calloc(nentries*c,sizeof(T));
+        if (TinyMATWriter_isSizer(mat)) {
+            TinyMATWriter_writeMatrixND_rowmajor( mat, name, data_real, siz, ndims+1);
+            return;
+        }
+        T* dat=static_cast<T*>(TinyMATWriter_scratch(mat, nentries*c*sizeof(T)));
+        if (!dat) return;
         uint32_t j=0;
         // resort array into planes
         for (uint32_t i=0; i<nentries; i++) {
@@ -454,8 +1022,6 @@ inline void TinyMATWriter_writeMultiChannelMatrixND_rowmajor(TinyMATWriterFile*
           }
         }
         TinyMATWriter_writeMatrixND_rowmajor( mat, name, dat, siz, ndims+1);
-        free(dat);
-        free(siz);
     }
 }
 
@@ -524,9 +1090,8 @@ inline  void TinyMATWriter_writeMatrix2D_rowmajor(TinyMATWriterFile* mat, const
   */
 template<typename T>
 inline  void TinyMATWriter_writeMatrix2x2(TinyMATWriterFile* mat, const char* name, T m11, T m12, T m21, T m22) {
-    int32_t siz[2]={2, 2};
-    T data[4]={m11,m12,m21,m22};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[4]={m11,m21,m12,m22};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 2, 2>(mat, name, data);
 }
 /*! \brief write a 3x3-dimensional double matrix with entries given in row-major order directly as parameters into a MAT-file
     \ingroup tinymatwriter
@@ -537,9 +1102,8 @@ inline  void TinyMATWriter_writeMatrix2x2(TinyMATWriterFile* mat, const char* na
   */
 template<typename T>
 inline  void TinyMATWriter_writeMatrix3x3(TinyMATWriterFile* mat, const char* name, T m11, T m12, T m13, T m21, T m22, T m23, T m31, T m32, T m33) {
-    int32_t siz[2]={3,3};
-    T data[9]={m11,m12,m13,m21,m22,m23,m31,m32,m33};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[9]={m11,m21,m31,m12,m22,m32,m13,m23,m33};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 3, 3>(mat, name, data);
 }
 
 /*! \brief write a 1-dimensional double vector as a row-vector into a MAT-file
@@ -570,69 +1134,58 @@ inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char*
   */
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2) {
-    int32_t siz[2]={1,2};
-    T data[2]={d1, d2};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 2>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3) {
-    int32_t siz[2]={1,3};
-    T data[]={d1, d2, d3};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 3>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4) {
-    int32_t siz[2]={1,4};
-    T data[]={d1, d2, d3, d4};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 4>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5) {
-    int32_t siz[2]={1,5};
-    T data[]={d1, d2, d3, d4, d5};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 5>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6) {
-    int32_t siz[2]={1,6};
-    T data[]={d1, d2, d3, d4, d5, d6};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 6>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7) {
-    int32_t siz[2]={1,7};
-    T data[]={d1, d2, d3, d4, d5, d6, d7};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 7>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8) {
-    int32_t siz[2]={1,8};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 8>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8, T d9) {
-    int32_t siz[2]={1,9};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 9>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8, T d9, T d10) {
-    int32_t siz[2]={1, 10};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 10>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8, T d9, T d10, T d11) {
-    int32_t siz[2]={1,11};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10, d11};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10, d11};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 11>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsRow(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8, T d9, T d10, T d11, T d12) {
-    int32_t siz[2]={1,12};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10, d11, d12};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10, d11, d12};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 1, 12>(mat, name, data);
 }
 
 /*! \brief write a 1-dimensional double vector as a column-vector into a MAT-file
@@ -662,57 +1215,48 @@ inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const cha
   */
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2) {
-    int32_t siz[2]={2,1};
-    T data[2]={d1, d2};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 2, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3) {
-    int32_t siz[2]={3,1};
-    T data[]={d1, d2, d3};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 3, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4) {
-    int32_t siz[2]={4,1};
-    T data[]={d1, d2, d3, d4};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 4, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5) {
-    int32_t siz[2]={5,1};
-    T data[]={d1, d2, d3, d4, d5};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 5, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6) {
-    int32_t siz[2]={6,1};
-    T data[]={d1, d2, d3, d4, d5, d6};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 6, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7) {
-    int32_t siz[2]={7,1};
-    T data[]={d1, d2, d3, d4, d5, d6, d7};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 7, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8) {
-    int32_t siz[2]={8,1};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 8, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8, T d9) {
-    int32_t siz[2]={9,1};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 9, 1>(mat, name, data);
 }
 template<typename T>
 inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const char* name, T d1, T d2, T d3, T d4, T d5, T d6, T d7, T d8, T d9, T d10) {
-    int32_t siz[2]={10,1};
-    T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10};
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, data, siz, 2);
+    const T data[]={d1, d2, d3, d4, d5, d6, d7, d8, d9, d10};
+    TinyMATWriter_writeSmallMatrix_colmajor<T, 10, 1>(mat, name, data);
 }
 
 
@@ -733,7 +1277,8 @@ inline  void TinyMATWriter_writeVectorAsColumn(TinyMATWriterFile* mat, const cha
 template<typename T>
 inline  void TinyMATWriter_writeContainerAsRow_internalCopy(TinyMATWriterFile* mat, const char* name, const T& data_vec) {
     int32_t siz[2]={1, (int32_t)data_vec.size()};
-    auto tmp=static_cast<typename T::value_type*>(malloc(data_vec.size()*sizeof(typename T::value_type)));
+    TinyMATWriterScratchScope scope(mat);
+    auto tmp=static_cast<typename T::value_type*>(TinyMATWriter_scratch(mat, data_vec.size()*sizeof(typename T::value_type)));
     if (tmp) {
         int i=0;
         for (auto it=data_vec.begin(); it!=data_vec.end(); ++it) {
@@ -741,7 +1286,6 @@ inline  void TinyMATWriter_writeContainerAsRow_internalCopy(TinyMATWriterFile* m
           i++;
         }
         TinyMATWriter_writeMatrixND_rowmajor(mat, name, tmp, siz, 2);
-        free(tmp);
     }
 }
 
@@ -762,13 +1306,15 @@ inline  void TinyMATWriter_writeContainerAsRow_internalCopy(TinyMATWriterFile* m
 template<typename T>
 inline  void TinyMATWriter_writeContainerAsColumn_internalCopy(TinyMATWriterFile* mat, const char* name, const T& data_vec) {
     int32_t siz[2]={(int32_t)data_vec.size(), 1};
-    auto tmp=std::unique_ptr<typename T::value_type[]>(new typename T::value_type[data_vec.size()]);
+    TinyMATWriterScratchScope scope(mat);
+    auto tmp=static_cast<typename T::value_type*>(TinyMATWriter_scratch(mat, data_vec.size()*sizeof(typename T::value_type)));
+    if (!tmp) return;
     int i=0;
     for (auto it=data_vec.begin(); it!=data_vec.end(); ++it) {
       tmp[i]=*it;
       i++;
     }
-    TinyMATWriter_writeMatrixND_rowmajor(mat, name, tmp.get(), siz, 2);
+    TinyMATWriter_writeMatrixND_rowmajor(mat, name, tmp, siz, 2);
 }
 
 
@@ -894,7 +1440,9 @@ inline  void TinyMATWriter_writeContainerAsColumn(TinyMATWriterFile* mat, const
     int32_t cols = 0;
     for (size_t i = 0; i < data_mat.size(); i++) cols = std::max<int32_t>(cols, data_mat[i].size());
 
-    T* tmp = (T*)malloc(rows*cols * sizeof(T));
+    TinyMATWriterScratchScope scope(mat);
+    T* tmp = static_cast<T*>(TinyMATWriter_scratch(mat, rows*cols * sizeof(T)));
+    if (!tmp) return;
     for (int32_t i = 0; i<rows*cols; i++) tmp[i] = 0;
     int r = 0;
     int c = 0;
@@ -908,7 +1456,6 @@ inline  void TinyMATWriter_writeContainerAsColumn(TinyMATWriterFile* mat, const
     }
     int32_t siz[2] = { rows, cols };
     TinyMATWriter_writeMatrixND_colmajor(mat, name, tmp, siz, 2);
-    free(tmp);
   }
 
 
@@ -928,7 +1475,9 @@ inline  void TinyMATWriter_writeContainerAsColumn(TinyMATWriterFile* mat, const
     int32_t cols = data_mat.size();
     for (size_t i = 0; i < data_mat.size(); i++) rows = std::max<int32_t>(rows, data_mat[i].size());
 
-    T* tmp = (T*)malloc(rows*cols * sizeof(T));
+    TinyMATWriterScratchScope scope(mat);
+    T* tmp = static_cast<T*>(TinyMATWriter_scratch(mat, rows*cols * sizeof(T)));
+    if (!tmp) return;
     for (int32_t i = 0; i<rows*cols; i++) tmp[i] = 0;
     int r = 0;
     int c = 0;
@@ -942,7 +1491,6 @@ inline  void TinyMATWriter_writeContainerAsColumn(TinyMATWriterFile* mat, const
     }
     int32_t siz[2] = { rows, cols };
     TinyMATWriter_writeMatrixND_colmajor(mat, name, tmp, siz, 2);
-    free(tmp);
   }
 #endif
 
@@ -1418,8 +1966,101 @@ TINYMAT_EXPORT void TinyMATWriter_writeQVariantMap(TinyMATWriterFile* mat, const
 
     \param tiff TIFF file to close
 
-    This function also releases memory allocated in TinyMATWriter_open() in \a tiff.
+    This function also releases memory allocated in TinyMATWriter_open() in \a tiff. If checking the file is enabled
+    (see TinyMATWriter_setVerifyOnClose() ), a \c std::runtime_error is thrown for a malformed file, after everything
+    has been released.
  */
 TINYMAT_EXPORT void TinyMATWriter_close(TinyMATWriterFile* mat);
 
+/*! \brief close a given MAT file, without throwing on errors
+    \ingroup tinymatwriter
+
+    \param mat MAT file to close
+    \param[out] error if not \c NULL, receives a description of the error (empty on success)
+    \return \c false, if the file could not be closed or checking it failed (see TinyMATWriter_setVerifyOnClose() )
+
+    Same as TinyMATWriter_close(), but reports a malformed file in the return value instead of throwing a
+    \c std::runtime_error. Use it on threads, which do not handle exceptions.
+ */
+TINYMAT_EXPORT bool TinyMATWriter_closeChecked(TinyMATWriterFile* mat, std::string* error=NULL);
+
+
+/*! \brief runs \a task on the background writer thread of \a mat
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param task the function to execute, it is called with \a mat as parameter and may call any TinyMATWriter_write...() function
+    \param callback optional function, that is called on the writer thread after \a task has finished
+                     (with a \c nullptr or the exception thrown by \a task)
+    \return a future, that becomes ready when \a task has finished (and reports exceptions from \a task)
+
+    Each MAT-file has (at most) one background thread, which is started by the first call of this function.
+    The tasks are executed one after the other, in the order in which they were submitted, so the variables appear
+    in the file in submission order. Do not call the synchronous TinyMATWriter_write...() functions on \a mat,
+    while tasks are pending (see TinyMATWriter_waitForWrites() ). TinyMATWriter_close() waits for all pending tasks.
+
+    \see TinyMATWriter_writeMatrixND_colmajorAsync()
+  */
+TINYMAT_EXPORT std::future<void> TinyMATWriter_enqueue(TinyMATWriterFile* mat, std::function<void(TinyMATWriterFile*)> task, std::function<void(std::exception_ptr)> callback=std::function<void(std::exception_ptr)>());
+
+/*! \brief waits until all tasks, submitted by TinyMATWriter_enqueue() for \a mat, have finished
+    \ingroup tinymatwriter
+  */
+TINYMAT_EXPORT void TinyMATWriter_waitForWrites(TinyMATWriterFile* mat);
+
+/*! \brief asynchronously write a N-dimensional matrix in column-major form into a MAT-file, taking ownership of the data
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in column-major order), moved into the write task
+    \param sizes number of entries in each dimension {rows, cols, matrices, ...}
+    \return a future, that becomes ready when the matrix is written
+
+    The call only enqueues the write (see TinyMATWriter_enqueue() ), no data is copied.
+  */
+template<typename T>
+inline std::future<void> TinyMATWriter_writeMatrixND_colmajorAsync(TinyMATWriterFile* mat, const char* name, std::vector<T>&& data, const std::vector<int32_t>& sizes) {
+    auto d=std::make_shared<std::vector<T> >(std::move(data));
+    const std::string n(name);
+    return TinyMATWriter_enqueue(mat, [d, n, sizes](TinyMATWriterFile* m) {
+        TinyMATWriter_writeMatrixND_colmajor(m, n.c_str(), d->data(), sizes.data(), static_cast<uint32_t>(sizes.size()));
+    });
+}
+
+/*! \brief asynchronously write a N-dimensional matrix in column-major form into a MAT-file, taking ownership of the data
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in column-major order), moved into the write task
+    \param sizes number of entries in each dimension {rows, cols, matrices, ...}
+    \return a future, that becomes ready when the matrix is written
+  */
+template<typename T>
+inline std::future<void> TinyMATWriter_writeMatrixND_colmajorAsync(TinyMATWriterFile* mat, const char* name, std::unique_ptr<T[]> data, const std::vector<int32_t>& sizes) {
+    std::shared_ptr<T> d(data.release(), std::default_delete<T[]>());
+    const std::string n(name);
+    return TinyMATWriter_enqueue(mat, [d, n, sizes](TinyMATWriterFile* m) {
+        TinyMATWriter_writeMatrixND_colmajor(m, n.c_str(), static_cast<const T*>(d.get()), sizes.data(), static_cast<uint32_t>(sizes.size()));
+    });
+}
+
+/*! \brief asynchronously write a N-dimensional matrix in column-major form into a MAT-file from a shared, immutable buffer
+    \ingroup tinymatwriter
+
+    \param mat the MAT-file to write into
+    \param name variable name for the new array
+    \param data the array to write (in column-major order), the task keeps a reference until the matrix is written
+    \param sizes number of entries in each dimension {rows, cols, matrices, ...}
+    \return a future, that becomes ready when the matrix is written
+  */
+template<typename T>
+inline std::future<void> TinyMATWriter_writeMatrixND_colmajorAsync(TinyMATWriterFile* mat, const char* name, std::shared_ptr<const std::vector<T> > data, const std::vector<int32_t>& sizes) {
+    const std::string n(name);
+    return TinyMATWriter_enqueue(mat, [data, n, sizes](TinyMATWriterFile* m) {
+        TinyMATWriter_writeMatrixND_colmajor(m, n.c_str(), data->data(), sizes.data(), static_cast<uint32_t>(sizes.size()));
+    });
+}
+
 #endif // TINYMATWRITER_H
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2008-2026 Jan W. Krieger (<jan@jkrieger.de>, <j.krieger@dkfz.de>), German Cancer Research Center (DKFZ) & IWR, University of Heidelberg
+
+    This software is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License (LGPL) as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include "tinymatmerge.h"
+
+using namespace std;
+
+
+static void printUsage(const char* program) {
+    cout<<"usage: "<<program<<" [options] OUTPUT.mat INPUT.mat [INPUT.mat ...]\n"
+          "\n"
+          "concatenates the variables of the INPUT files into the new file OUTPUT.\n"
+          "Variables with a name, that is already used, are renamed (name_2, name_3, ...).\n"
+          "\n"
+          "options:\n"
+          "  -i, --index               write an index of all variables into OUTPUT\n"
+          "  -d, --description TEXT    description in the header of OUTPUT\n"
+          "  -q, --quiet               do not list the renamed variables\n"
+          "  -h, --help                show this help\n";
+}
+
+int main( int argc, const char* argv[] ) {
+    TinyMATMergeOptions options;
+    bool quiet=false;
+    vector<const char*> files;
+    for (int i=1; i<argc; i++) {
+        const string arg=argv[i];
+        if (arg=="-h" || arg=="--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg=="-i" || arg=="--index") {
+            options.writeIndex=true;
+        } else if (arg=="-q" || arg=="--quiet") {
+            quiet=true;
+        } else if ((arg=="-d" || arg=="--description") && i+1<argc) {
+            options.description=argv[++i];
+        } else if (arg.size()>1 && arg[0]=='-') {
+            cerr<<argv[0]<<": unknown option "<<arg<<"\n";
+            printUsage(argv[0]);
+            return 2;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.size()<2) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    TinyMATMergeResult result;
+    if (!TinyMAT_mergeFiles(files[0], files.data()+1, static_cast<uint32_t>(files.size()-1), options, &result)) {
+        cerr<<argv[0]<<": "<<result.error<<"\n";
+        return 1;
+    }
+    if (!quiet) {
+        for (const TinyMATMergeRename& r: result.renamed) {
+            cout<<r.filename<<": renamed "<<r.oldName<<" to "<<r.newName<<"\n";
+        }
+        cout<<files[0]<<": "<<result.variables<<" variables from "<<(files.size()-1)<<" files ("<<result.bytes<<" bytes";
+        if (result.dropped>0) cout<<", "<<result.dropped<<" indexes/tombstones dropped";
+        cout<<")\n";
+    }
+    return 0;
+}